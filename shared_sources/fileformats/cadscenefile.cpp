@@ -28,7 +28,9 @@
 
 //////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <map>
 #include <stdint.h>
 #include <stdio.h>
@@ -46,8 +48,15 @@
 #include "cadscenefile.h"
 #include <NvFoundation.h>
 #include <nvh/filemapping.hpp>
+#include <nvh/threadpool.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CSF_TRANSFORM_SSE 1
+#include <xmmintrin.h>
+#endif
 
 #define CADSCENEFILE_MAGIC 1567262451
+#define CADSCENEFILE_MAGIC_CHUNKED 1567262452
 
 #ifdef WIN32
 #define FREAD(a, b, c, d, e) fread_s(a, b, c, d, e)
@@ -70,7 +79,8 @@ struct CSFileMemory_s
   std::vector<void*> m_allocations;
   std::mutex         m_mutex;
 
-  std::vector<nvh::FileReadMapping> m_readMappings;
+  std::vector<nvh::FileReadMapping>            m_readMappings;
+  std::vector<nvh::FileReadCopyOnWriteMapping> m_cowMappings;
 
   void* alloc(size_t size, const void* indata = nullptr, size_t indataSize = 0)
   {
@@ -100,6 +110,7 @@ struct CSFileMemory_s
   CSFileMemory_s()
   {
     m_config.secondariesReadOnly = 0;
+    m_config.mappedCopyOnWrite   = 0;
 #if CSF_GLTF2_SUPPORT
     m_config.gltfFindUniqueGeometries = 1;
 #endif
@@ -112,6 +123,7 @@ struct CSFileMemory_s
       free(m_allocations[i]);
     }
     m_readMappings.clear();
+    m_cowMappings.clear();
   }
 };
 
@@ -327,6 +339,24 @@ CSFAPI int CSFile_loadReadOnly(CSFile** outcsf, const char* filename, CSFileMemo
   return CADSCENEFILE_NOERROR;
 }
 
+CSFAPI int CSFile_loadMapped(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem)
+{
+  nvh::FileReadCopyOnWriteMapping file;
+  if(!file.open(filename))
+  {
+    *outcsf = 0;
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  // only the pages touched by the pointer fixup are copied, the bulk data stays shared
+  int result = CSFile_loadRaw(outcsf, file.size(), file.data());
+  if(result == CADSCENEFILE_NOERROR)
+  {
+    mem->m_cowMappings.push_back(std::move(file));
+  }
+  return result;
+}
+
 CSFAPI int CSFile_load(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem)
 {
   if(!filename)
@@ -360,6 +390,12 @@ CSFAPI int CSFile_load(CSFile** outcsf, const char* filename, CSFileMemoryPTR me
     return CSFile_loadReadOnly(outcsf, filename, mem);
   }
 
+  if(mem->m_config.mappedCopyOnWrite)
+  {
+    fclose(file);
+    return CSFile_loadMapped(outcsf, filename, mem);
+  }
+
   // load the full file to memory
   xfseek(file, 0, SEEK_END);
   size_t size = (size_t)xftell(file);
@@ -379,6 +415,128 @@ CSFAPI int CSFile_load(CSFile** outcsf, const char* filename, CSFileMemoryPTR me
   return CSFile_loadRaw(outcsf, size, data);
 }
 
+// nodes per frame of the chunked container, CSFile_saveInternal starts frames for every output
+enum
+{
+  CSF_CHUNKED_NODES_PER_FRAME = 4096,
+};
+
+#if CSF_ZIP_SUPPORT
+// chunked container (.csfz):
+//   CSFChunkedHeader
+//   CSFChunkedFrame[numFrames]
+//   zlib stream of each frame
+// decompressing all frames yields the raw file as written by CSFile_save
+enum
+{
+  CSF_CHUNKED_MAX_FRAME_SIZE = 16 * 1024 * 1024,
+};
+
+struct CSFChunkedHeader
+{
+  int       magic;
+  int       version;  // 0
+  int       numFrames;
+  int       _pad;
+  CSFoffset rawSize;
+};
+
+struct CSFChunkedFrame
+{
+  CSFoffset rawOffset;
+  CSFoffset rawSize;
+  CSFoffset fileOffset;
+  CSFoffset fileSize;
+  int       geometryIDX;  // -1 if not specific to a geometry
+  int       _pad;
+};
+
+CSFAPI int CSFile_loadChunked(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, int numGeometries, const int* geometryIDXs)
+{
+  *outcsf = 0;
+
+  nvh::FileReadMapping file;
+  if(!filename || !file.open(filename))
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  const uint8_t*          base   = (const uint8_t*)file.data();
+  const CSFChunkedHeader* header = (const CSFChunkedHeader*)base;
+  if(file.size() < sizeof(CSFChunkedHeader) || header->magic != CADSCENEFILE_MAGIC_CHUNKED
+     || file.size() < sizeof(CSFChunkedHeader) + sizeof(CSFChunkedFrame) * size_t(header->numFrames))
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+  const CSFChunkedFrame* frames = (const CSFChunkedFrame*)(header + 1);
+
+  std::vector<int> frameIndices;
+  for(int f = 0; f < header->numFrames; f++)
+  {
+    const CSFChunkedFrame& frame = frames[f];
+    if(frame.fileOffset + frame.fileSize > file.size() || frame.rawOffset + frame.rawSize > header->rawSize)
+    {
+      return CADSCENEFILE_ERROR_VERSION;
+    }
+    if(frame.geometryIDX < 0 || !geometryIDXs
+       || std::find(geometryIDXs, geometryIDXs + numGeometries, frame.geometryIDX) != geometryIDXs + numGeometries)
+    {
+      frameIndices.push_back(f);
+    }
+  }
+
+  // the frames of the geometries that are not selected are never touched
+  char* data = (char*)mem->alloc(size_t(header->rawSize));
+
+  std::atomic<bool> failed(false);
+  {
+    nvh::ThreadPool pool(std::thread::hardware_concurrency());
+    pool.parallelFor(frameIndices.size(),
+                     [&](uint64_t i) {
+                       const CSFChunkedFrame& frame = frames[frameIndices[i]];
+                       uLongf                 size  = (uLongf)frame.rawSize;
+                       if(uncompress((Bytef*)data + frame.rawOffset, &size, base + frame.fileOffset, (uLong)frame.fileSize) != Z_OK
+                          || size != frame.rawSize)
+                       {
+                         failed = true;
+                       }
+                     },
+                     1);
+  }
+  if(failed)
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  int result = CSFile_loadRaw(outcsf, size_t(header->rawSize), data);
+  if(result != CADSCENEFILE_NOERROR || !geometryIDXs)
+  {
+    return result;
+  }
+
+  CSFile* csf = *outcsf;
+  for(int g = 0; g < csf->numGeometries; g++)
+  {
+    if(std::find(geometryIDXs, geometryIDXs + numGeometries, g) == geometryIDXs + numGeometries)
+    {
+      CSFGeometry& geo        = csf->geometries[g];
+      geo.vertex              = nullptr;
+      geo.normal              = nullptr;
+      geo.tex                 = nullptr;
+      geo.aux                 = nullptr;
+      geo.auxStorageOrder     = nullptr;
+      geo.indexSolid          = nullptr;
+      geo.indexWire           = nullptr;
+      geo.perpart             = nullptr;
+      geo.perpartStorageOrder = nullptr;
+      geo.parts               = nullptr;
+    }
+  }
+
+  return CADSCENEFILE_NOERROR;
+}
+#endif
+
 #if CSF_GLTF2_SUPPORT
 CSFAPI int CSFile_loadGTLF(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 #endif
@@ -425,6 +583,13 @@ CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR
   }
   else
 #endif
+#if CSF_ZIP_SUPPORT
+      if(len > 5 && strcmp(filename + len - 5, ".csfz") == 0)
+  {
+    return CSFile_loadChunked(outcsf, filename, mem, 0, nullptr);
+  }
+  else
+#endif
 #if CSF_GLTF2_SUPPORT
       if(len > 5 && strcmp(filename + len - 5, ".gltf") == 0)
   {
@@ -446,12 +611,13 @@ struct OutputFILE
 #ifdef WIN32
     return fopen_s(&m_file, filename, "wb");
 #else
-    return (m_file = fopen(filename, "wb")) ? 1 : 0;
+    return (m_file = fopen(filename, "wb")) ? 0 : 1;
 #endif
   }
-  void close() { fclose(m_file); }
+  int  close() { return fclose(m_file) != 0; }
   void seek(size_t offset, int position) { xfseek(m_file, offset, position); }
   void write(const void* data, size_t dataSize) { fwrite(data, dataSize, 1, m_file); }
+  void beginFrame(int /*geometryIDX*/) {}
 };
 
 
@@ -470,7 +636,7 @@ struct OutputBuf
     m_cur       = 0;
     return 0;
   }
-  void close()
+  int close()
   {
     if(m_data)
     {
@@ -480,6 +646,7 @@ struct OutputBuf
     m_allocated = 0;
     m_used      = 0;
     m_cur       = 0;
+    return 0;
   }
   void seek(size_t offset, int position)
   {
@@ -520,6 +687,7 @@ struct OutputBuf
     memcpy(m_data + m_cur, data, dataSize);
     m_cur += dataSize;
   }
+  void beginFrame(int /*geometryIDX*/) {}
 };
 
 
@@ -535,14 +703,123 @@ struct OutputGZ
     m_file = gzopen(filename, "wb");
     return m_file == 0;
   }
-  void close()
+  int close()
   {
-    gzwrite(m_file, m_buf.m_data, (z_off_t)m_buf.m_used);
-    gzclose(m_file);
+    bool failed = m_buf.m_used && gzwrite(m_file, m_buf.m_data, (unsigned)m_buf.m_used) == 0;
+    failed      = gzclose(m_file) != Z_OK || failed;
     m_buf.close();
+    return failed;
   }
   void seek(size_t offset, int position) { m_buf.seek(offset, position); }
   void write(const void* data, size_t dataSize) { m_buf.write(data, dataSize); }
+  void beginFrame(int /*geometryIDX*/) {}
+};
+
+// The raw file is split into frames that are compressed independently,
+// see CSFile_loadChunked
+struct OutputChunked
+{
+  struct Boundary
+  {
+    size_t offset;
+    int    geometryIDX;
+  };
+
+  FILE*                 m_file;
+  OutputBuf             m_buf;
+  std::vector<Boundary> m_boundaries;
+
+  int open(const char* filename)
+  {
+    m_buf.open(filename);
+    m_boundaries.clear();
+#ifdef WIN32
+    return fopen_s(&m_file, filename, "wb");
+#else
+    return (m_file = fopen(filename, "wb")) ? 0 : 1;
+#endif
+  }
+  int close()
+  {
+    // frames between the boundaries, large ones are split further for parallelism
+    std::vector<CSFChunkedFrame> frames;
+    for(size_t b = 0; b < m_boundaries.size(); b++)
+    {
+      size_t begin = m_boundaries[b].offset;
+      size_t end   = b + 1 < m_boundaries.size() ? m_boundaries[b + 1].offset : m_buf.m_used;
+      for(size_t offset = begin; offset < end; offset += CSF_CHUNKED_MAX_FRAME_SIZE)
+      {
+        CSFChunkedFrame frame = {};
+        frame.rawOffset       = offset;
+        frame.rawSize         = std::min(end - offset, size_t(CSF_CHUNKED_MAX_FRAME_SIZE));
+        frame.geometryIDX     = m_boundaries[b].geometryIDX;
+        frames.push_back(frame);
+      }
+    }
+
+    std::vector<std::vector<Bytef>> compressed(frames.size());
+    std::atomic<bool>               failed(false);
+    {
+      nvh::ThreadPool pool(std::thread::hardware_concurrency());
+      pool.parallelFor(frames.size(),
+                       [&](uint64_t f) {
+                         uLongf size = compressBound((uLong)frames[f].rawSize);
+                         compressed[f].resize(size);
+                         if(compress2(compressed[f].data(), &size, (const Bytef*)m_buf.m_data + frames[f].rawOffset,
+                                      (uLong)frames[f].rawSize, Z_DEFAULT_COMPRESSION)
+                            != Z_OK)
+                         {
+                           failed = true;
+                         }
+                         compressed[f].resize(size);
+                       },
+                       1);
+    }
+    if(failed)
+    {
+      fclose(m_file);
+      m_buf.close();
+      return 1;
+    }
+
+    CSFChunkedHeader header = {};
+    header.magic            = CADSCENEFILE_MAGIC_CHUNKED;
+    header.numFrames        = int(frames.size());
+    header.rawSize          = m_buf.m_used;
+
+    CSFoffset fileOffset = sizeof(CSFChunkedHeader) + sizeof(CSFChunkedFrame) * frames.size();
+    for(size_t f = 0; f < frames.size(); f++)
+    {
+      frames[f].fileOffset = fileOffset;
+      frames[f].fileSize   = compressed[f].size();
+      fileOffset += frames[f].fileSize;
+    }
+
+    fwrite(&header, sizeof(header), 1, m_file);
+    fwrite(frames.data(), sizeof(CSFChunkedFrame), frames.size(), m_file);
+    for(size_t f = 0; f < frames.size(); f++)
+    {
+      fwrite(compressed[f].data(), compressed[f].size(), 1, m_file);
+    }
+    m_buf.close();
+    return fclose(m_file) != 0;
+  }
+  void seek(size_t offset, int position) { m_buf.seek(offset, position); }
+  void write(const void* data, size_t dataSize) { m_buf.write(data, dataSize); }
+  // everything written from now on until the next frame is in one frame, geometryIDX = -1 for
+  // data that is not specific to a geometry
+  void beginFrame(int geometryIDX)
+  {
+    if(!m_boundaries.empty() && m_boundaries.back().offset == m_buf.m_cur)
+    {
+      m_boundaries.back().geometryIDX = geometryIDX;
+    }
+    else
+    {
+      Boundary boundary = {m_buf.m_cur, geometryIDX};
+      m_boundaries.push_back(boundary);
+    }
+  }
 };
 #endif
 
@@ -560,8 +837,8 @@ struct CSFOffsetMgr
 
 
   CSFOffsetMgr(T& file)
-      : m_current(0)
-      , m_file(file)
+      : m_file(file)
+      , m_current(0)
   {
   }
 
@@ -623,12 +900,13 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
 
   CSFOffsetMgr<T> mgr(file);
 
-  CSFile dump = {0};
+  CSFile dump = {};
   memcpy(&dump, csf, CSFile_getHeaderSize(csf));
 
   dump.version = CADSCENEFILE_VERSION;
   dump.magic   = CADSCENEFILE_MAGIC;
   // dump main part as is
+  file.beginFrame(-1);
   mgr.store(&dump, sizeof(CSFile));
 
   // iterate the objects
@@ -639,6 +917,7 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
     for(int i = 0; i < csf->numGeometries; i++, geomOFFSET += sizeof(CSFGeometry))
     {
       const CSFGeometry* geo = csf->geometries + i;
+      file.beginFrame(i);
 
       if(geo->vertex && geo->numVertices)
       {
@@ -691,6 +970,7 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
   }
 
 
+  file.beginFrame(-1);
   {
     size_t matOFFSET = mgr.store(offsetof(CSFile, materialsOFFSET), csf->materials, sizeof(CSFMaterial) * csf->numMaterials);
 
@@ -710,6 +990,10 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
     for(int i = 0; i < csf->numNodes; i++, nodeOFFSET += sizeof(CSFNode))
     {
       const CSFNode* node = csf->nodes + i;
+      if(i % CSF_CHUNKED_NODES_PER_FRAME == 0)
+      {
+        file.beginFrame(-1);
+      }
       if(node->parts && node->numParts)
       {
         mgr.store(nodeOFFSET + offsetof(CSFNode, partsOFFSET), node->parts, sizeof(CSFNodePart) * node->numParts);
@@ -721,6 +1005,7 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
     }
   }
 
+  file.beginFrame(-1);
   if(CSFile_getNodeMetas(csf))
   {
     size_t metaOFFSET = mgr.store(offsetof(CSFile, nodeMetasOFFSET), csf->nodeMetas, sizeof(CSFMeta) * csf->numNodes);
@@ -764,7 +1049,12 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
 
   mgr.finalize(offsetof(CSFile, numPointers), offsetof(CSFile, pointersOFFSET));
 
-  file.close();
+  // compression or writing failed, don't leave a broken file
+  if(file.close())
+  {
+    remove(filename);
+    return CADSCENEFILE_ERROR_OPERATION;
+  }
 
   return CADSCENEFILE_NOERROR;
 }
@@ -782,6 +1072,10 @@ CSFAPI int CSFile_saveExt(CSFile* csf, const char* filename)
   {
     return CSFile_saveInternal<OutputGZ>(csf, filename);
   }
+  else if(len > 5 && strcmp(filename + len - 5, ".csfz") == 0)
+  {
+    return CSFile_saveInternal<OutputChunked>(csf, filename);
+  }
   else
   {
     return CSFile_saveInternal<OutputFILE>(csf, filename);
@@ -819,11 +1113,34 @@ static NV_FORCE_INLINE void Matrix44MultiplyFull(float* NV_RESTRICT clip, const
   clip[15] = modl[12] * proj[3] + modl[13] * proj[7] + modl[14] * proj[11] + modl[15] * proj[15];
 }
 
+#if CSF_TRANSFORM_SSE
+// same multiplies and additions in the same order as Matrix44MultiplyFull, so the results are bit-identical
+static NV_FORCE_INLINE void Matrix44MultiplyFullSSE(float* NV_RESTRICT clip, const float* NV_RESTRICT proj, const float* NV_RESTRICT modl)
+{
+  __m128 proj0 = _mm_loadu_ps(proj + 0);
+  __m128 proj1 = _mm_loadu_ps(proj + 4);
+  __m128 proj2 = _mm_loadu_ps(proj + 8);
+  __m128 proj3 = _mm_loadu_ps(proj + 12);
+
+  for(int r = 0; r < 16; r += 4)
+  {
+    __m128 row = _mm_mul_ps(_mm_set1_ps(modl[r + 0]), proj0);
+    row        = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(modl[r + 1]), proj1));
+    row        = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(modl[r + 2]), proj2));
+    row        = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(modl[r + 3]), proj3));
+    _mm_storeu_ps(clip + r, row);
+  }
+}
+#define Matrix44MultiplyNode Matrix44MultiplyFullSSE
+#else
+#define Matrix44MultiplyNode Matrix44MultiplyFull
+#endif
+
 static void CSFile_transformHierarchy(CSFile* csf, CSFNode* NV_RESTRICT node, CSFNode* NV_RESTRICT parent)
 {
   if(parent)
   {
-    Matrix44MultiplyFull(node->worldTM, parent->worldTM, node->objectTM);
+    Matrix44MultiplyNode(node->worldTM, parent->worldTM, node->objectTM);
   }
   else
   {
@@ -846,6 +1163,88 @@ CSFAPI int CSFile_transform(CSFile* csf)
   return CADSCENEFILE_NOERROR;
 }
 
+// the worldTM of the node must be computed already, children [begin, end) are transformed
+static void CSFile_transformChildren(CSFile* csf, int nodeIDX, int begin, int end, std::vector<int>& next)
+{
+  const CSFNode* NV_RESTRICT node = csf->nodes + nodeIDX;
+  for(int i = begin; i < end; i++)
+  {
+    CSFNode* NV_RESTRICT child = csf->nodes + node->children[i];
+    Matrix44MultiplyNode(child->worldTM, node->worldTM, child->objectTM);
+    if(child->numChildren)
+    {
+      next.push_back(node->children[i]);
+    }
+  }
+}
+
+CSFAPI int CSFile_transformParallel(CSFile* csf)
+{
+  if(!(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES))
+    return CADSCENEFILE_ERROR_OPERATION;
+
+  Matrix44Copy(csf->nodes[csf->rootIDX].worldTM, csf->nodes[csf->rootIDX].objectTM);
+
+  nvh::ThreadPool pool(std::thread::hardware_concurrency());
+
+  // expand breadth-first until there are enough independent subtrees to balance the threads,
+  // each level in parallel: the children are split in ranges, wide and flat scenes are done here
+  struct ChildRange
+  {
+    int nodeIDX;
+    int begin;
+    int end;
+  };
+  const int                     rangeSize   = 1024;
+  size_t                        numSubtrees = size_t(pool.getNumThreads()) * 64;
+  std::vector<int>              subtrees(1, csf->rootIDX);
+  std::vector<ChildRange>       ranges;
+  std::vector<std::vector<int>> nexts;
+  while(!subtrees.empty() && subtrees.size() < numSubtrees)
+  {
+    ranges.clear();
+    for(int nodeIDX : subtrees)
+    {
+      int numChildren = csf->nodes[nodeIDX].numChildren;
+      for(int begin = 0; begin < numChildren; begin += rangeSize)
+      {
+        ranges.push_back({nodeIDX, begin, std::min(begin + rangeSize, numChildren)});
+      }
+    }
+
+    nexts.resize(std::max(nexts.size(), ranges.size()));
+    pool.parallelFor(ranges.size(), [&](uint64_t r) {
+      nexts[r].clear();
+      CSFile_transformChildren(csf, ranges[r].nodeIDX, ranges[r].begin, ranges[r].end, nexts[r]);
+    });
+
+    // same order as a serial expansion
+    subtrees.clear();
+    for(size_t r = 0; r < ranges.size(); r++)
+    {
+      subtrees.insert(subtrees.end(), nexts[r].begin(), nexts[r].end());
+    }
+  }
+
+  // each subtree depth-first with an explicit stack, deep hierarchies would overflow the call stack
+  pool.parallelFor(subtrees.size(),
+                   [&](uint64_t s) {
+                     std::vector<int> stack(1, subtrees[s]);
+                     while(!stack.empty())
+                     {
+                       int nodeIDX = stack.back();
+                       stack.pop_back();
+                       size_t begin = stack.size();
+                       CSFile_transformChildren(csf, nodeIDX, 0, csf->nodes[nodeIDX].numChildren, stack);
+                       // visit the children in order, siblings are usually adjacent in memory
+                       std::reverse(stack.begin() + begin, stack.end());
+                     }
+                   },
+                   std::max(size_t(1), subtrees.size() / (size_t(pool.getNumThreads()) * 8)));
+
+  return CADSCENEFILE_NOERROR;
+}
+
 CSFAPI const CSFMeta* CSFile_getNodeMetas(const CSFile* csf)
 {
   if(csf->version >= CADSCENEFILE_VERSION_META && csf->fileFlags & CADSCENEFILE_FLAG_META_NODE)
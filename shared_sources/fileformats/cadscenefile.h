@@ -158,6 +158,13 @@ extern "C" {
     // but all pointers within them are mapped.
     int secondariesReadOnly;
 
+    // uncompressed files are mapped copy-on-write and the pointers
+    // are fixed within the mapping, nothing is read up front and
+    // the pages are loaded on first access.
+    // ignored if secondariesReadOnly is set
+    // default = false
+    int mappedCopyOnWrite;
+
   #if CSF_GLTF2_SUPPORT
     // uses hashes of geometry data to figure out what gltf mesh 
     // data is re-used under different materials, and can 
@@ -555,6 +562,12 @@ extern "C" {
   // It must be preserved for as long as the csf and its internals are accessed
   CSFAPI int    CSFile_load    (CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 
+  // Maps the file copy-on-write, the pointers are fixed within the private pages of the mapping
+  // and the file itself is never modified. The mapping is owned by the file memory, the csf and
+  // its internals are valid until CSFileMemory_delete. CSFile_load does the same if
+  // mappedCopyOnWrite is set in the loader config.
+  CSFAPI int    CSFile_loadMapped(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
+
   CSFAPI int    CSFile_save    (const CSFile* csf, const char* filename);
 
   // sets all content of _deprecated to zero, automatically done at load
@@ -593,12 +606,21 @@ extern "C" {
   CSFAPI const  CSFBytePacket*    CSFile_getMaterialBytePacket(const CSFile* csf, int materialIDX, CSFGuid guid);
 
   CSFAPI int    CSFile_transform(CSFile *csf);  // requires unique nodes
+  // same results as CSFile_transform, the levels of the hierarchy and its subtrees are processed on all cores
+  CSFAPI int    CSFile_transformParallel(CSFile *csf);  // requires unique nodes
 
+  // loadExt/saveExt handle ".gz", ".csfz" (chunked) and ".gltf" (load only) files
 #if CSF_ZIP_SUPPORT || CSF_GLTF2_SUPPORT
   CSFAPI int    CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 #endif
 #if CSF_ZIP_SUPPORT 
   CSFAPI int    CSFile_saveExt(CSFile* csf, const char* filename);
+
+  // ".csfz" files are split into frames that are compressed independently: one per geometry,
+  // per block of nodes and for the remaining sections. The frames are decompressed in parallel.
+  // If geometryIDXs is provided, only the frames of these geometries are decompressed, the
+  // other geometries keep their counts but all their data pointers are null.
+  CSFAPI int    CSFile_loadChunked(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, int numGeometries, const int* geometryIDXs);
 #endif
 
   CSFAPI void   CSFMatrix_identity(float*);
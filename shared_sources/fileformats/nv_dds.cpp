@@ -66,6 +66,7 @@ inline unsigned int comps2internalfmt(unsigned int i)
 CDDSImage::CDDSImage()
   : m_format(0),
     m_components(0),
+    m_dxgiFormat(0),
     m_type(TextureNone),
     m_valid(false)
 {
@@ -168,7 +169,6 @@ bool CDDSImage::load(string filename, bool flipImage, bool RGB2RGBA)
 {
     assert(filename.length() != 0);
 
-    std::cout << "File name has length" << std::endl;
     
     // clear any previously loaded images
     clear();
@@ -178,7 +178,6 @@ bool CDDSImage::load(string filename, bool flipImage, bool RGB2RGBA)
     if (fp == NULL)
         return false;
 
-    std::cout << "Found a file" << std::endl;
 
     // read in file marker, make sure its a DDS file
     char filecode[4];
@@ -189,7 +188,6 @@ bool CDDSImage::load(string filename, bool flipImage, bool RGB2RGBA)
         return false;
     }
 
-    std::cout << "Its a DDS file" << std::endl;
 
     // read in DDS header
     DDS_HEADER ddsh;
@@ -242,6 +240,61 @@ bool CDDSImage::load(string filename, bool flipImage, bool RGB2RGBA)
                 m_components = 4;
                 m_internal_format = m_format;
                 break;
+            case FOURCC_ATI1:
+                m_format = COMPRESSED_RED_RGTC1;
+                m_components = 1;
+                m_internal_format = m_format;
+                break;
+            case FOURCC_ATI2:
+                m_format = COMPRESSED_RG_RGTC2;
+                m_components = 2;
+                m_internal_format = m_format;
+                break;
+            case FOURCC_DX10:
+            {
+                DDS_HEADER_DXT10 dx10;
+                fread(&dx10, sizeof(DDS_HEADER_DXT10), 1, fp);
+                swap_endian(&dx10.dxgiFormat);
+                swap_endian(&dx10.arraySize);
+                m_dxgiFormat = dx10.dxgiFormat;
+                switch(dx10.dxgiFormat)
+                {
+                    case DXGI_FORMAT_BC1_UNORM:
+                    case DXGI_FORMAT_BC1_UNORM_SRGB:
+                        m_format = COMPRESSED_RGBA_S3TC_DXT1_EXT;
+                        m_components = 3;
+                        break;
+                    case DXGI_FORMAT_BC3_UNORM:
+                    case DXGI_FORMAT_BC3_UNORM_SRGB:
+                        m_format = COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                        m_components = 4;
+                        break;
+                    case DXGI_FORMAT_BC4_UNORM:
+                        m_format = COMPRESSED_RED_RGTC1;
+                        m_components = 1;
+                        break;
+                    case DXGI_FORMAT_BC5_UNORM:
+                        m_format = COMPRESSED_RG_RGTC2;
+                        m_components = 2;
+                        break;
+                    case DXGI_FORMAT_BC7_UNORM:
+                    case DXGI_FORMAT_BC7_UNORM_SRGB:
+                        m_format = COMPRESSED_RGBA_BPTC_UNORM;
+                        m_components = 4;
+                        break;
+                    default:
+                        fclose(fp);
+                        return false;
+                }
+                // texture arrays are not supported
+                if (dx10.arraySize > 1)
+                {
+                    fclose(fp);
+                    return false;
+                }
+                m_internal_format = m_format;
+                break;
+            }
             default:
                 fclose(fp);
                 return false;
@@ -470,6 +523,9 @@ bool CDDSImage::save(std::string filename, bool flipImage)
             ddsh.ddspf.dwFourCC = FOURCC_DXT3;
         if (m_format == COMPRESSED_RGBA_S3TC_DXT5_EXT)
             ddsh.ddspf.dwFourCC = FOURCC_DXT5;
+        if (m_format == COMPRESSED_RED_RGTC1 || m_format == COMPRESSED_RG_RGTC2 ||
+            m_format == COMPRESSED_RGBA_BPTC_UNORM || m_dxgiFormat != 0)
+            ddsh.ddspf.dwFourCC = FOURCC_DX10;
     }
     else
     {
@@ -514,6 +570,27 @@ bool CDDSImage::save(std::string filename, bool flipImage)
     // write dds header
     fwrite(&ddsh, 1, sizeof(DDS_HEADER), fp);
 
+    if (ddsh.ddspf.dwFourCC == FOURCC_DX10)
+    {
+        DDS_HEADER_DXT10 dx10;
+        memset(&dx10, 0, sizeof(DDS_HEADER_DXT10));
+        dx10.dxgiFormat = m_dxgiFormat;
+        if (dx10.dxgiFormat == 0)
+        {
+            switch (m_format)
+            {
+                case COMPRESSED_RGBA_S3TC_DXT1_EXT: dx10.dxgiFormat = DXGI_FORMAT_BC1_UNORM; break;
+                case COMPRESSED_RGBA_S3TC_DXT5_EXT: dx10.dxgiFormat = DXGI_FORMAT_BC3_UNORM; break;
+                case COMPRESSED_RED_RGTC1:          dx10.dxgiFormat = DXGI_FORMAT_BC4_UNORM; break;
+                case COMPRESSED_RG_RGTC2:           dx10.dxgiFormat = DXGI_FORMAT_BC5_UNORM; break;
+                case COMPRESSED_RGBA_BPTC_UNORM:    dx10.dxgiFormat = DXGI_FORMAT_BC7_UNORM; break;
+            }
+        }
+        dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        dx10.arraySize = 1;
+        fwrite(&dx10, 1, sizeof(DDS_HEADER_DXT10), fp);
+    }
+
     if (m_type != TextureCubemap)
     {
         CTexture tex = m_images[0];
@@ -550,6 +627,7 @@ void CDDSImage::clear()
 {
     m_components = 0;
     m_format = 0;
+    m_dxgiFormat = 0;
     m_type = TextureNone;
     m_valid = false;
 
@@ -576,7 +654,7 @@ inline unsigned int CDDSImage::clamp_size(unsigned int size)
 inline unsigned int CDDSImage::size_dxtc(unsigned int width, unsigned int height)
 {
     return ((width+3)/4)*((height+3)/4)*
-        (m_format == COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16);   
+        ((m_format == COMPRESSED_RGBA_S3TC_DXT1_EXT || m_format == COMPRESSED_RED_RGTC1) ? 8 : 16);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -651,6 +729,8 @@ void CDDSImage::flip(CSurface &surface)
                 flipblocks = &CDDSImage::flip_blocks_dxtc5; 
                 break;
             default:
+                // BC4, BC5 and BC7 are left as they are
+                assert(!"cannot flip this block format");
                 return;
         }
 
@@ -40,6 +40,9 @@
 #define COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
 #define COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
 #define COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define COMPRESSED_RED_RGTC1 0x8DBB
+#define COMPRESSED_RG_RGTC2 0x8DBD
+#define COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
 
 #define RED 0x1903
 #define RG8 0x822B
@@ -87,6 +90,21 @@ namespace nv_dds
     const uint32_t FOURCC_DXT1 = 0x31545844l; //(MAKEFOURCC('D','X','T','1'))
     const uint32_t FOURCC_DXT3 = 0x33545844l; //(MAKEFOURCC('D','X','T','3'))
     const uint32_t FOURCC_DXT5 = 0x35545844l; //(MAKEFOURCC('D','X','T','5'))
+    const uint32_t FOURCC_ATI1 = 0x31495441l; //(MAKEFOURCC('A','T','I','1'))
+    const uint32_t FOURCC_ATI2 = 0x32495441l; //(MAKEFOURCC('A','T','I','2'))
+    const uint32_t FOURCC_DX10 = 0x30315844l; //(MAKEFOURCC('D','X','1','0'))
+
+    // DXGI formats of the DX10 extended header, only the block compressed ones are handled
+    const uint32_t DXGI_FORMAT_BC1_UNORM       = 71;
+    const uint32_t DXGI_FORMAT_BC1_UNORM_SRGB  = 72;
+    const uint32_t DXGI_FORMAT_BC3_UNORM       = 77;
+    const uint32_t DXGI_FORMAT_BC3_UNORM_SRGB  = 78;
+    const uint32_t DXGI_FORMAT_BC4_UNORM       = 80;
+    const uint32_t DXGI_FORMAT_BC5_UNORM       = 83;
+    const uint32_t DXGI_FORMAT_BC7_UNORM       = 98;
+    const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB  = 99;
+
+    const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
 
     struct DXTColBlock
     {
@@ -137,6 +155,16 @@ namespace nv_dds
         uint32_t dwReserved2[3];
     };
 
+    // follows DDS_HEADER when ddspf.dwFourCC is FOURCC_DX10
+    struct DDS_HEADER_DXT10
+    {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
     enum TextureType
     {
         TextureNone,
@@ -229,6 +257,7 @@ namespace nv_dds
                                        const CTexture &positiveZ, const CTexture &negativeZ);
 
             void clear();
+            // BC4, BC5 and BC7 blocks cannot be flipped, use flipImage = false with them
             virtual bool load(std::string filename, bool flipImage = true, bool RGB2RGBA=true);
             bool save(std::string filename, bool flipImage = true);
 
@@ -304,13 +333,20 @@ namespace nv_dds
             inline unsigned int get_components() { return m_components; }
             inline unsigned int get_format() { return m_format; }
             inline unsigned int get_internal_format() { return m_internal_format; }
+            // the DXGI format of the DX10 header if the file had one, the image is sRGB encoded if
+            // it is one of the _SRGB formats
+            inline uint32_t get_dxgi_format() { return m_dxgiFormat; }
+            inline void set_dxgi_format(uint32_t dxgiFormat) { m_dxgiFormat = dxgiFormat; }
             inline TextureType get_type() { return m_type; }
 
             inline bool is_compressed() 
             { 
                 if ((m_format == COMPRESSED_RGBA_S3TC_DXT1_EXT) || 
                     (m_format == COMPRESSED_RGBA_S3TC_DXT3_EXT) ||
-                    (m_format == COMPRESSED_RGBA_S3TC_DXT5_EXT))
+                    (m_format == COMPRESSED_RGBA_S3TC_DXT5_EXT) ||
+                    (m_format == COMPRESSED_RED_RGTC1) ||
+                    (m_format == COMPRESSED_RG_RGTC2) ||
+                    (m_format == COMPRESSED_RGBA_BPTC_UNORM))
                     return true; 
                 else
                     return false;
@@ -355,6 +391,7 @@ namespace nv_dds
             
             unsigned int m_format, m_internal_format;
             unsigned int m_components;
+            uint32_t m_dxgiFormat;
             TextureType m_type;
             bool m_valid;
 
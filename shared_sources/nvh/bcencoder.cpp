@@ -0,0 +1,517 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bcencoder.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace nvh {
+namespace bc {
+
+namespace {
+
+// Principal axis of the points by power iteration on their covariance matrix,
+// the axis is zero if all points are the same
+template <int N>
+void principalAxis(const float points[16][N], float mean[N], float axis[N])
+{
+  for(int c = 0; c < N; c++)
+  {
+    mean[c] = 0;
+    for(int i = 0; i < 16; i++)
+      mean[c] += points[i][c];
+    mean[c] /= 16.0f;
+  }
+
+  float cov[N][N] = {};
+  for(int i = 0; i < 16; i++)
+  {
+    for(int a = 0; a < N; a++)
+    {
+      for(int b = a; b < N; b++)
+        cov[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+    }
+  }
+  for(int a = 0; a < N; a++)
+  {
+    for(int b = 0; b < a; b++)
+      cov[a][b] = cov[b][a];
+  }
+
+  // starting with the column of the largest variance avoids an initial guess orthogonal to the axis
+  int largest = 0;
+  for(int c = 1; c < N; c++)
+  {
+    if(cov[c][c] > cov[largest][largest])
+      largest = c;
+  }
+  for(int c = 0; c < N; c++)
+    axis[c] = cov[c][largest];
+
+  for(int iter = 0; iter < 8; iter++)
+  {
+    float next[N] = {};
+    float norm    = 0;
+    for(int a = 0; a < N; a++)
+    {
+      for(int b = 0; b < N; b++)
+        next[a] += cov[a][b] * axis[b];
+      norm = std::max(norm, std::abs(next[a]));
+    }
+    if(norm < FLT_EPSILON)
+      break;
+    for(int c = 0; c < N; c++)
+      axis[c] = next[c] / norm;
+  }
+
+  float length = 0;
+  for(int c = 0; c < N; c++)
+    length += axis[c] * axis[c];
+  length = std::sqrt(length);
+  for(int c = 0; c < N; c++)
+    axis[c] = length > FLT_EPSILON ? axis[c] / length : 0.0f;
+}
+
+// Extent of the points along the axis, relative to the mean
+template <int N>
+void projectRange(const float points[16][N], const float mean[N], const float axis[N], float& tMin, float& tMax)
+{
+  tMin = FLT_MAX;
+  tMax = -FLT_MAX;
+  for(int i = 0; i < 16; i++)
+  {
+    float t = 0;
+    for(int c = 0; c < N; c++)
+      t += (points[i][c] - mean[c]) * axis[c];
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+}
+
+// Least squares endpoints for fixed interpolation weights, `weights[i]` is the weight of e1.
+// Returns false if the system is singular (all texels use the same weight).
+template <int N>
+bool fitEndpoints(const float points[16][N], const float weights[16], float e0[N], float e1[N])
+{
+  float aa = 0, ab = 0, bb = 0;
+  float ax[N] = {}, bx[N] = {};
+  for(int i = 0; i < 16; i++)
+  {
+    float b = weights[i];
+    float a = 1.0f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for(int c = 0; c < N; c++)
+    {
+      ax[c] += a * points[i][c];
+      bx[c] += b * points[i][c];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if(std::abs(det) < FLT_EPSILON)
+    return false;
+  for(int c = 0; c < N; c++)
+  {
+    e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / det, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / det, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BC1
+
+inline uint16_t packRGB565(const float color[3])
+{
+  auto quantize = [](float v, float range) {
+    return uint32_t(std::min(std::max(v, 0.0f), 255.0f) * range / 255.0f + 0.5f);
+  };
+  return uint16_t((quantize(color[0], 31.0f) << 11) | (quantize(color[1], 63.0f) << 5) | quantize(color[2], 31.0f));
+}
+
+inline void unpackRGB565(uint16_t packed, float color[3])
+{
+  uint32_t r = (packed >> 11) & 31;
+  uint32_t g = (packed >> 5) & 63;
+  uint32_t b = packed & 31;
+  color[0]   = float((r << 3) | (r >> 2));
+  color[1]   = float((g << 2) | (g >> 4));
+  color[2]   = float((b << 3) | (b >> 2));
+}
+
+// Chooses the closest of the 4 palette colors for each texel, returns the squared error
+float selectIndicesBC1(const float points[16][3], uint16_t c0, uint16_t c1, uint32_t& indices)
+{
+  float palette[4][3];
+  unpackRGB565(c0, palette[0]);
+  unpackRGB565(c1, palette[1]);
+  for(int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+    palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+  }
+
+  float error = 0;
+  indices     = 0;
+  for(int i = 0; i < 16; i++)
+  {
+    float    best      = FLT_MAX;
+    uint32_t bestIndex = 0;
+    for(uint32_t p = 0; p < 4; p++)
+    {
+      float d = 0;
+      for(int c = 0; c < 3; c++)
+        d += (points[i][c] - palette[p][c]) * (points[i][c] - palette[p][c]);
+      if(d < best)
+      {
+        best      = d;
+        bestIndex = p;
+      }
+    }
+    indices |= bestIndex << (2 * i);
+    error += best;
+  }
+  return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BC7
+
+const uint32_t s_bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// 7 bit endpoint and its p-bit, chooses the p-bit with the lowest error unless forced
+inline void quantizeBC7Endpoint(const float endpoint[4], int forcedPBit, uint8_t quantized[4], uint32_t& pbit)
+{
+  float bestError = FLT_MAX;
+  for(uint32_t p = 0; p < 2; p++)
+  {
+    if(forcedPBit >= 0 && uint32_t(forcedPBit) != p)
+      continue;
+    float   error = 0;
+    uint8_t q[4];
+    for(int c = 0; c < 4; c++)
+    {
+      float v = (endpoint[c] - float(p)) * 0.5f;
+      q[c]    = uint8_t(std::min(std::max(int(v + 0.5f), 0), 127));
+      float r = float(q[c] * 2 + p);
+      error += (r - endpoint[c]) * (r - endpoint[c]);
+    }
+    if(error < bestError)
+    {
+      bestError = error;
+      pbit      = p;
+      memcpy(quantized, q, 4);
+    }
+  }
+}
+
+float selectIndicesBC7(const float points[16][4], const uint8_t q0[4], uint32_t p0, const uint8_t q1[4], uint32_t p1, uint8_t indices[16])
+{
+  float palette[16][4];
+  for(int c = 0; c < 4; c++)
+  {
+    uint32_t e0 = q0[c] * 2 + p0;
+    uint32_t e1 = q1[c] * 2 + p1;
+    for(int w = 0; w < 16; w++)
+      palette[w][c] = float(((64 - s_bc7Weights4[w]) * e0 + s_bc7Weights4[w] * e1 + 32) >> 6);
+  }
+
+  float error = 0;
+  for(int i = 0; i < 16; i++)
+  {
+    float best = FLT_MAX;
+    for(uint8_t w = 0; w < 16; w++)
+    {
+      float d = 0;
+      for(int c = 0; c < 4; c++)
+        d += (points[i][c] - palette[w][c]) * (points[i][c] - palette[w][c]);
+      if(d < best)
+      {
+        best       = d;
+        indices[i] = w;
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+struct BitWriter
+{
+  uint8_t* data;
+  uint32_t pos = 0;
+
+  void write(uint32_t value, uint32_t bits)
+  {
+    for(uint32_t b = 0; b < bits; b++, pos++)
+    {
+      if((value >> b) & 1)
+        data[pos >> 3] |= uint8_t(1 << (pos & 7));
+    }
+  }
+};
+
+}  // namespace
+
+//////////////////////////////////////////////////////////////////////////
+
+void encodeBlockBC1(const uint8_t rgba[64], uint8_t block[8])
+{
+  float points[16][3];
+  for(int i = 0; i < 16; i++)
+  {
+    for(int c = 0; c < 3; c++)
+      points[i][c] = float(rgba[i * 4 + c]);
+  }
+
+  float mean[3], axis[3], tMin, tMax;
+  principalAxis<3>(points, mean, axis);
+  projectRange<3>(points, mean, axis, tMin, tMax);
+
+  float e0[3], e1[3];
+  for(int c = 0; c < 3; c++)
+  {
+    e0[c] = mean[c] + axis[c] * tMax;
+    e1[c] = mean[c] + axis[c] * tMin;
+  }
+  uint16_t c0 = packRGB565(e0);
+  uint16_t c1 = packRGB565(e1);
+  uint32_t indices;
+  float    error = selectIndicesBC1(points, c0, c1, indices);
+
+  // one refinement step with the endpoints that best fit the chosen indices
+  const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  float       texelWeights[16];
+  for(int i = 0; i < 16; i++)
+    texelWeights[i] = weights[(indices >> (2 * i)) & 3];
+  if(fitEndpoints<3>(points, texelWeights, e0, e1))
+  {
+    uint16_t r0 = packRGB565(e0);
+    uint16_t r1 = packRGB565(e1);
+    uint32_t rIndices;
+    if(selectIndicesBC1(points, r0, r1, rIndices) < error)
+    {
+      c0      = r0;
+      c1      = r1;
+      indices = rIndices;
+    }
+  }
+
+  // the 4 color mode requires c0 > c1, swapping the endpoints swaps indices 0<->1 and 2<->3
+  if(c0 < c1)
+  {
+    std::swap(c0, c1);
+    indices ^= 0x55555555;
+  }
+  else if(c0 == c1)
+  {
+    indices = 0;
+  }
+
+  block[0] = uint8_t(c0 & 0xff);
+  block[1] = uint8_t(c0 >> 8);
+  block[2] = uint8_t(c1 & 0xff);
+  block[3] = uint8_t(c1 >> 8);
+  block[4] = uint8_t(indices & 0xff);
+  block[5] = uint8_t((indices >> 8) & 0xff);
+  block[6] = uint8_t((indices >> 16) & 0xff);
+  block[7] = uint8_t(indices >> 24);
+}
+
+void encodeBlockBC4(const uint8_t rgba[64], uint32_t channel, uint8_t block[8])
+{
+  uint32_t vMin = 255, vMax = 0;
+  for(int i = 0; i < 16; i++)
+  {
+    vMin = std::min(vMin, uint32_t(rgba[i * 4 + channel]));
+    vMax = std::max(vMax, uint32_t(rgba[i * 4 + channel]));
+  }
+
+  memset(block, 0, 8);
+  block[0] = uint8_t(vMax);
+  block[1] = uint8_t(vMin);
+  if(vMax == vMin)
+    return;
+
+  // 8 value mode, as block[0] > block[1]
+  uint32_t palette[8] = {vMax, vMin};
+  for(uint32_t p = 2; p < 8; p++)
+    palette[p] = ((8 - p) * vMax + (p - 1) * vMin + 3) / 7;
+
+  uint64_t indices = 0;
+  for(int i = 0; i < 16; i++)
+  {
+    uint32_t v         = rgba[i * 4 + channel];
+    uint32_t best      = ~0u;
+    uint64_t bestIndex = 0;
+    for(uint32_t p = 0; p < 8; p++)
+    {
+      uint32_t d = v > palette[p] ? v - palette[p] : palette[p] - v;
+      if(d < best)
+      {
+        best      = d;
+        bestIndex = p;
+      }
+    }
+    indices |= bestIndex << (3 * i);
+  }
+  for(int b = 0; b < 6; b++)
+    block[2 + b] = uint8_t((indices >> (8 * b)) & 0xff);
+}
+
+void encodeBlockBC3(const uint8_t rgba[64], uint8_t block[16])
+{
+  encodeBlockBC4(rgba, 3, block);
+  encodeBlockBC1(rgba, block + 8);
+}
+
+void encodeBlockBC5(const uint8_t rgba[64], uint8_t block[16])
+{
+  encodeBlockBC4(rgba, 0, block);
+  encodeBlockBC4(rgba, 1, block + 8);
+}
+
+void encodeBlockBC7(const uint8_t rgba[64], uint8_t block[16])
+{
+  float points[16][4];
+  bool  opaque = true;
+  for(int i = 0; i < 16; i++)
+  {
+    for(int c = 0; c < 4; c++)
+      points[i][c] = float(rgba[i * 4 + c]);
+    opaque = opaque && rgba[i * 4 + 3] == 255;
+  }
+  // opaque blocks need both p-bits set to decode to an alpha of exactly 255
+  int forcedPBit = opaque ? 1 : -1;
+
+  float mean[4], axis[4], tMin, tMax;
+  principalAxis<4>(points, mean, axis);
+  projectRange<4>(points, mean, axis, tMin, tMax);
+
+  float e0[4], e1[4];
+  for(int c = 0; c < 4; c++)
+  {
+    e0[c] = mean[c] + axis[c] * tMin;
+    e1[c] = mean[c] + axis[c] * tMax;
+  }
+  uint8_t  q0[4], q1[4], indices[16];
+  uint32_t p0 = 0, p1 = 0;
+  quantizeBC7Endpoint(e0, forcedPBit, q0, p0);
+  quantizeBC7Endpoint(e1, forcedPBit, q1, p1);
+  float error = selectIndicesBC7(points, q0, p0, q1, p1, indices);
+
+  float texelWeights[16];
+  for(int i = 0; i < 16; i++)
+    texelWeights[i] = float(s_bc7Weights4[indices[i]]) / 64.0f;
+  if(fitEndpoints<4>(points, texelWeights, e0, e1))
+  {
+    uint8_t  r0[4], r1[4], rIndices[16];
+    uint32_t rp0 = 0, rp1 = 0;
+    quantizeBC7Endpoint(e0, forcedPBit, r0, rp0);
+    quantizeBC7Endpoint(e1, forcedPBit, r1, rp1);
+    if(selectIndicesBC7(points, r0, rp0, r1, rp1, rIndices) < error)
+    {
+      memcpy(q0, r0, 4);
+      memcpy(q1, r1, 4);
+      memcpy(indices, rIndices, 16);
+      p0 = rp0;
+      p1 = rp1;
+    }
+  }
+
+  // the anchor index is stored without its top bit, which must be zero
+  if(indices[0] & 8)
+  {
+    for(int c = 0; c < 4; c++)
+      std::swap(q0[c], q1[c]);
+    std::swap(p0, p1);
+    for(int i = 0; i < 16; i++)
+      indices[i] = 15 - indices[i];
+  }
+
+  memset(block, 0, 16);
+  BitWriter bits{block};
+  bits.write(1 << 6, 7);  // mode 6
+  for(int c = 0; c < 4; c++)
+  {
+    bits.write(q0[c], 7);
+    bits.write(q1[c], 7);
+  }
+  bits.write(p0, 1);
+  bits.write(p1, 1);
+  bits.write(indices[0], 3);
+  for(int i = 1; i < 16; i++)
+    bits.write(indices[i], 4);
+}
+
+void encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks)
+{
+  uint32_t blockSize = getBlockSize(format);
+  uint8_t  texels[64];
+  for(uint32_t by = 0; by < height; by += 4)
+  {
+    for(uint32_t bx = 0; bx < width; bx += 4)
+    {
+      for(uint32_t y = 0; y < 4; y++)
+      {
+        uint32_t sy = std::min(by + y, height - 1);
+        for(uint32_t x = 0; x < 4; x++)
+        {
+          uint32_t sx = std::min(bx + x, width - 1);
+          memcpy(texels + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+        }
+      }
+
+      switch(format)
+      {
+        case eBC1:
+          encodeBlockBC1(texels, blocks);
+          break;
+        case eBC3:
+          encodeBlockBC3(texels, blocks);
+          break;
+        case eBC4:
+          encodeBlockBC4(texels, 0, blocks);
+          break;
+        case eBC5:
+          encodeBlockBC5(texels, blocks);
+          break;
+        case eBC7:
+          encodeBlockBC7(texels, blocks);
+          break;
+      }
+      blocks += blockSize;
+    }
+  }
+}
+
+}  // namespace bc
+}  // namespace nvh
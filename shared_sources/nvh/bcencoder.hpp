@@ -0,0 +1,97 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nvh {
+
+/**
+# namespace nvh::bc
+
+CPU encoders for the block compressed texture formats, so textures can be
+cooked offline and uploaded without any runtime conversion.
+
+- BC1: RGB, 8 bytes per 4x4 block, always uses the opaque 4 color mode
+- BC3: RGBA, BC1 color block preceded by a BC4 alpha block
+- BC4: one channel (red), 8 bytes per block
+- BC5: two channels (red, green) as two BC4 blocks, for normal maps
+- BC7: RGBA, 16 bytes per block, mode 6 only (single subset, 7.7.7.7 endpoints
+  with p-bit, 4 bit indices)
+
+The endpoints are fitted along the principal axis of the block colors and refined
+once with a least squares fit on the chosen indices. The quality is below the
+dedicated compressors but more than enough to ship sample assets and the
+encoders are fast enough to run at load time.
+
+Inputs are always tightly packed RGBA8, the encoders do not care whether the data
+is sRGB or linear: the blocks decode to the same encoding as the input.
+
+Example :
+~~~ C++
+std::vector<uint8_t> blocks(nvh::bc::getImageSize(nvh::bc::eBC7, width, height));
+nvh::bc::encodeImage(nvh::bc::eBC7, rgba, width, height, blocks.data());
+~~~
+*/
+
+namespace bc {
+
+enum Format
+{
+  eBC1,
+  eBC3,
+  eBC4,
+  eBC5,
+  eBC7,
+};
+
+inline uint32_t getBlockSize(Format format)
+{
+  return (format == eBC1 || format == eBC4) ? 8 : 16;
+}
+
+inline size_t getImageSize(Format format, uint32_t width, uint32_t height)
+{
+  return size_t((width + 3) / 4) * size_t((height + 3) / 4) * getBlockSize(format);
+}
+
+// `rgba` holds the 16 texels of the block in row major order
+void encodeBlockBC1(const uint8_t rgba[64], uint8_t block[8]);
+void encodeBlockBC3(const uint8_t rgba[64], uint8_t block[16]);
+// encodes rgba[channel + 4 * i]
+void encodeBlockBC4(const uint8_t rgba[64], uint32_t channel, uint8_t block[8]);
+void encodeBlockBC5(const uint8_t rgba[64], uint8_t block[16]);
+void encodeBlockBC7(const uint8_t rgba[64], uint8_t block[16]);
+
+// Encodes a full image, borders are replicated for partial blocks.
+// `blocks` must hold getImageSize(format, width, height) bytes.
+void encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+
+}  // namespace bc
+}  // namespace nvh
@@ -101,14 +101,14 @@ bool FileMapping::open(const char* fileName, MappingType mappingType, size_t fil
   }
 
 #if defined(_WIN32)
-  m_win32.file = mappingType == MAPPING_READONLY ?
+  m_win32.file = mappingType != MAPPING_READOVERWRITE ?
                      CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_READONLY, NULL) :
                      CreateFile(fileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 
   m_isValid = (m_win32.file != INVALID_HANDLE_VALUE);
   if(m_isValid)
   {
-    if(mappingType == MAPPING_READONLY)
+    if(mappingType != MAPPING_READOVERWRITE)
     {
       DWORD sizeHi  = 0;
       DWORD sizeLo  = GetFileSize(m_win32.file, &sizeHi);
@@ -116,14 +116,16 @@ bool FileMapping::open(const char* fileName, MappingType mappingType, size_t fil
       m_fileSize    = m_mappingSize;
     }
 
-    m_win32.fileMapping = CreateFileMapping(m_win32.file, NULL, mappingType == MAPPING_READONLY ? PAGE_READONLY : PAGE_READWRITE,
-                                            HIDWORD(m_mappingSize), LODWORD(m_mappingSize), NULL);
+    DWORD protect = mappingType == MAPPING_READONLY ? PAGE_READONLY :
+                    mappingType == MAPPING_READCOPYONWRITE ? PAGE_WRITECOPY : PAGE_READWRITE;
+    m_win32.fileMapping = CreateFileMapping(m_win32.file, NULL, protect, HIDWORD(m_mappingSize), LODWORD(m_mappingSize), NULL);
 
     m_isValid = (m_win32.fileMapping != NULL);
     if(m_isValid)
     {
-      m_mappingPtr = MapViewOfFile(m_win32.fileMapping, mappingType == MAPPING_READONLY ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS,
-                                   HIDWORD(0), LODWORD(0), (SIZE_T)0);
+      DWORD access = mappingType == MAPPING_READONLY ? FILE_MAP_READ :
+                     mappingType == MAPPING_READCOPYONWRITE ? FILE_MAP_COPY : FILE_MAP_ALL_ACCESS;
+      m_mappingPtr = MapViewOfFile(m_win32.fileMapping, access, HIDWORD(0), LODWORD(0), (SIZE_T)0);
       if (!m_mappingPtr)
       {
     #if 0
@@ -139,12 +141,12 @@ bool FileMapping::open(const char* fileName, MappingType mappingType, size_t fil
     }
   }
 #elif defined(LINUX)
-  m_unix.file = mappingType == MAPPING_READONLY ? ::open(fileName, O_RDONLY) : ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  m_unix.file = mappingType != MAPPING_READOVERWRITE ? ::open(fileName, O_RDONLY) : ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0666);
 
   m_isValid = (m_unix.file != -1);
   if(m_isValid)
   {
-    if(mappingType == MAPPING_READONLY)
+    if(mappingType != MAPPING_READOVERWRITE)
     {
       struct stat s;
       fstat(m_unix.file, &s);
@@ -159,7 +161,7 @@ bool FileMapping::open(const char* fileName, MappingType mappingType, size_t fil
     }
     m_fileSize = m_mappingSize;
     m_mappingPtr = mmap(0, m_mappingSize, mappingType == MAPPING_READONLY ? PROT_READ : (PROT_READ | PROT_WRITE),
-                        MAP_SHARED, m_unix.file, 0);
+                        mappingType == MAPPING_READCOPYONWRITE ? MAP_PRIVATE : MAP_SHARED, m_unix.file, 0);
     if (m_mappingPtr == MAP_FAILED)
     {
       ::close(m_unix.file);
@@ -73,6 +73,7 @@ public:
   {
     MAPPING_READONLY,       // opens existing file for read-only access
     MAPPING_READOVERWRITE,  // creates new file with read/write access, overwriting existing files
+    MAPPING_READCOPYONWRITE,  // opens existing file, writes go to private copies of the pages, the file is unchanged
   };
 
   // fileSize only for write access
@@ -130,4 +131,16 @@ public:
   size_t size() const { return m_fileSize; }
   bool   valid() const { return m_isValid; }
 };
+
+// pages are read on first access and copied on first write, other processes mapping
+// the same file share the pages that were not written
+class FileReadCopyOnWriteMapping : private FileMapping
+{
+public:
+  bool   open(const char* filename) { return FileMapping::open(filename, MAPPING_READCOPYONWRITE, 0); }
+  void   close() { FileMapping::close(); }
+  void*  data() { return m_mappingPtr; }
+  size_t size() const { return m_fileSize; }
+  bool   valid() const { return m_isValid; }
+};
 }  // namespace nvh
@@ -26,6 +26,7 @@
  */
 
 #include "gltfscene.hpp"
+#include "misc.hpp"
 #include "nvprint.hpp"
 #include <iostream>
 #include <numeric>
@@ -179,11 +180,8 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
   // Find the number of vertex(attributes) and index
   uint32_t nbVert{0};
   uint32_t nbIndex{0};
-  uint32_t meshCnt{0};  // use for mesh to new meshes
-  uint32_t primCnt{0};  //  "   "  "  "
   for(const auto& mesh : tmodel.meshes)
   {
-    std::vector<uint32_t> vprim;
     for(const auto& primitive : mesh.primitives)
     {
       if(primitive.mode != 4)  // Triangle
@@ -199,9 +197,7 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
       {
         nbIndex += static_cast<uint32_t>(posAccessor.count);
       }
-      vprim.emplace_back(primCnt++);
     }
-    m_meshToPrimMeshes[meshCnt++] = std::move(vprim);  // mesh-id = { prim0, prim1, ... }
   }
 
   // Reserving memory
@@ -217,12 +213,19 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
     m_colors0.reserve(nbVert);
 
   // Convert all mesh/primitives+ to a single primitive per mesh
-  for(const auto& tmesh : tmodel.meshes)
+  for(int meshIdx = 0; meshIdx < static_cast<int>(tmodel.meshes.size()); meshIdx++)
   {
+    const auto&           tmesh = tmodel.meshes[meshIdx];
+    std::vector<uint32_t> vprim;
     for(const auto& tprimitive : tmesh.primitives)
     {
-      processMesh(tmodel, tprimitive, attributes, tmesh.name);
+      if(tprimitive.mode != 4)  // Triangle
+        continue;
+      uint32_t primMesh = processMesh(tmodel, tprimitive, attributes, tmesh.name);
+      if(primMesh != ~0u)
+        vprim.emplace_back(primMesh);
     }
+    m_meshToPrimMeshes[meshIdx] = std::move(vprim);  // mesh-id = { prim0, prim1, ... }
   }
 
   // Transforming the scene hierarchy to a flat list
@@ -237,6 +240,7 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
   computeCamera();
 
   m_meshToPrimMeshes.clear();
+  m_primMeshHashes.clear();
   primitiveIndices32u.clear();
   primitiveIndices16u.clear();
   primitiveIndices8u.clear();
@@ -312,9 +316,9 @@ void GltfScene::processNode(const tinygltf::Model& tmodel, int& nodeIdx, const n
 }
 
 //--------------------------------------------------------------------------------------------------
-// Extracting the values to a linear buffer
+// Extracting the values to a linear buffer, returns the index of the prim mesh
 //
-void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name)
+uint32_t GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name)
 {
   GltfPrimMesh resultMesh;
   resultMesh.name          = name;
@@ -325,7 +329,7 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
   // Only triangles are supported
   // 0:point, 1:lines, 2:line_loop, 3:line_strip, 4:triangles, 5:triangle_strip, 6:triangle_fan
   if(tmesh.mode != 4)
-    return;
+    return ~0u;
 
   // INDICES
   if(tmesh.indices > -1)
@@ -361,7 +365,7 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
       }
       default:
         std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
-        return;
+        return ~0u;
     }
   }
   else
@@ -590,8 +594,67 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
     }
   }
 
+  // Instancing: the same data was already extracted, dropping this copy
+  if(m_findUniquePrimMeshes)
+  {
+    uint64_t hash       = hashPrimMesh(resultMesh);
+    auto&    candidates = m_primMeshHashes[hash];
+    for(uint32_t candidate : candidates)
+    {
+      if(isEqualPrimMesh(m_primMeshes[candidate], resultMesh))
+      {
+        auto truncate = [&](auto& attrib) {
+          if(attrib.size() > resultMesh.vertexOffset)
+            attrib.resize(resultMesh.vertexOffset);
+        };
+        m_indices.resize(resultMesh.firstIndex);
+        truncate(m_positions);
+        truncate(m_normals);
+        truncate(m_tangents);
+        truncate(m_texcoords0);
+        truncate(m_texcoords1);
+        truncate(m_colors0);
+        return candidate;
+      }
+    }
+    candidates.push_back(static_cast<uint32_t>(m_primMeshes.size()));
+  }
+
   m_primMeshes.emplace_back(resultMesh);
-}  // namespace nvh
+  return static_cast<uint32_t>(m_primMeshes.size() - 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Content of a prim mesh: material, indices and all attributes
+//
+uint64_t GltfScene::hashPrimMesh(const GltfPrimMesh& primMesh) const
+{
+  uint64_t hash = nvh::hashBytes(&primMesh.materialIndex, sizeof(int));
+  hash          = nvh::hashBytes(m_indices.data() + primMesh.firstIndex, sizeof(uint32_t) * primMesh.indexCount, hash);
+  hash          = nvh::hashBytes(m_positions.data() + primMesh.vertexOffset, sizeof(nvmath::vec3f) * primMesh.vertexCount, hash);
+  if(m_normals.size() > primMesh.vertexOffset)
+    hash = nvh::hashBytes(m_normals.data() + primMesh.vertexOffset, sizeof(nvmath::vec3f) * primMesh.vertexCount, hash);
+  if(m_texcoords0.size() > primMesh.vertexOffset)
+    hash = nvh::hashBytes(m_texcoords0.data() + primMesh.vertexOffset, sizeof(nvmath::vec2f) * primMesh.vertexCount, hash);
+  return hash;
+}
+
+bool GltfScene::isEqualPrimMesh(const GltfPrimMesh& a, const GltfPrimMesh& b) const
+{
+  if(a.materialIndex != b.materialIndex || a.indexCount != b.indexCount || a.vertexCount != b.vertexCount)
+    return false;
+
+  auto equal = [&](const auto& attrib) {
+    using T = typename std::decay_t<decltype(attrib)>::value_type;
+    if(attrib.size() <= a.vertexOffset || attrib.size() <= b.vertexOffset)
+      return attrib.size() <= a.vertexOffset && attrib.size() <= b.vertexOffset;
+    return memcmp(attrib.data() + a.vertexOffset, attrib.data() + b.vertexOffset, sizeof(T) * a.vertexCount) == 0;
+  };
+
+  return memcmp(m_indices.data() + a.firstIndex, m_indices.data() + b.firstIndex, sizeof(uint32_t) * a.indexCount) == 0
+         && equal(m_positions) && equal(m_normals) && equal(m_tangents) && equal(m_texcoords0) && equal(m_texcoords1)
+         && equal(m_colors0);
+}
 
 //--------------------------------------------------------------------------------------------------
 // Return the matrix of the node
@@ -278,6 +278,10 @@ struct GltfScene
 
   static GltfStats getStatistics(const tinygltf::Model& tinyModel);
 
+  // Primitives with identical attributes, indices and material share one GltfPrimMesh,
+  // the nodes using them become its instances
+  bool m_findUniquePrimMeshes{true};
+
   // Scene data
   std::vector<GltfMaterial> m_materials;   // Material for shading
   std::vector<GltfNode>     m_nodes;       // Drawable nodes, flat hierarchy
@@ -312,10 +316,13 @@ struct GltfScene
 
 private:
   void          processNode(const tinygltf::Model& tmodel, int& nodeIdx, const nvmath::mat4f& parentMatrix);
-  void          processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name);
+  uint32_t      processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name);
+  uint64_t      hashPrimMesh(const GltfPrimMesh& primMesh) const;
+  bool          isEqualPrimMesh(const GltfPrimMesh& a, const GltfPrimMesh& b) const;
   
   // Temporary data
   std::unordered_map<int, std::vector<uint32_t>> m_meshToPrimMeshes;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> m_primMeshHashes;  // content hash to prim meshes
   std::vector<uint32_t>                          primitiveIndices32u;
   std::vector<uint16_t>                          primitiveIndices16u;
   std::vector<uint8_t>                           primitiveIndices8u;
@@ -0,0 +1,238 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "meshletbuilder.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace nvh {
+
+namespace {
+
+struct Position
+{
+  float v[3];
+};
+
+Position readPosition(const uint8_t* bytes, size_t stride, size_t positionOffset, uint32_t vertex)
+{
+  Position p;
+  memcpy(p.v, bytes + vertex * stride + positionOffset, sizeof(p.v));
+  return p;
+}
+
+// Sphere around the box of the vertices, normal cone of the non-degenerate triangles
+void computeBounds(const uint8_t*                bytes,
+                   size_t                        stride,
+                   size_t                        positionOffset,
+                   const MeshletBuilder::Result& result,
+                   const uint32_t*               indices,
+                   MeshletBuilder::Meshlet&      meshlet)
+{
+  float boxMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float boxMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+  {
+    Position p = readPosition(bytes, stride, positionOffset, result.vertices[meshlet.vertexOffset + i]);
+    for(int k = 0; k < 3; k++)
+    {
+      boxMin[k] = std::min(boxMin[k], p.v[k]);
+      boxMax[k] = std::max(boxMax[k], p.v[k]);
+    }
+  }
+  for(int k = 0; k < 3; k++)
+  {
+    meshlet.center[k] = (boxMin[k] + boxMax[k]) * 0.5f;
+  }
+  float radius2 = 0.f;
+  for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+  {
+    Position p  = readPosition(bytes, stride, positionOffset, result.vertices[meshlet.vertexOffset + i]);
+    float    dx = p.v[0] - meshlet.center[0], dy = p.v[1] - meshlet.center[1], dz = p.v[2] - meshlet.center[2];
+    radius2     = std::max(radius2, dx * dx + dy * dy + dz * dz);
+  }
+  meshlet.radius = std::sqrt(radius2);
+
+  std::vector<Position> normals;
+  normals.reserve(meshlet.triangleCount);
+  float axis[3] = {0.f, 0.f, 0.f};
+  for(uint32_t t = 0; t < meshlet.triangleCount; t++)
+  {
+    uint32_t triangle = result.sourceTriangles[meshlet.triangleOffset + t];
+    Position p0       = readPosition(bytes, stride, positionOffset, indices[triangle * 3 + 0]);
+    Position p1       = readPosition(bytes, stride, positionOffset, indices[triangle * 3 + 1]);
+    Position p2       = readPosition(bytes, stride, positionOffset, indices[triangle * 3 + 2]);
+    float    e1[3]    = {p1.v[0] - p0.v[0], p1.v[1] - p0.v[1], p1.v[2] - p0.v[2]};
+    float    e2[3]    = {p2.v[0] - p0.v[0], p2.v[1] - p0.v[1], p2.v[2] - p0.v[2]};
+    Position n        = {{e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]}};
+    float    length   = std::sqrt(n.v[0] * n.v[0] + n.v[1] * n.v[1] + n.v[2] * n.v[2]);
+    if(length == 0.f)
+      continue;
+    for(int k = 0; k < 3; k++)
+    {
+      n.v[k] /= length;
+      axis[k] += n.v[k];
+    }
+    normals.push_back(n);
+  }
+
+  meshlet.coneCutoff = 1.f;
+  float length       = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  if(length == 0.f)
+    return;
+  float minDot = 1.f;
+  for(int k = 0; k < 3; k++)
+  {
+    meshlet.coneAxis[k] = axis[k] / length;
+  }
+  for(const auto& n : normals)
+  {
+    minDot = std::min(minDot, n.v[0] * meshlet.coneAxis[0] + n.v[1] * meshlet.coneAxis[1] + n.v[2] * meshlet.coneAxis[2]);
+  }
+  // Past a cone of about 84 degrees the test rejects almost nothing
+  if(minDot > 0.1f)
+    meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+}  // namespace
+
+void MeshletBuilder::build(const void*     vertices,
+                           size_t          numVertices,
+                           size_t          stride,
+                           const uint32_t* indices,
+                           size_t          numIndices,
+                           Result&         result,
+                           size_t          positionOffset) const
+{
+  const uint8_t* bytes        = static_cast<const uint8_t*>(vertices);
+  const uint32_t maxVertices  = std::min(std::max(m_settings.maxVertices, 3u), 256u);  // local indices are 8 bits
+  const uint32_t maxTriangles = std::max(m_settings.maxTriangles, 1u);
+  const size_t   numTriangles = numIndices / 3;
+
+  result.meshlets.clear();
+  result.vertices.clear();
+  result.primitiveIndices.clear();
+  result.sourceTriangles.clear();
+  result.primitiveIndices.reserve(numTriangles * 3);
+  result.sourceTriangles.reserve(numTriangles);
+
+  // Triangles of each vertex
+  std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+  for(size_t i = 0; i < numTriangles * 3; i++)
+  {
+    adjacencyOffsets[indices[i] + 1]++;
+  }
+  for(size_t v = 0; v < numVertices; v++)
+  {
+    adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+  }
+  std::vector<uint32_t> adjacency(numTriangles * 3);
+  {
+    std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for(size_t i = 0; i < numTriangles * 3; i++)
+    {
+      adjacency[cursor[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  std::vector<uint8_t>  used(numTriangles, 0);
+  std::vector<int32_t>  slots(numVertices, -1);  // local index of the vertices of the current meshlet
+  std::vector<uint32_t> candidates;              // unused triangles touching the current meshlet
+  size_t                seed = 0;
+  while(true)
+  {
+    while(seed < numTriangles && used[seed])
+      seed++;
+    if(seed == numTriangles)
+      break;
+
+    Meshlet meshlet;
+    meshlet.vertexOffset   = uint32_t(result.vertices.size());
+    meshlet.triangleOffset = uint32_t(result.sourceTriangles.size());
+    candidates.clear();
+    uint32_t next = uint32_t(seed);
+    while(true)
+    {
+      used[next] = 1;
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        uint32_t v = indices[next * 3 + k];
+        if(slots[v] < 0)
+        {
+          slots[v] = int32_t(meshlet.vertexCount++);
+          result.vertices.push_back(v);
+          for(uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++)
+          {
+            if(!used[adjacency[a]])
+              candidates.push_back(adjacency[a]);
+          }
+        }
+        result.primitiveIndices.push_back(uint8_t(slots[v]));
+      }
+      result.sourceTriangles.push_back(next);
+      if(++meshlet.triangleCount == maxTriangles)
+        break;
+
+      // The candidate adding the fewest vertices that still fits, the first one on ties
+      uint32_t best      = ~0u;
+      uint32_t bestAdded = 4;
+      size_t   kept      = 0;
+      for(size_t c = 0; c < candidates.size(); c++)
+      {
+        uint32_t t = candidates[c];
+        if(used[t])
+          continue;
+        candidates[kept++] = t;
+        if(bestAdded == 0)
+          continue;
+        uint32_t a = indices[t * 3 + 0], b = indices[t * 3 + 1], d = indices[t * 3 + 2];
+        uint32_t added = (slots[a] < 0 ? 1 : 0) + (slots[b] < 0 && b != a ? 1 : 0) + (slots[d] < 0 && d != a && d != b ? 1 : 0);
+        if(meshlet.vertexCount + added <= maxVertices && added < bestAdded)
+        {
+          best      = t;
+          bestAdded = added;
+        }
+      }
+      candidates.resize(kept);
+      if(best == ~0u)
+        break;
+      next = best;
+    }
+
+    computeBounds(bytes, stride, positionOffset, result, indices, meshlet);
+    for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+      slots[result.vertices[meshlet.vertexOffset + i]] = -1;
+    }
+    result.meshlets.push_back(meshlet);
+  }
+}
+
+}  // namespace nvh
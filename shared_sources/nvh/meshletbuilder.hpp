@@ -0,0 +1,118 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nvh {
+
+/**
+# class nvh::MeshletBuilder
+
+Partitions the triangles of an indexed mesh into meshlets (clusters) of
+at most `maxVertices` vertices and `maxTriangles` triangles, the limits of
+mesh shaders, with the bounds needed to cull each meshlet on its own:
+
+- a bounding sphere, for frustum and occlusion tests
+- a normal cone, to reject the meshlets whose triangles all face away
+  from the camera. A meshlet is backfacing from `camera` when
+  `dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius`,
+  `coneCutoff` is 1 when the normals are too spread for the test to succeed.
+
+Each meshlet is grown greedily from the first unused triangle, adding the
+neighboring triangle that brings the fewest new vertices. The result only
+depends on the input, two builds of the same mesh are identical.
+
+The triangles of a meshlet are stored as local indices into its vertices,
+as mesh shaders read them, and `sourceTriangles` gives the input triangle
+of each meshlet triangle, in meshlet order: drawing the input indices in
+that order draws each meshlet as a contiguous range.
+
+Example :
+~~~ C++
+nvh::MeshletBuilder          builder;
+nvh::MeshletBuilder::Result  result;
+builder.build(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), result);
+for(const auto& meshlet : result.meshlets)
+{
+  // triangle t of the meshlet is input triangle result.sourceTriangles[meshlet.triangleOffset + t]
+}
+~~~
+*/
+
+class MeshletBuilder
+{
+public:
+  struct Settings
+  {
+    uint32_t maxVertices{64};
+    uint32_t maxTriangles{124};
+  };
+
+  struct Meshlet
+  {
+    uint32_t vertexOffset{0};    // in Result::vertices
+    uint32_t vertexCount{0};
+    uint32_t triangleOffset{0};  // in triangles, 3 local indices each in Result::primitiveIndices
+    uint32_t triangleCount{0};
+    float    center[3]{};
+    float    radius{0.f};
+    float    coneAxis[3]{};
+    float    coneCutoff{1.f};
+  };
+
+  struct Result
+  {
+    std::vector<Meshlet>  meshlets;
+    std::vector<uint32_t> vertices;          // input vertices of each meshlet
+    std::vector<uint8_t>  primitiveIndices;  // local to the meshlet vertices
+    std::vector<uint32_t> sourceTriangles;   // input triangle of each meshlet triangle
+  };
+
+  MeshletBuilder() = default;
+  MeshletBuilder(const Settings& settings)
+      : m_settings(settings)
+  {
+  }
+
+  // The position is the 3 floats at `positionOffset` in each vertex of `stride` bytes
+  void build(const void*     vertices,
+             size_t          numVertices,
+             size_t          stride,
+             const uint32_t* indices,
+             size_t          numIndices,
+             Result&         result,
+             size_t          positionOffset = 0) const;
+
+private:
+  Settings m_settings;
+};
+
+}  // namespace nvh
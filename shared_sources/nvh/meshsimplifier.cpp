@@ -0,0 +1,490 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "meshsimplifier.hpp"
+#include "misc.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace nvh {
+
+namespace {
+
+// Sum of the squared distances to a set of planes, as the symmetric 4x4 matrix of the planes
+struct Quadric
+{
+  double a2{0}, ab{0}, ac{0}, ad{0}, b2{0}, bc{0}, bd{0}, c2{0}, cd{0}, d2{0};
+
+  static Quadric fromPlane(double a, double b, double c, double d)
+  {
+    Quadric q;
+    q.a2 = a * a;
+    q.ab = a * b;
+    q.ac = a * c;
+    q.ad = a * d;
+    q.b2 = b * b;
+    q.bc = b * c;
+    q.bd = b * d;
+    q.c2 = c * c;
+    q.cd = c * d;
+    q.d2 = d * d;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& q)
+  {
+    a2 += q.a2;
+    ab += q.ab;
+    ac += q.ac;
+    ad += q.ad;
+    b2 += q.b2;
+    bc += q.bc;
+    bd += q.bd;
+    c2 += q.c2;
+    cd += q.cd;
+    d2 += q.d2;
+    return *this;
+  }
+
+  double evaluate(const std::array<float, 3>& p) const
+  {
+    double x = p[0], y = p[1], z = p[2];
+    return a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+           + 2.0 * (ad * x + bd * y + cd * z) + d2;
+  }
+};
+
+struct Collapse
+{
+  double   cost;
+  uint32_t src;  // position vertex moved onto dst
+  uint32_t dst;
+  uint32_t srcVersion;
+  uint32_t dstVersion;
+
+  bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+// Vertices come in two kinds:
+// - attribute vertices, the distinct input vertices, referenced by the triangle corners
+// - position vertices, the distinct positions, on which the topology and quadrics are defined
+// A position vertex with several attribute vertices lies on a seam.
+class Collapser
+{
+public:
+  Collapser(const void* vertices, size_t numVertices, size_t stride, size_t positionOffset, const uint32_t* indices, size_t numIndices);
+
+  // Collapses until at most `targetTriangles` are left or the next collapse is above
+  // `maxError`, returns the error of all collapses so far
+  float  run(size_t targetTriangles, float maxError);
+  size_t getNumTriangles() const { return m_numAlive; }
+  void   extract(MeshSimplifier::Level& level) const;
+
+private:
+  void     push(uint32_t src, uint32_t dst);
+  bool     collapse(uint32_t u, uint32_t v);
+  uint32_t positionOf(uint32_t triangle, uint32_t corner) const { return m_posOf[m_corners[triangle * 3 + corner]]; }
+  void     gatherNeighbors(uint32_t p, std::vector<uint32_t>& neighbors);
+
+  std::vector<uint32_t>                m_representative;  // attribute vertex -> input vertex
+  std::vector<uint32_t>                m_posOf;           // attribute vertex -> position vertex
+  std::vector<std::array<float, 3>>    m_positions;
+  std::vector<Quadric>                 m_quadrics;
+  std::vector<uint32_t>                m_versions;  // incremented when the quadric or the triangles change
+  std::vector<uint8_t>                 m_locked;    // on a border or a non-manifold edge
+  std::vector<uint8_t>                 m_removed;
+  std::vector<std::vector<uint32_t>>   m_vertexTriangles;  // per position vertex, dead triangles are removed lazily
+  std::vector<uint32_t>                m_corners;          // 3 attribute vertices per triangle
+  std::vector<uint8_t>                 m_alive;
+  size_t                               m_numAlive{0};
+  double                               m_maxCost{0.0};
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_heap;
+
+  // scratch of collapse()
+  std::vector<uint32_t>                        m_edgeTriangles;
+  std::vector<uint32_t>                        m_otherTriangles;
+  std::vector<std::pair<uint32_t, uint32_t>>   m_attribRemap;
+  std::vector<uint32_t>                        m_opposites;
+  std::vector<uint32_t>                        m_neighbors;
+};
+
+std::array<double, 3> triangleNormal(const std::array<float, 3>& p0, const std::array<float, 3>& p1, const std::array<float, 3>& p2)
+{
+  double e1[3] = {double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2]};
+  double e2[3] = {double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2]};
+  return {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+}
+
+Collapser::Collapser(const void* vertices, size_t numVertices, size_t stride, size_t positionOffset, const uint32_t* indices, size_t numIndices)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+
+  // Weld the vertices with the same bytes, then the attribute vertices with the same position
+  auto vertexHash  = [&](uint32_t v) { return size_t(hashBytes(bytes + v * stride, stride)); };
+  auto vertexEqual = [&](uint32_t a, uint32_t b) { return memcmp(bytes + a * stride, bytes + b * stride, stride) == 0; };
+  std::unordered_map<uint32_t, uint32_t, decltype(vertexHash), decltype(vertexEqual)> attribMap(numVertices, vertexHash, vertexEqual);
+  std::vector<uint32_t> attribOf(numVertices, ~0u);
+  for(size_t i = 0; i < numIndices; i++)
+  {
+    uint32_t v = indices[i];
+    if(attribOf[v] == ~0u)
+    {
+      auto it = attribMap.emplace(v, uint32_t(m_representative.size()));
+      if(it.second)
+        m_representative.push_back(v);
+      attribOf[v] = it.first->second;
+    }
+  }
+
+  auto positionHash = [&](uint32_t v) { return size_t(hashBytes(bytes + v * stride + positionOffset, sizeof(float) * 3)); };
+  auto positionEqual = [&](uint32_t a, uint32_t b) {
+    return memcmp(bytes + a * stride + positionOffset, bytes + b * stride + positionOffset, sizeof(float) * 3) == 0;
+  };
+  std::unordered_map<uint32_t, uint32_t, decltype(positionHash), decltype(positionEqual)> positionMap(
+      m_representative.size(), positionHash, positionEqual);
+  m_posOf.resize(m_representative.size());
+  for(size_t a = 0; a < m_representative.size(); a++)
+  {
+    auto it = positionMap.emplace(m_representative[a], uint32_t(m_positions.size()));
+    if(it.second)
+    {
+      std::array<float, 3> position;
+      memcpy(position.data(), bytes + m_representative[a] * stride + positionOffset, sizeof(position));
+      m_positions.push_back(position);
+    }
+    m_posOf[a] = it.first->second;
+  }
+
+  size_t numPositions = m_positions.size();
+  m_quadrics.resize(numPositions);
+  m_versions.resize(numPositions, 0);
+  m_locked.resize(numPositions, 0);
+  m_removed.resize(numPositions, 0);
+  m_vertexTriangles.resize(numPositions);
+
+  size_t numTriangles = numIndices / 3;
+  m_corners.resize(numTriangles * 3);
+  m_alive.resize(numTriangles, 0);
+  std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+  for(size_t t = 0; t < numTriangles; t++)
+  {
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      m_corners[t * 3 + k] = attribOf[indices[t * 3 + k]];
+    }
+    uint32_t p[3] = {positionOf(uint32_t(t), 0), positionOf(uint32_t(t), 1), positionOf(uint32_t(t), 2)};
+    if(p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+      continue;
+
+    m_alive[t] = 1;
+    m_numAlive++;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      m_vertexTriangles[p[k]].push_back(uint32_t(t));
+      uint64_t a = std::min(p[k], p[(k + 1) % 3]);
+      uint64_t b = std::max(p[k], p[(k + 1) % 3]);
+      edgeTriangles[(a << 32) | b]++;
+    }
+
+    // Zero area triangles have no plane, they go away with their edges
+    std::array<double, 3> n      = triangleNormal(m_positions[p[0]], m_positions[p[1]], m_positions[p[2]]);
+    double                length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(length > 0.0)
+    {
+      double  d     = -(n[0] * m_positions[p[0]][0] + n[1] * m_positions[p[0]][1] + n[2] * m_positions[p[0]][2]);
+      Quadric plane = Quadric::fromPlane(n[0] / length, n[1] / length, n[2] / length, d / length);
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        m_quadrics[p[k]] += plane;
+      }
+    }
+  }
+
+  for(const auto& edge : edgeTriangles)
+  {
+    if(edge.second != 2)
+    {
+      m_locked[edge.first >> 32]        = 1;
+      m_locked[edge.first & 0xffffffff] = 1;
+    }
+  }
+
+  // Each interior edge is in two triangles, once in each direction
+  for(size_t t = 0; t < numTriangles; t++)
+  {
+    if(!m_alive[t])
+      continue;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t src = positionOf(uint32_t(t), k);
+      if(!m_locked[src])
+        push(src, positionOf(uint32_t(t), (k + 1) % 3));
+    }
+  }
+}
+
+void Collapser::push(uint32_t src, uint32_t dst)
+{
+  Quadric quadric = m_quadrics[src];
+  quadric += m_quadrics[dst];
+  m_heap.push({quadric.evaluate(m_positions[dst]), src, dst, m_versions[src], m_versions[dst]});
+}
+
+void Collapser::gatherNeighbors(uint32_t p, std::vector<uint32_t>& neighbors)
+{
+  auto& triangles = m_vertexTriangles[p];
+  triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&](uint32_t t) { return !m_alive[t]; }),
+                  triangles.end());
+  neighbors.clear();
+  for(uint32_t t : triangles)
+  {
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t n = positionOf(t, k);
+      if(n != p)
+        neighbors.push_back(n);
+    }
+  }
+  std::sort(neighbors.begin(), neighbors.end());
+  neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+}
+
+bool Collapser::collapse(uint32_t u, uint32_t v)
+{
+  m_edgeTriangles.clear();
+  m_otherTriangles.clear();
+  for(uint32_t t : m_vertexTriangles[u])
+  {
+    if(!m_alive[t])
+      continue;
+    bool hasV = positionOf(t, 0) == v || positionOf(t, 1) == v || positionOf(t, 2) == v;
+    (hasV ? m_edgeTriangles : m_otherTriangles).push_back(t);
+  }
+  if(m_edgeTriangles.empty())
+    return false;
+
+  // The attribute vertices of u take the ones of v found across the collapsed edge,
+  // an attribute vertex of u that doesn't touch the edge is on another side of a seam
+  m_attribRemap.clear();
+  m_opposites.clear();
+  for(uint32_t t : m_edgeTriangles)
+  {
+    uint32_t au = 0, av = 0;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t p = positionOf(t, k);
+      if(p == u)
+        au = m_corners[t * 3 + k];
+      else if(p == v)
+        av = m_corners[t * 3 + k];
+      else
+        m_opposites.push_back(p);
+    }
+    auto found = std::find_if(m_attribRemap.begin(), m_attribRemap.end(),
+                              [&](const std::pair<uint32_t, uint32_t>& remap) { return remap.first == au; });
+    if(found == m_attribRemap.end())
+      m_attribRemap.emplace_back(au, av);
+    else if(found->second != av)
+      return false;
+  }
+  for(uint32_t t : m_otherTriangles)
+  {
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      if(positionOf(t, k) != u)
+        continue;
+      uint32_t au    = m_corners[t * 3 + k];
+      auto     found = std::find_if(m_attribRemap.begin(), m_attribRemap.end(),
+                                [&](const std::pair<uint32_t, uint32_t>& remap) { return remap.first == au; });
+      if(found == m_attribRemap.end())
+        return false;
+    }
+  }
+
+  // Link condition: the only neighbors shared by u and v are across the collapsed edge,
+  // otherwise the collapse pinches the mesh
+  gatherNeighbors(v, m_neighbors);
+  for(uint32_t t : m_otherTriangles)
+  {
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t p = positionOf(t, k);
+      if(p != u && std::binary_search(m_neighbors.begin(), m_neighbors.end(), p)
+         && std::find(m_opposites.begin(), m_opposites.end(), p) == m_opposites.end())
+        return false;
+    }
+  }
+
+  // No triangle may flip or become degenerate once u is moved to v
+  for(uint32_t t : m_otherTriangles)
+  {
+    std::array<float, 3> before[3];
+    std::array<float, 3> after[3];
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t p = positionOf(t, k);
+      before[k]  = m_positions[p];
+      after[k]   = m_positions[p == u ? v : p];
+    }
+    std::array<double, 3> n0 = triangleNormal(before[0], before[1], before[2]);
+    std::array<double, 3> n1 = triangleNormal(after[0], after[1], after[2]);
+    // large rotations fold the surface even without flipping the triangle
+    double l0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+    double l1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+    double d  = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+    if(d <= 0.0 || d * d < 0.0625 * l0 * l1)
+      return false;
+    // collinear corners leave a normal made of rounding errors, which passes the test above
+    double longest = 0.0;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      const std::array<float, 3>& a = after[k];
+      const std::array<float, 3>& b = after[(k + 1) % 3];
+      double d[3] = {double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2]};
+      longest     = std::max(longest, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    if(l1 <= 1e-8 * longest * longest)
+      return false;
+  }
+
+  for(uint32_t t : m_edgeTriangles)
+  {
+    m_alive[t] = 0;
+    m_numAlive--;
+  }
+  for(uint32_t t : m_otherTriangles)
+  {
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t& corner = m_corners[t * 3 + k];
+      if(m_posOf[corner] != u)
+        continue;
+      corner = std::find_if(m_attribRemap.begin(), m_attribRemap.end(),
+                            [&](const std::pair<uint32_t, uint32_t>& remap) { return remap.first == corner; })
+                   ->second;
+    }
+    m_vertexTriangles[v].push_back(t);
+  }
+  m_quadrics[v] += m_quadrics[u];
+  m_versions[v]++;
+  m_removed[u] = 1;
+  m_vertexTriangles[u].clear();
+  m_vertexTriangles[u].shrink_to_fit();
+
+  // The costs of all the edges of v changed
+  gatherNeighbors(v, m_neighbors);
+  for(uint32_t n : m_neighbors)
+  {
+    if(!m_locked[v])
+      push(v, n);
+    if(!m_locked[n])
+      push(n, v);
+  }
+  return true;
+}
+
+float Collapser::run(size_t targetTriangles, float maxError)
+{
+  double maxCost = double(maxError) * double(maxError);
+  while(m_numAlive > targetTriangles && !m_heap.empty())
+  {
+    Collapse candidate = m_heap.top();
+    if(m_removed[candidate.src] || m_removed[candidate.dst] || m_versions[candidate.src] != candidate.srcVersion
+       || m_versions[candidate.dst] != candidate.dstVersion)
+    {
+      m_heap.pop();
+      continue;
+    }
+    if(candidate.cost > maxCost)
+      break;
+    m_heap.pop();
+    if(collapse(candidate.src, candidate.dst))
+      m_maxCost = std::max(m_maxCost, candidate.cost);
+  }
+  return float(std::sqrt(std::max(m_maxCost, 0.0)));
+}
+
+void Collapser::extract(MeshSimplifier::Level& level) const
+{
+  level.indices.clear();
+  level.sourceTriangles.clear();
+  level.indices.reserve(m_numAlive * 3);
+  level.sourceTriangles.reserve(m_numAlive);
+  for(size_t t = 0; t < m_alive.size(); t++)
+  {
+    if(!m_alive[t])
+      continue;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      level.indices.push_back(m_representative[m_corners[t * 3 + k]]);
+    }
+    level.sourceTriangles.push_back(uint32_t(t));
+  }
+  level.error = float(std::sqrt(std::max(m_maxCost, 0.0)));
+}
+
+}  // namespace
+
+void MeshSimplifier::buildLevels(const void*         vertices,
+                                 size_t              numVertices,
+                                 size_t              stride,
+                                 const uint32_t*     indices,
+                                 size_t              numIndices,
+                                 std::vector<Level>& levels,
+                                 size_t              positionOffset) const
+{
+  levels.clear();
+  levels.emplace_back();
+  levels[0].indices.assign(indices, indices + numIndices);
+  levels[0].sourceTriangles.resize(numIndices / 3);
+  std::iota(levels[0].sourceTriangles.begin(), levels[0].sourceTriangles.end(), 0u);
+  if(m_settings.maxLevels <= 1 || numIndices < 3)
+    return;
+
+  // One simplification, a snapshot is taken at the target of each level
+  Collapser collapser(vertices, numVertices, stride, positionOffset, indices, numIndices);
+  size_t    previous = numIndices / 3;
+  while(levels.size() < m_settings.maxLevels)
+  {
+    collapser.run(size_t(double(previous) * m_settings.reduction), m_settings.maxError);
+    size_t kept = collapser.getNumTriangles();
+    if(kept == 0 || double(kept) > double(previous) * m_settings.minReduction)
+      break;
+    levels.emplace_back();
+    collapser.extract(levels.back());
+    previous = kept;
+  }
+}
+
+}  // namespace nvh
@@ -0,0 +1,110 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nvh {
+
+/**
+# class nvh::MeshSimplifier
+
+Builds the levels of detail of an indexed triangle mesh with quadric error
+metrics (Garland and Heckbert). Edges are collapsed onto one of their
+vertices, cheapest first, so every level indexes the vertices of the
+original mesh: the levels share one vertex buffer and only need their own
+indices.
+
+- vertices with the same bytes are welded first, meshes with one vertex
+  per corner (like the OBJ loader output) are connected again
+- vertices at the same position but with other attributes (uv or normal
+  seams) only collapse along the seam, the attributes are never mixed
+- vertices on borders and non-manifold edges are kept, collapses that
+  flip, fold or degenerate a triangle or would make the mesh non-manifold are skipped
+- the quadric of a vertex sums the planes of all the original triangles
+  merged into it. The error of a level is the largest distance from a
+  moved vertex to these planes, in the units of the positions: an
+  estimate of the distance to the input surface, not a strict bound
+
+`buildLevels()` simplifies the mesh once, taking a snapshot each time the
+triangle count reaches the target of the next level, and stops early when
+a level would not remove enough triangles.
+
+Example :
+~~~ C++
+nvh::MeshSimplifier::Settings settings;
+settings.maxLevels = 4;
+nvh::MeshSimplifier simplifier(settings);
+
+std::vector<nvh::MeshSimplifier::Level> levels;
+simplifier.buildLevels(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), levels);
+// levels[0] is the input, levels[i].sourceTriangles[t] is the input triangle of triangle t
+~~~
+*/
+
+class MeshSimplifier
+{
+public:
+  struct Settings
+  {
+    uint32_t maxLevels{4};         // including the input
+    float    reduction{0.5f};      // triangles of a level relative to the previous one
+    float    minReduction{0.85f};  // no more levels once a level keeps more than this
+    float    maxError{FLT_MAX};    // no more collapses above this error
+  };
+
+  struct Level
+  {
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> sourceTriangles;  // input triangle each triangle comes from, for per-triangle data
+    float                 error{0.f};       // largest quadric error of the collapses
+  };
+
+  MeshSimplifier() = default;
+  MeshSimplifier(const Settings& settings)
+      : m_settings(settings)
+  {
+  }
+
+  // The position is the 3 floats at `positionOffset` in each vertex of `stride` bytes
+  void buildLevels(const void*         vertices,
+                   size_t              numVertices,
+                   size_t              stride,
+                   const uint32_t*     indices,
+                   size_t              numIndices,
+                   std::vector<Level>& levels,
+                   size_t              positionOffset = 0) const;
+
+private:
+  Settings m_settings;
+};
+
+}  // namespace nvh
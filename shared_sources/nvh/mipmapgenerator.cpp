@@ -0,0 +1,402 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mipmapgenerator.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define NVH_MIPMAP_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NVH_MIPMAP_SSE2 1
+#endif
+
+#if NVH_MIPMAP_AVX2
+#include <immintrin.h>
+#elif NVH_MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace nvh {
+
+namespace {
+
+const float c_pi = 3.14159265358979f;
+
+// sRGB decoding of each 8 bit value
+struct SrgbToLinear
+{
+  float table[256];
+  SrgbToLinear()
+  {
+    for(int i = 0; i < 256; i++)
+    {
+      float v  = float(i) / 255.0f;
+      table[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+  }
+};
+
+// sRGB encoding, indexed by the linear value quantized to 16 bits which is
+// fine enough for the steep part of the curve near black
+struct LinearToSrgb
+{
+  static const uint32_t SIZE = 65536;
+  uint8_t               table[SIZE];
+  LinearToSrgb()
+  {
+    for(uint32_t i = 0; i < SIZE; i++)
+    {
+      float v  = float(i) / float(SIZE - 1);
+      float s  = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+      table[i] = uint8_t(std::min(std::max(s * 255.0f + 0.5f, 0.0f), 255.0f));
+    }
+  }
+};
+
+const SrgbToLinear& getSrgbToLinear()
+{
+  static SrgbToLinear s_table;
+  return s_table;
+}
+
+const LinearToSrgb& getLinearToSrgb()
+{
+  static LinearToSrgb s_table;
+  return s_table;
+}
+
+inline uint8_t quantizeUnorm(float v)
+{
+  return uint8_t(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Modified Bessel function of the first kind, order 0
+float besselI0(float x)
+{
+  float sum  = 1.0f;
+  float term = 1.0f;
+  for(int k = 1; k < 32; k++)
+  {
+    float t = x / (2.0f * float(k));
+    term *= t * t;
+    sum += term;
+    if(term < sum * 1e-7f)
+      break;
+  }
+  return sum;
+}
+
+float sinc(float x)
+{
+  return std::abs(x) < 1e-6f ? 1.0f : std::sin(c_pi * x) / (c_pi * x);
+}
+
+inline uint32_t clampIndex(int32_t i, uint32_t size)
+{
+  return uint32_t(std::min(std::max(i, 0), int32_t(size) - 1));
+}
+
+}  // namespace
+
+//////////////////////////////////////////////////////////////////////////
+
+void MipmapGenerator::init(const Settings& settings, ThreadPool* pool)
+{
+  m_settings = settings;
+  m_settings.tileHeight = std::max(m_settings.tileHeight, 1u);
+  m_pool     = pool;
+
+  // Taps of a 2:1 decimation: the destination texel x is centered between the
+  // source texels 2x and 2x+1, the weights are the same for all texels.
+  m_kaiserWeights.clear();
+  float   width  = std::max(m_settings.kaiserWidth, 0.5f);
+  int32_t radius = std::max(int32_t(2.0f * width), 1);
+  m_kaiserFirstOffset = 1 - radius;
+  float sum           = 0;
+  for(int32_t o = 1 - radius; o <= radius; o++)
+  {
+    float d = (float(o) - 0.5f) * 0.5f;  // in destination texels
+    float t = d / width;
+    float w = sinc(d) * besselI0(m_settings.kaiserAlpha * std::sqrt(std::max(1.0f - t * t, 0.0f))) / besselI0(m_settings.kaiserAlpha);
+    m_kaiserWeights.push_back(w);
+    sum += w;
+  }
+  for(auto& w : m_kaiserWeights)
+    w /= sum;
+
+  // create the tables before any thread can race on them
+  getSrgbToLinear();
+  getLinearToSrgb();
+}
+
+uint32_t MipmapGenerator::getNumLevels(uint32_t width, uint32_t height)
+{
+  uint32_t levels = 1;
+  for(uint32_t size = std::max(width, height); size > 1; size >>= 1)
+    levels++;
+  return levels;
+}
+
+const char* MipmapGenerator::getSimdName() const
+{
+  if(!m_settings.useSimd)
+    return "scalar";
+#if NVH_MIPMAP_AVX2
+  return "AVX2";
+#elif NVH_MIPMAP_SSE2
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
+
+template <class F>
+void MipmapGenerator::forEachTile(uint32_t numRows, F&& fn) const
+{
+  uint32_t tileHeight = m_settings.tileHeight;
+  uint32_t numTiles   = (numRows + tileHeight - 1) / tileHeight;
+  auto     tile       = [&](uint64_t t) {
+    uint32_t begin = uint32_t(t) * tileHeight;
+    fn(begin, std::min(begin + tileHeight, numRows));
+  };
+  if(m_pool && numTiles > 1)
+  {
+    m_pool->parallelFor(numTiles, tile);
+  }
+  else
+  {
+    for(uint32_t t = 0; t < numTiles; t++)
+      tile(t);
+  }
+}
+
+void MipmapGenerator::generate(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<std::vector<uint8_t>>& levels) const
+{
+  uint32_t numLevels = getNumLevels(width, height);
+  levels.resize(numLevels);
+  levels[0].assign(rgba, rgba + size_t(width) * height * 4);
+  if(numLevels == 1)
+    return;
+
+  // level 0 to linear float
+  Level               current{width, height, std::vector<float>(size_t(width) * height * 4)};
+  const SrgbToLinear& toLinear = getSrgbToLinear();
+  forEachTile(height, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(size_t i = size_t(rowBegin) * width * 4; i < size_t(rowEnd) * width * 4; i += 4)
+    {
+      for(size_t c = 0; c < 3; c++)
+        current.texels[i + c] = m_settings.srgb ? toLinear.table[rgba[i + c]] : float(rgba[i + c]) / 255.0f;
+      current.texels[i + 3] = float(rgba[i + 3]) / 255.0f;
+    }
+  });
+
+  Level next;
+  for(uint32_t l = 1; l < numLevels; l++)
+  {
+    next.width  = std::max(current.width >> 1, 1u);
+    next.height = std::max(current.height >> 1, 1u);
+    next.texels.resize(size_t(next.width) * next.height * 4);
+    if(m_settings.filter == eFilterKaiser)
+      downsampleKaiser(current, next);
+    else
+      downsampleBox(current, next);
+
+    levels[l].resize(size_t(next.width) * next.height * 4);
+    encode(next, levels[l].data());
+    std::swap(current, next);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void MipmapGenerator::downsampleBox(const Level& src, Level& dst) const
+{
+  forEachTile(dst.height, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(uint32_t y = rowBegin; y < rowEnd; y++)
+    {
+      const float* row0 = src.texels.data() + size_t(clampIndex(2 * y, src.height)) * src.width * 4;
+      const float* row1 = src.texels.data() + size_t(clampIndex(2 * y + 1, src.height)) * src.width * 4;
+      float*       out  = dst.texels.data() + size_t(y) * dst.width * 4;
+
+      uint32_t x = 0;
+      // interior texels, both source columns exist
+      uint32_t interior = src.width >= 2 ? src.width / 2 : 0;
+      if(m_settings.useSimd)
+      {
+#if NVH_MIPMAP_AVX2
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        for(; x + 2 <= interior; x += 2)
+        {
+          // 4 source texels per row: [t0 t1] [t2 t3] -> [t0 t2] + [t1 t3]
+          __m256 a0 = _mm256_loadu_ps(row0 + x * 8);
+          __m256 b0 = _mm256_loadu_ps(row0 + x * 8 + 8);
+          __m256 a1 = _mm256_loadu_ps(row1 + x * 8);
+          __m256 b1 = _mm256_loadu_ps(row1 + x * 8 + 8);
+          __m256 s0 = _mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x20), _mm256_permute2f128_ps(a0, b0, 0x31));
+          __m256 s1 = _mm256_add_ps(_mm256_permute2f128_ps(a1, b1, 0x20), _mm256_permute2f128_ps(a1, b1, 0x31));
+          _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(s0, s1), quarter));
+        }
+#endif
+#if NVH_MIPMAP_SSE2 || NVH_MIPMAP_AVX2
+        const __m128 quarter4 = _mm_set1_ps(0.25f);
+        for(; x < interior; x++)
+        {
+          __m128 s = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+          _mm_storeu_ps(out + x * 4, _mm_mul_ps(s, quarter4));
+        }
+#endif
+      }
+      // scalar path and borders
+      for(; x < dst.width; x++)
+      {
+        uint32_t x0 = clampIndex(2 * x, src.width) * 4;
+        uint32_t x1 = clampIndex(2 * x + 1, src.width) * 4;
+        for(uint32_t c = 0; c < 4; c++)
+          out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+      }
+    }
+  });
+}
+
+void MipmapGenerator::downsampleKaiser(const Level& src, Level& dst) const
+{
+  const float* weights    = m_kaiserWeights.data();
+  uint32_t     numWeights = uint32_t(m_kaiserWeights.size());
+  int32_t      first      = m_kaiserFirstOffset;
+
+  // horizontal pass, all source rows at the destination width. A dimension of size 1
+  // is left as is, all taps would read the same texel.
+  std::vector<float> horizontal(size_t(dst.width) * src.height * 4);
+  forEachTile(src.height, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(uint32_t y = rowBegin; y < rowEnd; y++)
+    {
+      const float* in  = src.texels.data() + size_t(y) * src.width * 4;
+      float*       out = horizontal.data() + size_t(y) * dst.width * 4;
+      if(src.width == 1)
+      {
+        memcpy(out, in, sizeof(float) * 4);
+        continue;
+      }
+      for(uint32_t x = 0; x < dst.width; x++)
+      {
+        int32_t  base     = int32_t(2 * x) + first;
+        bool     interior = base >= 0 && base + int32_t(numWeights) <= int32_t(src.width);
+        uint32_t k        = 0;
+        float    sum[4]   = {};
+        if(m_settings.useSimd && interior)
+        {
+#if NVH_MIPMAP_SSE2 || NVH_MIPMAP_AVX2
+          __m128       acc = _mm_setzero_ps();
+          const float* tap = in + size_t(base) * 4;
+          for(; k < numWeights; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(tap + k * 4), _mm_set1_ps(weights[k])));
+          _mm_storeu_ps(sum, acc);
+#endif
+        }
+        for(; k < numWeights; k++)
+        {
+          const float* tap = in + size_t(clampIndex(base + int32_t(k), src.width)) * 4;
+          for(uint32_t c = 0; c < 4; c++)
+            sum[c] += tap[c] * weights[k];
+        }
+        memcpy(out + x * 4, sum, sizeof(sum));
+      }
+    }
+  });
+
+  // vertical pass, contiguous along the rows so it vectorizes over x
+  size_t rowFloats = size_t(dst.width) * 4;
+  forEachTile(dst.height, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(uint32_t y = rowBegin; y < rowEnd; y++)
+    {
+      float* out = dst.texels.data() + size_t(y) * rowFloats;
+      if(src.height == 1)
+      {
+        memcpy(out, horizontal.data(), sizeof(float) * rowFloats);
+        continue;
+      }
+      const float* rows[64];
+      uint32_t     numTaps = std::min(numWeights, 64u);
+      for(uint32_t k = 0; k < numTaps; k++)
+        rows[k] = horizontal.data() + size_t(clampIndex(int32_t(2 * y) + first + int32_t(k), src.height)) * rowFloats;
+
+      size_t i = 0;
+      if(m_settings.useSimd)
+      {
+#if NVH_MIPMAP_AVX2
+        for(; i + 8 <= rowFloats; i += 8)
+        {
+          __m256 acc = _mm256_setzero_ps();
+          for(uint32_t k = 0; k < numTaps; k++)
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(weights[k])));
+          _mm256_storeu_ps(out + i, acc);
+        }
+#endif
+#if NVH_MIPMAP_SSE2 || NVH_MIPMAP_AVX2
+        for(; i + 4 <= rowFloats; i += 4)
+        {
+          __m128 acc = _mm_setzero_ps();
+          for(uint32_t k = 0; k < numTaps; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weights[k])));
+          _mm_storeu_ps(out + i, acc);
+        }
+#endif
+      }
+      for(; i < rowFloats; i++)
+      {
+        float sum = 0;
+        for(uint32_t k = 0; k < numTaps; k++)
+          sum += rows[k][i] * weights[k];
+        out[i] = sum;
+      }
+    }
+  });
+}
+
+void MipmapGenerator::encode(const Level& level, uint8_t* rgba) const
+{
+  const LinearToSrgb& toSrgb = getLinearToSrgb();
+  forEachTile(level.height, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(size_t i = size_t(rowBegin) * level.width * 4; i < size_t(rowEnd) * level.width * 4; i += 4)
+    {
+      for(size_t c = 0; c < 3; c++)
+      {
+        float v = std::min(std::max(level.texels[i + c], 0.0f), 1.0f);
+        rgba[i + c] = m_settings.srgb ? toSrgb.table[uint32_t(v * float(LinearToSrgb::SIZE - 1) + 0.5f)] : quantizeUnorm(v);
+      }
+      rgba[i + 3] = quantizeUnorm(level.texels[i + 3]);
+    }
+  });
+}
+
+}  // namespace nvh
@@ -0,0 +1,119 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace nvh {
+
+class ThreadPool;
+
+/**
+# class nvh::MipmapGenerator
+
+Computes the full mip chain of an RGBA8 image on the CPU, so that no blit
+support or runtime mipmap generation is needed on the device, and so the
+result is the same on every driver.
+
+- sRGB images have their color filtered in linear space, alpha is always
+  filtered as is
+- each level is computed from the previous one, kept in linear float to
+  avoid requantization between levels
+- box (2x2 average) and Kaiser windowed sinc filters, the latter keeps
+  more detail in the lower levels
+- SSE2 / AVX2 paths chosen at compile time, with a scalar fallback that
+  can also be forced with `Settings::useSimd = false` for comparisons
+- with a thread pool, each level is split into tiles of rows that are
+  filtered in parallel. The pool must not be the one running the caller.
+
+Example :
+~~~ C++
+nvh::MipmapGenerator::Settings settings;
+settings.filter = nvh::MipmapGenerator::eFilterKaiser;
+nvh::MipmapGenerator generator(settings, &pool);
+
+std::vector<std::vector<uint8_t>> levels;
+generator.generate(rgba, width, height, levels);  // levels[0] is a copy of rgba
+~~~
+*/
+
+class MipmapGenerator
+{
+public:
+  enum Filter
+  {
+    eFilterBox,
+    eFilterKaiser,
+  };
+
+  struct Settings
+  {
+    Filter   filter{eFilterBox};
+    bool     srgb{true};          // RGB is sRGB encoded
+    float    kaiserWidth{3.0f};   // filter radius, in texels of the level being computed
+    float    kaiserAlpha{4.0f};   // window shape, larger is smoother
+    uint32_t tileHeight{16};      // rows of a level per parallel task
+    bool     useSimd{true};
+  };
+
+  MipmapGenerator() { init(Settings()); }
+  MipmapGenerator(const Settings& settings, ThreadPool* pool = nullptr) { init(settings, pool); }
+
+  void init(const Settings& settings, ThreadPool* pool = nullptr);
+
+  static uint32_t getNumLevels(uint32_t width, uint32_t height);
+
+  // `levels[l]` receives the max(width >> l, 1) x max(height >> l, 1) RGBA8 level l, down to 1x1
+  void generate(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<std::vector<uint8_t>>& levels) const;
+
+  // "AVX2", "SSE2" or "scalar", depending on the compiler flags and settings
+  const char* getSimdName() const;
+
+private:
+  struct Level
+  {
+    uint32_t           width;
+    uint32_t           height;
+    std::vector<float> texels;  // linear RGBA
+  };
+
+  // calls fn(rowBegin, rowEnd) for tiles covering [0, numRows)
+  template <class F>
+  void forEachTile(uint32_t numRows, F&& fn) const;
+  void downsampleBox(const Level& src, Level& dst) const;
+  void downsampleKaiser(const Level& src, Level& dst) const;
+  void encode(const Level& level, uint8_t* rgba) const;
+
+  Settings           m_settings;
+  ThreadPool*        m_pool{nullptr};
+  std::vector<float> m_kaiserWeights;
+  int32_t            m_kaiserFirstOffset{0};  // source offset of the first weight, relative to 2 * x
+};
+
+}  // namespace nvh
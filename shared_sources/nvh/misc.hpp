@@ -29,7 +29,9 @@
 #define NV_MISC_INCLUDED
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <string>
 #include <vector>
@@ -45,6 +47,7 @@
   - stringFormat : sprintf for std::string
   - frand : random float using rand()
   - permutation : fills uint vector with random permutation of values [0... vec.size-1]
+  - hashBytes : 64-bit hash of a memory range, to find duplicated content
 
 */
 
@@ -96,6 +99,54 @@ namespace nvh
       std::swap(data[i],data[other]);
     }
   }
+
+  // MurmurHash64A by Austin Appleby, public domain.
+  // Chain ranges by passing the previous hash as seed.
+
+  inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+  {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int      r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    const uint8_t* end   = bytes + (size / 8) * 8;
+    for (; bytes != end; bytes += 8){
+      uint64_t k;
+      memcpy(&k, bytes, 8);
+
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+
+      h ^= k;
+      h *= m;
+    }
+
+    switch (size & 7){
+      case 7: h ^= uint64_t(bytes[6]) << 48;  // fall through
+      case 6: h ^= uint64_t(bytes[5]) << 40;  // fall through
+      case 5: h ^= uint64_t(bytes[4]) << 32;  // fall through
+      case 4: h ^= uint64_t(bytes[3]) << 24;  // fall through
+      case 3: h ^= uint64_t(bytes[2]) << 16;  // fall through
+      case 2: h ^= uint64_t(bytes[1]) << 8;   // fall through
+      case 1: h ^= uint64_t(bytes[0]);
+              h *= m;
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+  }
+
+  template <class T>
+  inline uint64_t hashBytes(const std::vector<T>& vec, uint64_t seed = 0)
+  {
+    return hashBytes(vec.data(), sizeof(T) * vec.size(), seed);
+  }
 }
 
 #endif
@@ -0,0 +1,194 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nvh {
+
+/**
+  # class nvh::ThreadPool
+
+  A minimal fixed-size pool of worker threads. Tasks are executed in
+  submission order by whichever worker is free, `enqueue` returns a
+  std::future for the result of the task.
+
+  A default constructed pool has no threads until `init` is called, so
+  members can be initialized once with their final size. Without workers
+  `enqueue` and `parallelFor` run the work on the calling thread.
+
+  `parallelFor` splits [0, count) into batches and blocks until all of
+  them are done; the calling thread takes part in the work. It must not
+  be called from within a task of the same pool.
+
+  Example :
+
+  ~~~ C++
+  nvh::ThreadPool pool;
+  pool.init();                     // std::thread::hardware_concurrency() workers
+  auto result = pool.enqueue([]{ return expensive(); });
+  ...
+  pool.parallelFor(items.size(), [&](uint64_t i) { process(items[i]); });
+  use(result.get());
+  ~~~
+*/
+
+class ThreadPool
+{
+public:
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  ThreadPool() = default;
+  explicit ThreadPool(uint32_t numThreads) { init(numThreads); }
+  ~ThreadPool() { deinit(); }
+
+  // 0: one worker per hardware thread
+  void init(uint32_t numThreads = 0)
+  {
+    deinit();
+    if(numThreads == 0)
+    {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_stop = false;
+    for(uint32_t i = 0; i < numThreads; i++)
+    {
+      m_workers.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  // waits for all pending tasks to finish, then joins the workers
+  void deinit()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_condition.notify_all();
+    for(auto& worker : m_workers)
+    {
+      worker.join();
+    }
+    m_workers.clear();
+  }
+
+  uint32_t getNumThreads() const { return static_cast<uint32_t>(m_workers.size()); }
+
+  template <class F>
+  auto enqueue(F&& fn) -> std::future<decltype(std::declval<std::decay_t<F>&>()())>
+  {
+    using ReturnType = decltype(std::declval<std::decay_t<F>&>()());
+
+    auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<F>(fn));
+    std::future<ReturnType> result = task->get_future();
+    if(m_workers.empty())
+    {
+      (*task)();
+      return result;
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_tasks.emplace([task]() { (*task)(); });
+    }
+    m_condition.notify_one();
+    return result;
+  }
+
+  // calls fn(i) for every i in [0, count), blocks until done
+  template <class F>
+  void parallelFor(uint64_t count, F&& fn, uint64_t batchSize = 0)
+  {
+    if(count == 0)
+      return;
+
+    uint64_t numBatches = std::min<uint64_t>(count, uint64_t(getNumThreads()) + 1);
+    if(batchSize == 0)
+    {
+      batchSize = (count + numBatches - 1) / numBatches;
+    }
+    numBatches = (count + batchSize - 1) / batchSize;
+
+    std::vector<std::future<void>> pending;
+    pending.reserve(numBatches);
+    for(uint64_t b = 1; b < numBatches; b++)
+    {
+      uint64_t begin = b * batchSize;
+      uint64_t end   = std::min(count, begin + batchSize);
+      pending.push_back(enqueue([&fn, begin, end] {
+        for(uint64_t i = begin; i < end; i++)
+          fn(i);
+      }));
+    }
+
+    // first batch runs on the calling thread
+    for(uint64_t i = 0; i < std::min(count, batchSize); i++)
+    {
+      fn(i);
+    }
+    for(auto& it : pending)
+    {
+      it.get();
+    }
+  }
+
+private:
+  void workerLoop()
+  {
+    for(;;)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+        if(m_stop && m_tasks.empty())
+          return;
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread>          m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex                        m_mutex;
+  std::condition_variable           m_condition;
+  bool                              m_stop{true};
+};
+
+}  // namespace nvh
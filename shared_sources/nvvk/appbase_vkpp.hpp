@@ -26,6 +26,7 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <vulkan/vulkan.hpp>
 #include "nvvk/context_vk.hpp"
 #include "imgui.h"
@@ -126,6 +127,9 @@ AppBase works with 3 
 other. This is a design choice that can be debated, but makes it simple. I think it is still possible to submit other 
 command buffers in a frame, but those command buffers will have to be submitted before the frame one. The frame 
 command buffer when submitted with submitFrame, will use the current fence.
+Work submitted to another queue that the frame depends on, signals a semaphore given to
+addFrameWaitSemaphore() before submitFrame(). Work depending on the frame can wait on a
+semaphore given to addFrameSignalSemaphore(), timeline semaphores are supported by both.
 
 ### Fences
 
@@ -278,6 +282,9 @@ public:
     m_queue_comp = m_device.getQueue(vkctx.m_queueC.familyIndex, vkctx.m_queueC.queueIndex);
     m_cmdPool_comp = m_device.createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer, m_computeQueueIndex });
 
+    // all the compute queues requested with ContextCreateInfo::setComputeQueues, m_queue_comp is the first
+    m_computeQueues = vkctx.m_queuesC;
+
      //======================================
   // * Check needed queues and create corresponding command pools.
     //m_queue = vkctx.m_queueGCT;
@@ -688,6 +695,27 @@ public:
     }
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // The next submitFrame() also waits on `semaphore` at `stages`, e.g. for the compute work
+  // the frame consumes. The semaphore must be signaled by a submit done before submitFrame().
+  // `value` is only used by timeline semaphores.
+  //
+  void addFrameWaitSemaphore(vk::Semaphore semaphore, vk::PipelineStageFlags stages, uint64_t value = 0)
+  {
+    m_frameWaitSemaphores.push_back(semaphore);
+    m_frameWaitStages.push_back(stages);
+    m_frameWaitValues.push_back(value);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // The next submitFrame() also signals `semaphore` (to `value` for a timeline semaphore)
+  //
+  void addFrameSignalSemaphore(vk::Semaphore semaphore, uint64_t value = 0)
+  {
+    m_frameSignalSemaphores.push_back(semaphore);
+    m_frameSignalValues.push_back(value);
+  }
+
   //--------------------------------------------------------------------------------------------------
   // Convenient function to call for submitting the rendering command
   //
@@ -696,30 +724,62 @@ public:
     uint32_t imageIndex = m_swapChain.getActiveImageIndex();
     m_device.resetFences(m_waitFences[imageIndex]);
 
+    vk::Semaphore semaphoreRead  = m_swapChain.getActiveReadSemaphore();
+    vk::Semaphore semaphoreWrite = m_swapChain.getActiveWrittenSemaphore();
+
+    // The swapchain image first, then the semaphores added for this frame
+    std::vector<vk::Semaphore>          waitSemaphores   = {semaphoreRead};
+    std::vector<vk::PipelineStageFlags> waitStages       = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+    std::vector<uint64_t>               waitValues       = {0};
+    std::vector<vk::Semaphore>          signalSemaphores = {semaphoreWrite};
+    std::vector<uint64_t>               signalValues     = {0};
+    waitSemaphores.insert(waitSemaphores.end(), m_frameWaitSemaphores.begin(), m_frameWaitSemaphores.end());
+    waitStages.insert(waitStages.end(), m_frameWaitStages.begin(), m_frameWaitStages.end());
+    waitValues.insert(waitValues.end(), m_frameWaitValues.begin(), m_frameWaitValues.end());
+    signalSemaphores.insert(signalSemaphores.end(), m_frameSignalSemaphores.begin(), m_frameSignalSemaphores.end());
+    signalValues.insert(signalValues.end(), m_frameSignalValues.begin(), m_frameSignalValues.end());
+    bool hasTimeline = std::any_of(waitValues.begin(), waitValues.end(), [](uint64_t v) { return v != 0; })
+                       || std::any_of(signalValues.begin(), signalValues.end(), [](uint64_t v) { return v != 0; });
+    m_frameWaitSemaphores.clear();
+    m_frameWaitStages.clear();
+    m_frameWaitValues.clear();
+    m_frameSignalSemaphores.clear();
+    m_frameSignalValues.clear();
+
     // In case of using NVLINK
-    const uint32_t                deviceMask  = m_useNvlink ? 0b0000'0011 : 0b0000'0001;
-    const std::array<uint32_t, 2> deviceIndex = {0, 1};
+    const uint32_t        deviceMask = m_useNvlink ? 0b0000'0011 : 0b0000'0001;
+    std::vector<uint32_t> signalDeviceIndices(signalSemaphores.size(), 0);
+    if(m_useNvlink)
+    {
+      signalDeviceIndices.insert(signalDeviceIndices.begin() + 1, 1);
+    }
+    const std::vector<uint32_t> waitDeviceIndices(waitSemaphores.size(), 0);
 
     vk::DeviceGroupSubmitInfo deviceGroupSubmitInfo;
-    deviceGroupSubmitInfo.setWaitSemaphoreCount(1);
+    deviceGroupSubmitInfo.setWaitSemaphoreCount(static_cast<uint32_t>(waitSemaphores.size()));
     deviceGroupSubmitInfo.setCommandBufferCount(1);
     deviceGroupSubmitInfo.setPCommandBufferDeviceMasks(&deviceMask);
-    deviceGroupSubmitInfo.setSignalSemaphoreCount(m_useNvlink ? 2 : 1);
-    deviceGroupSubmitInfo.setPSignalSemaphoreDeviceIndices(deviceIndex.data());
-    deviceGroupSubmitInfo.setPWaitSemaphoreDeviceIndices(deviceIndex.data());
-
-    vk::Semaphore semaphoreRead  = m_swapChain.getActiveReadSemaphore();
-    vk::Semaphore semaphoreWrite = m_swapChain.getActiveWrittenSemaphore();
+    deviceGroupSubmitInfo.setSignalSemaphoreCount(static_cast<uint32_t>(signalDeviceIndices.size()));
+    deviceGroupSubmitInfo.setPSignalSemaphoreDeviceIndices(signalDeviceIndices.data());
+    deviceGroupSubmitInfo.setPWaitSemaphoreDeviceIndices(waitDeviceIndices.data());
+
+    vk::TimelineSemaphoreSubmitInfo timelineSubmitInfo;
+    timelineSubmitInfo.setWaitSemaphoreValueCount(static_cast<uint32_t>(waitValues.size()));
+    timelineSubmitInfo.setPWaitSemaphoreValues(waitValues.data());
+    timelineSubmitInfo.setSignalSemaphoreValueCount(static_cast<uint32_t>(signalValues.size()));
+    timelineSubmitInfo.setPSignalSemaphoreValues(signalValues.data());
+    if(hasTimeline)
+    {
+      deviceGroupSubmitInfo.setPNext(&timelineSubmitInfo);
+    }
 
-    // Pipeline stage at which the queue submission will wait (via pWaitSemaphores)
-    const vk::PipelineStageFlags waitStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
     // The submit info structure specifies a command buffer queue submission batch
     vk::SubmitInfo submitInfo;
-    submitInfo.setPWaitDstStageMask(&waitStageMask);  // Pointer to the list of pipeline stages that the semaphore waits will occur at
-    submitInfo.setPWaitSemaphores(&semaphoreRead);  // Semaphore(s) to wait upon before the submitted command buffer starts executing
-    submitInfo.setWaitSemaphoreCount(1);               // One wait semaphore
-    submitInfo.setPSignalSemaphores(&semaphoreWrite);  // Semaphore(s) to be signaled when command buffers have completed
-    submitInfo.setSignalSemaphoreCount(1);             // One signal semaphore
+    submitInfo.setPWaitDstStageMask(waitStages.data());  // Pointer to the list of pipeline stages that the semaphore waits will occur at
+    submitInfo.setPWaitSemaphores(waitSemaphores.data());  // Semaphore(s) to wait upon before the submitted command buffer starts executing
+    submitInfo.setWaitSemaphoreCount(static_cast<uint32_t>(waitSemaphores.size()));
+    submitInfo.setPSignalSemaphores(signalSemaphores.data());  // Semaphore(s) to be signaled when command buffers have completed
+    submitInfo.setSignalSemaphoreCount(static_cast<uint32_t>(signalSemaphores.size()));
     submitInfo.setPCommandBuffers(&m_commandBuffers[imageIndex]);  // Command buffers(s) to execute in this batch (submission)
     submitInfo.setCommandBufferCount(1);                           // One command buffer
     submitInfo.setPNext(&deviceGroupSubmitInfo);
@@ -1075,6 +1135,7 @@ public:
   vk::Queue                             getComputeQueue() { return m_queue_comp; }
   uint32_t                              getComputeQueueFamily() { return m_computeQueueIndex; }
   vk::CommandPool                       getComputeCommandPool() { return m_cmdPool_comp; }
+  const std::vector<nvvk::Context::Queue>& getComputeQueues() { return m_computeQueues; }
   //- RH
   vk::RenderPass                        getRenderPass() { return m_renderPass; }
   vk::Extent2D                          getSize() { return m_size; }
@@ -1134,6 +1195,7 @@ protected:
   uint32_t           m_computeQueueIndex{ VK_QUEUE_FAMILY_IGNORED };
   vk::Queue          m_queue_comp;
   vk::CommandPool    m_cmdPool_comp;
+  std::vector<nvvk::Context::Queue> m_computeQueues;
   //- RH
   vk::DescriptorPool m_imguiDescPool;
 
@@ -1143,6 +1205,11 @@ protected:
   std::vector<vk::CommandBuffer> m_commandBuffers;    // Command buffer per nb element in Swapchain
   vk::CommandBuffer m_commandBuffer_comp;
   std::vector<vk::Fence>         m_waitFences;        // Fences per nb element in Swapchain
+  std::vector<vk::Semaphore>          m_frameWaitSemaphores;  // Waited by the next submitFrame()
+  std::vector<vk::PipelineStageFlags> m_frameWaitStages;
+  std::vector<uint64_t>               m_frameWaitValues;
+  std::vector<vk::Semaphore>          m_frameSignalSemaphores;  // Signaled by the next submitFrame()
+  std::vector<uint64_t>               m_frameSignalValues;
   vk::Image                      m_depthImage;        // Depth/Stencil
   vk::DeviceMemory               m_depthMemory;       // Depth/Stencil
   vk::ImageView                  m_depthView;         // Depth/Stencil
@@ -0,0 +1,255 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "bindlesstable_vk.hpp"
+
+namespace nvvk {
+
+uint32_t BindlessTable::addArray(const std::vector<ArrayBinding>& bindings, uint32_t capacity)
+{
+  assert(!m_layout);
+  using vkDBF = vk::DescriptorBindingFlagBits;
+
+  for(const auto& b : bindings)
+  {
+    m_bindings.addBinding(b.binding, b.type, capacity, b.stages);
+    m_bindings.setBindingFlags(b.binding, vkDBF::eUpdateAfterBind | vkDBF::ePartiallyBound | vkDBF::eUpdateUnusedWhilePending);
+    m_arrayBindings.push_back(b.binding);
+  }
+  Array array;
+  array.capacity = capacity;
+  array.freeRanges.push_back({0, capacity});
+  m_arrays.push_back(array);
+  return static_cast<uint32_t>(m_arrays.size() - 1);
+}
+
+void BindlessTable::addBinding(uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages)
+{
+  assert(!m_layout);
+  m_bindings.addBinding(binding, type, 1, stages);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void BindlessTable::init(vk::Device device, uint32_t numSets)
+{
+  m_device = device;
+
+  // Only the last binding can have a variable count
+  uint32_t lastBinding  = 0;
+  uint32_t lastCapacity = 0;
+  for(size_t i = 0; i < m_bindings.size(); i++)
+  {
+    lastBinding = std::max(lastBinding, m_bindings.data()[i].binding);
+  }
+  bool variable = std::find(m_arrayBindings.begin(), m_arrayBindings.end(), lastBinding) != m_arrayBindings.end();
+  if(variable)
+  {
+    using vkDBF  = vk::DescriptorBindingFlagBits;
+    lastCapacity = m_bindings.getCount(lastBinding);
+    m_bindings.setBindingFlags(lastBinding, vkDBF::eUpdateAfterBind | vkDBF::ePartiallyBound
+                                                | vkDBF::eUpdateUnusedWhilePending | vkDBF::eVariableDescriptorCount);
+  }
+
+  m_layout = m_bindings.createLayout(device, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+                                     DescriptorSupport::CORE_1_2);
+  m_pool   = m_bindings.createPool(device, numSets, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+
+  std::vector<vk::DescriptorSetLayout>                 layouts(numSets, m_layout);
+  std::vector<uint32_t>                                counts(numSets, lastCapacity);
+  vk::DescriptorSetVariableDescriptorCountAllocateInfo variableInfo{numSets, counts.data()};
+  vk::DescriptorSetAllocateInfo                        allocInfo{m_pool, numSets, layouts.data()};
+  if(variable)
+  {
+    allocInfo.setPNext(&variableInfo);
+  }
+  m_sets = m_device.allocateDescriptorSets(allocInfo);
+  m_pending.resize(numSets);
+}
+
+void BindlessTable::deinit()
+{
+  if(!m_device)
+    return;
+  for(auto& release : m_releases)
+  {
+    release.fn();
+  }
+  m_device.destroy(m_pool);
+  m_device.destroy(m_layout);
+  m_releases.clear();
+  m_pending.clear();
+  m_sets.clear();
+  m_arrays.clear();
+  m_arrayBindings.clear();
+  m_bindings.clear();
+  m_pool   = vk::DescriptorPool();
+  m_layout = vk::DescriptorSetLayout();
+  m_device = vk::Device();
+}
+
+//--------------------------------------------------------------------------------------------------
+// First fit in the free list
+//
+uint32_t BindlessTable::allocate(uint32_t array, uint32_t count)
+{
+  auto& ranges = m_arrays[array].freeRanges;
+  for(auto it = ranges.begin(); it != ranges.end(); ++it)
+  {
+    if(it->count >= count)
+    {
+      uint32_t first = it->first;
+      it->first += count;
+      it->count -= count;
+      if(it->count == 0)
+      {
+        ranges.erase(it);
+      }
+      return first;
+    }
+  }
+  return INVALID_SLOT;
+}
+
+void BindlessTable::free(uint32_t array, uint32_t first, uint32_t count)
+{
+  if(count == 0 || first == INVALID_SLOT)
+    return;
+  auto& ranges = m_arrays[array].freeRanges;
+  auto  it     = std::lower_bound(ranges.begin(), ranges.end(), first,
+                             [](const Range& r, uint32_t slot) { return r.first < slot; });
+  assert(it == ranges.end() || first + count <= it->first);
+  it = ranges.insert(it, {first, count});
+
+  // merging with the neighbors
+  if(it + 1 != ranges.end() && it->first + it->count == (it + 1)->first)
+  {
+    it->count += (it + 1)->count;
+    ranges.erase(it + 1);
+  }
+  if(it != ranges.begin() && (it - 1)->first + (it - 1)->count == it->first)
+  {
+    (it - 1)->count += it->count;
+    ranges.erase(it);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void BindlessTable::write(uint32_t binding, uint32_t slot, const vk::DescriptorImageInfo& info)
+{
+  Write write{binding, slot, static_cast<vk::DescriptorType>(m_bindings.getType(binding))};
+  write.image = info;
+  queue(write);
+}
+
+void BindlessTable::write(uint32_t binding, uint32_t slot, const vk::DescriptorBufferInfo& info)
+{
+  Write write{binding, slot, static_cast<vk::DescriptorType>(m_bindings.getType(binding))};
+  write.buffer = info;
+  queue(write);
+}
+
+void BindlessTable::queue(const Write& write)
+{
+  for(auto& pending : m_pending)
+  {
+    auto it = std::find_if(pending.begin(), pending.end(), [&](const Write& w) {
+      return w.binding == write.binding && w.slot == write.slot;
+    });
+    if(it != pending.end())
+      *it = write;
+    else
+      pending.push_back(write);
+  }
+}
+
+void BindlessTable::flush(uint32_t set)
+{
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.reserve(m_pending[set].size());
+  for(const auto& w : m_pending[set])
+  {
+    vk::WriteDescriptorSet write{m_sets[set], w.binding, w.slot, 1, w.type};
+    switch(w.type)
+    {
+      case vk::DescriptorType::eUniformBuffer:
+      case vk::DescriptorType::eStorageBuffer:
+      case vk::DescriptorType::eUniformBufferDynamic:
+      case vk::DescriptorType::eStorageBufferDynamic:
+        write.setPBufferInfo(&w.buffer);
+        break;
+      default:
+        write.setPImageInfo(&w.image);
+    }
+    writes.push_back(write);
+  }
+  if(!writes.empty())
+  {
+    m_device.updateDescriptorSets(writes, nullptr);
+  }
+  m_pending[set].clear();
+
+  for(auto it = m_releases.begin(); it != m_releases.end();)
+  {
+    it->pending[set] = false;
+    if(std::none_of(it->pending.begin(), it->pending.end(), [](bool p) { return p; }))
+    {
+      it->fn();
+      it = m_releases.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void BindlessTable::flushAll()
+{
+  for(uint32_t set = 0; set < getNumSets(); set++)
+  {
+    flush(set);
+  }
+}
+
+void BindlessTable::deferRelease(std::function<void()> fn)
+{
+  if(m_sets.empty())
+  {
+    fn();
+    return;
+  }
+  m_releases.push_back({std::move(fn), std::vector<bool>(m_sets.size(), true)});
+}
+
+}  // namespace nvvk
@@ -0,0 +1,166 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "descriptorsets_vk.hpp"
+
+namespace nvvk {
+
+/**
+# class nvvk::BindlessTable
+
+A descriptor set holding large arrays of resources indexed in the shaders,
+built on `VK_EXT_descriptor_indexing` (core in Vulkan 1.2):
+
+- the array bindings are `UPDATE_AFTER_BIND`, `PARTIALLY_BOUND` and
+  `UPDATE_UNUSED_WHILE_PENDING`, the array with the highest binding number
+  also has a variable descriptor count
+- slots are handed out from a free list, as contiguous ranges, and given
+  back with `free()`; several bindings can share one slot allocator, for
+  example the vertex and index buffers of a mesh
+- `write()` only queues the changed descriptors, `flush(set)` writes them
+
+There is one copy of the set per frame in flight, so descriptors still
+read by a pending frame are never overwritten: `flush(set)` must be called
+once the frame that last used `getSet(set)` has completed. `deferRelease()`
+runs a function once all sets were flushed, when the resources previously
+referenced by the flushed descriptors can be destroyed.
+
+The non-array bindings (uniform buffers, ...) are plain bindings, they are
+written with `write()` too but must not change while a frame is in flight.
+
+Example :
+~~~ C++
+nvvk::BindlessTable table;
+uint32_t meshes   = table.addArray({{1, vk::DescriptorType::eStorageBuffer, vkSS::eClosestHitKHR},
+                                    {2, vk::DescriptorType::eStorageBuffer, vkSS::eClosestHitKHR}}, 1024);
+uint32_t textures = table.addArray({{3, vk::DescriptorType::eCombinedImageSampler, vkSS::eFragment}}, 4096);
+table.init(device, numFramesInFlight);
+
+uint32_t mesh = table.allocate(meshes);
+table.write(1, mesh, vk::DescriptorBufferInfo{vertexBuffer, 0, VK_WHOLE_SIZE});
+table.write(2, mesh, vk::DescriptorBufferInfo{indexBuffer, 0, VK_WHOLE_SIZE});
+
+// each frame, after waiting for the fence of `frame`
+table.flush(frame);
+cmd.bindDescriptorSets(bindPoint, pipelineLayout, 0, {table.getSet(frame)}, {});
+~~~
+*/
+
+class BindlessTable
+{
+public:
+  static const uint32_t INVALID_SLOT = ~0u;
+
+  struct ArrayBinding
+  {
+    uint32_t             binding;
+    vk::DescriptorType   type;
+    vk::ShaderStageFlags stages;
+  };
+
+  BindlessTable(BindlessTable const&) = delete;
+  BindlessTable& operator=(BindlessTable const&) = delete;
+
+  BindlessTable() = default;
+  ~BindlessTable() { deinit(); }
+
+  // before init(): arrays of `capacity` descriptors, all `bindings` share the same slots
+  uint32_t addArray(const std::vector<ArrayBinding>& bindings, uint32_t capacity);
+  // before init(): single descriptor, not update-after-bind
+  void addBinding(uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages);
+
+  void init(vk::Device device, uint32_t numSets);
+  void deinit();
+
+  vk::DescriptorSetLayout getLayout() const { return m_layout; }
+  vk::DescriptorSet       getSet(uint32_t set) const { return m_sets[set]; }
+  uint32_t                getNumSets() const { return static_cast<uint32_t>(m_sets.size()); }
+  uint32_t                getCapacity(uint32_t array) const { return m_arrays[array].capacity; }
+
+  // first of `count` contiguous slots of `array`, INVALID_SLOT if there is no room
+  uint32_t allocate(uint32_t array, uint32_t count = 1);
+  void     free(uint32_t array, uint32_t first, uint32_t count = 1);
+
+  void write(uint32_t binding, uint32_t slot, const vk::DescriptorImageInfo& info);
+  void write(uint32_t binding, uint32_t slot, const vk::DescriptorBufferInfo& info);
+
+  // writes the descriptors changed since the last flush of `set`
+  void flush(uint32_t set);
+  // writes all pending descriptors, when no frame is in flight
+  void flushAll();
+
+  // `fn` is called once every set was flushed
+  void deferRelease(std::function<void()> fn);
+
+private:
+  struct Range
+  {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  struct Array
+  {
+    uint32_t           capacity{0};
+    std::vector<Range> freeRanges;  // sorted, never adjacent
+  };
+
+  struct Write
+  {
+    uint32_t                 binding;
+    uint32_t                 slot;
+    vk::DescriptorType       type;
+    vk::DescriptorImageInfo  image;
+    vk::DescriptorBufferInfo buffer;
+  };
+
+  struct Release
+  {
+    std::function<void()> fn;
+    std::vector<bool>     pending;  // per set
+  };
+
+  void queue(const Write& write);
+
+  vk::Device                       m_device;
+  DescriptorSetBindings            m_bindings;
+  std::vector<Array>               m_arrays;
+  std::vector<uint32_t>            m_arrayBindings;  // bindings of all arrays
+  vk::DescriptorSetLayout          m_layout;
+  vk::DescriptorPool               m_pool;
+  std::vector<vk::DescriptorSet>   m_sets;
+  std::vector<std::vector<Write>>  m_pending;  // per set
+  std::vector<Release>             m_releases;
+};
+
+}  // namespace nvvk
@@ -381,35 +381,120 @@ bool Context::initDevice(uint32_t deviceIndex, const ContextCreateInfo& info)
   std::vector<void*>                   featureStructs;
 
   bool queueFamilyGeneralPurpose = false;
+  for(auto& it : m_physicalInfo.queueProperties)
   {
-    for(auto& it : m_physicalInfo.queueProperties)
+    if((it.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))
+       == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))
     {
-      if((it.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))
-         == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))
-      {
-        queueFamilyGeneralPurpose = true;
-      }
-     // if(it.queueCount > priorities.size())
+      queueFamilyGeneralPurpose = true;
+    }
+  }
+
+  // Pick the graphics and compute queues before creating the device, so that their priorities
+  // can be set. The other queues are created as well, and remain available for m_queueT.
+  struct QueueScore
+  {
+    uint32_t score;  // the lower the score, the more 'specialized' it is
+    uint32_t familyIndex;
+    uint32_t queueIndex;
+  };
+
+  std::vector<QueueScore> queueScores;
+  for(uint32_t qF = 0; qF < m_physicalInfo.queueProperties.size(); ++qF)
+  {
+    const auto& queueFamily = m_physicalInfo.queueProperties[qF];
+
+    QueueScore score{0, qF, 0};
+    if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+    {
+      score.score++;
+    }
+    if(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
+    {
+      score.score++;
+    }
+    if(queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+    {
+      score.score++;
+    }
+    for(uint32_t qI = 0; qI < queueFamily.queueCount; ++qI)
+    {
+      score.queueIndex = qI;
+      queueScores.emplace_back(score);
+    }
+  }
+
+  // Sort the queues for specialization, highest specialization has lowest score
+  std::sort(queueScores.begin(), queueScores.end(), [](const QueueScore& lhs, const QueueScore& rhs) {
+    if(lhs.score < rhs.score)
+      return true;
+    if(lhs.score > rhs.score)
+      return false;
+    return lhs.queueIndex < rhs.queueIndex;
+  });
+
+  // takes the most specialized queue having needFlags, and none of avoidFlags if possible
+  auto reserveQueue = [this, &queueScores](VkQueueFlags needFlags, VkQueueFlags avoidFlags, Queue& queue) -> bool {
+    for(int pass = avoidFlags ? 0 : 1; pass < 2; ++pass)
+    {
+      for(uint32_t q = 0; q < queueScores.size(); ++q)
       {
-        // set all priorities equal
-        //priorities.resize(it.queueCount, 1.0);
+        const QueueScore& score = queueScores[q];
+        VkQueueFlags      flags = m_physicalInfo.queueProperties[score.familyIndex].queueFlags;
+        if((flags & needFlags) == needFlags && (pass == 1 || (flags & avoidFlags) == 0))
+        {
+          queue.familyIndex = score.familyIndex;
+          queue.queueIndex  = score.queueIndex;
+          queueScores.erase(queueScores.begin() + q);
+          return true;
+        }
       }
     }
-    priorities.resize(m_physicalInfo.queueProperties.size());
-    for(uint32_t i = 0; i < m_physicalInfo.queueProperties.size(); ++i)
+    return false;
+  };
+
+  m_queueGCT          = Queue();
+  m_queueGCT.priority = info.graphicsQueuePriority;
+  reserveQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 0, m_queueGCT);
+  assert(m_queueGCT.familyIndex != ~uint32_t(0));
+
+  m_queuesC.clear();
+  for(float priority : info.computeQueuePriorities)
+  {
+    Queue queue;
+    queue.priority = priority;
+    bool found     = info.preferComputeOnlyFamily ?
+                     reserveQueue(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, queue) :
+                     (reserveQueue(VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT, 0, queue)
+                      || reserveQueue(VK_QUEUE_COMPUTE_BIT, 0, queue));
+    if(!found)
     {
-      VkDeviceQueueCreateInfo queueInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-      queueInfo.queueFamilyIndex = i;
-      queueInfo.queueCount       = m_physicalInfo.queueProperties[i].queueCount;
-     
-      if(i==0)
-          priorities[i] = std::vector<float>(queueInfo.queueCount, PRIORITY_GRAPHICS_QUEUE);
-      else
-          priorities[i] = std::vector<float>(queueInfo.queueCount, PRIORITY_COMPUTE_QUEUE);
-
-      queueInfo.pQueuePriorities = priorities[i].data();
-      queueCreateInfos.push_back(queueInfo);
+      LOGW("only %d of the %d requested compute queues are available\n", int(m_queuesC.size()),
+           int(info.computeQueuePriorities.size()));
+      break;
     }
+    m_queuesC.push_back(queue);
+  }
+
+  priorities.resize(m_physicalInfo.queueProperties.size());
+  for(uint32_t i = 0; i < m_physicalInfo.queueProperties.size(); ++i)
+  {
+    uint32_t queueCount = m_physicalInfo.queueProperties[i].queueCount;
+    priorities[i]       = std::vector<float>(queueCount, i == 0 ? PRIORITY_GRAPHICS_QUEUE : PRIORITY_COMPUTE_QUEUE);
+  }
+  priorities[m_queueGCT.familyIndex][m_queueGCT.queueIndex] = m_queueGCT.priority;
+  for(const auto& queue : m_queuesC)
+  {
+    priorities[queue.familyIndex][queue.queueIndex] = queue.priority;
+  }
+
+  for(uint32_t i = 0; i < m_physicalInfo.queueProperties.size(); ++i)
+  {
+    VkDeviceQueueCreateInfo queueInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+    queueInfo.queueFamilyIndex = i;
+    queueInfo.queueCount       = m_physicalInfo.queueProperties[i].queueCount;
+    queueInfo.pQueuePriorities = priorities[i].data();
+    queueCreateInfos.push_back(queueInfo);
   }
 
   if(!queueFamilyGeneralPurpose)
@@ -545,48 +630,7 @@ bool Context::initDevice(uint32_t deviceIndex, const ContextCreateInfo& info)
   // Now we have the device and instance, we can initialize the debug tool
   nvvk::DebugUtil debugUtil(m_device);
 
-  // Now pick 3 distinct queues for graphics, compute and transfer operations
-  struct QueueScore
-  {
-    uint32_t score;  // the lower the score, the more 'specialized' it is
-    uint32_t familyIndex;
-    uint32_t queueIndex;
-  };
-
-  std::vector<QueueScore> queueScores;
-  for(uint32_t qF = 0; qF < m_physicalInfo.queueProperties.size(); ++qF)
-  {
-    const auto& queueFamily = m_physicalInfo.queueProperties[qF];
-
-    QueueScore score{0, qF, 0};
-    if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-    {
-      score.score++;
-    }
-    if(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
-    {
-      score.score++;
-    }
-    if(queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
-    {
-      score.score++;
-    }
-    for(uint32_t qI = 0; qI < queueFamily.queueCount; ++qI)
-    {
-      score.queueIndex = qI;
-      queueScores.emplace_back(score);
-    }
-  }
-
-  // Sort the queues for specialization, highest specialization has lowest score
-  std::sort(queueScores.begin(), queueScores.end(), [](const QueueScore& lhs, const QueueScore& rhs) {
-    if(lhs.score < rhs.score)
-      return true;
-    if(lhs.score > rhs.score)
-      return false;
-    return lhs.queueIndex < rhs.queueIndex;
-  });
-
+  // Now fetch the reserved graphics and compute queues, and pick a distinct transfer queue
   auto findQueue = [this, &queueScores, &debugUtil](VkQueueFlags needFlags, const std::string& name) -> Queue {
     for(uint32_t q = 0; q < queueScores.size(); ++q)
     {
@@ -607,12 +651,28 @@ bool Context::initDevice(uint32_t deviceIndex, const ContextCreateInfo& info)
     return Queue();
   };
 
-  m_queueGCT = findQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, "queueGCT");
-  assert(m_queueGCT.familyIndex != ~uint32_t(0));
+  vkGetDeviceQueue(m_device, m_queueGCT.familyIndex, m_queueGCT.queueIndex, &m_queueGCT.queue);
+  debugUtil.setObjectName(m_queueGCT.queue, "queueGCT");
+
+  for(size_t i = 0; i < m_queuesC.size(); ++i)
+  {
+    vkGetDeviceQueue(m_device, m_queuesC[i].familyIndex, m_queuesC[i].queueIndex, &m_queuesC[i].queue);
+    debugUtil.setObjectName(m_queuesC[i].queue, "queueC" + std::to_string(i));
+  }
+  m_queueC = m_queuesC.empty() ? Queue() : m_queuesC[0];
 
-  m_queueC = findQueue(VK_QUEUE_COMPUTE_BIT, "queueC");
   m_queueT = findQueue(VK_QUEUE_TRANSFER_BIT, "queueT");
 
+  if(info.verboseUsed)
+  {
+    LOGI("Queues (family, index, priority) :\n");
+    LOGI("GCT %d, %d, %.2f\n", m_queueGCT.familyIndex, m_queueGCT.queueIndex, m_queueGCT.priority);
+    for(const auto& queue : m_queuesC)
+    {
+      LOGI("C   %d, %d, %.2f\n", queue.familyIndex, queue.queueIndex, queue.priority);
+    }
+  }
+
   return true;
 }
 
@@ -735,6 +795,8 @@ bool Context::hasInstanceExtension(const char* name) const
 //
 //
 ContextCreateInfo::ContextCreateInfo(bool bUseValidation)
+    : graphicsQueuePriority(PRIORITY_GRAPHICS_QUEUE)
+    , computeQueuePriorities{PRIORITY_COMPUTE_QUEUE}
 {
 #ifdef _DEBUG
   instanceExtensions.push_back({VK_EXT_DEBUG_UTILS_EXTENSION_NAME, true});
@@ -743,6 +805,12 @@ ContextCreateInfo::ContextCreateInfo(bool bUseValidation)
 #endif
 }
 
+void ContextCreateInfo::setComputeQueues(const std::vector<float>& priorities, bool preferComputeOnly)
+{
+  computeQueuePriorities  = priorities;
+  preferComputeOnlyFamily = preferComputeOnly;
+}
+
 void ContextCreateInfo::addInstanceExtension(const char* name, bool optional)
 {
   instanceExtensions.emplace_back(name, optional);
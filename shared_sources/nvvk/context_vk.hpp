@@ -66,6 +66,8 @@ Example on how to populate information in it :
     ctxInfo.addInstanceExtension(VK_KHR_SURFACE_EXTENSION_NAME, false);
     ctxInfo.addInstanceExtension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME, false);
     ctxInfo.addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME, false);
+    // latency critical and background async compute
+    ctxInfo.setComputeQueues({1.0f, 0.1f});
 ~~~~
 
 then you are ready to create initialize `nvvk::Context`
@@ -106,6 +108,16 @@ struct ContextCreateInfo
   // may impact performance hence disable by default
   bool disableRobustBufferAccess = true;
 
+  // Queue configuration, priorities are in [0,1]
+  // One async compute queue is created per entry of computeQueuePriorities (see Context::m_queuesC).
+  // With preferComputeOnlyFamily they are taken from families without graphics first,
+  // otherwise from the graphics family first, which avoids queue family ownership transfers.
+  float              graphicsQueuePriority;
+  std::vector<float> computeQueuePriorities;
+  bool               preferComputeOnlyFamily = true;
+
+  void setComputeQueues(const std::vector<float>& priorities, bool preferComputeOnly = true);
+
   // Information printed at Context::init time
   bool verboseCompatibleDevices = true;
   bool verboseUsed              = true;  // Print what is used
@@ -170,6 +182,7 @@ At this point, the class will have created the `VkInstance` and `VkDevice` accor
  * `Queue m_queueGCT` : Graphics/Compute/Transfer Queue + family index
  * `Queue m_queueT` : async Transfer Queue + family index
  * `Queue m_queueC` : Compute Queue + family index
+ * `std::vector<Queue> m_queuesC` : all the compute queues requested with `ContextCreateInfo::setComputeQueues`, `m_queueC` is the first one
 * maintains what extensions are finally available
 * implicitly hooks up the debug callback
 
@@ -313,6 +326,7 @@ public:
     VkQueue  queue       = VK_NULL_HANDLE;
     uint32_t familyIndex = ~0;
     uint32_t queueIndex  = ~0;
+    float    priority    = 0.0f;
 
     operator VkQueue() const { return queue; }
     operator uint32_t() const { return familyIndex; }
@@ -329,9 +343,12 @@ public:
   // All the queues (if present) is distinct from each other
   Queue m_queueGCT;  // for Graphics/Compute/Transfer (must exist)
   Queue m_queueT;    // for pure async Transfer Queue (can exist, supports at least transfer)
-  Queue m_queueC;    // for async Compute (can exist, supports at least compute)
+  Queue m_queueC;    // for async Compute (can exist, supports at least compute), same as m_queuesC[0]
   Queue m_queueB;  // for binding
 
+  // all async compute queues, in the order of ContextCreateInfo::computeQueuePriorities
+  std::vector<Queue> m_queuesC;
+
   operator VkDevice() const { return m_device; }
 
   // All-in-one instance and device creation
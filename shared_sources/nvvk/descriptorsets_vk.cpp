@@ -27,6 +27,8 @@
 
 #include "descriptorsets_vk.hpp"
 
+#include <algorithm>
+
 namespace nvvk {
 
 //////////////////////////////////////////////////////////////////////////
@@ -186,7 +188,7 @@ void DescriptorSetBindings::addRequiredPoolSizes(std::vector<VkDescriptorPoolSiz
   }
 }
 
-VkDescriptorPool DescriptorSetBindings::createPool(VkDevice device, uint32_t maxSets /*= 1*/) const
+VkDescriptorPool DescriptorSetBindings::createPool(VkDevice device, uint32_t maxSets /*= 1*/, VkDescriptorPoolCreateFlags flags /*= 0*/) const
 {
   VkResult result;
 
@@ -201,6 +203,7 @@ VkDescriptorPool DescriptorSetBindings::createPool(VkDevice device, uint32_t max
   descrPoolInfo.maxSets                    = maxSets;
   descrPoolInfo.poolSizeCount              = uint32_t(poolSizes.size());
   descrPoolInfo.pPoolSizes                 = poolSizes.data();
+  descrPoolInfo.flags                      = flags;
 
   // scene pool
   result = vkCreateDescriptorPool(device, &descrPoolInfo, nullptr, &descrPool);
@@ -447,6 +450,146 @@ VkWriteDescriptorSet DescriptorSetBindings::makeWriteArray(VkDescriptorSet
 
 //////////////////////////////////////////////////////////////////////////
 
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPage /*= 64*/, VkDescriptorPoolCreateFlags flags /*= 0*/)
+{
+  assert(m_device == VK_NULL_HANDLE);
+  assert(setsPerPage > 0);
+  m_device      = device;
+  m_setsPerPage = setsPerPage;
+  m_flags       = flags;
+}
+
+void DescriptorAllocator::deinit()
+{
+  for(auto pool : m_usedPages)
+  {
+    vkDestroyDescriptorPool(m_device, pool, nullptr);
+  }
+  for(auto pool : m_freePages)
+  {
+    vkDestroyDescriptorPool(m_device, pool, nullptr);
+  }
+  m_usedPages.clear();
+  m_freePages.clear();
+  m_totalSizes.clear();
+  m_totalSets = 0;
+  m_current   = VK_NULL_HANDLE;
+  m_device    = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const DescriptorSetBindings& bindings)
+{
+  assert(m_device);
+
+  std::vector<VkDescriptorPoolSize> required;
+  bindings.addRequiredPoolSizes(required, 1);
+
+  // update the statistics first, so a new page accounts for this set
+  for(const auto& size : required)
+  {
+    bool found = false;
+    for(auto& total : m_totalSizes)
+    {
+      if(total.type == size.type)
+      {
+        total.descriptorCount += size.descriptorCount;
+        found = true;
+        break;
+      }
+    }
+    if(!found)
+    {
+      m_totalSizes.push_back(size);
+    }
+  }
+  m_totalSets++;
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  if(m_current && tryAllocate(m_current, layout, set))
+  {
+    return set;
+  }
+
+  // the current page is full: recycled pages first, the ones too small for this set stay
+  // free as they are still empty
+  for(size_t i = m_freePages.size(); i-- > 0;)
+  {
+    if(tryAllocate(m_freePages[i], layout, set))
+    {
+      m_current = m_freePages[i];
+      m_freePages.erase(m_freePages.begin() + i);
+      m_usedPages.push_back(m_current);
+      return set;
+    }
+  }
+
+  m_current = createPage(required);
+  m_usedPages.push_back(m_current);
+  bool result = tryAllocate(m_current, layout, set);
+  assert(result && "new page cannot hold the set");
+  (void)result;
+  return set;
+}
+
+void DescriptorAllocator::reset()
+{
+  for(auto pool : m_usedPages)
+  {
+    vkResetDescriptorPool(m_device, pool, 0);
+    m_freePages.push_back(pool);
+  }
+  m_usedPages.clear();
+  m_current = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::createPage(const std::vector<VkDescriptorPoolSize>& required) const
+{
+  // average set of the statistics times the number of sets per page, enough for `required` in any case
+  std::vector<VkDescriptorPoolSize> poolSizes;
+  for(const auto& total : m_totalSizes)
+  {
+    VkDescriptorPoolSize size;
+    size.type            = total.type;
+    size.descriptorCount = uint32_t((uint64_t(total.descriptorCount) * m_setsPerPage + m_totalSets - 1) / m_totalSets);
+    for(const auto& req : required)
+    {
+      if(req.type == size.type)
+      {
+        size.descriptorCount = std::max(size.descriptorCount, req.descriptorCount);
+      }
+    }
+    poolSizes.push_back(size);
+  }
+
+  VkResult result;
+
+  VkDescriptorPool           descrPool;
+  VkDescriptorPoolCreateInfo descrPoolInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  descrPoolInfo.maxSets                    = m_setsPerPage;
+  descrPoolInfo.poolSizeCount              = uint32_t(poolSizes.size());
+  descrPoolInfo.pPoolSizes                 = poolSizes.data();
+  descrPoolInfo.flags                      = m_flags;
+
+  result = vkCreateDescriptorPool(m_device, &descrPoolInfo, nullptr, &descrPool);
+  assert(result == VK_SUCCESS);
+  return descrPool;
+}
+
+bool DescriptorAllocator::tryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set) const
+{
+  VkDescriptorSetAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  allocInfo.descriptorPool              = pool;
+  allocInfo.descriptorSetCount          = 1;
+  allocInfo.pSetLayouts                 = &layout;
+
+  VkResult result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+  // running out of sets is reported as out of pool memory too
+  assert(result == VK_SUCCESS || result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL);
+  return result == VK_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 static void s_test()
 {
   TDescriptorSetContainer<1, 1> test;
@@ -240,7 +240,7 @@ public:
 
   // Once the bindings have been added, this generates the descriptor pool with enough space to
   // handle all the bound resources and allocate up to maxSets descriptor sets
-  VkDescriptorPool createPool(VkDevice device, uint32_t maxSets = 1) const;
+  VkDescriptorPool createPool(VkDevice device, uint32_t maxSets = 1, VkDescriptorPoolCreateFlags flags = 0) const;
 
   // appends the required poolsizes for N sets
   void addRequiredPoolSizes(std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t numSets) const;
@@ -416,6 +416,84 @@ private:
   std::vector<VkDescriptorBindingFlags>     m_bindingFlags;
 };
 
+/////////////////////////////////////////////////////////////
+/**
+# class nvvk::DescriptorAllocator
+
+Allocates descriptor sets of any layout from pages of descriptor pools,
+instead of creating one pool per layout.
+
+- sets are allocated from the current page; when it is exhausted, a
+  recycled page or a new page is used
+- a new page holds `setsPerPage` sets, its descriptor counts per type are
+  derived from the average set allocated so far (and always fit the
+  requested set)
+- `reset()` frees all sets at once and keeps the pages for reuse, which
+  makes it suited to transient sets: use one allocator per frame in
+  flight and reset it once the frame's fence is signaled
+
+Sets are not freed individually, they live until `reset()` or `deinit()`.
+Sets with a variable descriptor count or update-after-bind bindings need
+their own pool (see nvvk::BindlessTable).
+
+Example :
+~~~ C++
+nvvk::DescriptorAllocator descAllocator;
+descAllocator.init(device);
+
+VkDescriptorSet set = descAllocator.allocate(layout, bindings);
+...
+// transient sets, with one allocator per frame
+frameAllocators[frame].reset();
+VkDescriptorSet tmp = frameAllocators[frame].allocate(tmpLayout, tmpBindings);
+...
+descAllocator.deinit();
+~~~
+*/
+
+class DescriptorAllocator
+{
+public:
+  DescriptorAllocator(DescriptorAllocator const&) = delete;
+  DescriptorAllocator& operator=(DescriptorAllocator const&) = delete;
+
+  DescriptorAllocator() {}
+  ~DescriptorAllocator() { deinit(); }
+
+  void init(VkDevice device, uint32_t setsPerPage = 64, VkDescriptorPoolCreateFlags flags = 0);
+  void deinit();
+
+  // `bindings` must be the ones `layout` was created from, they provide the descriptor counts
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout, const DescriptorSetBindings& bindings);
+#ifdef VULKAN_HPP
+  vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, const DescriptorSetBindings& bindings)
+  {
+    return allocate(static_cast<VkDescriptorSetLayout>(layout), bindings);
+  }
+#endif
+
+  // frees all sets allocated so far, the pages are kept
+  void reset();
+
+  uint32_t getNumPages() const { return uint32_t(m_usedPages.size() + m_freePages.size()); }
+
+private:
+  VkDescriptorPool createPage(const std::vector<VkDescriptorPoolSize>& required) const;
+  bool             tryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set) const;
+
+  VkDevice                    m_device = VK_NULL_HANDLE;
+  uint32_t                    m_setsPerPage = 64;
+  VkDescriptorPoolCreateFlags m_flags = 0;
+
+  // statistics of the sets allocated so far, to size new pages
+  std::vector<VkDescriptorPoolSize> m_totalSizes;
+  uint64_t                          m_totalSets = 0;
+
+  VkDescriptorPool              m_current = VK_NULL_HANDLE;
+  std::vector<VkDescriptorPool> m_usedPages;  // including m_current
+  std::vector<VkDescriptorPool> m_freePages;
+};
+
 /////////////////////////////////////////////////////////////
 /**
 # class nvvk::DescriptorSetContainer
@@ -0,0 +1,143 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "nvh/threadpool.hpp"
+#include "shaders_vk.hpp"
+
+namespace nvvk {
+
+/**
+# class nvvk::PipelineBuilderAsync
+
+Compiles pipelines on a pool of worker threads. Pipeline creation is
+thread-safe in Vulkan, and so is the pipeline cache unless it was created
+with `VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT`, therefore
+all tasks share the single cache given at init time.
+
+Each task receives the cache and returns the created pipeline, the result
+is handed back as a std::future. Everything a task touches (layouts, render
+passes, shader code) must stay valid until its future is ready.
+
+Example :
+~~~ C++
+m_pipelineBuilder.init(m_device, m_pipelineCache);
+
+std::future<vk::Pipeline> graphics = m_pipelineBuilder.enqueue([&](vk::PipelineCache cache) {
+  nvvk::GraphicsPipelineGeneratorCombined gpb(m_device, m_pipelineLayout, m_renderPass);
+  ...
+  return vk::Pipeline(gpb.createPipeline(cache));
+});
+
+// ... load models, build acceleration structures ...
+
+m_graphicsPipeline = graphics.get();
+~~~
+*/
+
+class PipelineBuilderAsync
+{
+public:
+  PipelineBuilderAsync(PipelineBuilderAsync const&) = delete;
+  PipelineBuilderAsync& operator=(PipelineBuilderAsync const&) = delete;
+
+  PipelineBuilderAsync() = default;
+  ~PipelineBuilderAsync() { deinit(); }
+
+  void init(vk::Device device, vk::PipelineCache cache, uint32_t numThreads = 0)
+  {
+    m_device        = device;
+    m_pipelineCache = cache;
+    m_pool.init(numThreads);
+  }
+
+  // waits for all enqueued pipelines
+  void deinit() { m_pool.deinit(); }
+
+  // fn: vk::Pipeline(vk::PipelineCache)
+  template <class F>
+  std::future<vk::Pipeline> enqueue(F&& fn)
+  {
+    vk::PipelineCache cache = m_pipelineCache;
+    return m_pool.enqueue([cache, fn = std::forward<F>(fn)]() mutable { return vk::Pipeline(fn(cache)); });
+  }
+
+  // Compute pipelines only need the SPIR-V and the layout, the code is copied into the task
+  std::future<vk::Pipeline> createComputePipeline(const std::string&              spirv,
+                                                  vk::PipelineLayout              layout,
+                                                  const vk::SpecializationInfo*   specialization = nullptr,
+                                                  const char*                     entryPoint     = "main")
+  {
+    vk::Device device = m_device;
+    // copy the specialization as the caller's struct is likely on the stack
+    std::vector<vk::SpecializationMapEntry> entries;
+    std::vector<uint8_t>                    data;
+    if(specialization)
+    {
+      entries.assign(specialization->pMapEntries, specialization->pMapEntries + specialization->mapEntryCount);
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(specialization->pData);
+      data.assign(bytes, bytes + specialization->dataSize);
+    }
+
+    return enqueue([device, spirv, layout, entries, data, hasSpec = specialization != nullptr,
+                    entryPoint](vk::PipelineCache cache) {
+      vk::SpecializationInfo specInfo;
+      specInfo.setMapEntryCount(static_cast<uint32_t>(entries.size()));
+      specInfo.setPMapEntries(entries.data());
+      specInfo.setDataSize(data.size());
+      specInfo.setPData(data.data());
+
+      vk::ShaderModule module = nvvk::createShaderModule(device, spirv);
+
+      vk::ComputePipelineCreateInfo createInfo{{}, {}, layout};
+      createInfo.stage.setStage(vk::ShaderStageFlagBits::eCompute);
+      createInfo.stage.setModule(module);
+      createInfo.stage.setPName(entryPoint);
+      createInfo.stage.setPSpecializationInfo(hasSpec ? &specInfo : nullptr);
+
+      vk::Pipeline pipeline =
+          static_cast<const vk::Pipeline&>(device.createComputePipeline(cache, createInfo, nullptr));
+      device.destroy(module);
+      return pipeline;
+    });
+  }
+
+  vk::PipelineCache getPipelineCache() const { return m_pipelineCache; }
+
+private:
+  vk::Device        m_device;
+  vk::PipelineCache m_pipelineCache;
+  nvh::ThreadPool   m_pool;  // no threads until init()
+};
+
+}  // namespace nvvk
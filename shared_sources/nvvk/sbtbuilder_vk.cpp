@@ -0,0 +1,159 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "nvh/alignment.hpp"
+#include "nvh/nvprint.hpp"
+#include "sbtbuilder_vk.hpp"
+
+namespace nvvk {
+
+void SbtBuilder::init(vk::Device device, const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR& properties)
+{
+  m_device     = device;
+  m_properties = properties;
+}
+
+void SbtBuilder::clear()
+{
+  for(auto& region : m_regions)
+  {
+    region.records.clear();
+  }
+}
+
+uint32_t SbtBuilder::addRecord(Region region, uint32_t group, const void* data, size_t dataSize)
+{
+  m_regions[region].records.push_back({});
+  uint32_t index = getRecordCount(region) - 1;
+  setRecord(region, index, group, data, dataSize);
+  return index;
+}
+
+void SbtBuilder::setRecord(Region region, uint32_t index, uint32_t group, const void* data, size_t dataSize)
+{
+  Record& record = m_regions[region].records[index];
+  record.group   = group;
+  record.data.resize(dataSize);
+  if(dataSize)
+  {
+    memcpy(record.data.data(), data, dataSize);
+  }
+  assert(getStride(region) <= m_properties.maxShaderGroupStride);
+}
+
+void SbtBuilder::setMinStride(Region region, uint32_t stride)
+{
+  m_regions[region].minStride = stride;
+  assert(getStride(region) <= m_properties.maxShaderGroupStride);
+}
+
+//--------------------------------------------------------------------------------------------------
+// The raygen region is a single record, its size must be its stride and it must be aligned like
+// the start of a region
+//
+uint32_t SbtBuilder::getStride(Region region) const
+{
+  size_t dataSize = 0;
+  for(const auto& record : m_regions[region].records)
+  {
+    dataSize = std::max(dataSize, record.data.size());
+  }
+  uint32_t stride = std::max(m_properties.shaderGroupHandleSize + static_cast<uint32_t>(dataSize),
+                             m_regions[region].minStride);
+  stride = nvh::align_up(stride, m_properties.shaderGroupHandleAlignment);
+  if(region == eRaygen)
+  {
+    stride = nvh::align_up(stride, m_properties.shaderGroupBaseAlignment);
+  }
+  return stride;
+}
+
+vk::DeviceSize SbtBuilder::getOffset(Region region) const
+{
+  vk::DeviceSize offset = 0;
+  for(uint32_t r = 0; r < region; r++)
+  {
+    offset = nvh::align_up(offset + getRegionSize(Region(r)), m_properties.shaderGroupBaseAlignment);
+  }
+  return offset;
+}
+
+vk::DeviceSize SbtBuilder::getSize() const
+{
+  return getOffset(eCallable) + getRegionSize(eCallable);
+}
+
+bool SbtBuilder::fetchHandles(vk::Pipeline pipeline, uint32_t groupCount)
+{
+  m_handles.resize(size_t(groupCount) * m_properties.shaderGroupHandleSize);
+  auto result = m_device.getRayTracingShaderGroupHandlesKHR(pipeline, 0, groupCount, m_handles.size(), m_handles.data());
+  if(result != vk::Result::eSuccess)
+  {
+    LOGE("getRayTracingShaderGroupHandlesKHR failed: %s\n", vk::to_string(result).c_str());
+    m_handles.clear();
+    return false;
+  }
+  return true;
+}
+
+void SbtBuilder::write(void* dst) const
+{
+  uint32_t handleSize = m_properties.shaderGroupHandleSize;
+  for(uint32_t r = 0; r < eRegionCount; r++)
+  {
+    uint32_t stride = getStride(Region(r));
+    auto*    pData  = reinterpret_cast<uint8_t*>(dst) + getOffset(Region(r));
+    for(const auto& record : m_regions[r].records)
+    {
+      assert((record.group + 1) * handleSize <= m_handles.size());
+      memcpy(pData, m_handles.data() + record.group * handleSize, handleSize);
+      if(!record.data.empty())
+      {
+        memcpy(pData + handleSize, record.data.data(), record.data.size());
+      }
+      pData += stride;
+    }
+  }
+}
+
+vk::StridedDeviceAddressRegionKHR SbtBuilder::getRegion(Region region, vk::DeviceAddress address, uint32_t first) const
+{
+  uint32_t count = getRecordCount(region);
+  if(first >= count)
+  {
+    return {0u, 0u, 0u};
+  }
+  uint32_t          stride = getStride(region);
+  vk::DeviceAddress start  = address + getOffset(region) + vk::DeviceSize(first) * stride;
+  vk::DeviceSize    size   = region == eRaygen ? stride : vk::DeviceSize(count - first) * stride;
+  return {start, stride, size};
+}
+
+}  // namespace nvvk
@@ -0,0 +1,152 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace nvvk {
+
+/**
+# class nvvk::SbtBuilder
+
+Layout and content of a ray tracing shader binding table: the records of
+the raygen, miss, hit and callable regions, each one a shader group handle
+followed by optional inline data read in the shaders with a
+`shaderRecordEXT` buffer block.
+
+- the stride of a region is the handle plus its largest data, aligned to
+  `shaderGroupHandleAlignment`; `setMinStride()` makes it larger, for
+  example to keep room for data added later
+- each region starts at a multiple of `shaderGroupBaseAlignment`
+- `setRecord()` changes the group or the data of a record; as long as
+  `getSize()` still fits the buffer, `write()` rewrites the table in place
+  and the buffer does not need to be recreated
+- `getRegion()` returns the strided region of `traceRaysKHR`, a raygen
+  region is a single record
+
+The builder does not own the buffer, which must be created with
+`eShaderBindingTableKHR | eShaderDeviceAddress` usage and host visible to
+be written by `write()`, or copied from a staging buffer.
+
+Example :
+~~~ C++
+nvvk::SbtBuilder sbt;
+sbt.init(device, rtProperties);
+sbt.addRecord(nvvk::SbtBuilder::eRaygen, 0);
+sbt.addRecord(nvvk::SbtBuilder::eMiss, 1);
+for(const auto& inst : instances)
+  sbt.addRecord(nvvk::SbtBuilder::eHit, 2, HitRecord{inst.objIndex});  // instance hitGroupId = index
+sbt.fetchHandles(pipeline, 3);
+
+// buffer of at least sbt.getSize()
+sbt.write(alloc.map(sbtBuffer));
+
+vk::DeviceAddress address = device.getBufferAddress({sbtBuffer.buffer});
+auto raygen = sbt.getRegion(nvvk::SbtBuilder::eRaygen, address);
+auto miss   = sbt.getRegion(nvvk::SbtBuilder::eMiss, address);
+auto hit    = sbt.getRegion(nvvk::SbtBuilder::eHit, address);
+auto call   = sbt.getRegion(nvvk::SbtBuilder::eCallable, address);
+cmdBuf.traceRaysKHR(&raygen, &miss, &hit, &call, width, height, 1);
+~~~
+*/
+
+class SbtBuilder
+{
+public:
+  enum Region
+  {
+    eRaygen   = 0,
+    eMiss     = 1,
+    eHit      = 2,
+    eCallable = 3,
+    eRegionCount
+  };
+
+  void init(vk::Device device, const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR& properties);
+
+  // removes the records of all regions, the minimum strides are kept
+  void clear();
+
+  // index of the new record in `region`, the record of `group` followed by `data`
+  uint32_t addRecord(Region region, uint32_t group, const void* data = nullptr, size_t dataSize = 0);
+  template <typename T>
+  uint32_t addRecord(Region region, uint32_t group, const T& data)
+  {
+    return addRecord(region, group, &data, sizeof(T));
+  }
+
+  void setRecord(Region region, uint32_t index, uint32_t group, const void* data = nullptr, size_t dataSize = 0);
+  template <typename T>
+  void setRecord(Region region, uint32_t index, uint32_t group, const T& data)
+  {
+    setRecord(region, index, group, &data, sizeof(T));
+  }
+
+  // 0 uses the smallest stride fitting the records
+  void setMinStride(Region region, uint32_t stride);
+
+  uint32_t       getRecordCount(Region region) const { return static_cast<uint32_t>(m_regions[region].records.size()); }
+  uint32_t       getStride(Region region) const;
+  vk::DeviceSize getOffset(Region region) const;
+  vk::DeviceSize getRegionSize(Region region) const { return vk::DeviceSize(getStride(region)) * getRecordCount(region); }
+  // size of the whole table
+  vk::DeviceSize getSize() const;
+
+  // reads the handles of the first `groupCount` groups of `pipeline`, after it is created.
+  // Returns false and logs the error if the handles could not be read.
+  bool fetchHandles(vk::Pipeline pipeline, uint32_t groupCount);
+
+  // handles and data of all records, at `dst` of at least getSize() bytes
+  void write(void* dst) const;
+
+  // region of `traceRaysKHR` starting at record `first`; for eRaygen, only that record
+  vk::StridedDeviceAddressRegionKHR getRegion(Region region, vk::DeviceAddress address, uint32_t first = 0) const;
+
+private:
+  struct Record
+  {
+    uint32_t             group;
+    std::vector<uint8_t> data;
+  };
+
+  struct RegionRecords
+  {
+    std::vector<Record> records;
+    uint32_t            minStride{0};
+  };
+
+  vk::Device                                        m_device;
+  vk::PhysicalDeviceRayTracingPipelinePropertiesKHR m_properties;
+  std::array<RegionRecords, eRegionCount>           m_regions;
+  std::vector<uint8_t>                              m_handles;  // of the groups of the pipeline
+};
+
+}  // namespace nvvk
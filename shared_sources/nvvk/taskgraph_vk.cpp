@@ -0,0 +1,590 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <assert.h>
+#include <nvh/nvprint.hpp>
+
+#include "taskgraph_vk.hpp"
+
+namespace nvvk {
+
+//--------------------------------------------------------------------------------------------------
+// PassBuilder
+//
+TaskGraph::PassBuilder& TaskGraph::PassBuilder::read(ResourceId id, const Access& access)
+{
+  assert(id < m_graph->m_resources.size());
+  m_graph->m_passes[m_pass].accesses.push_back({id, access, false, true});
+  m_graph->m_compiled = false;
+  return *this;
+}
+
+TaskGraph::PassBuilder& TaskGraph::PassBuilder::write(ResourceId id, const Access& access)
+{
+  assert(id < m_graph->m_resources.size());
+  m_graph->m_passes[m_pass].accesses.push_back({id, access, true, false});
+  m_graph->m_compiled = false;
+  return *this;
+}
+
+TaskGraph::PassBuilder& TaskGraph::PassBuilder::readWrite(ResourceId id, const Access& access)
+{
+  assert(id < m_graph->m_resources.size());
+  m_graph->m_passes[m_pass].accesses.push_back({id, access, true, true});
+  m_graph->m_compiled = false;
+  return *this;
+}
+
+TaskGraph::PassBuilder& TaskGraph::PassBuilder::sideEffects()
+{
+  m_graph->m_passes[m_pass].sideEffects = true;
+  m_graph->m_compiled                   = false;
+  return *this;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void TaskGraph::init(vk::Device device, vk::Queue graphicsQueue, uint32_t graphicsFamily, vk::Queue computeQueue, uint32_t computeFamily)
+{
+  m_device                 = device;
+  m_queues[eGraphics]      = graphicsQueue;
+  m_families[eGraphics]    = graphicsFamily;
+  m_queues[eCompute]       = computeQueue ? computeQueue : graphicsQueue;
+  m_families[eCompute]     = computeQueue ? computeFamily : graphicsFamily;
+
+  m_cmdPools[eGraphics].init(device, m_families[eGraphics], vk::CommandPoolCreateFlagBits::eTransient, m_queues[eGraphics]);
+  if(physicalQueue(eCompute) != eGraphics)
+  {
+    m_cmdPools[eCompute].init(device, m_families[eCompute], vk::CommandPoolCreateFlagBits::eTransient, m_queues[eCompute]);
+  }
+}
+
+void TaskGraph::deinit()
+{
+  if(!m_device)
+    return;
+
+  wait();
+  releaseExecution();
+  for(auto& pool : m_cmdPools)
+  {
+    pool.deinit();
+  }
+  m_resources.clear();
+  m_passes.clear();
+  m_batches.clear();
+  m_compiled = false;
+  m_device   = vk::Device();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Resources
+//
+TaskGraph::ResourceId TaskGraph::importBuffer(const std::string& name, vk::Buffer buffer, const Access& initial, QueueType owner, bool concurrent)
+{
+  Resource res;
+  res.name               = name;
+  res.buffer             = buffer;
+  res.concurrent         = concurrent;
+  res.state.writeStages  = initial.stages;
+  res.state.writeAccess  = initial.access;
+  res.state.queue        = physicalQueue(owner);
+  m_resources.push_back(res);
+  m_compiled = false;
+  return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+TaskGraph::ResourceId TaskGraph::importImage(const std::string&               name,
+                                             vk::Image                        image,
+                                             const vk::ImageSubresourceRange& range,
+                                             const Access&                    initial,
+                                             QueueType                        owner,
+                                             bool                             concurrent)
+{
+  Resource res;
+  res.name              = name;
+  res.isImage           = true;
+  res.image             = image;
+  res.range             = range;
+  res.concurrent        = concurrent;
+  res.state.writeStages = initial.stages;
+  res.state.writeAccess = initial.access;
+  res.state.layout      = initial.layout;
+  res.state.queue       = physicalQueue(owner);
+  m_resources.push_back(res);
+  m_compiled = false;
+  return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+void TaskGraph::markOutput(ResourceId id, const Access& finalAccess)
+{
+  assert(id < m_resources.size());
+  m_resources[id].isOutput    = true;
+  m_resources[id].finalAccess = finalAccess;
+  m_compiled                  = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Passes
+//
+TaskGraph::PassBuilder TaskGraph::addPass(const std::string& name, QueueType queue, RecordFn record)
+{
+  Pass pass;
+  pass.name   = name;
+  pass.queue  = queue;
+  pass.record = std::move(record);
+  m_passes.push_back(std::move(pass));
+  m_compiled = false;
+  return PassBuilder(this, static_cast<uint32_t>(m_passes.size() - 1));
+}
+
+void TaskGraph::clearPasses()
+{
+  m_passes.clear();
+  m_compiled = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Compilation
+//
+// Batches 0 and 1 are the prologues of the graphics and compute queues, they only hold the
+// release barriers of resources owned by a queue before the graph starts.
+//
+uint32_t TaskGraph::getBatch(std::vector<int32_t>& lastBatchOfQueue, uint32_t queue, bool forceNew)
+{
+  uint32_t last = static_cast<uint32_t>(m_batches.size() - 1);
+  if(!forceNew && m_batches.size() > eQueueCount && m_batches[last].queue == queue)
+  {
+    return last;
+  }
+
+  Batch batch;
+  batch.queue = queue;
+  m_batches.push_back(batch);
+  lastBatchOfQueue[queue] = static_cast<int32_t>(m_batches.size() - 1);
+  return static_cast<uint32_t>(m_batches.size() - 1);
+}
+
+void TaskGraph::addWait(uint32_t consumer, uint32_t producer, vk::PipelineStageFlags stages)
+{
+  if(m_batches[consumer].queue == m_batches[producer].queue)
+    return;
+
+  Batch& prod = m_batches[producer];
+  prod.signals = true;
+  // a later batch of the same queue is covered by the first wait, which then needs its stages too
+  uint32_t waiter = prod.waitedBy >= 0 ? uint32_t(prod.waitedBy) : consumer;
+  prod.waitedBy   = static_cast<int32_t>(waiter);
+
+  Batch& cons = m_batches[waiter];
+  auto   it   = std::find(cons.waitBatches.begin(), cons.waitBatches.end(), producer);
+  if(it == cons.waitBatches.end())
+  {
+    cons.waitBatches.push_back(producer);
+    cons.waitStages.push_back(stages);
+  }
+  else
+  {
+    cons.waitStages[it - cons.waitBatches.begin()] |= stages;
+  }
+}
+
+void TaskGraph::transition(Resource& res, uint32_t batch, Step& step, const Access& access, bool isWrite)
+{
+  State&   s     = m_finalStates[&res - m_resources.data()];
+  uint32_t queue = m_batches[batch].queue;
+
+  vk::ImageLayout newLayout = res.isImage && access.layout != vk::ImageLayout::eUndefined ? access.layout : s.layout;
+  bool            layoutChange = res.isImage && newLayout != s.layout;
+  bool            used         = s.batch >= 0 || s.writeStages || s.readStages;
+
+  Barrier barrier;
+  barrier.id        = static_cast<ResourceId>(&res - m_resources.data());
+  barrier.dstStages = access.stages;
+  barrier.dstAccess = access.access;
+  barrier.oldLayout = s.layout;
+  barrier.newLayout = newLayout;
+
+  if(used && s.queue != queue)
+  {
+    uint32_t producer = s.batch >= 0 ? uint32_t(s.batch) : s.queue;  // prologue of the owning queue
+    addWait(batch, producer, access.stages);
+
+    if(!res.concurrent && m_families[s.queue] != m_families[queue])
+    {
+      Barrier release   = barrier;
+      release.srcStages = s.writeStages | s.readStages;
+      release.srcAccess = s.writeAccess;
+      release.dstStages = vk::PipelineStageFlagBits::eBottomOfPipe;
+      release.dstAccess = {};
+      release.srcFamily = m_families[s.queue];
+      release.dstFamily = m_families[queue];
+      if(!release.srcStages)
+        release.srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+      m_batches[producer].release.push_back(release);
+
+      barrier.srcStages = access.stages;  // chained with the semaphore wait
+      barrier.srcFamily = release.srcFamily;
+      barrier.dstFamily = release.dstFamily;
+      step.barriers.push_back(barrier);
+    }
+    else if(layoutChange)
+    {
+      barrier.srcStages = access.stages;
+      step.barriers.push_back(barrier);
+    }
+
+    // the semaphore made the writes available, later accesses on this queue chain to this one
+    s.writeStages = access.stages;
+    s.writeAccess = {};
+    s.readStages  = {};
+    s.readAccess  = {};
+  }
+  else
+  {
+    bool visible = (access.stages & ~s.readStages) == vk::PipelineStageFlags() && (access.access & ~s.readAccess) == vk::AccessFlags();
+
+    if(s.writeStages && (isWrite || !visible))
+    {
+      barrier.srcStages |= s.writeStages;
+      barrier.srcAccess |= s.writeAccess;
+    }
+    if(isWrite && s.readStages)
+    {
+      barrier.srcStages |= s.readStages;
+    }
+    if(barrier.srcStages || layoutChange)
+    {
+      if(!barrier.srcStages)
+        barrier.srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+      step.barriers.push_back(barrier);
+    }
+  }
+
+  s.queue  = queue;
+  s.batch  = static_cast<int32_t>(batch);
+  s.layout = newLayout;
+  if(isWrite)
+  {
+    s.writeStages = access.stages;
+    s.writeAccess = access.access;
+    s.readStages  = {};
+    s.readAccess  = {};
+  }
+  else
+  {
+    s.readStages |= access.stages;
+    s.readAccess |= access.access;
+  }
+}
+
+void TaskGraph::compile()
+{
+  wait();
+  releaseExecution();
+  m_batches.clear();
+
+  // cull, walking backwards from the outputs
+  std::vector<bool> needed(m_resources.size());
+  std::vector<bool> alive(m_passes.size());
+  for(size_t i = 0; i < m_resources.size(); i++)
+  {
+    needed[i] = m_resources[i].isOutput;
+  }
+  for(size_t p = m_passes.size(); p-- > 0;)
+  {
+    const Pass& pass = m_passes[p];
+    bool        keep = pass.sideEffects;
+    for(const auto& it : pass.accesses)
+    {
+      keep = keep || (it.isWrite && needed[it.id]);
+    }
+    if(!keep)
+      continue;
+
+    alive[p] = true;
+    // a plain write overwrites the resource, earlier writers are not needed for it anymore
+    for(const auto& it : pass.accesses)
+    {
+      if(it.isWrite && !it.isRead)
+        needed[it.id] = false;
+    }
+    for(const auto& it : pass.accesses)
+    {
+      if(it.isRead)
+        needed[it.id] = true;
+    }
+  }
+
+  // batches and synchronization
+  m_finalStates.resize(m_resources.size());
+  for(size_t i = 0; i < m_resources.size(); i++)
+  {
+    m_finalStates[i]       = m_resources[i].state;
+    m_finalStates[i].batch = -1;
+  }
+
+  std::vector<int32_t> lastBatchOfQueue(eQueueCount, -1);
+  for(uint32_t q = 0; q < eQueueCount; q++)
+  {
+    getBatch(lastBatchOfQueue, q, true);
+  }
+
+  m_numActivePasses = 0;
+  for(size_t p = 0; p < m_passes.size(); p++)
+  {
+    if(!alive[p])
+      continue;
+
+    const Pass& pass  = m_passes[p];
+    uint32_t    batch = getBatch(lastBatchOfQueue, physicalQueue(pass.queue), false);
+    Step        step;
+    step.pass = static_cast<int32_t>(p);
+    for(const auto& it : pass.accesses)
+    {
+      transition(m_resources[it.id], batch, step, it.access, it.isWrite);
+    }
+    m_batches[batch].steps.push_back(std::move(step));
+    m_numActivePasses++;
+  }
+
+  // transitions expected outside of the graph
+  for(auto& res : m_resources)
+  {
+    const State& s = m_finalStates[&res - m_resources.data()];
+    if(!res.isOutput || !res.finalAccess.stages || s.batch < 0)
+      continue;
+
+    Step     step;
+    uint32_t batch = static_cast<uint32_t>(s.batch);
+    transition(res, batch, step, res.finalAccess, false);
+    m_batches[batch].release.insert(m_batches[batch].release.end(), step.barriers.begin(), step.barriers.end());
+  }
+
+  // A prologue without release barriers is not submitted: there is no GPU work to wait for
+  for(uint32_t q = 0; q < eQueueCount; q++)
+  {
+    Batch& prologue = m_batches[q];
+    if(!prologue.release.empty() || prologue.waitedBy < 0)
+      continue;
+
+    Batch& cons = m_batches[prologue.waitedBy];
+    auto   it   = std::find(cons.waitBatches.begin(), cons.waitBatches.end(), q);
+    if(it != cons.waitBatches.end())
+    {
+      cons.waitStages.erase(cons.waitStages.begin() + (it - cons.waitBatches.begin()));
+      cons.waitBatches.erase(it);
+    }
+    prologue.signals  = false;
+    prologue.waitedBy = -1;
+  }
+
+  m_compiled = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Execution
+//
+void TaskGraph::recordBarriers(vk::CommandBuffer cmd, const std::vector<Barrier>& barriers) const
+{
+  // one vkCmdPipelineBarrier per distinct pair of stage masks
+  std::vector<bool> done(barriers.size());
+  for(size_t i = 0; i < barriers.size(); i++)
+  {
+    if(done[i])
+      continue;
+
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier>  imageBarriers;
+    for(size_t j = i; j < barriers.size(); j++)
+    {
+      const Barrier& b = barriers[j];
+      if(done[j] || b.srcStages != barriers[i].srcStages || b.dstStages != barriers[i].dstStages)
+        continue;
+      done[j] = true;
+
+      const Resource& res = m_resources[b.id];
+      if(res.isImage)
+      {
+        imageBarriers.push_back({b.srcAccess, b.dstAccess, b.oldLayout, b.newLayout, b.srcFamily, b.dstFamily, res.image, res.range});
+      }
+      else
+      {
+        bufferBarriers.push_back({b.srcAccess, b.dstAccess, b.srcFamily, b.dstFamily, res.buffer, 0, VK_WHOLE_SIZE});
+      }
+    }
+    cmd.pipelineBarrier(barriers[i].srcStages, barriers[i].dstStages, {}, nullptr, bufferBarriers, imageBarriers);
+  }
+}
+
+void TaskGraph::execute()
+{
+  if(!m_compiled)
+  {
+    compile();
+  }
+
+  // last non-empty batch of each queue gets a fence
+  std::vector<int32_t> lastBatch(eQueueCount, -1);
+  for(size_t b = 0; b < m_batches.size(); b++)
+  {
+    if(!m_batches[b].steps.empty() || !m_batches[b].release.empty())
+      lastBatch[m_batches[b].queue] = static_cast<int32_t>(b);
+  }
+
+  for(size_t b = 0; b < m_batches.size(); b++)
+  {
+    Batch& batch = m_batches[b];
+    if(batch.steps.empty() && batch.release.empty())
+      continue;
+
+    batch.cmd = m_cmdPools[batch.queue].createCommandBuffer(vk::CommandBufferLevel::ePrimary, true,
+                                                            vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    m_cmds[batch.queue].push_back(batch.cmd);
+    for(const auto& step : batch.steps)
+    {
+      if(!step.barriers.empty())
+        recordBarriers(batch.cmd, step.barriers);
+      if(step.pass >= 0 && m_passes[step.pass].record)
+        m_passes[step.pass].record(batch.cmd);
+    }
+    if(!batch.release.empty())
+      recordBarriers(batch.cmd, batch.release);
+    batch.cmd.end();
+
+    std::vector<vk::Semaphore> waits;
+    for(auto producer : batch.waitBatches)
+    {
+      waits.push_back(m_batches[producer].semaphore);
+    }
+    if(batch.signals)
+    {
+      batch.semaphore = m_device.createSemaphore({});
+      m_semaphores.push_back(batch.semaphore);
+    }
+
+    vk::Fence fence;
+    if(lastBatch[batch.queue] == int32_t(b))
+    {
+      fence = m_device.createFence({});
+      m_fences.push_back(fence);
+    }
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.setWaitSemaphoreCount(static_cast<uint32_t>(waits.size()));
+    submitInfo.setPWaitSemaphores(waits.data());
+    submitInfo.setPWaitDstStageMask(batch.waitStages.data());
+    submitInfo.setCommandBufferCount(1);
+    submitInfo.setPCommandBuffers(&batch.cmd);
+    submitInfo.setSignalSemaphoreCount(batch.signals ? 1 : 0);
+    submitInfo.setPSignalSemaphores(&batch.semaphore);
+    m_queues[batch.queue].submit(submitInfo, fence);
+  }
+
+  // the next execution starts from where this one ends, which needs a new compilation
+  for(size_t i = 0; i < m_resources.size(); i++)
+  {
+    m_resources[i].state = m_finalStates[i];
+  }
+  m_compiled = false;
+}
+
+bool TaskGraph::isDone()
+{
+  for(auto fence : m_fences)
+  {
+    if(m_device.getFenceStatus(fence) != vk::Result::eSuccess)
+      return false;
+  }
+  return true;
+}
+
+void TaskGraph::wait()
+{
+  if(!m_fences.empty())
+  {
+    m_device.waitForFences(m_fences, VK_TRUE, UINT64_MAX);
+  }
+}
+
+void TaskGraph::releaseExecution()
+{
+  for(auto fence : m_fences)
+  {
+    m_device.destroy(fence);
+  }
+  for(auto semaphore : m_semaphores)
+  {
+    m_device.destroy(semaphore);
+  }
+  m_fences.clear();
+  m_semaphores.clear();
+  for(uint32_t q = 0; q < eQueueCount; q++)
+  {
+    if(!m_cmds[q].empty())
+      m_cmdPools[q].destroy(m_cmds[q]);
+    m_cmds[q].clear();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void TaskGraph::printCompiled() const
+{
+  static const char* queueNames[eQueueCount] = {"graphics", "compute"};
+  for(size_t b = 0; b < m_batches.size(); b++)
+  {
+    const Batch& batch = m_batches[b];
+    if(batch.steps.empty() && batch.release.empty())
+      continue;
+
+    LOGI("batch %d on %s queue%s\n", int(b), queueNames[batch.queue], batch.signals ? ", signals" : "");
+    for(size_t w = 0; w < batch.waitBatches.size(); w++)
+    {
+      LOGI("  wait batch %d at 0x%x\n", int(batch.waitBatches[w]), uint32_t(VkPipelineStageFlags(batch.waitStages[w])));
+    }
+    for(const auto& step : batch.steps)
+    {
+      for(const auto& barrier : step.barriers)
+      {
+        LOGI("  barrier %s%s\n", m_resources[barrier.id].name.c_str(),
+             barrier.srcFamily != barrier.dstFamily ? " (acquire)" : "");
+      }
+      LOGI("  pass %s\n", m_passes[step.pass].name.c_str());
+    }
+    for(const auto& barrier : batch.release)
+    {
+      LOGI("  barrier %s%s\n", m_resources[barrier.id].name.c_str(),
+           barrier.srcFamily != barrier.dstFamily ? " (release)" : "");
+    }
+  }
+}
+
+}  // namespace nvvk
@@ -0,0 +1,274 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "commands_vk.hpp"
+
+namespace nvvk {
+
+/**
+# class nvvk::TaskGraph
+
+A small render/compute graph. Passes are added in execution order and
+declare which imported buffers and images they read and write; the graph
+then:
+
+- culls passes whose results are never used, a pass is kept if it writes
+  a resource marked as output, or a resource read by a kept pass, or if
+  it was flagged with `sideEffects()`
+- runs graphics passes on the graphics queue and compute passes on the
+  compute queue (on the graphics queue if both are the same)
+- groups consecutive passes of a queue into one command buffer and submit
+- inserts pipeline barriers and image layout transitions between passes
+- inserts queue family ownership transfers (release/acquire) and binary
+  semaphores when a resource changes queue
+
+The state of each resource (layout, owning queue, last access) is carried
+over from one execution to the next, so a graph can be rebuilt every
+frame with `clearPasses()` while keeping its imported resources.
+Resources created with `VK_SHARING_MODE_CONCURRENT` should be imported
+with `concurrent = true` to skip the ownership transfers.
+
+`execute()` waits for the previous execution before reusing its command
+buffers and semaphores; use `isDone()` to poll without blocking.
+
+Example :
+~~~ C++
+nvvk::TaskGraph graph;
+graph.init(m_device, m_queue, m_graphicsQueueIndex, m_queue_comp, m_computeQueueIndex);
+auto counter = graph.importBuffer("counter", m_counterBuffer);
+graph.markOutput(counter, {vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead});
+
+graph.addComputePass("clear", [&](vk::CommandBuffer cmd) { cmd.fillBuffer(m_counterBuffer, 0, VK_WHOLE_SIZE, 0); })
+    .write(counter, {vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite});
+graph.addComputePass("count", [&](vk::CommandBuffer cmd) { ... cmd.dispatch(...); })
+    .readWrite(counter, {vk::PipelineStageFlagBits::eComputeShader,
+                         vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite});
+graph.execute();
+...
+if(graph.isDone()) { ... read the counter ... }
+~~~
+*/
+
+class TaskGraph
+{
+public:
+  using ResourceId                         = uint32_t;
+  static const ResourceId INVALID_RESOURCE = ~0u;
+
+  enum QueueType
+  {
+    eGraphics = 0,
+    eCompute  = 1,
+    eQueueCount
+  };
+
+  // How a pass (or the outside world, for markOutput) touches a resource
+  struct Access
+  {
+    vk::PipelineStageFlags stages;
+    vk::AccessFlags        access;
+    vk::ImageLayout        layout = vk::ImageLayout::eUndefined;  // images only
+  };
+
+  using RecordFn = std::function<void(vk::CommandBuffer)>;
+
+  class PassBuilder
+  {
+  public:
+    PassBuilder& read(ResourceId id, const Access& access);
+    PassBuilder& write(ResourceId id, const Access& access);
+    PassBuilder& readWrite(ResourceId id, const Access& access);
+    // keep the pass even if nothing reads its results
+    PassBuilder& sideEffects();
+
+  private:
+    friend class TaskGraph;
+    PassBuilder(TaskGraph* graph, uint32_t pass)
+        : m_graph(graph)
+        , m_pass(pass)
+    {
+    }
+    TaskGraph* m_graph;
+    uint32_t   m_pass;
+  };
+
+  TaskGraph(TaskGraph const&) = delete;
+  TaskGraph& operator=(TaskGraph const&) = delete;
+
+  TaskGraph() = default;
+  ~TaskGraph() { deinit(); }
+
+  void init(vk::Device device, vk::Queue graphicsQueue, uint32_t graphicsFamily, vk::Queue computeQueue, uint32_t computeFamily);
+  void deinit();
+
+  // `initial` describes the last access before the graph takes over, its layout is the current layout
+  ResourceId importBuffer(const std::string& name,
+                          vk::Buffer         buffer,
+                          const Access&      initial    = {},
+                          QueueType          owner      = eGraphics,
+                          bool               concurrent = false);
+  ResourceId importImage(const std::string&               name,
+                         vk::Image                        image,
+                         const vk::ImageSubresourceRange& range,
+                         const Access&                    initial    = {},
+                         QueueType                        owner      = eGraphics,
+                         bool                             concurrent = false);
+
+  // Resource read outside of the graph: passes writing it are kept, and it is transitioned
+  // to `finalAccess` at the end of the graph if the stages are non-zero
+  void markOutput(ResourceId id, const Access& finalAccess = {});
+
+  PassBuilder addGraphicsPass(const std::string& name, RecordFn record) { return addPass(name, eGraphics, record); }
+  PassBuilder addComputePass(const std::string& name, RecordFn record) { return addPass(name, eCompute, record); }
+  PassBuilder addPass(const std::string& name, QueueType queue, RecordFn record);
+
+  // removes all passes, the resources and their current state are kept
+  void clearPasses();
+
+  // culls, batches and derives the synchronization from the current resource states,
+  // waits for the previous execution. Called by execute() unless done just before.
+  void compile();
+  // records and submits all batches
+  void execute();
+
+  bool isDone();
+  void wait();
+
+  // number of passes left after culling, for debugging
+  uint32_t getNumActivePasses() const { return m_numActivePasses; }
+  // prints the batches, barriers and semaphores of the compiled graph
+  void printCompiled() const;
+
+private:
+  struct State
+  {
+    vk::PipelineStageFlags writeStages;
+    vk::AccessFlags        writeAccess;
+    vk::PipelineStageFlags readStages;  // reads since the last write
+    vk::AccessFlags        readAccess;
+    vk::ImageLayout        layout = vk::ImageLayout::eUndefined;
+    uint32_t               queue  = eGraphics;
+    int32_t                batch  = -1;  // last batch touching the resource, -1: before the graph
+  };
+
+  struct Resource
+  {
+    std::string               name;
+    bool                      isImage{false};
+    bool                      concurrent{false};
+    vk::Buffer                buffer;
+    vk::Image                 image;
+    vk::ImageSubresourceRange range;
+    State                     state;
+    bool                      isOutput{false};
+    Access                    finalAccess;
+  };
+
+  struct PassAccess
+  {
+    ResourceId id;
+    Access     access;
+    bool       isWrite;
+    bool       isRead;
+  };
+
+  struct Pass
+  {
+    std::string             name;
+    QueueType               queue;
+    RecordFn                record;
+    std::vector<PassAccess> accesses;
+    bool                    sideEffects{false};
+  };
+
+  struct Barrier
+  {
+    vk::PipelineStageFlags srcStages;
+    vk::PipelineStageFlags dstStages;
+    vk::AccessFlags        srcAccess;
+    vk::AccessFlags        dstAccess;
+    vk::ImageLayout        oldLayout;
+    vk::ImageLayout        newLayout;
+    uint32_t               srcFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t               dstFamily = VK_QUEUE_FAMILY_IGNORED;
+    ResourceId             id;
+  };
+
+  struct Step
+  {
+    int32_t              pass = -1;  // -1: barriers only
+    std::vector<Barrier> barriers;   // recorded before the pass
+  };
+
+  struct Batch
+  {
+    uint32_t                            queue;
+    std::vector<Step>                   steps;
+    std::vector<Barrier>                release;  // recorded after the last pass
+    std::vector<uint32_t>               waitBatches;
+    std::vector<vk::PipelineStageFlags> waitStages;
+    bool                                signals{false};
+    int32_t                             waitedBy{-1};  // a binary semaphore has a single waiter
+    vk::Semaphore                       semaphore;
+    vk::CommandBuffer                   cmd;
+  };
+
+  uint32_t physicalQueue(uint32_t queue) const { return m_queues[queue] == m_queues[eGraphics] ? eGraphics : queue; }
+  uint32_t getBatch(std::vector<int32_t>& lastBatchOfQueue, uint32_t queue, bool forceNew);
+  void     addWait(uint32_t consumer, uint32_t producer, vk::PipelineStageFlags stages);
+  void     transition(Resource& res, uint32_t batch, Step& step, const Access& access, bool isWrite);
+  void     recordBarriers(vk::CommandBuffer cmd, const std::vector<Barrier>& barriers) const;
+  void     releaseExecution();
+
+  vk::Device  m_device;
+  vk::Queue   m_queues[eQueueCount];
+  uint32_t    m_families[eQueueCount]{};
+  CommandPool m_cmdPools[eQueueCount];
+
+  std::vector<Resource> m_resources;
+  std::vector<Pass>     m_passes;
+
+  // compiled
+  bool                  m_compiled{false};
+  uint32_t              m_numActivePasses{0};
+  std::vector<Batch>    m_batches;
+  std::vector<State>    m_finalStates;
+
+  // in flight
+  std::vector<vk::Fence>         m_fences;
+  std::vector<vk::Semaphore>     m_semaphores;
+  std::vector<vk::CommandBuffer> m_cmds[eQueueCount];
+};
+
+}  // namespace nvvk
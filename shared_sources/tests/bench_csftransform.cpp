@@ -0,0 +1,166 @@
+/* Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Times CSFile_transform against CSFile_transformParallel on generated
+// hierarchies and checks that both compute the same world matrices.
+//
+// usage: bench_csftransform [numNodes] [repeats]
+
+#include <algorithm>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "fileformats/cadscenefile.h"
+
+namespace {
+
+struct Scene
+{
+  CSFile               csf;
+  std::vector<CSFNode> nodes;
+  std::vector<int>     children;
+};
+
+// `parents[i]` is the parent of node i + 1, node 0 is the root, parents come before their children
+void buildScene(Scene& scene, const std::vector<int>& parents)
+{
+  size_t numNodes = parents.size() + 1;
+
+  std::vector<int> numChildren(numNodes, 0);
+  for(int parent : parents)
+    numChildren[parent]++;
+  std::vector<int> firstChild(numNodes, 0);
+  for(size_t i = 1; i < numNodes; i++)
+    firstChild[i] = firstChild[i - 1] + numChildren[i - 1];
+
+  scene.children.resize(parents.size());
+  scene.nodes.assign(numNodes, CSFNode());
+  std::vector<int> filled(numNodes, 0);
+  for(size_t i = 0; i < numNodes; i++)
+  {
+    CSFNode& node = scene.nodes[i];
+    memset(&node, 0, sizeof(CSFNode));
+    CSFMatrix_identity(node.objectTM);
+    node.objectTM[0]  = 1.0f + float(i % 7) * 0.001f;
+    node.objectTM[5]  = 1.0f - float(i % 5) * 0.001f;
+    node.objectTM[12] = float(i % 13) * 0.1f;
+    node.objectTM[13] = float(i % 11) * 0.1f;
+    node.geometryIDX  = -1;
+    node.numChildren  = numChildren[i];
+    node.children     = scene.children.data() + firstChild[i];
+    if(i > 0)
+    {
+      int parent = parents[i - 1];
+      scene.children[firstChild[parent] + filled[parent]++] = int(i);
+    }
+  }
+
+  memset(&scene.csf, 0, sizeof(CSFile));
+  scene.csf.fileFlags = CADSCENEFILE_FLAG_UNIQUENODES;
+  scene.csf.numNodes  = int(numNodes);
+  scene.csf.rootIDX   = 0;
+  scene.csf.nodes     = scene.nodes.data();
+}
+
+template <class F>
+double bestTime(int repeats, F&& fn)
+{
+  double best = 0.0;
+  for(int r = 0; r < repeats; r++)
+  {
+    auto begin = std::chrono::high_resolution_clock::now();
+    fn();
+    double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+    best        = r == 0 ? time : std::min(best, time);
+  }
+  return best;
+}
+
+bool run(const char* name, const std::vector<int>& parents, int repeats)
+{
+  Scene scene;
+  buildScene(scene, parents);
+
+  double serial = bestTime(repeats, [&] { CSFile_transform(&scene.csf); });
+  std::vector<float> reference(scene.nodes.size() * 16);
+  for(size_t i = 0; i < scene.nodes.size(); i++)
+    memcpy(&reference[i * 16], scene.nodes[i].worldTM, sizeof(float) * 16);
+
+  for(CSFNode& node : scene.nodes)
+    memset(node.worldTM, 0, sizeof(node.worldTM));
+  double parallel = bestTime(repeats, [&] { CSFile_transformParallel(&scene.csf); });
+
+  bool same = true;
+  for(size_t i = 0; i < scene.nodes.size(); i++)
+    same = same && memcmp(&reference[i * 16], scene.nodes[i].worldTM, sizeof(float) * 16) == 0;
+
+  printf("%-8s %9zu nodes: transform %8.3f ms, transformParallel %8.3f ms, speedup %5.2fx%s\n", name,
+         scene.nodes.size(), serial, parallel, serial / parallel, same ? "" : ", DIFFERENT RESULTS");
+  return same;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  int numNodes = argc > 1 ? atoi(argv[1]) : 1000000;
+  int repeats  = argc > 2 ? atoi(argv[2]) : 5;
+  if(numNodes < 2 || repeats < 1)
+  {
+    fprintf(stderr, "usage: %s [numNodes] [repeats]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<int> parents(numNodes - 1);
+  bool             same = true;
+
+  // every node below the root
+  std::fill(parents.begin(), parents.end(), 0);
+  same = run("flat", parents, repeats) && same;
+
+  // groups of 1000 nodes below the root
+  for(int i = 1; i < numNodes; i++)
+    parents[i - 1] = i <= 1000 ? 0 : 1 + (i - 1001) % 1000;
+  same = run("wide", parents, repeats) && same;
+
+  // 64 chains below the root
+  for(int i = 1; i < numNodes; i++)
+    parents[i - 1] = i <= 64 ? 0 : i - 64;
+  same = run("deep", parents, repeats) && same;
+
+  // binary tree
+  for(int i = 1; i < numNodes; i++)
+    parents[i - 1] = (i - 1) / 2;
+  same = run("binary", parents, repeats) && same;
+
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,219 @@
+/* Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Checks the invariants of nvh::MeshletBuilder that the cluster culling
+// relies on: identical results for the same input, vertex and triangle
+// limits, every input triangle in exactly one meshlet, and conservative
+// bounding spheres and normal cones.
+
+#include "nvh/meshletbuilder.hpp"
+#include "tests/check.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Vertex
+{
+  float pos[3];
+  float uv[2];
+};
+
+// UV sphere, the seam column and the poles have one vertex per segment as an exporter writes them
+void buildSphere(uint32_t segments, uint32_t rings, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+  for(uint32_t r = 0; r <= rings; r++)
+  {
+    for(uint32_t s = 0; s <= segments; s++)
+    {
+      float u     = float(s) / float(segments);
+      float v     = float(r) / float(rings);
+      float theta = u * 6.2831853f;
+      float phi   = v * 3.14159265f;
+      vertices.push_back({{sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta)}, {u, v}});
+    }
+  }
+  for(uint32_t r = 0; r < rings; r++)
+  {
+    for(uint32_t s = 0; s < segments; s++)
+    {
+      uint32_t a = r * (segments + 1) + s;
+      uint32_t b = a + segments + 1;
+      // outward facing, counter-clockwise
+      if(r > 0)
+        indices.insert(indices.end(), {a, a + 1, b});
+      if(r + 1 < rings)
+        indices.insert(indices.end(), {a + 1, b + 1, b});
+    }
+  }
+}
+
+bool isEqual(const nvh::MeshletBuilder::Result& a, const nvh::MeshletBuilder::Result& b)
+{
+  if(a.meshlets.size() != b.meshlets.size() || a.vertices != b.vertices || a.primitiveIndices != b.primitiveIndices
+     || a.sourceTriangles != b.sourceTriangles)
+    return false;
+  for(size_t m = 0; m < a.meshlets.size(); m++)
+  {
+    const nvh::MeshletBuilder::Meshlet& ma = a.meshlets[m];
+    const nvh::MeshletBuilder::Meshlet& mb = b.meshlets[m];
+    if(ma.vertexOffset != mb.vertexOffset || ma.vertexCount != mb.vertexCount || ma.triangleOffset != mb.triangleOffset
+       || ma.triangleCount != mb.triangleCount || memcmp(ma.center, mb.center, sizeof(ma.center)) != 0
+       || ma.radius != mb.radius || memcmp(ma.coneAxis, mb.coneAxis, sizeof(ma.coneAxis)) != 0
+       || ma.coneCutoff != mb.coneCutoff)
+      return false;
+  }
+  return true;
+}
+
+float dot(const float a[3], const float b[3])
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+int checkResult(const std::vector<Vertex>&           vertices,
+                const std::vector<uint32_t>&         indices,
+                const nvh::MeshletBuilder::Settings& settings,
+                const nvh::MeshletBuilder::Result&   result)
+{
+  size_t numTriangles = indices.size() / 3;
+  CHECK(result.sourceTriangles.size() == numTriangles);
+  CHECK(result.primitiveIndices.size() == numTriangles * 3);
+
+  std::vector<int> seen(numTriangles, 0);
+  uint32_t         vertexOffset   = 0;
+  uint32_t         triangleOffset = 0;
+  for(const nvh::MeshletBuilder::Meshlet& meshlet : result.meshlets)
+  {
+    // limits, meshlets are packed one after the other
+    CHECK(meshlet.vertexCount > 0 && meshlet.vertexCount <= settings.maxVertices);
+    CHECK(meshlet.triangleCount > 0 && meshlet.triangleCount <= settings.maxTriangles);
+    CHECK(meshlet.vertexOffset == vertexOffset);
+    CHECK(meshlet.triangleOffset == triangleOffset);
+    vertexOffset += meshlet.vertexCount;
+    triangleOffset += meshlet.triangleCount;
+    CHECK(vertexOffset <= result.vertices.size());
+
+    for(uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+      uint32_t source = result.sourceTriangles[meshlet.triangleOffset + t];
+      CHECK(source < numTriangles);
+      seen[source]++;
+
+      // the local indices give back the input triangle, corners in the same order
+      const float* p[3];
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        uint8_t local = result.primitiveIndices[(meshlet.triangleOffset + t) * 3 + k];
+        CHECK(local < meshlet.vertexCount);
+        CHECK(result.vertices[meshlet.vertexOffset + local] == indices[source * 3 + k]);
+        p[k] = vertices[indices[source * 3 + k]].pos;
+
+        // inside the bounding sphere
+        float d[3] = {p[k][0] - meshlet.center[0], p[k][1] - meshlet.center[1], p[k][2] - meshlet.center[2]};
+        CHECK(sqrtf(dot(d, d)) <= meshlet.radius * 1.0001f + 1e-6f);
+      }
+
+      // inside the normal cone
+      float e1[3]  = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+      float e2[3]  = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+      float n[3]   = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      float length = sqrtf(dot(n, n));
+      if(length > 0.f && meshlet.coneCutoff < 1.f)
+      {
+        float cosine = dot(n, meshlet.coneAxis) / length;
+        CHECK(cosine >= sqrtf(1.f - meshlet.coneCutoff * meshlet.coneCutoff) - 1e-4f);
+      }
+    }
+
+    // from cameras around the mesh, a meshlet found backfacing only has backfacing triangles
+    for(int c = 0; c < 64; c++)
+    {
+      float camera[3] = {4.f * cosf(float(c) * 0.7f), 4.f * sinf(float(c) * 1.3f), 4.f * cosf(float(c) * 2.1f)};
+      float view[3]   = {meshlet.center[0] - camera[0], meshlet.center[1] - camera[1], meshlet.center[2] - camera[2]};
+      if(dot(view, meshlet.coneAxis) < meshlet.coneCutoff * sqrtf(dot(view, view)) + meshlet.radius)
+        continue;
+      for(uint32_t t = 0; t < meshlet.triangleCount; t++)
+      {
+        uint32_t     source   = result.sourceTriangles[meshlet.triangleOffset + t];
+        const float* p0       = vertices[indices[source * 3 + 0]].pos;
+        const float* p1       = vertices[indices[source * 3 + 1]].pos;
+        const float* p2       = vertices[indices[source * 3 + 2]].pos;
+        float        e1[3]    = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float        e2[3]    = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float        n[3]     = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float        toTri[3] = {p0[0] - camera[0], p0[1] - camera[1], p0[2] - camera[2]};
+        CHECK(dot(n, toTri) >= -1e-6f);
+      }
+    }
+  }
+  CHECK(vertexOffset == result.vertices.size());
+  CHECK(triangleOffset == numTriangles);
+  for(size_t t = 0; t < numTriangles; t++)
+    CHECK(seen[t] == 1);
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  std::vector<Vertex>   vertices;
+  std::vector<uint32_t> indices;
+  buildSphere(48, 24, vertices, indices);
+
+  nvh::MeshletBuilder::Settings limits[] = {{64, 124}, {32, 32}, {128, 256}, {256, 512}, {3, 1}};
+  for(const nvh::MeshletBuilder::Settings& settings : limits)
+  {
+    nvh::MeshletBuilder::Result first, second;
+    nvh::MeshletBuilder(settings).build(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), first);
+    CHECK(!first.meshlets.empty());
+    CHECK_SUCCESS(checkResult(vertices, indices, settings, first));
+
+    // same input, same meshlets: also when the result is reused
+    nvh::MeshletBuilder(settings).build(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), second);
+    CHECK(isEqual(first, second));
+    nvh::MeshletBuilder(settings).build(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), second);
+    CHECK(isEqual(first, second));
+  }
+
+  // the 8 bit local indices cap the vertices, a single triangle fills a meshlet when it must
+  {
+    nvh::MeshletBuilder::Settings settings{1000, 1000};
+    nvh::MeshletBuilder::Result   result;
+    nvh::MeshletBuilder(settings).build(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), result);
+    for(const nvh::MeshletBuilder::Meshlet& meshlet : result.meshlets)
+      CHECK(meshlet.vertexCount <= 256);
+    nvh::MeshletBuilder::Settings capped{256, 1000};
+    CHECK_SUCCESS(checkResult(vertices, indices, capped, result));
+  }
+
+  printf("test_meshletbuilder: passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/* Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Simplifies a curved grid with a uv seam down the middle and checks the
+// guarantees of nvh::MeshSimplifier: triangle targets, error bound, kept
+// borders and seams.
+
+#include "nvh/meshsimplifier.hpp"
+#include "tests/check.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+struct Vertex
+{
+  float pos[3];
+  float uv[2];
+};
+
+const uint32_t kGrid = 32;  // quads per side, the seam is the column at kGrid / 2
+
+float height(float x, float y)
+{
+  return 0.1f * sinf(x * 3.14159265f) * sinf(y * 3.14159265f);
+}
+
+// Unit square in xy, the columns left of the seam use u in [0,0.5], the
+// columns right of it u in [1.5,2]: the seam column exists twice
+void buildGrid(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+  const uint32_t half = kGrid / 2;
+  auto           add  = [&](uint32_t x, uint32_t y, bool right) {
+    float fx = float(x) / float(kGrid);
+    float fy = float(y) / float(kGrid);
+    vertices.push_back({{fx, fy, height(fx, fy)}, {right ? fx + 1.0f : fx, fy}});
+    return uint32_t(vertices.size() - 1);
+  };
+
+  std::vector<uint32_t> left((half + 1) * (kGrid + 1));
+  std::vector<uint32_t> right((half + 1) * (kGrid + 1));
+  for(uint32_t y = 0; y <= kGrid; y++)
+  {
+    for(uint32_t x = 0; x <= half; x++)
+    {
+      left[y * (half + 1) + x]  = add(x, y, false);
+      right[y * (half + 1) + x] = add(x + half, y, true);
+    }
+  }
+
+  for(const std::vector<uint32_t>* side : {&left, &right})
+  {
+    for(uint32_t y = 0; y < kGrid; y++)
+    {
+      for(uint32_t x = 0; x < half; x++)
+      {
+        uint32_t a = (*side)[y * (half + 1) + x];
+        uint32_t b = (*side)[y * (half + 1) + x + 1];
+        uint32_t c = (*side)[(y + 1) * (half + 1) + x];
+        uint32_t d = (*side)[(y + 1) * (half + 1) + x + 1];
+        indices.insert(indices.end(), {a, b, d, a, d, c});
+      }
+    }
+  }
+}
+
+bool isBorder(const Vertex& v)
+{
+  return v.pos[0] == 0.0f || v.pos[0] == 1.0f || v.pos[1] == 0.0f || v.pos[1] == 1.0f;
+}
+
+bool isRight(const Vertex& v)
+{
+  return v.uv[0] >= 1.0f;
+}
+
+// Signed area of the triangle projected on xy
+float area(const Vertex& a, const Vertex& b, const Vertex& c)
+{
+  return 0.5f * ((b.pos[0] - a.pos[0]) * (c.pos[1] - a.pos[1]) - (c.pos[0] - a.pos[0]) * (b.pos[1] - a.pos[1]));
+}
+
+int checkLevels(const std::vector<Vertex>&                     vertices,
+                const std::vector<nvh::MeshSimplifier::Level>& levels,
+                const nvh::MeshSimplifier::Settings&           settings)
+{
+  bool bounded = settings.maxError != FLT_MAX;
+  CHECK(levels.size() >= 2);
+  CHECK(levels.size() <= settings.maxLevels);
+
+  for(size_t l = 0; l < levels.size(); l++)
+  {
+    const nvh::MeshSimplifier::Level& level     = levels[l];
+    size_t                            triangles = level.indices.size() / 3;
+    CHECK(level.indices.size() % 3 == 0);
+    CHECK(level.sourceTriangles.size() == triangles);
+    CHECK(level.error <= settings.maxError);
+    if(l > 0)
+    {
+      size_t previous = levels[l - 1].indices.size() / 3;
+      // a level stopped by the error bound only has to remove enough triangles
+      CHECK(float(triangles) <= float(previous) * (bounded ? settings.minReduction : settings.reduction));
+    }
+
+    // the borders are kept and no triangle crosses the seam or flips: both
+    // halves still cover exactly their half of the square
+    std::vector<bool> used(vertices.size(), false);
+    float             areas[2] = {0.0f, 0.0f};
+    for(size_t t = 0; t < triangles; t++)
+    {
+      const Vertex& a = vertices[level.indices[t * 3 + 0]];
+      const Vertex& b = vertices[level.indices[t * 3 + 1]];
+      const Vertex& c = vertices[level.indices[t * 3 + 2]];
+      CHECK(isRight(a) == isRight(b) && isRight(a) == isRight(c));
+      CHECK(area(a, b, c) > 0.0f);
+      CHECK(level.sourceTriangles[t] < levels[0].indices.size() / 3);
+      areas[isRight(a) ? 1 : 0] += area(a, b, c);
+      for(uint32_t i = 0; i < 3; i++)
+        used[level.indices[t * 3 + i]] = true;
+    }
+    CHECK(fabsf(areas[0] - 0.5f) < 1e-4f);
+    CHECK(fabsf(areas[1] - 0.5f) < 1e-4f);
+
+    for(size_t v = 0; v < vertices.size(); v++)
+    {
+      // the seam ends are on the border, the rest of the seam may collapse along itself
+      CHECK(!isBorder(vertices[v]) || used[v] || vertices[v].pos[0] == 0.5f);
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  std::vector<Vertex>   vertices;
+  std::vector<uint32_t> indices;
+  buildGrid(vertices, indices);
+
+  // unbounded error: the triangle targets are reached
+  {
+    nvh::MeshSimplifier::Settings settings;
+    settings.maxLevels = 4;
+
+    std::vector<nvh::MeshSimplifier::Level> levels;
+    nvh::MeshSimplifier(settings).buildLevels(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(),
+                                              indices.size(), levels);
+    CHECK(levels.size() == settings.maxLevels);
+    CHECK(levels[0].indices == indices);
+    CHECK(levels[0].error == 0.0f);
+    CHECK_SUCCESS(checkLevels(vertices, levels, settings));
+  }
+
+  // bounded error: simplification stops before the bound is exceeded
+  {
+    nvh::MeshSimplifier::Settings settings;
+    settings.maxLevels = 8;
+    settings.maxError  = 0.002f;
+
+    std::vector<nvh::MeshSimplifier::Level> levels;
+    nvh::MeshSimplifier(settings).buildLevels(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(),
+                                              indices.size(), levels);
+    CHECK(levels.size() < settings.maxLevels);
+    CHECK_SUCCESS(checkLevels(vertices, levels, settings));
+  }
+
+  printf("test_meshsimplifier: passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/* Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Checks the level sizes and the filtering of nvh::MipmapGenerator on known
+// images, and that the SIMD, scalar and threaded paths agree.
+
+#include "nvh/mipmapgenerator.hpp"
+#include "nvh/threadpool.hpp"
+#include "tests/check.hpp"
+
+#include <vector>
+
+namespace {
+
+using Levels = std::vector<std::vector<uint8_t>>;
+
+bool isNear(int a, int b, int tolerance = 1)
+{
+  return a - b <= tolerance && b - a <= tolerance;
+}
+
+// Largest difference between the texels of two mip chains
+int maxDifference(const Levels& a, const Levels& b)
+{
+  int difference = 0;
+  for(size_t l = 0; l < a.size(); l++)
+  {
+    for(size_t i = 0; i < a[l].size(); i++)
+    {
+      int d      = int(a[l][i]) - int(b[l][i]);
+      difference = d > difference ? d : (-d > difference ? -d : difference);
+    }
+  }
+  return difference;
+}
+
+// Checker of texels a and b, in 1x1 squares
+std::vector<uint8_t> checker(uint32_t width, uint32_t height, const uint8_t a[4], const uint8_t b[4])
+{
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
+  for(uint32_t y = 0; y < height; y++)
+    for(uint32_t x = 0; x < width; x++)
+      for(uint32_t c = 0; c < 4; c++)
+        rgba[(size_t(y) * width + x) * 4 + c] = ((x + y) & 1) ? b[c] : a[c];
+  return rgba;
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  CHECK(nvh::MipmapGenerator::getNumLevels(1, 1) == 1);
+  CHECK(nvh::MipmapGenerator::getNumLevels(256, 64) == 9);
+  CHECK(nvh::MipmapGenerator::getNumLevels(5, 3) == 3);
+  CHECK(nvh::MipmapGenerator::getNumLevels(1, 1000) == 10);
+
+  const nvh::MipmapGenerator::Filter filters[] = {nvh::MipmapGenerator::eFilterBox, nvh::MipmapGenerator::eFilterKaiser};
+  for(nvh::MipmapGenerator::Filter filter : filters)
+  {
+    for(bool srgb : {false, true})
+    {
+      nvh::MipmapGenerator::Settings settings;
+      settings.filter = filter;
+      settings.srgb   = srgb;
+      nvh::MipmapGenerator generator(settings);
+
+      // sizes of the levels of a non power of two image, level 0 is a copy
+      const uint8_t        color[4] = {200, 100, 30, 90};
+      std::vector<uint8_t> flat     = checker(37, 12, color, color);
+      Levels               levels;
+      generator.generate(flat.data(), 37, 12, levels);
+      CHECK(levels.size() == nvh::MipmapGenerator::getNumLevels(37, 12));
+      CHECK(levels[0] == flat);
+      for(uint32_t l = 0; l < levels.size(); l++)
+      {
+        uint32_t width  = 37 >> l > 1 ? 37 >> l : 1;
+        uint32_t height = 12 >> l > 1 ? 12 >> l : 1;
+        CHECK(levels[l].size() == size_t(width) * height * 4);
+        // a constant image stays constant
+        for(size_t i = 0; i < levels[l].size(); i++)
+          CHECK(isNear(levels[l][i], color[i % 4]));
+      }
+
+      // black and white checker: its average is mid gray in the space the color is
+      // filtered in, alpha is always filtered as is
+      const uint8_t        black[4] = {0, 0, 0, 0};
+      const uint8_t        white[4] = {255, 255, 255, 255};
+      std::vector<uint8_t> image    = checker(64, 64, black, white);
+      generator.generate(image.data(), 64, 64, levels);
+      const std::vector<uint8_t>& last = levels.back();
+      CHECK(last.size() == 4);
+      // 0.5 linear is 188 in sRGB
+      int gray = srgb ? 188 : 128;
+      for(uint32_t c = 0; c < 3; c++)
+        CHECK(isNear(last[c], gray, 2));
+      CHECK(isNear(last[3], 128, 2));
+      if(filter == nvh::MipmapGenerator::eFilterBox)
+      {
+        // each texel of level 1 averages one black and one white pair
+        for(size_t i = 0; i < levels[1].size(); i++)
+          CHECK(isNear(levels[1][i], i % 4 == 3 ? 128 : gray));
+      }
+
+      // SIMD against scalar, threads against a single thread, on a noisy image
+      std::vector<uint8_t> noise(size_t(123) * 77 * 4);
+      uint32_t             state = 12345;
+      for(uint8_t& v : noise)
+      {
+        state = state * 1664525u + 1013904223u;
+        v     = uint8_t(state >> 24);
+      }
+      Levels simd, scalar, threaded;
+      generator.generate(noise.data(), 123, 77, simd);
+
+      nvh::MipmapGenerator::Settings scalarSettings = settings;
+      scalarSettings.useSimd                        = false;
+      nvh::MipmapGenerator(scalarSettings).generate(noise.data(), 123, 77, scalar);
+      CHECK(maxDifference(simd, scalar) <= 1);
+
+      nvh::ThreadPool                pool(4);
+      nvh::MipmapGenerator::Settings tiledSettings = settings;
+      tiledSettings.tileHeight                     = 4;
+      nvh::MipmapGenerator(tiledSettings, &pool).generate(noise.data(), 123, 77, threaded);
+      CHECK(maxDifference(simd, threaded) == 0);
+    }
+  }
+
+  printf("test_mipmapgenerator: passed\n");
+  return EXIT_SUCCESS;
+}
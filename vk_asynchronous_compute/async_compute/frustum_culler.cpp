@@ -0,0 +1,179 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "frustum_culler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLER_SSE 1
+#include <xmmintrin.h>
+#else
+#define FRUSTUM_CULLER_SSE 0
+#endif
+
+Frustum extractFrustum(const nvmath::mat4f& viewProj)
+{
+  // clip = viewProj * p, inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w
+  const nvmath::vec4f r0 = viewProj.row(0);
+  const nvmath::vec4f r1 = viewProj.row(1);
+  const nvmath::vec4f r2 = viewProj.row(2);
+  const nvmath::vec4f r3 = viewProj.row(3);
+
+  Frustum frustum;
+  frustum.planes[0] = r3 + r0;  // left
+  frustum.planes[1] = r3 - r0;  // right
+  frustum.planes[2] = r3 + r1;  // bottom
+  frustum.planes[3] = r3 - r1;  // top
+  frustum.planes[4] = r2;       // near
+  frustum.planes[5] = r3 - r2;  // far
+  for(auto& plane : frustum.planes)
+  {
+    float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    plane        = plane / length;
+  }
+  return frustum;
+}
+
+CullInstance makeCullInstance(const nvmath::vec3f& bboxMin, const nvmath::vec3f& bboxMax, const nvmath::mat4f& transform, uint32_t objIndex)
+{
+  // The center is transformed, the extent is spread on the world axes by the absolute matrix
+  nvmath::vec3f center = (bboxMin + bboxMax) * 0.5f;
+  nvmath::vec3f extent = (bboxMax - bboxMin) * 0.5f;
+  nvmath::vec3f worldCenter(transform * nvmath::vec4f(center, 1.f));
+  nvmath::vec3f worldExtent;
+  for(int i = 0; i < 3; i++)
+  {
+    worldExtent[i] = std::abs(transform(i, 0)) * extent.x + std::abs(transform(i, 1)) * extent.y
+                     + std::abs(transform(i, 2)) * extent.z;
+  }
+
+  CullInstance instance;
+  instance.bboxMin  = worldCenter - worldExtent;
+  instance.bboxMax  = worldCenter + worldExtent;
+  instance.objIndex = objIndex;
+  instance.scale    = 0.f;
+  for(int i = 0; i < 3; i++)
+  {
+    nvmath::vec3f axis(transform(0, i), transform(1, i), transform(2, i));
+    instance.scale = std::max(instance.scale, nvmath::length(axis));
+  }
+  return instance;
+}
+
+bool isBoxVisible(const Frustum& frustum, const CullInstance& instance)
+{
+  // Distance of the corner the furthest along the normal, outside if it is behind the plane
+  for(const auto& plane : frustum.planes)
+  {
+    float distance = std::max(plane.x * instance.bboxMin.x, plane.x * instance.bboxMax.x)
+                     + std::max(plane.y * instance.bboxMin.y, plane.y * instance.bboxMax.y)
+                     + std::max(plane.z * instance.bboxMin.z, plane.z * instance.bboxMax.z) + plane.w;
+    if(distance < 0.f)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t cullInstances(const Frustum& frustum, const CullInstance* instances, uint32_t count, uint32_t* visible)
+{
+  uint32_t numVisible = 0;
+#if FRUSTUM_CULLER_SSE
+  // Planes transposed in two groups of 4, the last two are padding planes accepting everything
+  alignas(16) float planes[4][8];
+  for(int p = 0; p < 8; p++)
+  {
+    nvmath::vec4f plane = p < 6 ? frustum.planes[p] : nvmath::vec4f(0.f, 0.f, 0.f, 1.f);
+    planes[0][p]        = plane.x;
+    planes[1][p]        = plane.y;
+    planes[2][p]        = plane.z;
+    planes[3][p]        = plane.w;
+  }
+  __m128 nx[2], ny[2], nz[2], nw[2];
+  for(int g = 0; g < 2; g++)
+  {
+    nx[g] = _mm_load_ps(&planes[0][g * 4]);
+    ny[g] = _mm_load_ps(&planes[1][g * 4]);
+    nz[g] = _mm_load_ps(&planes[2][g * 4]);
+    nw[g] = _mm_load_ps(&planes[3][g * 4]);
+  }
+  const __m128 zero = _mm_setzero_ps();
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    const CullInstance& instance = instances[i];
+    const __m128        minX     = _mm_set1_ps(instance.bboxMin.x);
+    const __m128        minY     = _mm_set1_ps(instance.bboxMin.y);
+    const __m128        minZ     = _mm_set1_ps(instance.bboxMin.z);
+    const __m128        maxX     = _mm_set1_ps(instance.bboxMax.x);
+    const __m128        maxY     = _mm_set1_ps(instance.bboxMax.y);
+    const __m128        maxZ     = _mm_set1_ps(instance.bboxMax.z);
+
+    int outside = 0;
+    for(int g = 0; g < 2; g++)
+    {
+      // same operations and order as isBoxVisible, the results are identical
+      __m128 distance = _mm_max_ps(_mm_mul_ps(nx[g], minX), _mm_mul_ps(nx[g], maxX));
+      distance        = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(ny[g], minY), _mm_mul_ps(ny[g], maxY)));
+      distance        = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(nz[g], minZ), _mm_mul_ps(nz[g], maxZ)));
+      distance        = _mm_add_ps(distance, nw[g]);
+      outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, zero));
+    }
+    visible[numVisible] = i;
+    numVisible += outside == 0 ? 1 : 0;
+  }
+#else
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if(isBoxVisible(frustum, instances[i]))
+    {
+      visible[numVisible++] = i;
+    }
+  }
+#endif
+  return numVisible;
+}
+
+uint32_t selectLod(const CullInstance& instance, const float* lodErrors, uint32_t nbLods, const nvmath::mat4f& view, float lodScale)
+{
+  // Distance to the bounding sphere of the box, level 0 from inside
+  nvmath::vec3f center   = (instance.bboxMin + instance.bboxMax) * 0.5f;
+  float         radius   = nvmath::length(instance.bboxMax - instance.bboxMin) * 0.5f;
+  float         distance = nvmath::length(nvmath::vec3f(view * nvmath::vec4f(center, 1.f))) - radius;
+  if(lodScale <= 0.f || distance <= 0.f)
+    return 0;
+
+  uint32_t lod = 0;
+  while(lod + 1 < nbLods && lodErrors[lod + 1] * instance.scale * lodScale <= distance)
+  {
+    lod++;
+  }
+  return lod;
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <cstdint>
+
+#include <nvmath/nvmath.h>
+
+//--------------------------------------------------------------------------------------------------
+// Frustum culling of the instances, the CPU reference of shaders/cull.comp
+// - each instance is reduced to its world space bounding box, computed once from the model
+//   extents and the instance transform
+// - a box is visible unless it is entirely on the outer side of one of the 6 planes
+// - the level of detail of a visible instance is the coarsest one whose error, projected at
+//   the distance of the box, stays under a given number of pixels
+//
+// `CullInstance` and `Frustum` are uploaded as is, their layout must match cull.comp.
+// The results of cullInstances() and of the shader are the same set of instances, only the
+// order of the survivors differs (the shader compacts them with atomics).
+//
+struct CullInstance
+{
+  nvmath::vec3f bboxMin;
+  uint32_t      objIndex{0};  // model of the instance, selects its draw region
+  nvmath::vec3f bboxMax;
+  float         scale{1.f};   // largest scale of the transform, for the errors of the levels of detail
+};
+static_assert(sizeof(CullInstance) == 32, "must match CullInstance in cull.comp");
+
+// Planes are (normal, distance), with the normals pointing inside
+struct Frustum
+{
+  nvmath::vec4f planes[6];
+};
+
+// Planes of the clip volume of `viewProj` (Vulkan depth range [0, 1]), normalized
+Frustum extractFrustum(const nvmath::mat4f& viewProj);
+
+// World space box of the local box [bboxMin, bboxMax] transformed by `transform`
+CullInstance makeCullInstance(const nvmath::vec3f& bboxMin, const nvmath::vec3f& bboxMax, const nvmath::mat4f& transform, uint32_t objIndex);
+
+// Scalar test, written as in cull.comp
+bool isBoxVisible(const Frustum& frustum, const CullInstance& instance);
+
+// Writes the indices of the visible instances in `visible` (room for `count`), in increasing
+// order, and returns their number. Uses SSE when available, 4 planes are tested at once.
+uint32_t cullInstances(const Frustum& frustum, const CullInstance* instances, uint32_t count, uint32_t* visible);
+
+// Level of detail of the instance among `nbLods` levels of increasing model space errors.
+// `lodScale` is the pixels covered by one unit at a distance of one, divided by the allowed
+// error in pixels; 0 always selects level 0.
+uint32_t selectLod(const CullInstance& instance, const float* lodErrors, uint32_t nbLods, const nvmath::mat4f& view, float lodScale);
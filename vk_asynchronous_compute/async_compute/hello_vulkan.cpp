@@ -25,6 +25,11 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "VulkanHelper.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
 #include <sstream>
 #include <vulkan/vulkan.hpp>
 
@@ -43,6 +48,11 @@ extern std::vector<std::string> defaultSearchPaths;
 
 #include "nvh/alignment.hpp"
 #include "nvh/fileoperations.hpp"
+#include "nvh/meshletbuilder.hpp"
+#include "nvh/meshsimplifier.hpp"
+#include "nvh/misc.hpp"
+#include "nvh/radixsort.hpp"
+#include "nvpsystem.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/renderpasses_vk.hpp"
 #include "nvvk/shaders_vk.hpp"
@@ -59,6 +69,58 @@ struct CameraMatrices
   nvmath::mat4f projInverse;
 };
 
+// Camera of the frame, shared by the uniform buffer and the culling
+static CameraMatrices getCameraMatrices(const vk::Extent2D& size)
+{
+  const float    aspectRatio = size.width / static_cast<float>(size.height);
+  CameraMatrices matrices    = {};
+  matrices.view              = CameraManip.getMatrix();
+  matrices.proj = nvmath::perspectiveVK(CameraManip.getFov(), aspectRatio, 0.1f, 1000.0f);
+  // matrices.proj[1][1] *= -1;  // Inverting Y for Vulkan (not needed with perspectiveVK).
+  matrices.viewInverse = nvmath::invert(matrices.view);
+  // #VKRay
+  matrices.projInverse = nvmath::invert(matrices.proj);
+  return matrices;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Hash of the geometry, materials and textures of a loaded OBJ file, different seeds give
+// independent hashes to confirm a match
+//
+static uint64_t hashObj(const ObjLoader& loader, uint64_t seed)
+{
+  uint64_t hash = nvh::hashBytes(loader.m_vertices, seed);
+  hash          = nvh::hashBytes(loader.m_indices, hash);
+  hash          = nvh::hashBytes(loader.m_materials, hash);
+  hash          = nvh::hashBytes(loader.m_matIndx, hash);
+  for(const auto& texture : loader.m_textures)
+  {
+    hash = nvh::hashBytes(texture.data(), texture.size(), hash);
+  }
+  return hash;
+}
+
+// Size in bytes of the content hashed by hashObj()
+static size_t getObjByteSize(const ObjLoader& loader)
+{
+  size_t size = sizeof(loader.m_vertices[0]) * loader.m_vertices.size()
+                + sizeof(loader.m_indices[0]) * loader.m_indices.size()
+                + sizeof(loader.m_materials[0]) * loader.m_materials.size()
+                + sizeof(loader.m_matIndx[0]) * loader.m_matIndx.size();
+  for(const auto& texture : loader.m_textures)
+  {
+    size += texture.size();
+  }
+  return size;
+}
+
+// Part of the offscreen images rendered at `scale`, see HelloVulkan::updateRenderSize()
+static vk::Extent2D getScaledExtent(const vk::Extent2D& size, float scale)
+{
+  return vk::Extent2D{std::max(static_cast<uint32_t>(size.width * scale + 0.5f), 1u),
+                      std::max(static_cast<uint32_t>(size.height * scale + 0.5f), 1u)};
+}
+
 //--------------------------------------------------------------------------------------------------
 // Keep the handle on the device
 // Initialize the tool to do all our allocations: buffers, images
@@ -89,8 +151,37 @@ void HelloVulkan::setup(  nvvk::Context &            vkctx)
   m_alloc.init(device, physicalDevice, m_memAllocator);
 #endif
   m_debug.setup(m_device);
+  m_pipelineBuilder.init(m_device, m_pipelineCache);
+  m_descAllocator.init(m_device, 16);
+  m_compGraph.init(m_device, m_queue, m_graphicsQueueIndex, m_queue_comp, m_computeQueueIndex);
+  m_textureLoader.init(&m_alloc, m_device, m_queue, m_graphicsQueueIndex, defaultSearchPaths);
+  // Block compressed textures with their mip chain, cooked once and cached next to the executable
+  TextureLoader::CookSettings cookSettings;
+  cookSettings.enabled        = m_physicalDevice.getFeatures().textureCompressionBC == VK_TRUE;
+  cookSettings.cacheDirectory = NVPSystem::exePath() + "texture_cache";
+  m_textureLoader.setCookSettings(cookSettings);
+  nvh::MipmapGenerator::Settings mipSettings;
+  mipSettings.filter = nvh::MipmapGenerator::eFilterKaiser;
+  m_textureLoader.setMipSettings(mipSettings);
+  // Only the mip tail is loaded, the other levels are streamed as the shaders need them
+  m_textureStreamer.init(&m_alloc, m_device, m_queue, m_graphicsQueueIndex, &m_textureLoader);
   m_offscreenDepthFormat = nvvk::findDepthFormat(m_physicalDevice);
-  m_PushConstant.use_atomic = 0;
+  // The culled draws are compacted and reference their instance with firstInstance
+  m_cullingSupported = vkctx.m_physicalInfo.features12.drawIndirectCount == VK_TRUE
+                       && vkctx.m_physicalInfo.features10.drawIndirectFirstInstance == VK_TRUE;
+  if(!m_cullingSupported)
+    LOGW("drawIndirectCount or drawIndirectFirstInstance not supported, frustum culling is disabled\n");
+  // The late pass of a frame signals a timeline value waited by the early pass of the next one
+  m_occlusionSupported = m_cullingSupported && vkctx.m_physicalInfo.features12.timelineSemaphore == VK_TRUE;
+  if(m_cullingSupported && !m_occlusionSupported)
+    LOGW("timelineSemaphore not supported, occlusion culling is disabled\n");
+  // The post-processing on the compute queue is synchronized with the frames by timeline semaphores
+  if(vkctx.m_physicalInfo.features12.timelineSemaphore != VK_TRUE)
+  {
+    LOGE("timelineSemaphore not supported, it is required by the post-processing\n");
+    exit(1);
+  }
+  m_PushConstant.accum_mode = eAccumNone;
   //===========================================================================
 
   m_commandBuffer_comp = m_device.allocateCommandBuffers(
@@ -112,19 +203,13 @@ void HelloVulkan::setup(  nvvk::Context &            vkctx)
 void HelloVulkan::updateUniformBuffer(const vk::CommandBuffer& cmdBuf)
 {
   // Prepare new UBO contents on host.
-  const float    aspectRatio = m_size.width / static_cast<float>(m_size.height);
-  CameraMatrices hostUBO     = {};
-  hostUBO.view               = CameraManip.getMatrix();
-  hostUBO.proj = nvmath::perspectiveVK(CameraManip.getFov(), aspectRatio, 0.1f, 1000.0f);
-  // hostUBO.proj[1][1] *= -1;  // Inverting Y for Vulkan (not needed with perspectiveVK).
-  hostUBO.viewInverse = nvmath::invert(hostUBO.view);
-  // #VKRay
-  hostUBO.projInverse = nvmath::invert(hostUBO.proj);
+  CameraMatrices hostUBO = getCameraMatrices(m_size);
 
   // UBO on the device, and what stages access it.
   vk::Buffer deviceUBO = m_cameraMat.buffer;
   auto       uboUsageStages =
-      vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+      vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR
+      | vk::PipelineStageFlagBits::eComputeShader;
 
   // Ensure that the modified UBO is not visible to previous frames.
   vk::BufferMemoryBarrier beforeBarrier;
@@ -156,80 +241,42 @@ void HelloVulkan::updateUniformBuffer(const vk::CommandBuffer& cmdBuf)
 //
 void HelloVulkan::createDescriptorSetLayout()
 {
-  using vkDS     = vk::DescriptorSetLayoutBinding;
-  using vkDT     = vk::DescriptorType;
-  using vkSS     = vk::ShaderStageFlagBits;
-  uint32_t nbTxt = static_cast<uint32_t>(m_textures.size());
-  uint32_t nbObj = static_cast<uint32_t>(m_objModel.size());
+  using vkDT = vk::DescriptorType;
+  using vkSS = vk::ShaderStageFlagBits;
 
   // Camera matrices (binding = 0)
-  m_descSetLayoutBind.addBinding(
-      vkDS(0, vkDT::eUniformBuffer, 1, vkSS::eVertex | vkSS::eRaygenKHR));
-  // Materials (binding = 1)
-  m_descSetLayoutBind.addBinding(
-      vkDS(1, vkDT::eStorageBuffer, nbObj, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitKHR));
+  m_bindless.addBinding(0, vkDT::eUniformBuffer, vkSS::eVertex | vkSS::eRaygenKHR);
   // Scene description (binding = 2)
-  m_descSetLayoutBind.addBinding(  //
-      vkDS(2, vkDT::eStorageBuffer, 1, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitKHR));
-  // Textures (binding = 3)
-  m_descSetLayoutBind.addBinding(
-      vkDS(3, vkDT::eCombinedImageSampler, nbTxt, vkSS::eFragment | vkSS::eClosestHitKHR));
-  // Materials (binding = 4)
-  m_descSetLayoutBind.addBinding(
-      vkDS(4, vkDT::eStorageBuffer, nbObj, vkSS::eFragment | vkSS::eClosestHitKHR));
-  // Storing vertices (binding = 5)
-  m_descSetLayoutBind.addBinding(  //
-      vkDS(5, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitKHR));
-  // Storing indices (binding = 6)
-  m_descSetLayoutBind.addBinding(  //
-      vkDS(6, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitKHR));
-
-
-  m_descSetLayout = m_descSetLayoutBind.createLayout(m_device);
-  m_descPool      = m_descSetLayoutBind.createPool(m_device, 1);
-  m_descSet       = nvvk::allocateDescriptorSet(m_device, m_descPool, m_descSetLayout);
+  m_bindless.addBinding(2, vkDT::eStorageBuffer, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitKHR);
+  // Texture feedback (binding = 3)
+  m_bindless.addBinding(3, vkDT::eStorageBuffer, vkSS::eFragment | vkSS::eClosestHitKHR);
+  // Materials (binding = 1), material indices (binding = 4), vertices (binding = 5) and
+  // indices (binding = 6) of each model
+  m_modelArray = m_bindless.addArray({{1, vkDT::eStorageBuffer, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitKHR},
+                                      {4, vkDT::eStorageBuffer, vkSS::eFragment | vkSS::eClosestHitKHR},
+                                      {5, vkDT::eStorageBuffer, vkSS::eClosestHitKHR},
+                                      {6, vkDT::eStorageBuffer, vkSS::eClosestHitKHR}},
+                                     s_maxModels);
+  // Textures (binding = 7), last binding for its variable count
+  m_textureArray = m_bindless.addArray({{7, vkDT::eCombinedImageSampler, vkSS::eFragment | vkSS::eClosestHitKHR}},
+                                       s_maxTextures);
+
+  m_bindless.init(m_device, m_swapChain.getImageCount());
 }
 
 //--------------------------------------------------------------------------------------------------
-// Setting up the buffers in the descriptor set
+// Setting up the buffers in the descriptor set, the models and textures are written as they
+// are loaded
 //
 void HelloVulkan::updateDescriptorSet()
 {
-  std::vector<vk::WriteDescriptorSet> writes;
-
-  // Camera matrices and scene description
-  vk::DescriptorBufferInfo dbiUnif{m_cameraMat.buffer, 0, VK_WHOLE_SIZE};
-  writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descSet, 0, &dbiUnif));
-  vk::DescriptorBufferInfo dbiSceneDesc{m_sceneDesc.buffer, 0, VK_WHOLE_SIZE};
-  writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descSet, 2, &dbiSceneDesc));
-
-  // All material buffers, 1 buffer per OBJ
-  std::vector<vk::DescriptorBufferInfo> dbiMat;
-  std::vector<vk::DescriptorBufferInfo> dbiMatIdx;
-  std::vector<vk::DescriptorBufferInfo> dbiVert;
-  std::vector<vk::DescriptorBufferInfo> dbiIdx;
-  for(auto& obj : m_objModel)
-  {
-    dbiMat.emplace_back(obj.matColorBuffer.buffer, 0, VK_WHOLE_SIZE);
-    dbiMatIdx.emplace_back(obj.matIndexBuffer.buffer, 0, VK_WHOLE_SIZE);
-    dbiVert.emplace_back(obj.vertexBuffer.buffer, 0, VK_WHOLE_SIZE);
-    dbiIdx.emplace_back(obj.indexBuffer.buffer, 0, VK_WHOLE_SIZE);
-  }
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, 1, dbiMat.data()));
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, 4, dbiMatIdx.data()));
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, 5, dbiVert.data()));
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, 6, dbiIdx.data()));
-
-  // All texture samplers
-  std::vector<vk::DescriptorImageInfo> diit;
-  for(auto& texture : m_textures)
-  {
-    diit.emplace_back(texture.descriptor);
-  }
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, 3, diit.data()));
+  // Camera matrices, scene description and texture feedback
+  m_bindless.write(0, 0, vk::DescriptorBufferInfo{m_cameraMat.buffer, 0, VK_WHOLE_SIZE});
+  m_bindless.write(2, 0, vk::DescriptorBufferInfo{m_sceneDesc.buffer, 0, VK_WHOLE_SIZE});
+  m_bindless.write(3, 0, vk::DescriptorBufferInfo{m_textureStreamer.getFeedbackBuffer(), 0, VK_WHOLE_SIZE});
 
-  // Writing the information
-  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  // Writing the information, no frame is in flight yet
+  m_bindless.flushAll();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -244,27 +291,53 @@ void HelloVulkan::createGraphicsPipeline()
 
   // Creating the Pipeline Layout
   vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
-  vk::DescriptorSetLayout      descSetLayout(m_descSetLayout);
+  vk::DescriptorSetLayout      descSetLayout(m_bindless.getLayout());
   pipelineLayoutCreateInfo.setSetLayoutCount(1);
   pipelineLayoutCreateInfo.setPSetLayouts(&descSetLayout);
   pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
   pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRanges);
   m_pipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
 
-  // Creating the Pipeline
-  std::vector<std::string>                paths = defaultSearchPaths;
-  nvvk::GraphicsPipelineGeneratorCombined gpb(m_device, m_pipelineLayout, m_offscreenRenderPass);
-  gpb.depthStencilState.depthTestEnable = true;
-  gpb.addShader(nvh::loadFile("spv/vert_shader.vert.spv", true, paths, true), vkSS::eVertex);
-  gpb.addShader(nvh::loadFile("spv/frag_shader.frag.spv", true, paths, true), vkSS::eFragment);
-  gpb.addBindingDescription({0, sizeof(VertexObj)});
-  gpb.addAttributeDescriptions({{0, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, pos)},
-                                {1, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, nrm)},
-                                {2, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, color)},
-                                {3, 0, vk::Format::eR32G32Sfloat, offsetof(VertexObj, texCoord)}});
-
-  m_graphicsPipeline = gpb.createPipeline();
-  m_debug.setObjectName(m_graphicsPipeline, "Graphics");
+  // Creating the Pipelines, compiled on worker threads. The cluster draws have a second vertex
+  // buffer, read per instance, with the instance and first triangle of each draw.
+  auto enqueueGraphics = [this](const char* vertexShader, bool clusterDraws, vk::Pipeline* pipeline, const char* name) {
+    m_pipelineTasks.push_back(m_pipelineBuilder.enqueue([=](vk::PipelineCache cache) {
+      std::vector<std::string>                paths = defaultSearchPaths;
+      nvvk::GraphicsPipelineGeneratorCombined gpb(m_device, m_pipelineLayout, m_offscreenRenderPass);
+      gpb.depthStencilState.depthTestEnable = true;
+      gpb.addShader(nvh::loadFile(vertexShader, true, paths, true), vkSS::eVertex);
+      gpb.addShader(nvh::loadFile("spv/frag_shader.frag.spv", true, paths, true), vkSS::eFragment);
+      gpb.addBindingDescription({0, sizeof(VertexObj)});
+      gpb.addAttributeDescriptions({{0, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, pos)},
+                                    {1, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, nrm)},
+                                    {2, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, color)},
+                                    {3, 0, vk::Format::eR32G32Sfloat, offsetof(VertexObj, texCoord)}});
+      if(clusterDraws)
+      {
+        gpb.addBindingDescriptions({{1, 2 * sizeof(uint32_t), vk::VertexInputRate::eInstance}});
+        gpb.addAttributeDescriptions({{4, 1, vk::Format::eR32G32Uint, 0}});
+      }
+
+      *pipeline = gpb.createPipeline(cache);
+      m_debug.setObjectName(*pipeline, name);
+      return *pipeline;
+    }));
+  };
+  enqueueGraphics("spv/vert_shader.vert.spv", false, &m_graphicsPipeline, "Graphics");
+  enqueueGraphics("spv/vert_cluster.vert.spv", true, &m_clusterGraphicsPipeline, "GraphicsClusters");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Blocks until all pipelines enqueued in m_pipelineBuilder are created
+// - rethrows the first error that happened on a worker thread
+//
+void HelloVulkan::waitForPipelines()
+{
+  for(auto& task : m_pipelineTasks)
+  {
+    task.get();
+  }
+  m_pipelineTasks.clear();
 }
 void HelloVulkan::createComputeShaderPipline()
 {
@@ -282,22 +355,11 @@ void HelloVulkan::createComputeShaderPipline()
   createCompPipelines("spv/parallelTest.comp.spv", computeA);
   // createCompPipelines("spv/parallelTest.comp.spv", computeB);
   //computeB.queueIndex = m_computeQueueIndex;
+  updateCompDescriptorSet(computeA);
 
- 
-  for(auto compData : m_compDataList)
-  {
-    {
-      VkFenceCreateInfo fenceInfo{};
-      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-
-      if(vkCreateFence(m_device, &fenceInfo, nullptr, &compData->fence) != VK_SUCCESS)
-      {
-        throw std::runtime_error("failed to create synchronization objects!");
-      }
-    }
-
-   
-  }
+  // the counters are read back by the host once the graph is done
+  m_compCounters = m_compGraph.importBuffer("counters", computeA->buffers[0].buffer, {}, nvvk::TaskGraph::eCompute);
+  m_compGraph.markOutput(m_compCounters, {vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead});
 }
 //--------------------------------------------------------------------------------------------------
 // Loading the OBJ file and setting up all buffers
@@ -318,16 +380,100 @@ void HelloVulkan::loadModel(const std::string& filename, nvmath::mat4f transform
     m.specular = nvmath::pow(m.specular, 2.2f);
   }
 
+  // Instancing: a file with the same content as an already loaded model adds an instance of it.
+  // Matches of the first hash are confirmed with the size and a second, independent hash.
+  uint64_t hash     = hashObj(loader, 0);
+  uint64_t confirm  = hashObj(loader, 0x9e3779b97f4a7c15ULL);
+  size_t   numBytes = getObjByteSize(loader);
+  auto     range    = m_modelHashes.equal_range(hash);
+  for(auto found = range.first; found != range.second; ++found)
+  {
+    if(found->second.numBytes != numBytes || found->second.confirmHash != confirm)
+      continue;
+
+    LOGI("  same content as model %u, adding an instance\n", found->second.instance.objIndex);
+    ObjInstance instance = found->second.instance;
+    instance.transform   = transform;
+    instance.transformIT = nvmath::transpose(nvmath::invert(transform));
+    m_objInstance.emplace_back(instance);
+    return;
+  }
+
+  // Models are never removed, the slot of a model is its index
+  uint32_t slot = m_bindless.allocate(m_modelArray);
+  assert(slot == m_objModel.size());
+
   ObjInstance instance;
-  instance.objIndex    = static_cast<uint32_t>(m_objModel.size());
+  instance.objIndex    = slot;
   instance.transform   = transform;
   instance.transformIT = nvmath::transpose(nvmath::invert(transform));
-  instance.txtOffset   = static_cast<uint32_t>(m_textures.size());
 
   ObjModel model;
   model.nbIndices  = static_cast<uint32_t>(loader.m_indices.size());
   model.nbVertices = static_cast<uint32_t>(loader.m_vertices.size());
+  model.nbTextures = static_cast<uint32_t>(loader.m_textures.size());
+  if(!loader.m_vertices.empty())
+  {
+    model.bboxMin = model.bboxMax = loader.m_vertices[0].pos;
+  }
+  for(const auto& v : loader.m_vertices)
+  {
+    model.radius  = std::max(model.radius, nvmath::length(v.pos));
+    model.bboxMin = nvmath::nv_min(model.bboxMin, v.pos);
+    model.bboxMax = nvmath::nv_max(model.bboxMax, v.pos);
+  }
   std::cout << "nbVertices=" << model.nbVertices<<std::endl;
+
+  // Levels of detail, each one after the previous in the index buffer. They index the same
+  // vertices, and the material indices of their triangles follow the same order. The triangles
+  // of a level are sorted by meshlet, each meshlet is a cluster drawn on its own.
+  nvh::MeshSimplifier::Settings lodSettings;
+  lodSettings.maxLevels = s_maxLods;
+  std::vector<nvh::MeshSimplifier::Level> levels;
+  nvh::MeshSimplifier(lodSettings)
+      .buildLevels(loader.m_vertices.data(), loader.m_vertices.size(), sizeof(VertexObj), loader.m_indices.data(),
+                   loader.m_indices.size(), levels, offsetof(VertexObj, pos));
+  std::vector<uint32_t>       lodIndices;
+  std::vector<int32_t>        lodMatIndices;
+  nvh::MeshletBuilder::Result meshlets;
+  for(const auto& level : levels)
+  {
+    nvh::MeshletBuilder().build(loader.m_vertices.data(), loader.m_vertices.size(), sizeof(VertexObj),
+                                level.indices.data(), level.indices.size(), meshlets, offsetof(VertexObj, pos));
+    Lod lod;
+    lod.firstIndex   = static_cast<uint32_t>(lodIndices.size());
+    lod.nbIndices    = static_cast<uint32_t>(level.indices.size());
+    lod.error        = level.error;
+    lod.firstCluster = static_cast<uint32_t>(model.clusters.size());
+    lod.nbClusters   = static_cast<uint32_t>(meshlets.meshlets.size());
+    instance.lodFirstTriangle[model.lods.size()] = lod.firstIndex / 3;
+    model.lods.push_back(lod);
+    for(const auto& meshlet : meshlets.meshlets)
+    {
+      Cluster cluster;
+      cluster.center     = nvmath::vec3f(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+      cluster.radius     = meshlet.radius;
+      cluster.coneAxis   = nvmath::vec3f(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+      cluster.coneCutoff = meshlet.coneCutoff;
+      cluster.firstIndex = lod.firstIndex + meshlet.triangleOffset * 3;
+      cluster.nbIndices  = meshlet.triangleCount * 3;
+      model.clusters.push_back(cluster);
+    }
+    for(uint32_t triangle : meshlets.sourceTriangles)
+    {
+      const uint32_t* corners = &level.indices[triangle * 3];
+      lodIndices.insert(lodIndices.end(), corners, corners + 3);
+      uint32_t source = level.sourceTriangles[triangle];
+      lodMatIndices.push_back(source < loader.m_matIndx.size() ? loader.m_matIndx[source] : 0);
+    }
+    LOGI("  LOD %zu: %u triangles in %u clusters, error %g\n", model.lods.size() - 1, lod.nbIndices / 3,
+         lod.nbClusters, lod.error);
+  }
+  for(size_t l = model.lods.size(); l < s_maxLods; l++)
+  {
+    instance.lodFirstTriangle[l] = instance.lodFirstTriangle[model.lods.size() - 1];
+  }
+
   // Create the buffers on Device and copy vertices, indices and materials
   nvvk::CommandPool cmdBufGet(m_device, m_graphicsQueueIndex);
   vk::CommandBuffer cmdBuf = cmdBufGet.createCommandBuffer();
@@ -336,16 +482,25 @@ void HelloVulkan::loadModel(const std::string& filename, nvmath::mat4f transform
                            vkBU::eVertexBuffer | vkBU::eStorageBuffer | vkBU::eShaderDeviceAddress
                                | vkBU::eAccelerationStructureBuildInputReadOnlyKHR);
   model.indexBuffer =
-      m_alloc.createBuffer(cmdBuf, loader.m_indices,
+      m_alloc.createBuffer(cmdBuf, lodIndices,
                            vkBU::eIndexBuffer | vkBU::eStorageBuffer | vkBU::eShaderDeviceAddress
                                | vkBU::eAccelerationStructureBuildInputReadOnlyKHR);
-  model.matColorBuffer = m_alloc.createBuffer(cmdBuf, loader.m_materials, vkBU::eStorageBuffer);
-  model.matIndexBuffer = m_alloc.createBuffer(cmdBuf, loader.m_matIndx, vkBU::eStorageBuffer);
+  model.matColorBuffer = m_alloc.createBuffer(cmdBuf, loader.m_materials, vkBU::eStorageBuffer | vkBU::eShaderDeviceAddress);
+  model.matIndexBuffer = m_alloc.createBuffer(cmdBuf, lodMatIndices, vkBU::eStorageBuffer | vkBU::eShaderDeviceAddress);
   // Creates all textures found
-  createTextureImages(cmdBuf, loader.m_textures);
+  instance.txtOffset = createTextureImages(cmdBuf, loader.m_textures);
   cmdBufGet.submitAndWait(cmdBuf);
   m_alloc.finalizeAndReleaseStaging();
 
+  m_bindless.write(1, slot, vk::DescriptorBufferInfo{model.matColorBuffer.buffer, 0, VK_WHOLE_SIZE});
+  m_bindless.write(4, slot, vk::DescriptorBufferInfo{model.matIndexBuffer.buffer, 0, VK_WHOLE_SIZE});
+  m_bindless.write(5, slot, vk::DescriptorBufferInfo{model.vertexBuffer.buffer, 0, VK_WHOLE_SIZE});
+  m_bindless.write(6, slot, vk::DescriptorBufferInfo{model.indexBuffer.buffer, 0, VK_WHOLE_SIZE});
+  instance.vertexAddress        = m_device.getBufferAddress({model.vertexBuffer.buffer});
+  instance.indexAddress         = m_device.getBufferAddress({model.indexBuffer.buffer});
+  instance.materialAddress      = m_device.getBufferAddress({model.matColorBuffer.buffer});
+  instance.materialIndexAddress = m_device.getBufferAddress({model.matIndexBuffer.buffer});
+
   std::string objNb = std::to_string(instance.objIndex);
   m_debug.setObjectName(model.vertexBuffer.buffer, (std::string("vertex_" + objNb).c_str()));
   m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb).c_str()));
@@ -354,6 +509,7 @@ void HelloVulkan::loadModel(const std::string& filename, nvmath::mat4f transform
 
   m_objModel.emplace_back(model);
   m_objInstance.emplace_back(instance);
+  m_modelHashes.emplace(hash, LoadedModel{instance, confirm, numBytes});
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -389,79 +545,97 @@ void HelloVulkan::createSceneDescriptionBuffer()
 }
 
 //--------------------------------------------------------------------------------------------------
-// Creating all textures and samplers
+// Creating all textures and samplers in a range of texture slots, returns the first slot
 //
-void HelloVulkan::createTextureImages(const vk::CommandBuffer&        cmdBuf,
-                                      const std::vector<std::string>& textures)
+uint32_t HelloVulkan::createTextureImages(const vk::CommandBuffer&        cmdBuf,
+                                          const std::vector<std::string>& textures)
 {
-  using vkIU = vk::ImageUsageFlagBits;
-
   vk::SamplerCreateInfo samplerCreateInfo{
       {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
   samplerCreateInfo.setMaxLod(FLT_MAX);
   vk::Format format = vk::Format::eR8G8B8A8Srgb;
 
-  // If no textures are present, create a dummy one to accommodate the pipeline layout
-  if(textures.empty() && m_textures.empty())
+  // The texture array is partially bound, no dummy texture is needed without textures
+  if(textures.empty())
   {
-    nvvk::Texture texture;
-
-    std::array<uint8_t, 4> color{255u, 255u, 255u, 255u};
-    vk::DeviceSize         bufferSize      = sizeof(color);
-    auto                   imgSize         = vk::Extent2D(1, 1);
-    auto                   imageCreateInfo = nvvk::makeImage2DCreateInfo(imgSize, format);
-
-    // Creating the dummy texture
-    nvvk::Image image = m_alloc.createImage(cmdBuf, bufferSize, color.data(), imageCreateInfo);
-    vk::ImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
-    texture                        = m_alloc.createTexture(image, ivInfo, samplerCreateInfo);
-
-    // The image format must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-    nvvk::cmdBarrierImageLayout(cmdBuf, texture.image, vk::ImageLayout::eUndefined,
-                                vk::ImageLayout::eShaderReadOnlyOptimal);
-    m_textures.push_back(texture);
+    return 0;
   }
-  else
+  uint32_t base = m_bindless.allocate(m_textureArray, static_cast<uint32_t>(textures.size()));
+  if(base == nvvk::BindlessTable::INVALID_SLOT)
   {
-    // Uploading all images
-    for(const auto& texture : textures)
-    {
-      std::stringstream o;
-      int               texWidth, texHeight, texChannels;
-      o << "media/textures/" << texture;
-      std::string txtFile = nvh::findFile(o.str(), defaultSearchPaths, true);
+    LOGW("No room for %zu more textures\n", textures.size());
+    return 0;
+  }
 
-      stbi_uc* stbi_pixels =
-          stbi_load(txtFile.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+  // Decoding all images in parallel, each one is uploaded as soon as it is decoded
+  std::vector<std::string> files;
+  for(const auto& texture : textures)
+  {
+    files.push_back("media/textures/" + texture);
+  }
+  m_textures.resize(std::max<size_t>(m_textures.size(), base + files.size()));
+  m_textureLoader.load(
+      files, samplerCreateInfo, format,
+      [&](uint32_t index, const nvvk::Texture& texture, const TextureLoader::TextureInfo& info) {
+        m_textures[base + index] = texture;
+        m_bindless.write(7, base + index, vk::DescriptorImageInfo(texture.descriptor));
+        m_textureStreamer.addTexture(base + index, files[index], format, info, samplerCreateInfo);
+      },
+      m_textureStreamer.getSettings().tailExtent);
+  return base;
+}
 
-      std::array<stbi_uc, 4> color{255u, 0u, 255u, 255u};
+//--------------------------------------------------------------------------------------------------
+// One region per frame in flight, where the shaders write the extent each texture needs
+//
+void HelloVulkan::createTextureFeedbackBuffer()
+{
+  m_textureStreamer.createFeedbackBuffer(m_swapChain.getImageCount(), s_maxTextures);
+  m_debug.setObjectName(m_textureStreamer.getFeedbackBuffer(), "textureFeedback");
+}
 
-      stbi_uc* pixels = stbi_pixels;
-      // Handle failure
-      if(!stbi_pixels)
+//--------------------------------------------------------------------------------------------------
+// Called after prepareFrame: reads the texture feedback of the frame that used the same image,
+// streams the levels and queues the descriptors of the replaced textures. The previous
+// textures are destroyed once no frame in flight can use them.
+// The ray tracer only marks the textures it hits, the levels are estimated from the distance
+// of each instance to the camera.
+//
+void HelloVulkan::updateTextureStreaming(uint32_t frame, bool raytracing)
+{
+  if(raytracing)
+  {
+    nvmath::vec3f eye, center, up;
+    CameraManip.getLookat(eye, center, up);
+    float pixelsPerUnit = m_renderSize.height / (2.f * tanf(nv_to_rad * CameraManip.getFov() * 0.5f));
+    for(const auto& inst : m_objInstance)
+    {
+      const ObjModel& model    = m_objModel[inst.objIndex];
+      float           scale    = nvmath::length(nvmath::vec3f(inst.transform.col(0)));
+      float           distance = std::max(nvmath::length(nvmath::vec3f(inst.transform.col(3)) - eye), 0.001f);
+      float           extent   = 2.f * model.radius * scale * pixelsPerUnit / distance;
+      for(uint32_t t = 0; t < model.nbTextures; t++)
       {
-        texWidth = texHeight = 1;
-        texChannels          = 4;
-        pixels               = reinterpret_cast<stbi_uc*>(color.data());
+        m_textureStreamer.request(inst.txtOffset + t, static_cast<uint32_t>(std::min(extent, 65535.f)));
       }
+    }
+  }
 
-      vk::DeviceSize bufferSize = static_cast<uint64_t>(texWidth) * texHeight * sizeof(uint8_t) * 4;
-      auto           imgSize    = vk::Extent2D(texWidth, texHeight);
-      auto imageCreateInfo = nvvk::makeImage2DCreateInfo(imgSize, format, vkIU::eSampled, true);
-
+  std::vector<nvvk::Texture> retired;
+  for(uint32_t slot : m_textureStreamer.update(frame, m_textures, retired))
+  {
+    m_bindless.write(7, slot, vk::DescriptorImageInfo(m_textures[slot].descriptor));
+  }
+  if(!retired.empty())
+  {
+    m_bindless.deferRelease([this, retired]() mutable {
+      for(auto& t : retired)
       {
-        nvvk::Image image = m_alloc.createImage(cmdBuf, bufferSize, pixels, imageCreateInfo);
-        nvvk::cmdGenerateMipmaps(cmdBuf, image.image, format, imgSize, imageCreateInfo.mipLevels);
-        vk::ImageViewCreateInfo ivInfo =
-            nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
-        nvvk::Texture texture = m_alloc.createTexture(image, ivInfo, samplerCreateInfo);
-
-        m_textures.push_back(texture);
+        m_alloc.destroy(t);
       }
-
-      stbi_image_free(stbi_pixels);
-    }
+    });
   }
+  m_pushConstant.feedbackOffset = m_textureStreamer.getFeedbackOffset(frame);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -469,13 +643,19 @@ void HelloVulkan::createTextureImages(const vk::CommandBuffer&        cmdBuf,
 //
 void HelloVulkan::destroyResources()
 {
+  m_pipelineBuilder.deinit();
+  m_compGraph.deinit();
+  m_textureStreamer.deinit();
+  m_textureLoader.deinit();
+
   for(auto c : m_compDataList)
   {
-    m_device.destroy(c->descPool);
     m_device.destroy(c->descSetLayout);
-    m_device.destroy(c->pipeline);
+    for(auto& v : c->variants)
+    {
+      m_device.destroy(v.second.get());
+    }
     m_device.destroy(c->pipelineLayout);
-    m_device.destroy(c->fence);
     for(auto b : c->buffers)
     {
       m_alloc.destroy(b);
@@ -483,12 +663,45 @@ void HelloVulkan::destroyResources()
   }
  
   m_device.destroy(m_graphicsPipeline);
+  m_device.destroy(m_clusterGraphicsPipeline);
   m_device.destroy(m_pipelineLayout);
-  m_device.destroy(m_descPool);
-  m_device.destroy(m_descSetLayout);
+  m_bindless.deinit();
   m_alloc.destroy(m_cameraMat);
   m_alloc.destroy(m_sceneDesc);
 
+  // #Culling
+  m_device.destroy(m_cullPipeline);
+  m_device.destroy(m_cullPipelineLayout);
+  m_device.destroy(m_cullDescSetLayout);
+  m_alloc.destroy(m_cullInstanceBuffer);
+  m_alloc.destroy(m_cullModelBuffer);
+  m_alloc.destroy(m_cullDraws);
+  m_alloc.destroy(m_cullCounts);
+  m_alloc.destroy(m_cullVisibility);
+  m_device.destroy(m_clusterPipeline);
+  m_device.destroy(m_clusterPipelineLayout);
+  m_device.destroy(m_clusterDescSetLayout);
+  m_alloc.destroy(m_clusterBuffer);
+  m_alloc.destroy(m_clusterDraws);
+  m_alloc.destroy(m_clusterDrawInfos);
+  for(auto& semaphore : m_cullSemaphores)
+  {
+    m_device.destroy(semaphore);
+  }
+  m_device.destroy(m_hizTimeline);
+  m_device.destroy(m_hizPipeline);
+  m_device.destroy(m_hizPipelineLayout);
+  m_device.destroy(m_hizDescSetLayout);
+  m_alloc.destroy(m_hizPyramid);
+  for(auto& view : m_hizLevelViews)
+  {
+    m_device.destroy(view);
+  }
+  if(!m_cullCmdBufs.empty())
+  {
+    m_device.freeCommandBuffers(m_cmdPool_comp, m_cullCmdBufs);
+  }
+
   for(auto& m : m_objModel)
   {
     m_alloc.destroy(m.vertexBuffer);
@@ -505,20 +718,45 @@ void HelloVulkan::destroyResources()
   //#Post
   m_device.destroy(m_postPipeline);
   m_device.destroy(m_postPipelineLayout);
-  m_device.destroy(m_postDescPool);
   m_device.destroy(m_postDescSetLayout);
-  m_alloc.destroy(m_offscreenColor);
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    m_alloc.destroy(m_offscreenColors[i]);
+    m_device.destroy(m_offscreenFramebuffers[i]);
+    m_alloc.destroy(m_gBuffers[i]);
+    m_alloc.destroy(m_postPingPong[i]);
+    m_alloc.destroy(m_bloom[i]);
+    m_alloc.destroy(m_postOutputs[i]);
+  }
   m_alloc.destroy(m_offscreenDepth);
   m_device.destroy(m_offscreenRenderPass);
-  m_device.destroy(m_offscreenFramebuffer);
+  m_device.destroy(m_offscreenRenderPassLoad);
+  m_device.destroy(m_postCompDescSetLayout);
+  m_device.destroy(m_postCompPipelineLayout);
+  m_device.destroy(m_denoisePipeline);
+  m_device.destroy(m_bloomPipeline);
+  m_device.destroy(m_tonemapPipeline);
+  m_device.destroy(m_renderTimeline);
+  m_device.destroy(m_postTimeline);
+  m_device.destroy(m_frameTimers);
 
   // #VKRay
   m_rtBuilder.destroy();
-  m_device.destroy(m_rtDescPool);
   m_device.destroy(m_rtDescSetLayout);
   m_device.destroy(m_rtPipeline);
   m_device.destroy(m_rtPipelineLayout);
   m_alloc.destroy(m_rtSBTBuffer);
+  m_alloc.destroy(m_rtMoments);
+  m_alloc.destroy(m_rtTiles);
+  m_alloc.destroy(m_shadowRays);
+  m_alloc.destroy(m_shadowRayCount);
+  m_alloc.destroy(m_shadowKeys);
+  m_alloc.destroy(m_shadowIndices);
+  m_alloc.destroy(m_shadowHistograms);
+  m_device.destroy(m_sortDescSetLayout);
+  m_device.destroy(m_sortPipelineLayout);
+  m_device.destroy(m_sortPipeline);
+  m_descAllocator.deinit();
 
  // m_device.freeCommandBuffers(m_cmdPool_comp, computeCommandBuffer);
  // m_device.destroy(m_cmdPool_comp);
@@ -534,7 +772,7 @@ void HelloVulkan::destroyResources()
 //--------------------------------------------------------------------------------------------------
 // Drawing the scene in raster mode
 //
-void HelloVulkan::rasterize(const vk::CommandBuffer& cmdBuf)
+void HelloVulkan::rasterize(const vk::CommandBuffer& cmdBuf, bool late)
 {
   using vkPBP = vk::PipelineBindPoint;
   using vkSS  = vk::ShaderStageFlagBits;
@@ -542,24 +780,70 @@ void HelloVulkan::rasterize(const vk::CommandBuffer& cmdBuf)
 
   m_debug.beginLabel(cmdBuf, "Rasterize");
 
-  // Dynamic Viewport
-  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
-  cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
+  // Dynamic Viewport, on the rendered part of the offscreen image
+  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_renderSize.width, (float)m_renderSize.height, 0, 1)});
+  cmdBuf.setScissor(0, {{{0, 0}, {m_renderSize.width, m_renderSize.height}}});
 
   // Drawing all triangles
   cmdBuf.bindPipeline(vkPBP::eGraphics, m_graphicsPipeline);
-  cmdBuf.bindDescriptorSets(vkPBP::eGraphics, m_pipelineLayout, 0, {m_descSet}, {});
-  for(int i = 0; i < m_objInstance.size(); ++i)
+  cmdBuf.bindDescriptorSets(vkPBP::eGraphics, m_pipelineLayout, 0, {m_bindless.getSet(getCurFrame())}, {});
+  cmdBuf.pushConstants<ObjPushConstant>(m_pipelineLayout, vkSS::eVertex | vkSS::eFragment, 0, m_pushConstant);
+  if(isClusterCulling())
   {
-    auto& inst                = m_objInstance[i];
-    auto& model               = m_objModel[inst.objIndex];
-    m_pushConstant.instanceId = i;  // Telling which instance is drawn
-    cmdBuf.pushConstants<ObjPushConstant>(m_pipelineLayout, vkSS::eVertex | vkSS::eFragment, 0,
-                                          m_pushConstant);
-
-    cmdBuf.bindVertexBuffers(0, {model.vertexBuffer.buffer}, {offset});
-    cmdBuf.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
-    cmdBuf.drawIndexed(model.nbIndices, 1, 0, 0, 0);
+    // The draws of the visible clusters, written by cullClusters() in the region of this frame,
+    // the counts are in the frustum region of the frame
+    cmdBuf.bindPipeline(vkPBP::eGraphics, m_clusterGraphicsPipeline);
+    const vk::DeviceSize drawStride = sizeof(vk::DrawIndexedIndirectCommand);
+    const vk::DeviceSize drawBase   = vk::DeviceSize(getCurFrame()) * m_clusterDrawsPerFrame * drawStride;
+    const vk::DeviceSize countBase  = 2 * getCurFrame() * m_objModel.size() * sizeof(uint32_t);
+    for(uint32_t m = 0; m < m_objModel.size(); ++m)
+    {
+      const auto& model = m_objModel[m];
+      const auto& cull  = m_cullModels[m];
+      cmdBuf.bindVertexBuffers(0, {model.vertexBuffer.buffer, m_clusterDrawInfos.buffer}, {offset, offset});
+      cmdBuf.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+      cmdBuf.drawIndexedIndirectCount(m_clusterDraws.buffer, drawBase + cull.clusterDrawOffset * drawStride,
+                                      m_cullCounts.buffer, countBase + m * sizeof(uint32_t), cull.maxClusterDraws,
+                                      static_cast<uint32_t>(drawStride));
+    }
+  }
+  else if(isCulling())
+  {
+    // The draws of the visible instances, written by cullFrame() or cullLate() in the regions of this frame
+    const vk::DeviceSize region     = 2 * getCurFrame() + (late ? 1 : 0);
+    const vk::DeviceSize drawStride = sizeof(vk::DrawIndexedIndirectCommand);
+    const vk::DeviceSize drawBase   = region * m_cullInstances.size() * drawStride;
+    const vk::DeviceSize countBase  = region * m_objModel.size() * sizeof(uint32_t);
+    for(uint32_t m = 0; m < m_objModel.size(); ++m)
+    {
+      const auto& model = m_objModel[m];
+      const auto& cull  = m_cullModels[m];
+      cmdBuf.bindVertexBuffers(0, {model.vertexBuffer.buffer}, {offset});
+      cmdBuf.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+      cmdBuf.drawIndexedIndirectCount(m_cullDraws.buffer, drawBase + cull.drawOffset * drawStride, m_cullCounts.buffer,
+                                      countBase + m * sizeof(uint32_t), cull.nbInstances,
+                                      static_cast<uint32_t>(drawStride));
+    }
+  }
+  else
+  {
+    nvmath::mat4f view     = CameraManip.getMatrix();
+    float         lodScale = getLodScale();
+    for(uint32_t i = 0; i < m_objInstance.size(); ++i)
+    {
+      auto&    inst  = m_objInstance[i];
+      auto&    model = m_objModel[inst.objIndex];
+      uint32_t lod   = 0;
+      if(i < m_cullInstances.size())
+      {
+        const CullModel& cull = m_cullModels[inst.objIndex];
+        lod                   = selectLod(m_cullInstances[i], cull.lodError, cull.nbLods, view, lodScale);
+      }
+      cmdBuf.bindVertexBuffers(0, {model.vertexBuffer.buffer}, {offset});
+      cmdBuf.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+      // the instance and its level of detail are gl_InstanceIndex, as written by cull.comp
+      cmdBuf.drawIndexed(model.lods[lod].nbIndices, 1, model.lods[lod].firstIndex, 0, i | (lod << 24));
+    }
   }
   m_debug.endLabel(cmdBuf);
 }
@@ -572,170 +856,1089 @@ void HelloVulkan::onResize(int /*w*/, int /*h*/)
   createOffscreenRender();
   updatePostDescriptorSet();
   updateRtDescriptorSet();
+  updateHizDescriptorSets();
 }
 
 //////////////////////////////////////////////////////////////////////////
-// Post-processing
+// Frustum and occlusion culling
 //////////////////////////////////////////////////////////////////////////
 
 //--------------------------------------------------------------------------------------------------
-// Creating an offscreen frame buffer and the associated render pass
+// Compute pipeline of the SPIR-V `file`, compiled on a worker thread, see waitForPipelines()
 //
-void HelloVulkan::createOffscreenRender()
+void HelloVulkan::enqueueComputePipeline(const char* file, vk::PipelineLayout layout, vk::Pipeline* pipeline)
 {
-  m_alloc.destroy(m_offscreenColor);
-  m_alloc.destroy(m_offscreenDepth);
-
-  // Creating the color image
-  {
-    auto colorCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_offscreenColorFormat,
-                                                       vk::ImageUsageFlagBits::eColorAttachment
-                                                           | vk::ImageUsageFlagBits::eSampled
-                                                           | vk::ImageUsageFlagBits::eStorage);
+  m_pipelineTasks.push_back(m_pipelineBuilder.enqueue([this, file, layout, pipeline](vk::PipelineCache cache) {
+    std::string                   spirv = nvh::loadFile(file, true, defaultSearchPaths, true);
+    vk::ComputePipelineCreateInfo createInfo;
+    createInfo.stage.setStage(vk::ShaderStageFlagBits::eCompute);
+    createInfo.stage.setModule(nvvk::createShaderModule(m_device, spirv));
+    createInfo.stage.setPName("main");
+    createInfo.setLayout(layout);
+    *pipeline = static_cast<const vk::Pipeline&>(m_device.createComputePipeline(cache, createInfo, nullptr));
+    m_device.destroy(createInfo.stage.module);
+    m_debug.setObjectName(*pipeline, file);
+    return *pipeline;
+  }));
+}
 
+//--------------------------------------------------------------------------------------------------
+// Layouts and pipelines of cull.comp, clustercull.comp and depthpyramid.comp, and the per-frame command buffers
+// and semaphores of the compute queue
+//
+void HelloVulkan::createCullPipeline()
+{
+  using vkDT = vk::DescriptorType;
+  using vkSS = vk::ShaderStageFlagBits;
 
-    nvvk::Image             image  = m_alloc.createImage(colorCreateInfo);
-    vk::ImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, colorCreateInfo);
-    m_offscreenColor               = m_alloc.createTexture(image, ivInfo, vk::SamplerCreateInfo());
-    m_offscreenColor.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  m_cullDescSetLayoutBind.addBinding({0, vkDT::eStorageBuffer, 1, vkSS::eCompute});         // instances
+  m_cullDescSetLayoutBind.addBinding({1, vkDT::eStorageBuffer, 1, vkSS::eCompute});         // models
+  m_cullDescSetLayoutBind.addBinding({2, vkDT::eStorageBuffer, 1, vkSS::eCompute});         // draws
+  m_cullDescSetLayoutBind.addBinding({3, vkDT::eStorageBuffer, 1, vkSS::eCompute});         // counts
+  m_cullDescSetLayoutBind.addBinding({4, vkDT::eStorageBuffer, 1, vkSS::eCompute});         // visibility
+  m_cullDescSetLayoutBind.addBinding({5, vkDT::eCombinedImageSampler, 1, vkSS::eCompute});  // depth pyramid
+  m_cullDescSetLayoutBind.addBinding({6, vkDT::eUniformBuffer, 1, vkSS::eCompute});         // camera
+  m_cullDescSetLayout = m_cullDescSetLayoutBind.createLayout(m_device);
+  m_cullDescSet       = m_descAllocator.allocate(m_cullDescSetLayout, m_cullDescSetLayoutBind);
+
+  m_clusterDescSetLayoutBind.addBinding({0, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // instances
+  m_clusterDescSetLayoutBind.addBinding({1, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // models
+  m_clusterDescSetLayoutBind.addBinding({2, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // clusters
+  m_clusterDescSetLayoutBind.addBinding({3, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // scene description
+  m_clusterDescSetLayoutBind.addBinding({4, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // draws
+  m_clusterDescSetLayoutBind.addBinding({5, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // draw infos
+  m_clusterDescSetLayoutBind.addBinding({6, vkDT::eStorageBuffer, 1, vkSS::eCompute});  // counts
+  m_clusterDescSetLayoutBind.addBinding({7, vkDT::eUniformBuffer, 1, vkSS::eCompute});  // camera
+  m_clusterDescSetLayout = m_clusterDescSetLayoutBind.createLayout(m_device);
+  m_clusterDescSet       = m_descAllocator.allocate(m_clusterDescSetLayout, m_clusterDescSetLayoutBind);
+
+  m_hizDescSetLayoutBind.addBinding({0, vkDT::eCombinedImageSampler, 1, vkSS::eCompute});           // depth buffer
+  m_hizDescSetLayoutBind.addBinding({1, vkDT::eCombinedImageSampler, 1, vkSS::eCompute});           // pyramid
+  m_hizDescSetLayoutBind.addBinding({2, vkDT::eStorageImage, s_maxHizLevels, vkSS::eCompute});  // levels
+  m_hizDescSetLayout = m_hizDescSetLayoutBind.createLayout(m_device);
+  m_hizDescSet       = m_descAllocator.allocate(m_hizDescSetLayout, m_hizDescSetLayoutBind);
+
+  vk::PushConstantRange        cullPushConstant{vkSS::eCompute, 0, sizeof(CullPushConstant)};
+  vk::PipelineLayoutCreateInfo cullLayoutInfo{{}, 1, &m_cullDescSetLayout, 1, &cullPushConstant};
+  m_cullPipelineLayout = m_device.createPipelineLayout(cullLayoutInfo);
+  vk::PushConstantRange        clusterPushConstant{vkSS::eCompute, 0, sizeof(ClusterPushConstant)};
+  vk::PipelineLayoutCreateInfo clusterLayoutInfo{{}, 1, &m_clusterDescSetLayout, 1, &clusterPushConstant};
+  m_clusterPipelineLayout = m_device.createPipelineLayout(clusterLayoutInfo);
+  // srcSize, dstSize and level
+  vk::PushConstantRange        hizPushConstant{vkSS::eCompute, 0, 5 * sizeof(int32_t)};
+  vk::PipelineLayoutCreateInfo hizLayoutInfo{{}, 1, &m_hizDescSetLayout, 1, &hizPushConstant};
+  m_hizPipelineLayout = m_device.createPipelineLayout(hizLayoutInfo);
+
+  enqueueComputePipeline("spv/cull.comp.spv", m_cullPipelineLayout, &m_cullPipeline);
+  enqueueComputePipeline("spv/clustercull.comp.spv", m_clusterPipelineLayout, &m_clusterPipeline);
+  enqueueComputePipeline("spv/depthpyramid.comp.spv", m_hizPipelineLayout, &m_hizPipeline);
+
+  uint32_t nbFrames = m_swapChain.getImageCount();
+  m_cullCmdBufs     = m_device.allocateCommandBuffers({m_cmdPool_comp, vk::CommandBufferLevel::ePrimary, nbFrames});
+  for(uint32_t i = 0; i < nbFrames; i++)
+  {
+    m_cullSemaphores.push_back(m_device.createSemaphore({}));
   }
-
-  // Creating the depth buffer
-  auto depthCreateInfo =
-      nvvk::makeImage2DCreateInfo(m_size, m_offscreenDepthFormat,
-                                  vk::ImageUsageFlagBits::eDepthStencilAttachment);
+  if(m_occlusionSupported)
   {
-    nvvk::Image image = m_alloc.createImage(depthCreateInfo);
+    vk::SemaphoreTypeCreateInfo timelineInfo{vk::SemaphoreType::eTimeline, 0};
+    m_hizTimeline = m_device.createSemaphore({{}, &timelineInfo});
+  }
+}
 
-    vk::ImageViewCreateInfo depthStencilView;
-    depthStencilView.setViewType(vk::ImageViewType::e2D);
-    depthStencilView.setFormat(m_offscreenDepthFormat);
-    depthStencilView.setSubresourceRange({vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1});
-    depthStencilView.setImage(image.image);
+//--------------------------------------------------------------------------------------------------
+// World space bounding boxes of the instances, and the draw regions of the models
+// - the instances of a model have consecutive draw commands, the region of the model
+// - the draw and count buffers have an early and a late copy of all regions per frame in flight
+// The buffers are shared by the compute and graphics queues.
+//
+void HelloVulkan::createCullingBuffers()
+{
+  using vkBU = vk::BufferUsageFlagBits;
+  using vkMP = vk::MemoryPropertyFlagBits;
 
-    m_offscreenDepth = m_alloc.createTexture(image, depthStencilView);
+  m_cullModels.resize(m_objModel.size());
+  for(uint32_t m = 0; m < m_objModel.size(); m++)
+  {
+    const ObjModel& model = m_objModel[m];
+    CullModel&      cull  = m_cullModels[m];
+    cull.nbIndices        = model.nbIndices;
+    cull.nbLods           = static_cast<uint32_t>(model.lods.size());
+    for(uint32_t l = 0; l < cull.nbLods; l++)
+    {
+      cull.lodFirstIndex[l] = model.lods[l].firstIndex;
+      cull.lodNbIndices[l]  = model.lods[l].nbIndices;
+      cull.lodError[l]      = model.lods[l].error;
+    }
   }
-
-  // Setting the image layout for both color and depth
+  // The draws carry the instance in the low 24 bits of firstInstance, and its level of detail above
+  assert(m_objInstance.size() < (1u << 24));
+  m_cullInstances.clear();
+  for(const auto& inst : m_objInstance)
   {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_offscreenColor.image, vk::ImageLayout::eUndefined,
-                                vk::ImageLayout::eGeneral);
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_offscreenDepth.image, vk::ImageLayout::eUndefined,
-                                vk::ImageLayout::eDepthStencilAttachmentOptimal,
-                                vk::ImageAspectFlagBits::eDepth);
+    const ObjModel& model = m_objModel[inst.objIndex];
+    m_cullInstances.push_back(makeCullInstance(model.bboxMin, model.bboxMax, inst.transform, inst.objIndex));
+    m_cullModels[inst.objIndex].nbInstances++;
+  }
+  uint32_t drawOffset = 0;
+  for(auto& cull : m_cullModels)
+  {
+    cull.drawOffset = drawOffset;
+    drawOffset += cull.nbInstances;
+  }
 
-    genCmdBuf.submitAndWait(cmdBuf);
+  // Clusters of all models, and a region per model large enough for all its instances
+  // drawing their level with the most clusters
+  std::vector<Cluster> clusters;
+  m_clusterDrawsPerFrame = 0;
+  for(uint32_t m = 0; m < m_objModel.size(); m++)
+  {
+    const ObjModel& model       = m_objModel[m];
+    CullModel&      cull        = m_cullModels[m];
+    uint32_t        maxClusters = 0;
+    for(uint32_t l = 0; l < cull.nbLods; l++)
+    {
+      cull.lodFirstCluster[l] = static_cast<uint32_t>(clusters.size()) + model.lods[l].firstCluster;
+      cull.lodNbClusters[l]   = model.lods[l].nbClusters;
+      maxClusters             = std::max(maxClusters, model.lods[l].nbClusters);
+    }
+    clusters.insert(clusters.end(), model.clusters.begin(), model.clusters.end());
+    cull.clusterDrawOffset = m_clusterDrawsPerFrame;
+    cull.maxClusterDraws   = cull.nbInstances * maxClusters;
+    m_clusterDrawsPerFrame += cull.maxClusterDraws;
   }
 
-  // Creating a renderpass for the offscreen
-  if(!m_offscreenRenderPass)
+  std::array<uint32_t, 2> families{m_graphicsQueueIndex, m_computeQueueIndex};
+  auto createShared = [&](vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memProps) {
+    vk::BufferCreateInfo info{{}, size, usage};
+    if(m_graphicsQueueIndex != m_computeQueueIndex)
+    {
+      info.setSharingMode(vk::SharingMode::eConcurrent);
+      info.setQueueFamilyIndexCount(static_cast<uint32_t>(families.size()));
+      info.setPQueueFamilyIndices(families.data());
+    }
+    return m_alloc.createBuffer(info, memProps);
+  };
+
+  // Written once, small enough to stay in host memory
+  vk::MemoryPropertyFlags hostMem = vkMP::eHostVisible | vkMP::eHostCoherent;
+  m_cullInstanceBuffer = createShared(m_cullInstances.size() * sizeof(CullInstance), vkBU::eStorageBuffer, hostMem);
+  m_cullModelBuffer    = createShared(m_cullModels.size() * sizeof(CullModel), vkBU::eStorageBuffer, hostMem);
+  memcpy(m_alloc.map(m_cullInstanceBuffer), m_cullInstances.data(), m_cullInstances.size() * sizeof(CullInstance));
+  m_alloc.unmap(m_cullInstanceBuffer);
+  memcpy(m_alloc.map(m_cullModelBuffer), m_cullModels.data(), m_cullModels.size() * sizeof(CullModel));
+  m_alloc.unmap(m_cullModelBuffer);
+  m_clusterBuffer = createShared(std::max<size_t>(clusters.size(), 1) * sizeof(Cluster), vkBU::eStorageBuffer, hostMem);
+  memcpy(m_alloc.map(m_clusterBuffer), clusters.data(), clusters.size() * sizeof(Cluster));
+  m_alloc.unmap(m_clusterBuffer);
+
+  vk::DeviceSize nbRegions = 2 * m_swapChain.getImageCount();
+  m_cullDraws      = createShared(nbRegions * m_cullInstances.size() * sizeof(vk::DrawIndexedIndirectCommand),
+                             vkBU::eStorageBuffer | vkBU::eIndirectBuffer, vkMP::eDeviceLocal);
+  m_cullCounts     = createShared(nbRegions * m_cullModels.size() * sizeof(uint32_t),
+                              vkBU::eStorageBuffer | vkBU::eIndirectBuffer | vkBU::eTransferDst, vkMP::eDeviceLocal);
+  m_cullVisibility = createShared(m_cullInstances.size() * sizeof(uint32_t),
+                                  vkBU::eStorageBuffer | vkBU::eTransferDst, vkMP::eDeviceLocal);
+  vk::DeviceSize nbClusterDraws = std::max<vk::DeviceSize>(m_swapChain.getImageCount() * m_clusterDrawsPerFrame, 1);
+  m_clusterDraws     = createShared(nbClusterDraws * sizeof(vk::DrawIndexedIndirectCommand),
+                                vkBU::eStorageBuffer | vkBU::eIndirectBuffer, vkMP::eDeviceLocal);
+  m_clusterDrawInfos = createShared(nbClusterDraws * 2 * sizeof(uint32_t), vkBU::eStorageBuffer | vkBU::eVertexBuffer,
+                                    vkMP::eDeviceLocal);
+  m_debug.setObjectName(m_cullInstanceBuffer.buffer, "cullInstances");
+  m_debug.setObjectName(m_cullModelBuffer.buffer, "cullModels");
+  m_debug.setObjectName(m_cullDraws.buffer, "cullDraws");
+  m_debug.setObjectName(m_cullCounts.buffer, "cullCounts");
+  m_debug.setObjectName(m_cullVisibility.buffer, "cullVisibility");
+  m_debug.setObjectName(m_clusterBuffer.buffer, "clusters");
+  m_debug.setObjectName(m_clusterDraws.buffer, "clusterDraws");
+  m_debug.setObjectName(m_clusterDrawInfos.buffer, "clusterDrawInfos");
+
+  // Nothing was visible before the first frame, the late pass draws all instances
   {
-    m_offscreenRenderPass =
-        nvvk::createRenderPass(m_device, {m_offscreenColorFormat}, m_offscreenDepthFormat, 1, true,
-                               true, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+    nvvk::CommandPool cmdGen(m_device, m_graphicsQueueIndex);
+    auto              cmdBuf = cmdGen.createCommandBuffer();
+    cmdBuf.fillBuffer(m_cullVisibility.buffer, 0, VK_WHOLE_SIZE, 0);
+    cmdGen.submitAndWait(cmdBuf);
   }
 
-  // Creating the frame buffer for offscreen
-  std::vector<vk::ImageView> attachments = {m_offscreenColor.descriptor.imageView,
-                                            m_offscreenDepth.descriptor.imageView};
+  std::array<vk::DescriptorBufferInfo, 5> infos{vk::DescriptorBufferInfo{m_cullInstanceBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                                vk::DescriptorBufferInfo{m_cullModelBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                                vk::DescriptorBufferInfo{m_cullDraws.buffer, 0, VK_WHOLE_SIZE},
+                                                vk::DescriptorBufferInfo{m_cullCounts.buffer, 0, VK_WHOLE_SIZE},
+                                                vk::DescriptorBufferInfo{m_cullVisibility.buffer, 0, VK_WHOLE_SIZE}};
+  vk::DescriptorBufferInfo            cameraInfo{m_cameraMat.buffer, 0, VK_WHOLE_SIZE};
+  std::vector<vk::WriteDescriptorSet> writes;
+  for(uint32_t i = 0; i < infos.size(); i++)
+  {
+    writes.emplace_back(m_cullDescSetLayoutBind.makeWrite(m_cullDescSet, i, &infos[i]));
+  }
+  writes.emplace_back(m_cullDescSetLayoutBind.makeWrite(m_cullDescSet, 6, &cameraInfo));
+
+  std::array<vk::DescriptorBufferInfo, 7> clusterInfos{
+      vk::DescriptorBufferInfo{m_cullInstanceBuffer.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_cullModelBuffer.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_clusterBuffer.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_sceneDesc.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_clusterDraws.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_clusterDrawInfos.buffer, 0, VK_WHOLE_SIZE},
+      vk::DescriptorBufferInfo{m_cullCounts.buffer, 0, VK_WHOLE_SIZE}};
+  for(uint32_t i = 0; i < clusterInfos.size(); i++)
+  {
+    writes.emplace_back(m_clusterDescSetLayoutBind.makeWrite(m_clusterDescSet, i, &clusterInfos[i]));
+  }
+  writes.emplace_back(m_clusterDescSetLayoutBind.makeWrite(m_clusterDescSet, 7, &cameraInfo));
+  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 
-  m_device.destroy(m_offscreenFramebuffer);
-  vk::FramebufferCreateInfo info;
-  info.setRenderPass(m_offscreenRenderPass);
-  info.setAttachmentCount(2);
-  info.setPAttachments(attachments.data());
-  info.setWidth(m_size.width);
-  info.setHeight(m_size.height);
-  info.setLayers(1);
-  m_offscreenFramebuffer = m_device.createFramebuffer(info);
+  updateHizDescriptorSets();
 }
 
 //--------------------------------------------------------------------------------------------------
-// The pipeline is how things are rendered, which shaders, type of primitives, depth test and more
+// Depth pyramid of the size of the offscreen depth buffer, rounded down to powers of two, with
+// all its mip levels. Called by createOffscreenRender().
 //
-void HelloVulkan::createPostPipeline()
+void HelloVulkan::createDepthPyramid()
 {
-  // Push constants in the fragment shader
-  vk::PushConstantRange pushConstantRanges = {vk::ShaderStageFlagBits::eFragment, 0, sizeof(float)};
-
-  // Creating the pipeline layout
-  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
-  pipelineLayoutCreateInfo.setSetLayoutCount(1);
-  pipelineLayoutCreateInfo.setPSetLayouts(&m_postDescSetLayout);
-  pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
-  pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRanges);
-  m_postPipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
+  m_alloc.destroy(m_hizPyramid);
+  for(auto& view : m_hizLevelViews)
+  {
+    m_device.destroy(view);
+  }
+  m_hizLevelViews.clear();
+
+  auto previousPow2 = [](uint32_t v) {
+    uint32_t r = 1;
+    while(r * 2 <= v)
+      r *= 2;
+    return r;
+  };
+  m_hizSize   = vk::Extent2D{previousPow2(m_size.width), previousPow2(m_size.height)};
+  m_hizLevels = std::min(nvvk::mipLevels(m_hizSize), s_maxHizLevels);
+
+  auto imageInfo = nvvk::makeImage2DCreateInfo(m_hizSize, vk::Format::eR32Sfloat,
+                                               vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage, true);
+  imageInfo.setMipLevels(m_hizLevels);
+  nvvk::Image             image    = m_alloc.createImage(imageInfo);
+  vk::ImageViewCreateInfo viewInfo = nvvk::makeImageViewCreateInfo(image.image, imageInfo);
+  vk::SamplerCreateInfo   samplerInfo{{}, vk::Filter::eNearest, vk::Filter::eNearest, vk::SamplerMipmapMode::eNearest};
+  samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+  samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+  samplerInfo.setMaxLod(FLT_MAX);
+  m_hizPyramid                        = m_alloc.createTexture(image, viewInfo, samplerInfo);
+  m_hizPyramid.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  m_debug.setObjectName(m_hizPyramid.image, "depthPyramid");
+
+  for(uint32_t level = 0; level < m_hizLevels; level++)
+  {
+    viewInfo.subresourceRange.setBaseMipLevel(level);
+    viewInfo.subresourceRange.setLevelCount(1);
+    m_hizLevelViews.push_back(m_device.createImageView(viewInfo));
+  }
 
-  // Pipeline: completely generic, no vertices
-  nvvk::GraphicsPipelineGeneratorCombined pipelineGenerator(m_device, m_postPipelineLayout,
-                                                            m_renderPass);
-  pipelineGenerator.addShader(nvh::loadFile("spv/passthrough.vert.spv", true, defaultSearchPaths,
-                                            true),
-                              vk::ShaderStageFlagBits::eVertex);
-  pipelineGenerator.addShader(nvh::loadFile("spv/post.frag.spv", true, defaultSearchPaths, true),
-                              vk::ShaderStageFlagBits::eFragment);
-  pipelineGenerator.rasterizationState.setCullMode(vk::CullModeFlagBits::eNone);
-  m_postPipeline = pipelineGenerator.createPipeline();
-  m_debug.setObjectName(m_postPipeline, "post");
+  nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
+  auto              cmdBuf = genCmdBuf.createCommandBuffer();
+  nvvk::cmdBarrierImageLayout(cmdBuf, m_hizPyramid.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+  genCmdBuf.submitAndWait(cmdBuf);
 }
 
 //--------------------------------------------------------------------------------------------------
-// The descriptor layout is the description of the data that is passed to the vertex or the
-// fragment program.
+// Depth buffer and pyramid in the sets of depthpyramid.comp and cull.comp, after they were
+// (re)created. The levels past the last one repeat it, the array must be fully written.
 //
-void HelloVulkan::createPostDescriptor()
+void HelloVulkan::updateHizDescriptorSets()
 {
-  using vkDS = vk::DescriptorSetLayoutBinding;
-  using vkDT = vk::DescriptorType;
-  using vkSS = vk::ShaderStageFlagBits;
+  if(!m_hizDescSet)
+    return;
+
+  vk::DescriptorImageInfo depthInfo{m_hizPyramid.descriptor.sampler, m_offscreenDepth.descriptor.imageView,
+                                    vk::ImageLayout::eDepthStencilReadOnlyOptimal};
+  vk::DescriptorImageInfo pyramidInfo(m_hizPyramid.descriptor);
+  std::vector<vk::DescriptorImageInfo> levelInfos;
+  for(uint32_t level = 0; level < s_maxHizLevels; level++)
+  {
+    levelInfos.push_back({{}, m_hizLevelViews[std::min(level, m_hizLevels - 1)], vk::ImageLayout::eGeneral});
+  }
 
-  m_postDescSetLayoutBind.addBinding(vkDS(0, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
-  m_postDescSetLayout = m_postDescSetLayoutBind.createLayout(m_device);
-  m_postDescPool      = m_postDescSetLayoutBind.createPool(m_device);
-  m_postDescSet       = nvvk::allocateDescriptorSet(m_device, m_postDescPool, m_postDescSetLayout);
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.emplace_back(m_hizDescSetLayoutBind.makeWrite(m_hizDescSet, 0, &depthInfo));
+  writes.emplace_back(m_hizDescSetLayoutBind.makeWrite(m_hizDescSet, 1, &pyramidInfo));
+  writes.emplace_back(m_hizDescSetLayoutBind.makeWriteArray(m_hizDescSet, 2, levelInfos.data()));
+  writes.emplace_back(m_cullDescSetLayoutBind.makeWrite(m_cullDescSet, 5, &pyramidInfo));
+  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
 //--------------------------------------------------------------------------------------------------
-// Update the output
+// Frustum of the current camera and regions of `mode` in the buffers of `frame`
 //
-void HelloVulkan::updatePostDescriptorSet()
+HelloVulkan::CullPushConstant HelloVulkan::getCullPushConstant(uint32_t frame, CullMode mode) const
 {
-  vk::WriteDescriptorSet writeDescriptorSets =
-      m_postDescSetLayoutBind.makeWrite(m_postDescSet, 0, &m_offscreenColor.descriptor);
-  m_device.updateDescriptorSets(writeDescriptorSets, nullptr);
+  uint32_t         region = 2 * frame + (mode == eCullLate ? 1 : 0);
+  CameraMatrices   camera = getCameraMatrices(m_size);
+  CullPushConstant pushConstant;
+  pushConstant.frustum       = extractFrustum(camera.proj * camera.view);
+  pushConstant.nbInstances   = static_cast<uint32_t>(m_cullInstances.size());
+  pushConstant.drawBase      = region * pushConstant.nbInstances;
+  pushConstant.countBase     = region * static_cast<uint32_t>(m_cullModels.size());
+  pushConstant.mode          = mode;
+  pushConstant.pyramidWidth  = static_cast<int32_t>(m_hizSize.width);
+  pushConstant.pyramidHeight = static_cast<int32_t>(m_hizSize.height);
+  pushConstant.pyramidLevels = static_cast<int32_t>(m_hizLevels);
+  pushConstant.lodScale      = getLodScale();
+  return pushConstant;
 }
 
 //--------------------------------------------------------------------------------------------------
-// Draw a full screen quad with the attached image
+// Pixels covered by one unit at a distance of one, per pixel of error allowed, see selectLod()
 //
-void HelloVulkan::drawPost(vk::CommandBuffer cmdBuf)
+float HelloVulkan::getLodScale() const
 {
-  m_debug.beginLabel(cmdBuf, "Post");
+  if(!m_useLods)
+    return 0.f;
+  CameraMatrices camera = getCameraMatrices(m_size);
+  return std::abs(camera.proj(1, 1)) * m_renderSize.height * 0.5f / m_lodPixelError;
+}
 
-  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
-  cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
+//--------------------------------------------------------------------------------------------------
+// Called after prepareFrame, before the frame is submitted: culls the instances against the
+// camera of the frame on the compute queue. The frame waits for it before reading its draws.
+// With occlusion culling, this is the early pass: it waits for the late pass of the previous
+// frame, which wrote the visibility of the instances.
+//
+void HelloVulkan::cullFrame(uint32_t frame)
+{
+  if(!isCulling())
+    return;
 
-  auto aspectRatio = static_cast<float>(m_size.width) / static_cast<float>(m_size.height);
-  cmdBuf.pushConstants<float>(m_postPipelineLayout, vk::ShaderStageFlagBits::eFragment, 0,
-                              aspectRatio);
-  cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_postPipeline);
-  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_postPipelineLayout, 0,
-                            m_postDescSet, {});
-  cmdBuf.draw(3, 1, 0, 0);
+  CullPushConstant pushConstant = getCullPushConstant(frame, isOcclusionCulling() ? eCullEarly : eCullFrustum);
+
+  // Same frustum test and levels of detail on the CPU, only used for the UI
+  if(m_showCullStats)
+  {
+    std::vector<uint32_t> visible(m_cullInstances.size());
+    m_cpuVisibleInstances = cullInstances(pushConstant.frustum, m_cullInstances.data(), pushConstant.nbInstances, visible.data());
+    m_cpuVisibleTriangles = 0;
+    nvmath::mat4f view    = CameraManip.getMatrix();
+    for(uint32_t v = 0; v < m_cpuVisibleInstances; v++)
+    {
+      const CullInstance& instance = m_cullInstances[visible[v]];
+      const CullModel&    model    = m_cullModels[instance.objIndex];
+      uint32_t            lod      = selectLod(instance, model.lodError, model.nbLods, view, pushConstant.lodScale);
+      m_cpuVisibleTriangles += model.lodNbIndices[lod] / 3;
+    }
+  }
+
+  // The previous use of the command buffer was waited by the frame, which is done
+  vk::CommandBuffer cmdBuf = m_cullCmdBufs[frame];
+  cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+  m_debug.beginLabel(cmdBuf, "Frustum culling");
+
+  vk::DeviceSize countOffset = pushConstant.countBase * sizeof(uint32_t);
+  vk::DeviceSize countSize   = m_cullModels.size() * sizeof(uint32_t);
+  cmdBuf.fillBuffer(m_cullCounts.buffer, countOffset, countSize, 0);
+  vk::BufferMemoryBarrier clearBarrier{vk::AccessFlagBits::eTransferWrite,
+                                       vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       m_cullCounts.buffer,
+                                       countOffset,
+                                       countSize};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {},
+                         {clearBarrier}, {});
+
+  if(isClusterCulling())
+  {
+    cullClusters(cmdBuf, frame, pushConstant);
+  }
+  else
+  {
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_cullPipeline);
+    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cullPipelineLayout, 0, {m_cullDescSet}, {});
+    cmdBuf.pushConstants<CullPushConstant>(m_cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+    cmdBuf.dispatch((pushConstant.nbInstances + 63) / 64, 1, 1);
+  }
 
   m_debug.endLabel(cmdBuf);
-}
+  cmdBuf.end();
+
+  // Visibility written by the late pass of the last frame that had one
+  vk::PipelineStageFlags          waitStage = vk::PipelineStageFlagBits::eComputeShader;
+  vk::TimelineSemaphoreSubmitInfo timelineInfo;
+  timelineInfo.setWaitSemaphoreValueCount(1);
+  timelineInfo.setPWaitSemaphoreValues(&m_hizTimelineValue);
+  uint64_t signalValue = 0;  // ignored, the signaled semaphore is binary
+  timelineInfo.setSignalSemaphoreValueCount(1);
+  timelineInfo.setPSignalSemaphoreValues(&signalValue);
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.setCommandBufferCount(1);
+  submitInfo.setPCommandBuffers(&cmdBuf);
+  submitInfo.setSignalSemaphoreCount(1);
+  submitInfo.setPSignalSemaphores(&m_cullSemaphores[frame]);
+  if(pushConstant.mode == eCullEarly && m_hizTimelineValue > 0)
+  {
+    submitInfo.setWaitSemaphoreCount(1);
+    submitInfo.setPWaitSemaphores(&m_hizTimeline);
+    submitInfo.setPWaitDstStageMask(&waitStage);
+    submitInfo.setPNext(&timelineInfo);
+  }
+  m_queue_comp.submit(submitInfo, {});
 
-//////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////
+  // The draw commands and their counts are read as indirect parameters, the late pass
+  // overwrites the visibility read by this one
+  addFrameWaitSemaphore(m_cullSemaphores[frame],
+                        vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader);
+}
 
 //--------------------------------------------------------------------------------------------------
-// Initialize Vulkan ray tracing
-// #VKRay
-void HelloVulkan::initRayTracing()
+// Recorded by cullFrame() instead of cull.comp: one workgroup per instance culls the clusters
+// of its level of detail, the counts are the frustum region of the frame
+//
+void HelloVulkan::cullClusters(const vk::CommandBuffer& cmdBuf, uint32_t frame, const CullPushConstant& instancePushConstant)
+{
+  ClusterPushConstant pushConstant;
+  pushConstant.frustum     = instancePushConstant.frustum;
+  pushConstant.nbInstances = instancePushConstant.nbInstances;
+  pushConstant.drawBase    = frame * m_clusterDrawsPerFrame;
+  pushConstant.countBase   = instancePushConstant.countBase;
+  pushConstant.lodScale    = instancePushConstant.lodScale;
+  pushConstant.useCones    = m_useClusterCones ? 1 : 0;
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_clusterPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_clusterPipelineLayout, 0, {m_clusterDescSet}, {});
+  cmdBuf.pushConstants<ClusterPushConstant>(m_clusterPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+  cmdBuf.dispatch(pushConstant.nbInstances, 1, 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Farthest depth of the early draws, level by level. Recorded in the frame after the early
+// draws, the depth buffer is read between the two render passes.
+//
+void HelloVulkan::buildDepthPyramid(const vk::CommandBuffer& cmdBuf)
+{
+  m_debug.beginLabel(cmdBuf, "Depth pyramid");
+  vk::ImageSubresourceRange depthRange{vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1};
+  vk::ImageSubresourceRange pyramidRange{vk::ImageAspectFlagBits::eColor, 0, m_hizLevels, 0, 1};
+
+  // Depth to read, and the previous frame done reading the pyramid
+  vk::ImageMemoryBarrier depthToRead{vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                     vk::AccessFlagBits::eShaderRead,
+                                     vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                     vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                                     VK_QUEUE_FAMILY_IGNORED,
+                                     VK_QUEUE_FAMILY_IGNORED,
+                                     m_offscreenDepth.image,
+                                     depthRange};
+  vk::ImageMemoryBarrier pyramidToWrite{vk::AccessFlagBits::eShaderRead,
+                                        vk::AccessFlagBits::eShaderWrite,
+                                        vk::ImageLayout::eGeneral,
+                                        vk::ImageLayout::eGeneral,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        m_hizPyramid.image,
+                                        pyramidRange};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader,
+                         vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, {depthToRead, pyramidToWrite});
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_hizPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_hizPipelineLayout, 0, {m_hizDescSet}, {});
+  // Level 0 covers the rendered part of the depth buffer, the pyramid stays in NDC for cull.comp
+  vk::Extent2D srcSize = m_renderSize;
+  for(uint32_t level = 0; level < m_hizLevels; level++)
+  {
+    vk::Extent2D                dstSize{std::max(m_hizSize.width >> level, 1u), std::max(m_hizSize.height >> level, 1u)};
+    const std::array<int32_t, 5> pushConstant{int32_t(srcSize.width), int32_t(srcSize.height), int32_t(dstSize.width),
+                                              int32_t(dstSize.height), int32_t(level)};
+    cmdBuf.pushConstants(m_hizPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+                         static_cast<uint32_t>(sizeof(pushConstant)), pushConstant.data());
+    cmdBuf.dispatch((dstSize.width + 7) / 8, (dstSize.height + 7) / 8, 1);
+
+    // The level is read by the next one, and by the late culling
+    vk::ImageMemoryBarrier levelBarrier{vk::AccessFlagBits::eShaderWrite,
+                                        vk::AccessFlagBits::eShaderRead,
+                                        vk::ImageLayout::eGeneral,
+                                        vk::ImageLayout::eGeneral,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        m_hizPyramid.image,
+                                        {vk::ImageAspectFlagBits::eColor, level, 1, 0, 1}};
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+                           {}, {}, {}, {levelBarrier});
+    srcSize = dstSize;
+  }
+
+  // The late draws test and write the depth again
+  vk::ImageMemoryBarrier depthToAttachment{vk::AccessFlagBits::eShaderRead,
+                                           vk::AccessFlagBits::eDepthStencilAttachmentRead
+                                               | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                           vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                                           vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           m_offscreenDepth.image,
+                                           depthRange};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                         vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                         {}, {}, {}, {depthToAttachment});
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Late pass, recorded in the frame after buildDepthPyramid(): tests the instances against the
+// pyramid, stores their visibility for the early pass of the next frame and writes the draws
+// of the ones to add. The next frame's early pass waits for this frame.
+//
+void HelloVulkan::cullLate(const vk::CommandBuffer& cmdBuf)
+{
+  CullPushConstant pushConstant = getCullPushConstant(getCurFrame(), eCullLate);
+
+  m_debug.beginLabel(cmdBuf, "Occlusion culling");
+  vk::DeviceSize countOffset = pushConstant.countBase * sizeof(uint32_t);
+  vk::DeviceSize countSize   = m_cullModels.size() * sizeof(uint32_t);
+  cmdBuf.fillBuffer(m_cullCounts.buffer, countOffset, countSize, 0);
+  vk::BufferMemoryBarrier clearBarrier{vk::AccessFlagBits::eTransferWrite,
+                                       vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       m_cullCounts.buffer,
+                                       countOffset,
+                                       countSize};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {},
+                         {clearBarrier}, {});
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_cullPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cullPipelineLayout, 0, {m_cullDescSet}, {});
+  cmdBuf.pushConstants<CullPushConstant>(m_cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+  cmdBuf.dispatch((pushConstant.nbInstances + 63) / 64, 1, 1);
+
+  vk::MemoryBarrier drawBarrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {},
+                         {drawBarrier}, {}, {});
+  m_debug.endLabel(cmdBuf);
+
+  addFrameSignalSemaphore(m_hizTimeline, ++m_hizTimelineValue);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Post-processing
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Creating the offscreen frame buffers and the associated render pass, and the images of the
+// post-processing. The images used by both queues are shared concurrently. They are all of the
+// size of the window, the largest render size.
+//
+void HelloVulkan::createOffscreenRender()
+{
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    m_alloc.destroy(m_offscreenColors[i]);
+    m_alloc.destroy(m_gBuffers[i]);
+    m_alloc.destroy(m_postPingPong[i]);
+    m_alloc.destroy(m_bloom[i]);
+    m_alloc.destroy(m_postOutputs[i]);
+  }
+  m_alloc.destroy(m_offscreenDepth);
+
+  std::array<uint32_t, 2> families{m_graphicsQueueIndex, m_computeQueueIndex};
+  auto createImage = [&](vk::Extent2D size, vk::Format format, vk::ImageUsageFlags usage, bool shared, const char* name) {
+    auto createInfo = nvvk::makeImage2DCreateInfo(size, format, usage);
+    if(shared && m_graphicsQueueIndex != m_computeQueueIndex)
+    {
+      createInfo.setSharingMode(vk::SharingMode::eConcurrent);
+      createInfo.setQueueFamilyIndexCount(static_cast<uint32_t>(families.size()));
+      createInfo.setPQueueFamilyIndices(families.data());
+    }
+    nvvk::Image             image  = m_alloc.createImage(createInfo);
+    vk::ImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, createInfo);
+    nvvk::Texture           texture = (usage & vk::ImageUsageFlagBits::eSampled) ?
+                                m_alloc.createTexture(image, ivInfo, vk::SamplerCreateInfo()) :
+                                m_alloc.createTexture(image, ivInfo);
+    texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    m_debug.setObjectName(texture.image, name);
+    return texture;
+  };
+
+  // Creating the color images, and the images of the post-processing
+  using vkIU = vk::ImageUsageFlagBits;
+  vk::Extent2D halfSize{std::max(m_size.width / 2, 1u), std::max(m_size.height / 2, 1u)};
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    m_offscreenColors[i] = createImage(m_size, m_offscreenColorFormat,
+                                       vkIU::eColorAttachment | vkIU::eSampled | vkIU::eStorage, true, "offscreenColor");
+    m_gBuffers[i]     = createImage(m_size, vk::Format::eR32G32B32A32Sfloat, vkIU::eStorage, true, "gBuffer");
+    m_postPingPong[i] = createImage(m_size, vk::Format::eR32G32B32A32Sfloat, vkIU::eStorage, false, "postPingPong");
+    m_bloom[i]        = createImage(halfSize, vk::Format::eR16G16B16A16Sfloat, vkIU::eStorage, false, "bloom");
+    m_postOutputs[i] = createImage(m_size, vk::Format::eR8G8B8A8Unorm, vkIU::eStorage | vkIU::eSampled | vkIU::eTransferDst,
+                                   true, "postOutput");
+  }
+
+  // Creating the depth buffer
+  auto depthCreateInfo =
+      nvvk::makeImage2DCreateInfo(m_size, m_offscreenDepthFormat,
+                                  vk::ImageUsageFlagBits::eDepthStencilAttachment
+                                      | vk::ImageUsageFlagBits::eSampled);
+  {
+    nvvk::Image image = m_alloc.createImage(depthCreateInfo);
+
+    vk::ImageViewCreateInfo depthStencilView;
+    depthStencilView.setViewType(vk::ImageViewType::e2D);
+    depthStencilView.setFormat(m_offscreenDepthFormat);
+    depthStencilView.setSubresourceRange({vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1});
+    depthStencilView.setImage(image.image);
+
+    m_offscreenDepth = m_alloc.createTexture(image, depthStencilView);
+  }
+
+  // Setting the image layout for all images, the first frame displays a black image
+  {
+    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
+    auto              cmdBuf = genCmdBuf.createCommandBuffer();
+    for(uint32_t i = 0; i < 2; i++)
+    {
+      for(const nvvk::Texture* texture : {&m_offscreenColors[i], &m_gBuffers[i], &m_postPingPong[i], &m_bloom[i]})
+      {
+        nvvk::cmdBarrierImageLayout(cmdBuf, texture->image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+      }
+      nvvk::cmdBarrierImageLayout(cmdBuf, m_postOutputs[i].image, vk::ImageLayout::eUndefined,
+                                  vk::ImageLayout::eTransferDstOptimal);
+      cmdBuf.clearColorImage(m_postOutputs[i].image, vk::ImageLayout::eTransferDstOptimal,
+                             vk::ClearColorValue(std::array<float, 4>{0.f, 0.f, 0.f, 1.f}),
+                             {{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}});
+      nvvk::cmdBarrierImageLayout(cmdBuf, m_postOutputs[i].image, vk::ImageLayout::eTransferDstOptimal,
+                                  vk::ImageLayout::eGeneral);
+    }
+    nvvk::cmdBarrierImageLayout(cmdBuf, m_offscreenDepth.image, vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                vk::ImageAspectFlagBits::eDepth);
+
+    genCmdBuf.submitAndWait(cmdBuf);
+  }
+
+  // Creating a renderpass for the offscreen
+  if(!m_offscreenRenderPass)
+  {
+    m_offscreenRenderPass =
+        nvvk::createRenderPass(m_device, {m_offscreenColorFormat}, m_offscreenDepthFormat, 1, true,
+                               true, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+    // Draws of the late occlusion culling pass, on top of the early ones
+    m_offscreenRenderPassLoad =
+        nvvk::createRenderPass(m_device, {m_offscreenColorFormat}, m_offscreenDepthFormat, 1, false,
+                               false, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+  }
+
+  // Creating the frame buffers for offscreen
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    std::vector<vk::ImageView> attachments = {m_offscreenColors[i].descriptor.imageView,
+                                              m_offscreenDepth.descriptor.imageView};
+
+    m_device.destroy(m_offscreenFramebuffers[i]);
+    vk::FramebufferCreateInfo info;
+    info.setRenderPass(m_offscreenRenderPass);
+    info.setAttachmentCount(2);
+    info.setPAttachments(attachments.data());
+    info.setWidth(m_size.width);
+    info.setHeight(m_size.height);
+    info.setLayers(1);
+    m_offscreenFramebuffers[i] = m_device.createFramebuffer(info);
+  }
+
+  m_renderSize = getScaledExtent(m_size, m_renderScale);
+  resetFrame();
+
+  createDepthPyramid();
+  createRtAccumulation();
+  updatePostComputeDescriptorSets();
+}
+
+//--------------------------------------------------------------------------------------------------
+// The pipeline is how things are rendered, which shaders, type of primitives, depth test and more
+//
+void HelloVulkan::createPostPipeline()
+{
+  // Push constants in the fragment shader
+  vk::PushConstantRange pushConstantRanges = {vk::ShaderStageFlagBits::eFragment, 0, sizeof(float)};
+
+  // Creating the pipeline layout
+  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+  pipelineLayoutCreateInfo.setSetLayoutCount(1);
+  pipelineLayoutCreateInfo.setPSetLayouts(&m_postDescSetLayout);
+  pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
+  pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRanges);
+  m_postPipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+  // Pipeline: completely generic, no vertices
+  m_pipelineTasks.push_back(m_pipelineBuilder.enqueue([this](vk::PipelineCache cache) {
+    nvvk::GraphicsPipelineGeneratorCombined pipelineGenerator(m_device, m_postPipelineLayout,
+                                                              m_renderPass);
+    pipelineGenerator.addShader(nvh::loadFile("spv/passthrough.vert.spv", true, defaultSearchPaths,
+                                              true),
+                                vk::ShaderStageFlagBits::eVertex);
+    pipelineGenerator.addShader(nvh::loadFile("spv/post.frag.spv", true, defaultSearchPaths, true),
+                                vk::ShaderStageFlagBits::eFragment);
+    pipelineGenerator.rasterizationState.setCullMode(vk::CullModeFlagBits::eNone);
+    m_postPipeline = pipelineGenerator.createPipeline(cache);
+    m_debug.setObjectName(m_postPipeline, "post");
+    return m_postPipeline;
+  }));
+}
+
+//--------------------------------------------------------------------------------------------------
+// The descriptor layout is the description of the data that is passed to the vertex or the
+// fragment program.
+//
+void HelloVulkan::createPostDescriptor()
+{
+  using vkDS = vk::DescriptorSetLayoutBinding;
+  using vkDT = vk::DescriptorType;
+  using vkSS = vk::ShaderStageFlagBits;
+
+  m_postDescSetLayoutBind.addBinding(vkDS(0, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
+  m_postDescSetLayout = m_postDescSetLayoutBind.createLayout(m_device);
+  for(auto& set : m_postDescSets)
+  {
+    set = m_descAllocator.allocate(m_postDescSetLayout, m_postDescSetLayoutBind);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Update the output
+//
+void HelloVulkan::updatePostDescriptorSet()
+{
+  std::vector<vk::WriteDescriptorSet> writes;
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    writes.emplace_back(m_postDescSetLayoutBind.makeWrite(m_postDescSets[i], 0, &m_postOutputs[i].descriptor));
+  }
+  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Draw a full screen quad with the post-processed image of the previous frame
+//
+void HelloVulkan::drawPost(vk::CommandBuffer cmdBuf)
+{
+  m_debug.beginLabel(cmdBuf, "Post");
+
+  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
+  cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
+
+  auto aspectRatio = static_cast<float>(m_size.width) / static_cast<float>(m_size.height);
+  cmdBuf.pushConstants<float>(m_postPipelineLayout, vk::ShaderStageFlagBits::eFragment, 0,
+                              aspectRatio);
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_postPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_postPipelineLayout, 0,
+                            m_postDescSets[(m_postFrame + 1) & 1], {});
+  cmdBuf.draw(3, 1, 0, 0);
+
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Layout and pipelines of the post-processing on the compute queue, one descriptor set per
+// offscreen image, and the per-frame command buffers
+//
+void HelloVulkan::createPostCompute()
+{
+  using vkDT = vk::DescriptorType;
+  using vkSS = vk::ShaderStageFlagBits;
+
+  for(uint32_t binding = 0; binding < 7; binding++)
+  {
+    // color, G-buffer, ping, pong, bloom0, bloom1, output
+    m_postCompDescSetLayoutBind.addBinding({binding, vkDT::eStorageImage, 1, vkSS::eCompute});
+  }
+  m_postCompDescSetLayout = m_postCompDescSetLayoutBind.createLayout(m_device);
+  for(auto& set : m_postCompDescSets)
+  {
+    set = m_descAllocator.allocate(m_postCompDescSetLayout, m_postCompDescSetLayoutBind);
+  }
+
+  vk::PushConstantRange        pushConstant{vkSS::eCompute, 0, sizeof(PostPushConstant)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, 1, &m_postCompDescSetLayout, 1, &pushConstant};
+  m_postCompPipelineLayout = m_device.createPipelineLayout(layoutInfo);
+  enqueueComputePipeline("spv/denoise.comp.spv", m_postCompPipelineLayout, &m_denoisePipeline);
+  enqueueComputePipeline("spv/bloom.comp.spv", m_postCompPipelineLayout, &m_bloomPipeline);
+  enqueueComputePipeline("spv/tonemap.comp.spv", m_postCompPipelineLayout, &m_tonemapPipeline);
+
+  uint32_t nbFrames = m_swapChain.getImageCount();
+  m_postCmdBufs     = m_device.allocateCommandBuffers({m_cmdPool_comp, vk::CommandBufferLevel::ePrimary, nbFrames});
+  m_postCmdValues.assign(nbFrames, 0);
+  vk::SemaphoreTypeCreateInfo timelineInfo{vk::SemaphoreType::eTimeline, 0};
+  m_renderTimeline = m_device.createSemaphore({{}, &timelineInfo});
+  m_postTimeline   = m_device.createSemaphore({{}, &timelineInfo});
+
+  updatePostComputeDescriptorSets();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Images in the sets of the post-processing, after they were (re)created
+//
+void HelloVulkan::updatePostComputeDescriptorSets()
+{
+  if(!m_postCompDescSets[0])
+    return;
+
+  std::vector<vk::DescriptorImageInfo> infos;
+  infos.reserve(2 * 7);
+  std::vector<vk::WriteDescriptorSet> writes;
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    const nvvk::Texture* images[] = {&m_offscreenColors[i], &m_gBuffers[i], &m_postPingPong[0], &m_postPingPong[1],
+                                     &m_bloom[0],           &m_bloom[1],    &m_postOutputs[i]};
+    for(uint32_t binding = 0; binding < 7; binding++)
+    {
+      infos.push_back({{}, images[binding]->descriptor.imageView, vk::ImageLayout::eGeneral});
+      writes.emplace_back(m_postCompDescSetLayoutBind.makeWrite(m_postCompDescSets[i], binding, &infos.back()));
+    }
+  }
+  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called after the command buffer of the frame begins, before anything is rendered: the frame
+// renders into the offscreen image of getOffscreenIndex(), and displays the image
+// post-processed from the other one by the previous frame.
+//
+void HelloVulkan::beginOffscreenFrame(const vk::CommandBuffer& cmdBuf)
+{
+  m_postFrame++;
+  addFrameSignalSemaphore(m_renderTimeline, m_postFrame);
+  if(m_postFrame > 1)
+  {
+    // Only drawPost() waits, the rendering of this frame overlaps the post-processing
+    addFrameWaitSemaphore(m_postTimeline, vk::PipelineStageFlagBits::eFragmentShader, m_postFrame - 1);
+  }
+
+  // The image of this frame was read by the post-processing two frames ago, which the
+  // fragment shaders of the previous frame waited for
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+                         vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                         {}, {}, {}, {});
+
+  if(m_frameTimersSupported)
+  {
+    uint32_t query = 4 * getCurFrame();
+    cmdBuf.resetQueryPool(m_frameTimers, query, 2);
+    cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_frameTimers, query);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called once the offscreen image of the frame is rendered, before drawPost()
+//
+void HelloVulkan::endOffscreenFrame(const vk::CommandBuffer& cmdBuf)
+{
+  if(!m_frameTimersSupported)
+    return;
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_frameTimers, 4 * getCurFrame() + 1);
+  m_renderTimerWritten[getCurFrame()] = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called after submitFrame(): post-processes the offscreen image of the frame on the compute
+// queue once the graphics queue rendered it, while the graphics queue goes on with the next
+// frame. The ray traced image is denoised, then bloom and tonemapping write m_postOutputs.
+//
+void HelloVulkan::postProcess(uint32_t frame, bool raytraced)
+{
+  // The last post-processing recorded in this command buffer must be done
+  if(m_postCmdValues[frame] > 0)
+  {
+    vk::SemaphoreWaitInfo waitInfo{{}, 1, &m_postTimeline, &m_postCmdValues[frame]};
+    while(m_device.waitSemaphores(waitInfo, 10000) == vk::Result::eTimeout)
+    {
+    }
+  }
+  m_postCmdValues[frame] = m_postFrame;
+
+  vk::CommandBuffer cmdBuf = m_postCmdBufs[frame];
+  cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+  m_debug.beginLabel(cmdBuf, "Post-processing");
+  if(m_postTimersSupported)
+  {
+    cmdBuf.resetQueryPool(m_frameTimers, 4 * frame + 2, 2);
+    cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_frameTimers, 4 * frame + 2);
+  }
+
+  // Each pass reads the results of the previous one, the first one overwrites the images of
+  // the previous post-processing
+  auto passBarrier = [&]() {
+    vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead,
+                              vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {},
+                           {barrier}, {}, {});
+  };
+  auto dispatch = [&](vk::Pipeline pipeline, const PostPushConstant& pushConstant, vk::Extent2D size) {
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    cmdBuf.pushConstants<PostPushConstant>(m_postCompPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+    cmdBuf.dispatch((size.width + 7) / 8, (size.height + 7) / 8, 1);
+    passBarrier();
+  };
+  passBarrier();
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_postCompPipelineLayout, 0,
+                            {m_postCompDescSets[getOffscreenIndex()]}, {});
+
+  // The passes before the tonemapper work on the rendered part of the images
+  PostPushConstant pushConstant = m_postSettings;
+  pushConstant.samples          = std::max(m_rtPushConstants.frame + 1, 1);
+  pushConstant.source           = ePostColor;
+  pushConstant.renderWidth      = static_cast<int32_t>(m_renderSize.width);
+  pushConstant.renderHeight     = static_cast<int32_t>(m_renderSize.height);
+  if(raytraced && m_useDenoiser)
+  {
+    m_debug.beginLabel(cmdBuf, "Denoise");
+    int iterations = std::min(m_denoiseIterations, static_cast<int>(s_postMaxIterations));
+    for(int i = 0; i < iterations; i++)
+    {
+      pushConstant.destination = (i & 1) ? ePostPong : ePostPing;
+      pushConstant.stepSize    = 1 << i;
+      dispatch(m_denoisePipeline, pushConstant, m_renderSize);
+      pushConstant.source = pushConstant.destination;
+    }
+    m_debug.endLabel(cmdBuf);
+  }
+
+  if(pushConstant.bloomIntensity > 0.f)
+  {
+    m_debug.beginLabel(cmdBuf, "Bloom");
+    vk::Extent2D halfSize{std::max(m_renderSize.width / 2, 1u), std::max(m_renderSize.height / 2, 1u)};
+    for(int32_t pass = 0; pass < 3; pass++)
+    {
+      pushConstant.stepSize = pass;
+      dispatch(m_bloomPipeline, pushConstant, halfSize);
+    }
+    m_debug.endLabel(cmdBuf);
+  }
+
+  // Upscales to the size of the window
+  dispatch(m_tonemapPipeline, pushConstant, m_size);
+  if(m_postTimersSupported)
+  {
+    cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_frameTimers, 4 * frame + 3);
+    m_postTimerWritten[frame] = true;
+  }
+  m_debug.endLabel(cmdBuf);
+  cmdBuf.end();
+
+  vk::PipelineStageFlags          waitStage = vk::PipelineStageFlagBits::eComputeShader;
+  vk::TimelineSemaphoreSubmitInfo timelineInfo;
+  timelineInfo.setWaitSemaphoreValueCount(1);
+  timelineInfo.setPWaitSemaphoreValues(&m_postFrame);
+  timelineInfo.setSignalSemaphoreValueCount(1);
+  timelineInfo.setPSignalSemaphoreValues(&m_postFrame);
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.setPNext(&timelineInfo);
+  submitInfo.setWaitSemaphoreCount(1);
+  submitInfo.setPWaitSemaphores(&m_renderTimeline);
+  submitInfo.setPWaitDstStageMask(&waitStage);
+  submitInfo.setCommandBufferCount(1);
+  submitInfo.setPCommandBuffers(&cmdBuf);
+  submitInfo.setSignalSemaphoreCount(1);
+  submitInfo.setPSignalSemaphores(&m_postTimeline);
+  m_queue_comp.submit(submitInfo, {});
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Dynamic resolution
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Two timestamps around the offscreen rendering and two around the post-processing of each
+// frame in flight. Dynamic resolution needs timestamps on the graphics queue, the time of the
+// post-processing is left out if the compute queue has none.
+//
+void HelloVulkan::createFrameTimers()
+{
+  auto families          = m_physicalDevice.getQueueFamilyProperties();
+  m_frameTimersSupported = families[m_graphicsQueueIndex].timestampValidBits > 0;
+  m_postTimersSupported  = m_frameTimersSupported && families[m_computeQueueIndex].timestampValidBits > 0;
+  if(!m_frameTimersSupported)
+  {
+    LOGW("Graphics queue does not support timestamps, dynamic resolution disabled\n");
+    return;
+  }
+
+  uint32_t nbFrames = m_swapChain.getImageCount();
+  m_frameTimers     = m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 4 * nbFrames});
+  m_renderTimerWritten.assign(nbFrames, false);
+  m_postTimerWritten.assign(nbFrames, false);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called after prepareFrame, before the frame is recorded: reads the timestamps of the last
+// frame that used `frame`, and picks the render size of the new frame. The GPU time is about
+// proportional to the number of pixels, the scale moves halfway to the one which would hold
+// the target, only when over the target or well under it. The next frames in flight were
+// recorded at the previous scale, their timings are skipped after a change.
+//
+void HelloVulkan::updateRenderSize(uint32_t frame)
+{
+  if(m_frameTimersSupported)
+  {
+    const float             timestampPeriod = m_physicalDevice.getProperties().limits.timestampPeriod;
+    std::array<uint64_t, 2> timestamps{};
+    // The fence of the frame was waited for, the rendering is done
+    if(m_renderTimerWritten[frame]
+       && m_device.getQueryPoolResults(m_frameTimers, 4 * frame, 2, sizeof(timestamps), timestamps.data(),
+                                       sizeof(uint64_t), vk::QueryResultFlagBits::e64)
+              == vk::Result::eSuccess)
+    {
+      m_gpuRenderTime = float(double(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0);
+    }
+    // The post-processing may still run, the previous time is kept
+    if(m_postTimerWritten[frame]
+       && m_device.getQueryPoolResults(m_frameTimers, 4 * frame + 2, 2, sizeof(timestamps), timestamps.data(),
+                                       sizeof(uint64_t), vk::QueryResultFlagBits::e64)
+              == vk::Result::eSuccess)
+    {
+      m_gpuPostTime = float(double(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0);
+    }
+
+    // Both queues share the GPU, the sum is an upper bound of the frame time
+    float gpuTime = m_gpuRenderTime + m_gpuPostTime;
+    if(m_renderScaleCooldown > 0)
+      m_renderScaleCooldown--;
+    else
+      m_gpuFrameTime = m_gpuFrameTime > 0.f ? m_gpuFrameTime + (gpuTime - m_gpuFrameTime) * 0.1f : gpuTime;
+  }
+
+  float scale = m_renderScale;
+  if(m_useDynamicResolution && m_frameTimersSupported && m_renderScaleCooldown == 0 && m_gpuFrameTime > 0.f)
+  {
+    float headroom = m_targetFrameTime / m_gpuFrameTime;
+    if(headroom < 1.f || headroom > 1.15f)
+    {
+      float wanted = m_renderScale * std::sqrt(headroom);
+      scale        = m_renderScale + (wanted - m_renderScale) * 0.5f;
+    }
+    // Steps of 1/32, small changes would restart the accumulation for nothing
+    scale = std::round(scale * 32.f) / 32.f;
+  }
+  if(m_useDynamicResolution)
+    scale = std::min(std::max(scale, m_minRenderScale), std::max(m_minRenderScale, m_maxRenderScale));
+  // The offscreen images are of the size of the window
+  m_renderScale = std::min(std::max(scale, 0.1f), 1.f);
+
+  vk::Extent2D renderSize = getScaledExtent(m_size, m_renderScale);
+  if(renderSize != m_renderSize)
+  {
+    m_renderSize = renderSize;
+    resetFrame();
+    m_renderScaleCooldown = m_swapChain.getImageCount() + 1;
+    m_gpuFrameTime        = 0.f;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Initialize Vulkan ray tracing
+// #VKRay
+void HelloVulkan::initRayTracing()
 {
   // Requesting ray tracing properties
   auto properties =
@@ -743,6 +1946,7 @@ void HelloVulkan::initRayTracing()
                                       vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
   m_rtProperties = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
   m_rtBuilder.setup(m_device, &m_alloc, m_graphicsQueueIndex);
+  m_sbt.init(m_device, m_rtProperties);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -804,7 +2008,7 @@ void HelloVulkan::createTopLevelAS()
     rayInst.transform        = m_objInstance[i].transform;  // Position of the instance
     rayInst.instanceCustomId = i;                           // gl_InstanceCustomIndexEXT
     rayInst.blasId           = m_objInstance[i].objIndex;
-    rayInst.hitGroupId       = 0;  // We will use the same hit group for all objects
+    rayInst.hitGroupId       = i;  // Hit record of the instance, see createRtShaderBindingTable()
     rayInst.flags            = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
     tlas.emplace_back(rayInst);
   }
@@ -814,7 +2018,10 @@ void HelloVulkan::createTopLevelAS()
 //--------------------------------------------------------------------------------------------------
 // This descriptor set holds the Acceleration structure and the output image
 //
-void HelloVulkan::createRtDescriptorSet()
+// - The layout is created first, so the ray tracing pipeline can be compiled while the
+//   acceleration structures are built
+//
+void HelloVulkan::createRtDescriptorSetLayout()
 {
   using vkDT   = vk::DescriptorType;
   using vkSS   = vk::ShaderStageFlagBits;
@@ -824,22 +2031,38 @@ void HelloVulkan::createRtDescriptorSet()
                                           vkSS::eRaygenKHR | vkSS::eClosestHitKHR));  // TLAS
   m_rtDescSetLayoutBind.addBinding(
       vkDSLB(1, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));  // Output image
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(2, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));   // Moments
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(3, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Tiles
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(4, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));   // Previous image
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(5, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));   // G-buffer
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(6, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));   // Previous G-buffer
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(7, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));   // Shadow rays
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(8, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));   // Shadow ray count
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(9, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));   // Shadow ray keys
+  m_rtDescSetLayoutBind.addBinding(vkDSLB(10, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Shadow ray indices
 
-  m_rtDescPool      = m_rtDescSetLayoutBind.createPool(m_device);
   m_rtDescSetLayout = m_rtDescSetLayoutBind.createLayout(m_device);
-  m_rtDescSet       = m_device.allocateDescriptorSets({m_rtDescPool, 1, &m_rtDescSetLayout})[0];
+}
+
+void HelloVulkan::createRtDescriptorSet()
+{
+  // One set per offscreen image, each one accumulates into its image from the other one
+  for(auto& set : m_rtDescSets)
+  {
+    set = m_descAllocator.allocate(m_rtDescSetLayout, m_rtDescSetLayoutBind);
+  }
 
   vk::AccelerationStructureKHR                   tlas = m_rtBuilder.getAccelerationStructure();
   vk::WriteDescriptorSetAccelerationStructureKHR descASInfo;
   descASInfo.setAccelerationStructureCount(1);
   descASInfo.setPAccelerationStructures(&tlas);
-  vk::DescriptorImageInfo imageInfo{
-      {}, m_offscreenColor.descriptor.imageView, vk::ImageLayout::eGeneral};
+  for(auto& set : m_rtDescSets)
+  {
+    vk::WriteDescriptorSet asWrite = m_rtDescSetLayoutBind.makeWrite(set, 0, &descASInfo);
+    m_device.updateDescriptorSets(asWrite, nullptr);
+  }
 
-  std::vector<vk::WriteDescriptorSet> writes;
-  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, 0, &descASInfo));
-  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, 1, &imageInfo));
-  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  updateRtDescriptorSet();
 }
 
 
@@ -849,143 +2072,354 @@ void HelloVulkan::createRtDescriptorSet()
 //
 void HelloVulkan::updateRtDescriptorSet()
 {
-  using vkDT = vk::DescriptorType;
+  // (1) Output buffer, (2) moments and (3) tiles of the accumulation, (4) previous output,
+  // (5) G-buffer and (6) previous G-buffer, (7-10) deferred shadow rays
+  vk::DescriptorImageInfo  momentsInfo{{}, m_rtMoments.descriptor.imageView, vk::ImageLayout::eGeneral};
+  vk::DescriptorBufferInfo tilesInfo{m_rtTiles.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo shadowRaysInfo{m_shadowRays.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo countInfo{m_shadowRayCount.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo keysInfo{m_shadowKeys.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo indicesInfo{m_shadowIndices.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo histogramsInfo{m_shadowHistograms.buffer, 0, VK_WHOLE_SIZE};
+  std::array<vk::DescriptorImageInfo, 2> imageInfos;
+  std::array<vk::DescriptorImageInfo, 2> gBufferInfos;
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    imageInfos[i]   = {{}, m_offscreenColors[i].descriptor.imageView, vk::ImageLayout::eGeneral};
+    gBufferInfos[i] = {{}, m_gBuffers[i].descriptor.imageView, vk::ImageLayout::eGeneral};
+  }
 
-  // (1) Output buffer
-  vk::DescriptorImageInfo imageInfo{
-      {}, m_offscreenColor.descriptor.imageView, vk::ImageLayout::eGeneral};
-  vk::WriteDescriptorSet wds{m_rtDescSet, 1, 0, 1, vkDT::eStorageImage, &imageInfo};
-  m_device.updateDescriptorSets(wds, nullptr);
+  std::vector<vk::WriteDescriptorSet> writes;
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 1, &imageInfos[i]));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 2, &momentsInfo));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 3, &tilesInfo));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 4, &imageInfos[1 - i]));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 5, &gBufferInfos[i]));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 6, &gBufferInfos[1 - i]));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 7, &shadowRaysInfo));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 8, &countInfo));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 9, &keysInfo));
+    writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSets[i], 10, &indicesInfo));
+  }
+  // The count, keys, indices and histograms of radixsort.comp
+  if(m_sortDescSet)
+  {
+    writes.emplace_back(m_sortDescSetLayoutBind.makeWrite(m_sortDescSet, 0, &countInfo));
+    writes.emplace_back(m_sortDescSetLayoutBind.makeWrite(m_sortDescSet, 1, &keysInfo));
+    writes.emplace_back(m_sortDescSetLayoutBind.makeWrite(m_sortDescSet, 2, &indicesInfo));
+    writes.emplace_back(m_sortDescSetLayoutBind.makeWrite(m_sortDescSet, 3, &histogramsInfo));
+  }
+  m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
-
 //--------------------------------------------------------------------------------------------------
-// Pipeline for the ray tracer: all shaders, raygen, chit, miss
+// Moments image and tile flags of the progressive accumulation, of the size of the offscreen
+// image. Called by createOffscreenRender(), the accumulation restarts.
 //
-void HelloVulkan::createRtPipeline()
+void HelloVulkan::createRtAccumulation()
 {
-  vk::ShaderModule raygenSM = nvvk::createShaderModule(
-      m_device, nvh::loadFile("spv/raytrace.rgen.spv", true, defaultSearchPaths, true));
-  vk::ShaderModule missSM = nvvk::createShaderModule(
-      m_device, nvh::loadFile("spv/raytrace.rmiss.spv", true, defaultSearchPaths, true));
-
-  // The second miss shader is invoked when a shadow ray misses the geometry. It
-  // simply indicates that no occlusion has been found
-  vk::ShaderModule shadowmissSM = nvvk::createShaderModule(
-      m_device, nvh::loadFile("spv/raytraceShadow.rmiss.spv", true, defaultSearchPaths, true));
-
-
-  std::vector<vk::PipelineShaderStageCreateInfo> stages;
-
-  // Raygen
-  vk::RayTracingShaderGroupCreateInfoKHR rg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
-  rg.setGeneralShader(static_cast<uint32_t>(stages.size()));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eRaygenKHR, raygenSM, "main"});
-  m_rtShaderGroups.push_back(rg);
-  // Miss
-  vk::RayTracingShaderGroupCreateInfoKHR mg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
-  mg.setGeneralShader(static_cast<uint32_t>(stages.size()));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, missSM, "main"});
-  m_rtShaderGroups.push_back(mg);
-  // Shadow Miss
-  mg.setGeneralShader(static_cast<uint32_t>(stages.size()));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, shadowmissSM, "main"});
-  m_rtShaderGroups.push_back(mg);
-
-  // Hit Group - Closest Hit + AnyHit
-  vk::ShaderModule chitSM = nvvk::createShaderModule(
-      m_device, nvh::loadFile("spv/raytrace.rchit.spv", true, defaultSearchPaths, true));
-
-  vk::RayTracingShaderGroupCreateInfoKHR hg{vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
-                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
-  hg.setClosestHitShader(static_cast<uint32_t>(stages.size()));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitKHR, chitSM, "main"});
-  m_rtShaderGroups.push_back(hg);
-
-  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
-
-  // Push constant: we want to be able to update constants used by the shaders
-  vk::PushConstantRange pushConstant{vk::ShaderStageFlagBits::eRaygenKHR
-                                         | vk::ShaderStageFlagBits::eClosestHitKHR
-                                         | vk::ShaderStageFlagBits::eMissKHR,
-                                     0, sizeof(RtPushConstant)};
-  pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
-  pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstant);
+  m_alloc.destroy(m_rtMoments);
+  m_alloc.destroy(m_rtTiles);
+
+  auto imageInfo = nvvk::makeImage2DCreateInfo(m_size, vk::Format::eR32Sfloat, vk::ImageUsageFlagBits::eStorage);
+  nvvk::Image image = m_alloc.createImage(imageInfo);
+  m_rtMoments       = m_alloc.createTexture(image, nvvk::makeImageViewCreateInfo(image.image, imageInfo));
+  m_rtMoments.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  m_debug.setObjectName(m_rtMoments.image, "rtMoments");
+
+  m_rtTileCount = vk::Extent2D{(m_size.width + s_rtTileSize - 1) / s_rtTileSize,
+                               (m_size.height + s_rtTileSize - 1) / s_rtTileSize};
+  m_rtTiles = m_alloc.createBuffer(2 * m_rtTileCount.width * m_rtTileCount.height * sizeof(uint32_t),
+                                   vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                   vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_debug.setObjectName(m_rtTiles.buffer, "rtTiles");
+
+  nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
+  auto              cmdBuf = genCmdBuf.createCommandBuffer();
+  nvvk::cmdBarrierImageLayout(cmdBuf, m_rtMoments.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+  genCmdBuf.submitAndWait(cmdBuf);
+
+  createShadowRayBuffers();
+  resetFrame();
+}
 
-  // Descriptor sets: one specific to ray tracing, and one shared with the rasterization pipeline
-  std::vector<vk::DescriptorSetLayout> rtDescSetLayouts = {m_rtDescSetLayout, m_descSetLayout};
-  pipelineLayoutCreateInfo.setSetLayoutCount(static_cast<uint32_t>(rtDescSetLayouts.size()));
-  pipelineLayoutCreateInfo.setPSetLayouts(rtDescSetLayouts.data());
+//--------------------------------------------------------------------------------------------------
+// Deferred shadow rays: at most one per pixel of the largest render size, and the histograms
+// of the radix sort of their keys, one per digit and block. Called by createRtAccumulation().
+//
+void HelloVulkan::createShadowRayBuffers()
+{
+  m_alloc.destroy(m_shadowRays);
+  m_alloc.destroy(m_shadowRayCount);
+  m_alloc.destroy(m_shadowKeys);
+  m_alloc.destroy(m_shadowIndices);
+  m_alloc.destroy(m_shadowHistograms);
+
+  using vkBU              = vk::BufferUsageFlagBits;
+  m_shadowRayCapacity     = m_size.width * m_size.height;
+  uint32_t       nbBlocks = (m_shadowRayCapacity + s_sortBlockSize - 1) / s_sortBlockSize;
+  vk::DeviceSize capacity = m_shadowRayCapacity;
+  // Read back by validateShadowSort()
+  m_shadowRays     = m_alloc.createBuffer(capacity * sizeof(ShadowRay), vkBU::eStorageBuffer | vkBU::eTransferSrc,
+                                      vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_shadowRayCount = m_alloc.createBuffer(sizeof(uint32_t), vkBU::eStorageBuffer | vkBU::eTransferDst | vkBU::eTransferSrc,
+                                          vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_shadowKeys     = m_alloc.createBuffer(2 * capacity * sizeof(uint32_t), vkBU::eStorageBuffer,
+                                      vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_shadowIndices  = m_alloc.createBuffer(2 * capacity * sizeof(uint32_t), vkBU::eStorageBuffer | vkBU::eTransferSrc,
+                                         vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_shadowHistograms = m_alloc.createBuffer(vk::DeviceSize(256) * nbBlocks * sizeof(uint32_t), vkBU::eStorageBuffer,
+                                            vk::MemoryPropertyFlagBits::eDeviceLocal);
+  m_debug.setObjectName(m_shadowRays.buffer, "shadowRays");
+  m_debug.setObjectName(m_shadowRayCount.buffer, "shadowRayCount");
+  m_debug.setObjectName(m_shadowKeys.buffer, "shadowKeys");
+  m_debug.setObjectName(m_shadowIndices.buffer, "shadowIndices");
+  m_debug.setObjectName(m_shadowHistograms.buffer, "shadowHistograms");
+}
 
-  m_rtPipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
+//--------------------------------------------------------------------------------------------------
+// Pipeline of radixsort.comp. The rank of the keys in a workgroup uses subgroup ballots, on
+// subgroups of 16 to 128 invocations. Without them, eShadowSorted is not offered.
+//
+void HelloVulkan::createShadowSortPipeline()
+{
+  auto props         = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+  auto subgroupProps = props.get<vk::PhysicalDeviceSubgroupProperties>();
+  m_shadowSortSupported = (subgroupProps.supportedStages & vk::ShaderStageFlagBits::eCompute)
+                          && (subgroupProps.supportedOperations & vk::SubgroupFeatureFlagBits::eBallot)
+                          && subgroupProps.subgroupSize >= 16 && subgroupProps.subgroupSize <= 128;
+  if(!m_shadowSortSupported)
+  {
+    LOGW("Subgroup ballots of 16 to 128 invocations are not supported, shadow rays are not sorted\n");
+    return;
+  }
 
-  // Assemble the shader stages and recursion depth info into the ray tracing pipeline
-  vk::RayTracingPipelineCreateInfoKHR rayPipelineInfo;
-  rayPipelineInfo.setStageCount(static_cast<uint32_t>(stages.size()));  // Stages are shaders
-  rayPipelineInfo.setPStages(stages.data());
+  using vkDT = vk::DescriptorType;
+  using vkSS = vk::ShaderStageFlagBits;
+  for(uint32_t binding = 0; binding < 4; binding++)
+  {
+    // count, keys, values, histograms
+    m_sortDescSetLayoutBind.addBinding({binding, vkDT::eStorageBuffer, 1, vkSS::eCompute});
+  }
+  m_sortDescSetLayout = m_sortDescSetLayoutBind.createLayout(m_device);
+  m_sortDescSet       = m_descAllocator.allocate(m_sortDescSetLayout, m_sortDescSetLayoutBind);
 
-  rayPipelineInfo.setGroupCount(static_cast<uint32_t>(
-      m_rtShaderGroups.size()));  // 1-raygen, n-miss, n-(hit[+anyhit+intersect])
-  rayPipelineInfo.setPGroups(m_rtShaderGroups.data());
+  vk::PushConstantRange        pushConstant{vkSS::eCompute, 0, 3 * sizeof(uint32_t)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, 1, &m_sortDescSetLayout, 1, &pushConstant};
+  m_sortPipelineLayout = m_device.createPipelineLayout(layoutInfo);
+  enqueueComputePipeline("spv/radixsort.comp.spv", m_sortPipelineLayout, &m_sortPipeline);
+}
 
-  rayPipelineInfo.setMaxPipelineRayRecursionDepth(2);  // Ray depth
-  rayPipelineInfo.setLayout(m_rtPipelineLayout);
-  m_rtPipeline = static_cast<const vk::Pipeline&>(
-      m_device.createRayTracingPipelineKHR({}, {}, rayPipelineInfo));
 
-  m_device.destroy(raygenSM);
-  m_device.destroy(missSM);
-  m_device.destroy(shadowmissSM);
-  m_device.destroy(chitSM);
+//--------------------------------------------------------------------------------------------------
+// Pipeline for the ray tracer: all shaders, raygen, chit, miss
+//
+void HelloVulkan::createRtPipeline()
+{
+  // Shader loading, layout and pipeline creation all happen on a worker thread,
+  // m_rtShaderGroups is only read by createRtShaderBindingTable after waitForPipelines()
+  m_pipelineTasks.push_back(m_pipelineBuilder.enqueue([this](vk::PipelineCache cache) {
+    vk::ShaderModule raygenSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytrace.rgen.spv", true, defaultSearchPaths, true));
+    vk::ShaderModule missSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytrace.rmiss.spv", true, defaultSearchPaths, true));
+
+    // The second miss shader is invoked when a shadow ray misses the geometry. It
+    // simply indicates that no occlusion has been found
+    vk::ShaderModule shadowmissSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytraceShadow.rmiss.spv", true, defaultSearchPaths, true));
+
+
+    std::vector<vk::PipelineShaderStageCreateInfo> stages;
+
+    // Raygen
+    vk::RayTracingShaderGroupCreateInfoKHR rg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+    rg.setGeneralShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eRaygenKHR, raygenSM, "main"});
+    m_rtShaderGroups.push_back(rg);
+    // Miss
+    vk::RayTracingShaderGroupCreateInfoKHR mg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+    mg.setGeneralShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, missSM, "main"});
+    m_rtShaderGroups.push_back(mg);
+    // Shadow Miss
+    mg.setGeneralShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, shadowmissSM, "main"});
+    m_rtShaderGroups.push_back(mg);
+
+    // Hit Group - Closest Hit + AnyHit
+    vk::ShaderModule chitSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytrace.rchit.spv", true, defaultSearchPaths, true));
+
+    vk::RayTracingShaderGroupCreateInfoKHR hg{vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                              VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+    hg.setClosestHitShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitKHR, chitSM, "main"});
+    m_rtShaderGroups.push_back(hg);
+
+    // Second raygen, tracing the deferred shadow rays
+    vk::ShaderModule shadowRaygenSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytraceShadow.rgen.spv", true, defaultSearchPaths, true));
+    rg.setGeneralShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eRaygenKHR, shadowRaygenSM, "main"});
+    m_rtShaderGroups.push_back(rg);
+
+    // Second hit group, reading the buffers of the objects through their device addresses
+    vk::ShaderModule chitAddressSM = nvvk::createShaderModule(
+        m_device, nvh::loadFile("spv/raytraceAddress.rchit.spv", true, defaultSearchPaths, true));
+    hg.setClosestHitShader(static_cast<uint32_t>(stages.size()));
+    stages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitKHR, chitAddressSM, "main"});
+    m_rtShaderGroups.push_back(hg);
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+
+    // Push constant: we want to be able to update constants used by the shaders
+    vk::PushConstantRange pushConstant{vk::ShaderStageFlagBits::eRaygenKHR
+                                           | vk::ShaderStageFlagBits::eClosestHitKHR
+                                           | vk::ShaderStageFlagBits::eMissKHR,
+                                       0, sizeof(RtPushConstant)};
+    pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
+    pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstant);
+
+    // Descriptor sets: one specific to ray tracing, and one shared with the rasterization pipeline
+    std::vector<vk::DescriptorSetLayout> rtDescSetLayouts = {m_rtDescSetLayout, m_bindless.getLayout()};
+    pipelineLayoutCreateInfo.setSetLayoutCount(static_cast<uint32_t>(rtDescSetLayouts.size()));
+    pipelineLayoutCreateInfo.setPSetLayouts(rtDescSetLayouts.data());
+
+    m_rtPipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    // Assemble the shader stages and recursion depth info into the ray tracing pipeline
+    vk::RayTracingPipelineCreateInfoKHR rayPipelineInfo;
+    rayPipelineInfo.setStageCount(static_cast<uint32_t>(stages.size()));  // Stages are shaders
+    rayPipelineInfo.setPStages(stages.data());
+
+    rayPipelineInfo.setGroupCount(static_cast<uint32_t>(
+        m_rtShaderGroups.size()));  // 1-raygen, n-miss, n-(hit[+anyhit+intersect])
+    rayPipelineInfo.setPGroups(m_rtShaderGroups.data());
+
+    rayPipelineInfo.setMaxPipelineRayRecursionDepth(2);  // Ray depth
+    rayPipelineInfo.setLayout(m_rtPipelineLayout);
+    m_rtPipeline = static_cast<const vk::Pipeline&>(
+        m_device.createRayTracingPipelineKHR({}, cache, rayPipelineInfo));
+
+    m_device.destroy(raygenSM);
+    m_device.destroy(missSM);
+    m_device.destroy(shadowmissSM);
+    m_device.destroy(chitSM);
+    m_device.destroy(shadowRaygenSM);
+    m_device.destroy(chitAddressSM);
+
+    return m_rtPipeline;
+  }));
 }
 
 //--------------------------------------------------------------------------------------------------
 // The Shader Binding Table (SBT)
-// - getting all shader handles and writing them in a SBT buffer
-// - Besides exception, this could be always done like this
-//   See how the SBT buffer is used in run()
+// - groups of the pipeline: raygen, 2 miss, chit, shadow raygen, chit with buffer addresses
+// - each instance has its own hit record, holding the data the closest hit shader would
+//   otherwise read from the scene description, the hit group depends on m_rtSceneAccess
+// - the buffer is kept while the new table fits in it, only the records are rewritten
 //
 void HelloVulkan::createRtShaderBindingTable()
 {
-  auto groupCount =
-      static_cast<uint32_t>(m_rtShaderGroups.size());               // shaders: raygen, 2 miss, chit
-  uint32_t groupHandleSize = m_rtProperties.shaderGroupHandleSize;  // Size of a program identifier
-  uint32_t groupSizeAligned =
-      nvh::align_up(groupHandleSize, m_rtProperties.shaderGroupBaseAlignment);
+  using Region = nvvk::SbtBuilder::Region;
+  m_sbt.clear();
+  m_sbt.addRecord(Region::eRaygen, 0);  // eRaygenPrimary
+  m_sbt.addRecord(Region::eRaygen, 4);  // eRaygenShadow
+  m_sbt.addRecord(Region::eMiss, 1);
+  m_sbt.addRecord(Region::eMiss, 2);  // shadow
+  uint32_t hitGroup = m_rtSceneAccess == eSceneAddresses ? 5 : 3;
+  for(const auto& inst : m_objInstance)
+  {
+    m_sbt.addRecord(Region::eHit, hitGroup,
+                    RtHitRecord{static_cast<int>(inst.objIndex), static_cast<int>(inst.txtOffset), inst.vertexAddress,
+                                inst.indexAddress, inst.materialAddress, inst.materialIndexAddress});
+  }
+  if(!m_sbt.fetchHandles(m_rtPipeline, static_cast<uint32_t>(m_rtShaderGroups.size())))
+    return;
 
-  // Fetch all the shader handles used in the pipeline, so that they can be written in the SBT
-  uint32_t sbtSize = groupCount * groupSizeAligned;
+  vk::DeviceSize sbtSize = m_sbt.getSize();
+  if(!m_rtSBTBuffer.buffer || sbtSize > m_rtSBTSize)
+  {
+    m_alloc.destroy(m_rtSBTBuffer);
+    m_rtSBTBuffer = m_alloc.createBuffer(
+        sbtSize,
+        vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddressKHR
+            | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    m_rtSBTSize = sbtSize;
+    m_debug.setObjectName(m_rtSBTBuffer.buffer, std::string("SBT").c_str());
+  }
 
-  std::vector<uint8_t> shaderHandleStorage(sbtSize);
-  auto result = m_device.getRayTracingShaderGroupHandlesKHR(m_rtPipeline, 0, groupCount, sbtSize,
-                                                            shaderHandleStorage.data());
-  assert(result == vk::Result::eSuccess);
+  // Write the handles and the records in the SBT
+  m_sbt.write(m_alloc.map(m_rtSBTBuffer));
+  m_alloc.unmap(m_rtSBTBuffer);
+}
 
-  // Write the handles in the SBT
-  m_rtSBTBuffer = m_alloc.createBuffer(
-      sbtSize,
-      vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddressKHR
-          | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
-      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-  m_debug.setObjectName(m_rtSBTBuffer.buffer, std::string("SBT").c_str());
+//--------------------------------------------------------------------------------------------------
+// Switches the hit group of all hit records, the SBT is rewritten in place once no frame uses it
+//
+void HelloVulkan::setSceneAccess(int sceneAccess)
+{
+  m_device.waitIdle();
+  m_rtSceneAccess = sceneAccess;
+  createRtShaderBindingTable();
+}
 
-  // Write the handles in the SBT
-  void* mapped = m_alloc.map(m_rtSBTBuffer);
-  auto* pData  = reinterpret_cast<uint8_t*>(mapped);
-  for(uint32_t g = 0; g < groupCount; g++)
+//--------------------------------------------------------------------------------------------------
+// GPU time of `frames` ray traced frames with each scene access, with timestamp queries on the
+// graphics queue. Adaptive sampling is disabled so that all pixels are traced in every frame,
+// the accumulation restarts afterwards.
+//
+void HelloVulkan::benchmarkSceneAccess(uint32_t frames)
+{
+  if(m_physicalDevice.getQueueFamilyProperties()[m_graphicsQueueIndex].timestampValidBits == 0)
   {
-    memcpy(pData, shaderHandleStorage.data() + g * groupHandleSize, groupHandleSize);  // raygen
-    pData += groupSizeAligned;
+    LOGW("Graphics queue does not support timestamps\n");
+    return;
   }
-  m_alloc.unmap(m_rtSBTBuffer);
 
+  static const char* names[]       = {"descriptors", "buffer addresses"};
+  int                sceneAccess     = m_rtSceneAccess;
+  bool               adaptive        = m_rtAdaptive;
+  float              timestampPeriod = m_physicalDevice.getProperties().limits.timestampPeriod;
+  vk::QueryPool      queryPool       = m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 2});
 
-  m_alloc.finalizeAndReleaseStaging();
+  m_rtAdaptive = false;
+  for(int access = eSceneDescriptors; access <= eSceneAddresses; access++)
+  {
+    setSceneAccess(access);
+    resetFrame();
+
+    nvvk::CommandPool cmdPool(m_device, m_graphicsQueueIndex);
+    vk::CommandBuffer cmdBuf = cmdPool.createCommandBuffer();
+    cmdBuf.resetQueryPool(queryPool, 0, 2);
+    cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, 0);
+    for(uint32_t f = 0; f < frames; f++)
+    {
+      raytrace(cmdBuf, m_rtRefClearColor);
+    }
+    cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 1);
+    cmdPool.submitAndWait(cmdBuf);
+
+    std::array<uint64_t, 2> timestamps{};
+    m_device.getQueryPoolResults(queryPool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                 vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    double timeMs = double(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+    LOGI("Scene access with %s: %.3f ms per frame\n", names[access], timeMs / frames);
+  }
+  m_device.destroy(queryPool);
+
+  m_rtAdaptive = adaptive;
+  setSceneAccess(sceneAccess);
+  resetFrame();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -994,59 +2428,231 @@ void HelloVulkan::createRtShaderBindingTable()
 void HelloVulkan::raytrace(const vk::CommandBuffer& cmdBuf, const nvmath::vec4f& clearColor)
 {
   m_debug.beginLabel(cmdBuf, "Ray trace");
+  updateFrame(clearColor);
   // Initializing push constant values
-  m_rtPushConstants.clearColor     = clearColor;
-  m_rtPushConstants.lightPosition  = m_pushConstant.lightPosition;
-  m_rtPushConstants.lightIntensity = m_pushConstant.lightIntensity;
-  m_rtPushConstants.lightType      = m_pushConstant.lightType;
+  m_rtPushConstants.clearColor        = clearColor;
+  m_rtPushConstants.lightPosition     = m_pushConstant.lightPosition;
+  m_rtPushConstants.lightIntensity    = m_pushConstant.lightIntensity;
+  m_rtPushConstants.lightType         = m_pushConstant.lightType;
+  m_rtPushConstants.feedbackOffset    = m_pushConstant.feedbackOffset;
+  m_rtPushConstants.varianceThreshold = m_rtAdaptive ? m_rtVarianceThreshold : 0.f;
+  m_rtPushConstants.minSamples        = m_rtMinSamples;
+  m_rtPushConstants.shadowMode =
+      (m_rtShadowMode == eShadowSorted && !m_shadowSortSupported) ? int(eShadowWavefront) : m_rtShadowMode;
+  bool deferredShadows = m_rtPushConstants.shadowMode != eShadowInline;
+
+  // The 16 cells of the grid of the shadow ray keys cover the scene on each axis around the eye
+  nvmath::vec3f eye, center, up;
+  CameraManip.getLookat(eye, center, up);
+  float sceneExtent = 0.001f;
+  for(const auto& inst : m_objInstance)
+  {
+    float scale    = nvmath::length(nvmath::vec3f(inst.transform.col(0)));
+    float distance = nvmath::length(nvmath::vec3f(inst.transform.col(3)) - eye);
+    sceneExtent    = std::max(sceneExtent, distance + m_objModel[inst.objIndex].radius * scale);
+  }
+  m_rtPushConstants.cellSize = sceneExtent / 8.f;
+
+  // The tiles to trace in the next frame are set by the pixels that are not converged yet,
+  // the previous frame must be done with the accumulation and with the flags
+  vk::Extent2D   tileCount{(m_renderSize.width + s_rtTileSize - 1) / s_rtTileSize,
+                         (m_renderSize.height + s_rtTileSize - 1) / s_rtTileSize};
+  uint32_t       nbTiles   = tileCount.width * tileCount.height;
+  vk::DeviceSize tilesSize = nbTiles * sizeof(uint32_t);
+  vk::DeviceSize nextTiles = ((m_rtPushConstants.frame + 1) & 1) * tilesSize;
+  vk::MemoryBarrier previousFrame{vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                  vk::AccessFlagBits::eTransferWrite};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eFragmentShader,
+                         vk::PipelineStageFlagBits::eTransfer, {}, {previousFrame}, {}, {});
+  cmdBuf.fillBuffer(m_rtTiles.buffer, nextTiles, tilesSize, 0);
+  if(deferredShadows)
+  {
+    cmdBuf.fillBuffer(m_shadowRayCount.buffer, 0, sizeof(uint32_t), 0);
+  }
+  vk::MemoryBarrier toTrace{vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite,
+                            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                         vk::PipelineStageFlagBits::eRayTracingShaderKHR, {}, {toTrace}, {}, {});
 
   cmdBuf.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, m_rtPipeline);
   cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_rtPipelineLayout, 0,
-                            {m_rtDescSet, m_descSet}, {});
+                            {m_rtDescSets[getOffscreenIndex()], m_bindless.getSet(getCurFrame())}, {});
   cmdBuf.pushConstants<RtPushConstant>(m_rtPipelineLayout,
                                        vk::ShaderStageFlagBits::eRaygenKHR
                                            | vk::ShaderStageFlagBits::eClosestHitKHR
                                            | vk::ShaderStageFlagBits::eMissKHR,
                                        0, m_rtPushConstants);
 
-  // Size of a program identifier
-  uint32_t groupSize =
-      nvh::align_up(m_rtProperties.shaderGroupHandleSize, m_rtProperties.shaderGroupBaseAlignment);
-  uint32_t          groupStride = groupSize;
-  vk::DeviceAddress sbtAddress  = m_device.getBufferAddress({m_rtSBTBuffer.buffer});
-
-  using Stride = vk::StridedDeviceAddressRegionKHR;
-  std::array<Stride, 4> strideAddresses{
-      Stride{sbtAddress + 0u * groupSize, groupStride, groupSize * 1},  // raygen
-      Stride{sbtAddress + 1u * groupSize, groupStride, groupSize * 2},  // miss
-      Stride{sbtAddress + 3u * groupSize, groupStride, groupSize * 1},  // hit
-      Stride{0u, 0u, 0u}};                                              // callable
+  using Region                 = nvvk::SbtBuilder::Region;
+  vk::DeviceAddress sbtAddress = m_device.getBufferAddress({m_rtSBTBuffer.buffer});
+  std::array<vk::StridedDeviceAddressRegionKHR, 4> strideAddresses{
+      m_sbt.getRegion(Region::eRaygen, sbtAddress, eRaygenPrimary), m_sbt.getRegion(Region::eMiss, sbtAddress),
+      m_sbt.getRegion(Region::eHit, sbtAddress), m_sbt.getRegion(Region::eCallable, sbtAddress)};
 
   cmdBuf.traceRaysKHR(&strideAddresses[0], &strideAddresses[1], &strideAddresses[2],
-                      &strideAddresses[3],              //
-                      m_size.width, m_size.height, 1);  //
+                      &strideAddresses[3],                          //
+                      m_renderSize.width, m_renderSize.height, 1);  //
+
+  if(deferredShadows)
+  {
+    // The shadow rays written by the primary rays, sorted or not, then traced by the second
+    // raygen. Its launch covers the largest possible number of shadow rays.
+    vk::MemoryBarrier primaryRays{vk::AccessFlagBits::eShaderWrite,
+                                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                           vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                           {}, {primaryRays}, {}, {});
+    if(m_rtPushConstants.shadowMode == eShadowSorted)
+    {
+      sortShadowRays(cmdBuf);
+      vk::MemoryBarrier sorted{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead};
+      cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                             {}, {sorted}, {}, {});
+      // The push constants of the sort disturbed the ones of the ray tracing layout
+      cmdBuf.pushConstants<RtPushConstant>(m_rtPipelineLayout,
+                                           vk::ShaderStageFlagBits::eRaygenKHR
+                                               | vk::ShaderStageFlagBits::eClosestHitKHR
+                                               | vk::ShaderStageFlagBits::eMissKHR,
+                                           0, m_rtPushConstants);
+    }
+
+    m_debug.beginLabel(cmdBuf, "Shadow rays");
+    strideAddresses[0] = m_sbt.getRegion(Region::eRaygen, sbtAddress, eRaygenShadow);
+    cmdBuf.traceRaysKHR(&strideAddresses[0], &strideAddresses[1], &strideAddresses[2], &strideAddresses[3],
+                        m_renderSize.width, m_renderSize.height, 1);
+    m_debug.endLabel(cmdBuf);
+  }
 
   m_debug.endLabel(cmdBuf);
 }
 
+//--------------------------------------------------------------------------------------------------
+// Sorts the keys of the shadow rays with their indices, two passes of one byte of
+// radixsort.comp. Each pass computes the histograms of the blocks, scans them and scatters the
+// keys, the dispatches are sized for the largest possible number of shadow rays and the
+// blocks past the count return early.
+//
+void HelloVulkan::sortShadowRays(const vk::CommandBuffer& cmdBuf)
+{
+  m_debug.beginLabel(cmdBuf, "Sort shadow rays");
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_sortPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_sortPipelineLayout, 0, {m_sortDescSet}, {});
+
+  uint32_t nbBlocks = (m_renderSize.width * m_renderSize.height + s_sortBlockSize - 1) / s_sortBlockSize;
+  vk::MemoryBarrier stageDone{vk::AccessFlagBits::eShaderWrite,
+                              vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+  for(uint32_t pass = 0; pass < 2; pass++)
+  {
+    for(uint32_t stage : {eSortHistogram, eSortScan, eSortScatter})
+    {
+      std::array<uint32_t, 3> constants{stage, pass, m_shadowRayCapacity};
+      cmdBuf.pushConstants(m_sortPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+                           static_cast<uint32_t>(sizeof(constants)), constants.data());
+      cmdBuf.dispatch(stage == eSortScan ? 1 : nbBlocks, 1, 1);
+      cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+                             {}, {stageDone}, {}, {});
+    }
+  }
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Compares the order of the shadow rays of the last frame with nvh::radixsort on the same
+// keys. Both sorts are stable, so the indices must be identical.
+//
+bool HelloVulkan::validateShadowSort()
+{
+  m_device.waitIdle();
+
+  // Everything the check needs, read back at once
+  vk::DeviceSize raysSize    = m_shadowRayCapacity * sizeof(ShadowRay);
+  vk::DeviceSize indicesSize = m_shadowRayCapacity * sizeof(uint32_t);
+  nvvk::Buffer   staging     = m_alloc.createBuffer(sizeof(uint32_t) + raysSize + indicesSize,
+                                              vk::BufferUsageFlagBits::eTransferDst,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+  {
+    nvvk::CommandPool cmdPool(m_device, m_graphicsQueueIndex);
+    vk::CommandBuffer cmdBuf = cmdPool.createCommandBuffer();
+    cmdBuf.copyBuffer(m_shadowRayCount.buffer, staging.buffer, {vk::BufferCopy{0, 0, sizeof(uint32_t)}});
+    cmdBuf.copyBuffer(m_shadowRays.buffer, staging.buffer, {vk::BufferCopy{0, sizeof(uint32_t), raysSize}});
+    cmdBuf.copyBuffer(m_shadowIndices.buffer, staging.buffer,
+                      {vk::BufferCopy{0, sizeof(uint32_t) + raysSize, indicesSize}});
+    cmdPool.submitAndWait(cmdBuf);
+  }
+
+  auto*            data    = reinterpret_cast<uint8_t*>(m_alloc.map(staging));
+  uint32_t         count   = std::min(*reinterpret_cast<uint32_t*>(data), m_shadowRayCapacity);
+  const ShadowRay* rays    = reinterpret_cast<const ShadowRay*>(data + sizeof(uint32_t));
+  const uint32_t*  indices = reinterpret_cast<const uint32_t*>(data + sizeof(uint32_t) + raysSize);
+
+  // The keys use the two low bytes of ShadowRay::key
+  std::vector<uint32_t> indicesIn(count), indicesTemp(count);
+  std::iota(indicesIn.begin(), indicesIn.end(), 0);
+  uint32_t* expected = nvh::radixsort<offsetof(ShadowRay, key), 2>(count, rays, indicesIn.data(), indicesTemp.data());
+  bool      valid    = std::equal(expected, expected + count, indices);
+
+  m_alloc.unmap(staging);
+  m_alloc.destroy(staging);
+  LOGI("Shadow ray sort of %u rays: %s\n", count, valid ? "valid" : "INVALID");
+  return valid;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Next sample of the accumulation, restarted if anything changed the image since the last one
+//
+void HelloVulkan::updateFrame(const nvmath::vec4f& clearColor)
+{
+  const nvmath::mat4f& camera = CameraManip.getMatrix();
+  const float          fov    = CameraManip.getFov();
+  if(memcmp(&m_rtRefCamera, &camera, sizeof(nvmath::mat4f)) != 0 || m_rtRefFov != fov
+     || memcmp(&m_rtRefClearColor, &clearColor, sizeof(nvmath::vec4f)) != 0
+     || memcmp(&m_rtRefLightPosition, &m_pushConstant.lightPosition, sizeof(nvmath::vec3f)) != 0
+     || m_rtRefLightIntensity != m_pushConstant.lightIntensity || m_rtRefLightType != m_pushConstant.lightType)
+  {
+    resetFrame();
+    m_rtRefCamera         = camera;
+    m_rtRefFov            = fov;
+    m_rtRefClearColor     = clearColor;
+    m_rtRefLightPosition  = m_pushConstant.lightPosition;
+    m_rtRefLightIntensity = m_pushConstant.lightIntensity;
+    m_rtRefLightType      = m_pushConstant.lightType;
+  }
+  m_rtPushConstants.frame++;
+}
+
 void HelloVulkan::printCounter()
 {
-  auto compData             = m_compDataList[0];
-  auto counter = (*((uint64_t*)compData->buffers[0].data));
-  std::cout << "counter=" << counter << "\n";
+  std::cout << "counter=" << readCounter() << "\n";
+
+}
+
+//--------------------------------------------------------------------------------------------------
+// Total of the counter buffer: counter[0] plus all shards written by eAccumSharded
+//
+uint64_t HelloVulkan::readCounter()
+{
+  auto      compData = m_compDataList[0];
+  uint64_t* counters = reinterpret_cast<uint64_t*>(compData->buffers[0].data);
+  uint64_t  total    = 0;
+  for(uint32_t i = 0; i < 1 + s_nbCounterShards; i++)
+  {
+    total += counters[i];
+  }
+  return total;
+}
 
-}  
   void HelloVulkan::createComputeBuffers(computeData* compData)
 {
 
-     auto nbCounters = 1;
+     auto nbCounters = 1 + s_nbCounterShards;  // total + shards
   // Creating all buffers
    // Creating output buffers
   using vkBU = vk::BufferUsageFlagBits;
   using vkMP = vk::MemoryPropertyFlagBits;
   auto cmdBuf = VulkanHelper::createCommandBuffer(m_device, m_cmdPool_comp);
   compData->buffers.push_back(m_alloc.createBuffer(cmdBuf, std::vector<uint64_t>(nbCounters, 0),
-                                                  vkBU::eStorageBuffer, vkMP::eHostVisible));
+                                                  vkBU::eStorageBuffer | vkBU::eTransferDst,
+                                                  vkMP::eHostVisible | vkMP::eHostCoherent));
     VulkanHelper::submitAndWait(m_device, 1, &cmdBuf, m_cmdPool_comp, m_queue_comp);
   
   m_alloc.finalizeAndReleaseStaging();
@@ -1059,9 +2665,7 @@ void HelloVulkan::createCompDescriptors(computeData* compData)
                                     1, vk::ShaderStageFlagBits::eCompute));
 
   compData->descSetLayout = compData->descSetLayoutBind.createLayout(m_device);
-  compData->descPool      = compData->descSetLayoutBind.createPool(m_device, 1);
-  compData->descSet =
-      nvvk::allocateDescriptorSet(m_device, compData->descPool, compData->descSetLayout);
+  compData->descSet       = m_descAllocator.allocate(compData->descSetLayout, compData->descSetLayoutBind);
 }
 void HelloVulkan::updateCompDescriptorSet(computeData* compData)
 {
@@ -1087,97 +2691,253 @@ void HelloVulkan::createCompPipelines(const std::string& filename, computeData*
   vk::PipelineLayoutCreateInfo layout_info{{}, 1, &compData->descSetLayout, 1, &push_constants};
   compData->pipelineLayout = m_device.createPipelineLayout(layout_info);
 
-  vk::ComputePipelineCreateInfo computePipelineCreateInfo{{}, {}, compData->pipelineLayout};
-  computePipelineCreateInfo.stage =
-      nvvk::createShaderStageInfo(m_device, nvh::loadFile(filename, true, defaultSearchPaths, true),
-                                  VK_SHADER_STAGE_COMPUTE_BIT);
+  // The SPIR-V is loaded once, all variants are specializations of it
+  compData->spirv = nvh::loadFile(filename, true, defaultSearchPaths, true);
 
-  compData->pipeline = static_cast<const vk::Pipeline&>(
-      m_device.createComputePipeline({}, computePipelineCreateInfo, nullptr));
+  // Pre-build all accumulation modes of the default configuration
+  m_compSubgroupArithmetic = hasSubgroupArithmetic();
+  CompVariant variant      = m_compVariant;
+  for(int32_t accumMode = 0; accumMode < eAccumCount; accumMode++)
+  {
+    if(accumMode == eAccumSubgroup && !m_compSubgroupArithmetic)
+      continue;
+    variant.accumMode = accumMode;
+    getCompPipelineAsync(compData, variant);
+  }
+}
 
-  m_device.destroy(computePipelineCreateInfo.stage.module);
+//--------------------------------------------------------------------------------------------------
+// subgroupAdd of eAccumSubgroup needs arithmetic subgroup operations in compute shaders
+//
+bool HelloVulkan::hasSubgroupArithmetic() const
+{
+  auto props = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+  auto subgroupProps = props.get<vk::PhysicalDeviceSubgroupProperties>();
+  return (subgroupProps.supportedStages & vk::ShaderStageFlagBits::eCompute)
+         && (subgroupProps.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
 }
-void HelloVulkan::executeComputeShaderPipline_graphicsQueue() {
 
-  auto              compData = m_compDataList[0];
-  nvvk::CommandPool cmdBufGet(m_device, m_graphicsQueueIndex);
-  vk::CommandBuffer cmdBuf = cmdBufGet.createCommandBuffer();
+//--------------------------------------------------------------------------------------------------
+// Returns the pipeline specialized for `variant`, compiling it on the pipeline builder if it
+// is not in the cache yet
+//
+std::shared_future<vk::Pipeline> HelloVulkan::getCompPipelineAsync(computeData*       compData,
+                                                                   const CompVariant& variant)
+{
+  auto it = compData->variants.find(variant);
+  if(it != compData->variants.end())
+    return it->second;
+
+  std::array<vk::SpecializationMapEntry, 4> entries{
+      vk::SpecializationMapEntry{0, offsetof(CompVariant, workgroupSize), sizeof(uint32_t)},
+      vk::SpecializationMapEntry{1, offsetof(CompVariant, outerLoop), sizeof(int32_t)},
+      vk::SpecializationMapEntry{2, offsetof(CompVariant, innerLoop), sizeof(int32_t)},
+      vk::SpecializationMapEntry{3, offsetof(CompVariant, accumMode), sizeof(int32_t)}};
+  vk::SpecializationInfo specInfo{static_cast<uint32_t>(entries.size()), entries.data(),
+                                  sizeof(CompVariant), &variant};
+
+  std::shared_future<vk::Pipeline> pipeline =
+      m_pipelineBuilder.createComputePipeline(compData->spirv, compData->pipelineLayout, &specInfo).share();
+  compData->variants[variant] = pipeline;
+  return pipeline;
+}
 
-  cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, compData->pipeline);
+vk::Pipeline HelloVulkan::getCompPipeline(computeData* compData, const CompVariant& variant)
+{
+  return getCompPipelineAsync(compData, variant).get();
+}
+
+//--------------------------------------------------------------------------------------------------
+// The variant matching the UI state: the accumulation mode is compiled in instead of being
+// tested in the inner loop
+//
+HelloVulkan::CompVariant HelloVulkan::currentCompVariant() const
+{
+  CompVariant variant = m_compVariant;
+  variant.accumMode   = m_PushConstant.accum_mode;
+  if(variant.accumMode == eAccumSubgroup && !m_compSubgroupArithmetic)
+    variant.accumMode = eAccumAtomic;  // not built, see createCompPipelines()
+  return variant;
+}
+
+void HelloVulkan::recordCompDispatch(const vk::CommandBuffer& cmdBuf,
+                                     computeData*             compData,
+                                     const CompVariant&       variant)
+{
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, getCompPipeline(compData, variant));
   cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compData->pipelineLayout, 0,
                             {compData->descSet}, {});
   cmdBuf.pushConstants<PushConstant>(compData->pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
                                      m_PushConstant);
-  auto numOfBlocks = ceil(float(m_PushConstant.m_threads) / 64.0f);
+  auto numOfBlocks = uint32_t((m_PushConstant.m_threads + variant.workgroupSize - 1) / variant.workgroupSize);
   cmdBuf.dispatch(numOfBlocks, 1, 1);
-  cmdBufGet.submitAndWait(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// GPU time in milliseconds of one dispatch of `variant` on the compute queue of the task graph,
+// measured with timestamp queries. Returns a negative value if the queue has no timestamp support.
+// The counters are cleared and made visible to the host like in executeComputeGraph().
+//
+double HelloVulkan::timeCompDispatch(const CompVariant& variant)
+{
+  if(m_physicalDevice.getQueueFamilyProperties()[m_computeQueueIndex].timestampValidBits == 0)
+    return -1.0;
+
+  vk::QueryPool queryPool = m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 2});
 
+  m_compGraph.wait();
+  recordCompGraph(nvvk::TaskGraph::eCompute, variant, queryPool);
+  m_compGraph.wait();
+
+  std::array<uint64_t, 2> timestamps{};
+  m_device.getQueryPoolResults(queryPool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                               vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  m_device.destroy(queryPool);
+
+  float timestampPeriod = m_physicalDevice.getProperties().limits.timestampPeriod;
+  return double(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
 }
-void HelloVulkan::prepareComputeShader()
+
+//--------------------------------------------------------------------------------------------------
+// Times one dispatch per workgroup size on the compute queue and keeps the fastest one
+// in m_compVariant. All variants are compiled in parallel before the first run.
+//
+uint32_t HelloVulkan::benchmarkCompWorkgroupSizes(const std::vector<uint32_t>& workgroupSizes)
 {
   auto compData = m_compDataList[0];
+
+  auto                  limits = m_physicalDevice.getProperties().limits;
+  std::vector<uint32_t> sizes;
+  for(auto size : workgroupSizes)
   {
-    //========== reset counter  ===============
-    //reset counter
-    auto           nbCounters = 1;
-    auto           counters   = std::vector<uint64_t>(nbCounters, 0);
-    vk::DeviceSize bufferSize = counters.size() * sizeof(uint64_t);
-    memcpy(compData->buffers[0].data, counters.data(), (size_t)bufferSize);
+    if(size > 0 && size <= limits.maxComputeWorkGroupSize[0] && size <= limits.maxComputeWorkGroupInvocations)
+    {
+      CompVariant variant   = currentCompVariant();
+      variant.workgroupSize = size;
+      getCompPipelineAsync(compData, variant);
+      sizes.push_back(size);
+    }
   }
-  updateCompDescriptorSet(compData);
-}
-void HelloVulkan::executeComputeShaderPipline(vk::CommandBuffer& cmdBuf)
-{
-    m_debug.beginLabel(cmdBuf, "Compute Shader :)");
- // for(int i = 0; i < m_compDataList.size(); i++)
+
+  double   bestTime = DBL_MAX;
+  uint32_t bestSize = m_compVariant.workgroupSize;
+  for(auto size : sizes)
   {
-    auto compData = m_compDataList[0];
- 
-   // cmdBuf.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-    cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, compData->pipeline);
-    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compData->pipelineLayout, 0,
-                              {compData->descSet}, {});
-    cmdBuf.pushConstants<PushConstant>(compData->pipelineLayout, vk::ShaderStageFlagBits::eCompute,
-                                       0, m_PushConstant);
-    auto numOfBlocks = ceil(float(m_PushConstant.m_threads) / 64.0f);
-    cmdBuf.dispatch(numOfBlocks, 1, 1);
-    cmdBuf.end();
-
-    submitComputeCommand(cmdBuf);
-    m_debug.endLabel(cmdBuf);
+    CompVariant variant   = currentCompVariant();
+    variant.workgroupSize = size;
+
+    double timeMs = timeCompDispatch(variant);
+    if(timeMs < 0.0)
+    {
+      LOGW("Compute queue does not support timestamps, keeping workgroup size %u\n", m_compVariant.workgroupSize);
+      return m_compVariant.workgroupSize;
+    }
+    LOGI("workgroup size %4u : %.3f ms\n", size, timeMs);
+    if(timeMs < bestTime)
+    {
+      bestTime = timeMs;
+      bestSize = size;
+    }
   }
+
+  m_compVariant.workgroupSize = bestSize;
+  LOGI("fastest workgroup size: %u\n", bestSize);
+  return bestSize;
 }
-void HelloVulkan::submitComputeCommand( vk::CommandBuffer& cmdBuf)
+
+//--------------------------------------------------------------------------------------------------
+// Runs every accumulation mode with the current configuration, checks they all produce
+// the expected total and prints the time and the increments per second of each
+//
+void HelloVulkan::benchmarkCompAccumModes()
 {
+  static const char* names[eAccumCount] = {"none", "atomic", "subgroup", "workgroup", "sharded"};
+
+  auto     compData = m_compDataList[0];
+  uint64_t expected = m_PushConstant.m_threads * uint64_t(m_compVariant.outerLoop) * uint64_t(m_compVariant.innerLoop);
+
+  bool hasSubgroupAdd = m_compSubgroupArithmetic;
+
+  // all modes are specialized, the push constant value does not matter
+  for(int32_t mode = 0; mode < eAccumCount; mode++)
   {
-    VkSubmitInfo computeSubmitInfo         = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    computeSubmitInfo.pNext                = nullptr;
-    computeSubmitInfo.pWaitSemaphores      = nullptr;
-    computeSubmitInfo.pSignalSemaphores    = nullptr;
-    computeSubmitInfo.pWaitDstStageMask    = nullptr;
-    computeSubmitInfo.signalSemaphoreCount = 0;
-    computeSubmitInfo.waitSemaphoreCount   = 0;
-    computeSubmitInfo.commandBufferCount   = 1;
-    computeSubmitInfo.pCommandBuffers      = reinterpret_cast<VkCommandBuffer*>(&cmdBuf);
-    auto compData                      = m_compDataList[0];
-    vkQueueSubmit(m_queue_comp, 1, &computeSubmitInfo, compData->fence);
-   // vkQueueSubmit(m_queue_comp, 1, &computeSubmitInfo, VK_NULL_HANDLE);
+    if(mode == eAccumSubgroup && !hasSubgroupAdd)
+      continue;
+    CompVariant variant = m_compVariant;
+    variant.accumMode   = mode;
+    getCompPipelineAsync(compData, variant);
   }
 
-}
-  bool HelloVulkan::isComputeShaderExecutionDone()
-{
-  
-    if(vkGetFenceStatus(m_device, m_compDataList[0]->fence) == VK_SUCCESS)
+  for(int32_t mode = 0; mode < eAccumCount; mode++)
+  {
+    if(mode == eAccumSubgroup && !hasSubgroupAdd)
     {
-      // Reset the compute fence
-      vkResetFences(m_device, 1, &m_compDataList[0]->fence);
-      return true;
+      LOGI("%-10s: not supported\n", names[mode]);
+      continue;
     }
-    else
-      return false;
+    CompVariant variant = m_compVariant;
+    variant.accumMode   = mode;
+
+    double   timeMs = timeCompDispatch(variant);
+    uint64_t total  = readCounter();
+    if(timeMs < 0.0)
+    {
+      LOGW("Compute queue does not support timestamps\n");
+      return;
+    }
+    if(mode == eAccumNone)
+    {
+      LOGI("%-10s: %10.3f ms\n", names[mode], timeMs);
+      continue;
+    }
+    LOGI("%-10s: %10.3f ms, %8.3f G increments/s, total %llu %s\n", names[mode], timeMs,
+         double(total) / (timeMs * 1000000.0), (unsigned long long)total, total == expected ? "OK" : "MISMATCH");
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Clears the counters and runs parallelTest.comp through the task graph, which adds the
+// barriers between the passes and before the host reads the counters.
+//
+void HelloVulkan::executeComputeGraph(bool useComputeQueue)
+{
+  recordCompGraph(useComputeQueue ? nvvk::TaskGraph::eCompute : nvvk::TaskGraph::eGraphics, currentCompVariant());
+}
 
-  //return true;
+//--------------------------------------------------------------------------------------------------
+// Builds and executes the clear + dispatch passes of m_compGraph on `queue`. If `timestamps`
+// is given, the dispatch is surrounded by the queries 0 and 1 of this pool.
+//
+void HelloVulkan::recordCompGraph(nvvk::TaskGraph::QueueType queue, const CompVariant& variant, vk::QueryPool timestamps)
+{
+  auto compData = m_compDataList[0];
+
+  m_compGraph.clearPasses();
+  m_compGraph
+      .addPass("clear counters", queue,
+               [=](vk::CommandBuffer cmdBuf) { cmdBuf.fillBuffer(compData->buffers[0].buffer, 0, VK_WHOLE_SIZE, 0); })
+      .write(m_compCounters, {vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite});
+  m_compGraph
+      .addPass("parallelTest", queue,
+               [=](vk::CommandBuffer cmdBuf) {
+                 m_debug.beginLabel(cmdBuf, "Compute Shader :)");
+                 if(timestamps)
+                 {
+                   cmdBuf.resetQueryPool(timestamps, 0, 2);
+                   cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestamps, 0);
+                 }
+                 recordCompDispatch(cmdBuf, compData, variant);
+                 if(timestamps)
+                 {
+                   cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestamps, 1);
+                 }
+                 m_debug.endLabel(cmdBuf);
+               })
+      .readWrite(m_compCounters, {vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite});
+  m_compGraph.execute();
+}
+bool HelloVulkan::isComputeShaderExecutionDone()
+{
+  return m_compGraph.isDone();
 }
\ No newline at end of file
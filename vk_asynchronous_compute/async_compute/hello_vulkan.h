@@ -33,8 +33,18 @@
 
 #include "nvvk/allocator_vk.hpp"
 #include "nvvk/appbase_vkpp.hpp"
+#include "nvvk/bindlesstable_vk.hpp"
 #include "nvvk/debug_util_vk.hpp"
 #include "nvvk/descriptorsets_vk.hpp"
+#include "nvvk/pipelinebuilder_vk.hpp"
+#include "nvvk/sbtbuilder_vk.hpp"
+#include "nvvk/taskgraph_vk.hpp"
+#include "frustum_culler.h"
+#include "texture_loader.h"
+#include "texture_streamer.h"
+#include<map>
+#include<tuple>
+#include<unordered_map>
 #include<vector>
 // #VKRay
 #include "nvvk/raytraceKHR_vk.hpp"
@@ -50,37 +60,74 @@
 class HelloVulkan : public nvvk::AppBase
 {
 public:
+  // How parallelTest.comp accumulates into the counter buffer, see ACCUM_* in the shader
+  enum AccumMode
+  {
+    eAccumNone      = 0,
+    eAccumAtomic    = 1,  // atomic per iteration on a single counter
+    eAccumSubgroup  = 2,  // subgroupAdd, one atomic per subgroup
+    eAccumWorkgroup = 3,  // shared memory, one atomic per workgroup
+    eAccumSharded   = 4,  // atomic on one of s_nbCounterShards counters
+    eAccumCount
+  };
+  static const uint32_t s_nbCounterShards = 64;  // must match NB_COUNTER_SHARDS in parallelTest.comp
+
   struct PushConstant
   {
     uint64_t m_threads;
-    int      use_atomic;
+    int      accum_mode;
   };
   PushConstant      m_PushConstant;
   bool              m_isTestComputeShaderRunning = false;
   bool            m_waitingComputeShaderFence = false;
   bool              m_printRenderingPerformance  = false;
+  // Specialization constants of parallelTest.comp, each distinct set is one cached pipeline
+  struct CompVariant
+  {
+    uint32_t workgroupSize{64};
+    int32_t  outerLoop{1000};
+    int32_t  innerLoop{1000};
+    int32_t  accumMode{-1};  // -1: PushConstant::accum_mode decides at runtime, else AccumMode
+
+    bool operator<(const CompVariant& o) const
+    {
+      return std::tie(workgroupSize, outerLoop, innerLoop, accumMode)
+             < std::tie(o.workgroupSize, o.outerLoop, o.innerLoop, o.accumMode);
+    }
+  };
+  CompVariant m_compVariant;
   struct computeData
   {
     nvvk::DescriptorSetBindings descSetLayoutBind;
-    vk::DescriptorPool          descPool;
     vk::DescriptorSetLayout     descSetLayout;
     vk::DescriptorSet           descSet;
-    vk::Pipeline                pipeline;
     vk::PipelineLayout          pipelineLayout;
+    std::string                 spirv;     // kept to specialize new variants
+    std::map<CompVariant, std::shared_future<vk::Pipeline>> variants;
     std::vector<nvvk::Buffer>   buffers;
     uint32_t                    queueIndex;
-    VkFence                     fence;
   };
   void                      printCounter();
+  uint64_t                  readCounter();
   void                      createComputeBuffers(computeData* compData);
   void                      createCompDescriptors(computeData* data);
   void                      updateCompDescriptorSet(computeData* data);
   void                 createCompPipelines(const std::string& filename, computeData* compData);
-  void                      executeComputeShaderPipline_graphicsQueue();
-  void                      prepareComputeShader();
-  void                      executeComputeShaderPipline( vk::CommandBuffer& cmdBuf);
-  void                      submitComputeCommand( vk::CommandBuffer& cmdBuf);
+  std::shared_future<vk::Pipeline> getCompPipelineAsync(computeData* compData, const CompVariant& variant);
+  vk::Pipeline         getCompPipeline(computeData* compData, const CompVariant& variant);
+  CompVariant          currentCompVariant() const;
+  bool                 hasSubgroupArithmetic() const;
+  bool                 m_compSubgroupArithmetic{false};  // eAccumSubgroup is supported
+  void                 recordCompDispatch(const vk::CommandBuffer& cmdBuf, computeData* compData, const CompVariant& variant);
+  double               timeCompDispatch(const CompVariant& variant);
+  uint32_t             benchmarkCompWorkgroupSizes(const std::vector<uint32_t>& workgroupSizes);
+  void                 benchmarkCompAccumModes();
+  void                      executeComputeGraph(bool useComputeQueue);
+  void recordCompGraph(nvvk::TaskGraph::QueueType queue, const CompVariant& variant, vk::QueryPool timestamps = {});
   std::vector<computeData*> m_compDataList;
+  // compute work scheduled on m_queue_comp, or m_queue with useComputeQueue = false
+  nvvk::TaskGraph             m_compGraph;
+  nvvk::TaskGraph::ResourceId m_compCounters{nvvk::TaskGraph::INVALID_RESOURCE};
  // computeData          m_computeA;
   bool                 isComputeShaderExecutionDone();
   //VkSemaphore               submissionSemaphore;
@@ -91,62 +138,117 @@ public:
   void createDescriptorSetLayout();
   void createGraphicsPipeline();
   void createComputeShaderPipline();
+  void waitForPipelines();
   void loadModel(const std::string& filename, nvmath::mat4f transform = nvmath::mat4f(1));
   void updateDescriptorSet();
   void createUniformBuffer();
   void createSceneDescriptionBuffer();
-  void createTextureImages(const vk::CommandBuffer&        cmdBuf,
-                           const std::vector<std::string>& textures);
+  uint32_t createTextureImages(const vk::CommandBuffer&        cmdBuf,
+                               const std::vector<std::string>& textures);
+  void createTextureFeedbackBuffer();
+  void updateTextureStreaming(uint32_t frame, bool raytracing);
   void updateUniformBuffer(const vk::CommandBuffer& cmdBuf);
   void onResize(int /*w*/, int /*h*/) override;
   void destroyResources();
-  void rasterize(const vk::CommandBuffer& cmdBuff);
+  void rasterize(const vk::CommandBuffer& cmdBuff, bool late = false);
+
+  // Level of detail of a model, see loadModel()
+  static const uint32_t s_maxLods = 4;  // must match MAX_LODS in wavefront.glsl
+  struct Lod
+  {
+    uint32_t firstIndex{0};  // in the index buffer, its triangles start at firstIndex / 3 in the material indices
+    uint32_t nbIndices{0};
+    float    error{0.f};     // model space, see nvh::MeshSimplifier
+    uint32_t firstCluster{0};
+    uint32_t nbClusters{0};
+  };
+
+  // Meshlet of a level of detail, a contiguous range of its indices, see nvh::MeshletBuilder.
+  // Uploaded as is, must match Cluster in clustercull.comp.
+  struct Cluster
+  {
+    nvmath::vec3f center{0.f};  // model space bounding sphere
+    float         radius{0.f};
+    nvmath::vec3f coneAxis{0.f};
+    float         coneCutoff{1.f};  // 1: the normals are too spread for the cone test
+    uint32_t      firstIndex{0};
+    uint32_t      nbIndices{0};
+  };
 
   // The OBJ model
   struct ObjModel
   {
-    uint32_t     nbIndices{0};
-    uint32_t     nbVertices{0};
-    nvvk::Buffer vertexBuffer;    // Device buffer of all 'Vertex'
-    nvvk::Buffer indexBuffer;     // Device buffer of the indices forming triangles
-    nvvk::Buffer matColorBuffer;  // Device buffer of array of 'Wavefront material'
-    nvvk::Buffer matIndexBuffer;  // Device buffer of array of 'Wavefront material'
+    uint32_t      nbIndices{0};
+    uint32_t      nbVertices{0};
+    uint32_t      nbTextures{0};
+    float         radius{0};       // of the bounding sphere around the origin
+    nvmath::vec3f bboxMin{0.f};    // local bounding box
+    nvmath::vec3f bboxMax{0.f};
+    nvvk::Buffer  vertexBuffer;    // Device buffer of all 'Vertex'
+    nvvk::Buffer  indexBuffer;     // Device buffer of the indices forming triangles
+    nvvk::Buffer  matColorBuffer;  // Device buffer of array of 'Wavefront material'
+    nvvk::Buffer  matIndexBuffer;  // Device buffer of array of 'Wavefront material'
+    std::vector<Lod> lods;         // lods[0] is the loaded mesh, the levels are after it in the buffers
+    std::vector<Cluster> clusters; // of all levels, their triangles are in meshlet order
   };
 
   // Instance of the OBJ
   struct ObjInstance
   {
-    uint32_t      objIndex{0};     // Reference to the `m_objModel`
-    uint32_t      txtOffset{0};    // Offset in `m_textures`
-    nvmath::mat4f transform{1};    // Position of the instance
-    nvmath::mat4f transformIT{1};  // Inverse transpose
+    uint32_t          objIndex{0};     // Reference to the `m_objModel`
+    uint32_t          txtOffset{0};    // Offset in `m_textures`
+    nvmath::mat4f     transform{1};    // Position of the instance
+    nvmath::mat4f     transformIT{1};  // Inverse transpose
+    uint32_t          lodFirstTriangle[s_maxLods]{};  // of each level of the model, in its material indices
+    vk::DeviceAddress vertexAddress{0};  // of the buffers of the model, read by the shaders
+    vk::DeviceAddress indexAddress{0};   // with GL_EXT_buffer_reference
+    vk::DeviceAddress materialAddress{0};
+    vk::DeviceAddress materialIndexAddress{0};
   };
 
   // Information pushed at each draw call
   struct ObjPushConstant
   {
     nvmath::vec3f lightPosition{10.f, 15.f, 8.f};
-    int           instanceId{0};  // To retrieve the transformation matrix
     float         lightIntensity{100.f};
     int           lightType{0};  // 0: point, 1: infinite
+    uint32_t      feedbackOffset{0};  // region of the texture feedback buffer of this frame
   };
   ObjPushConstant m_pushConstant;
 
   // Array of objects and instances in the scene
   std::vector<ObjModel>    m_objModel;
   std::vector<ObjInstance> m_objInstance;
+  // content hash of the loaded files to the first instance of their model, with the size and
+  // a second hash of the content compared before reusing it
+  struct LoadedModel
+  {
+    ObjInstance instance;
+    uint64_t    confirmHash{0};
+    size_t      numBytes{0};
+  };
+  std::unordered_multimap<uint64_t, LoadedModel> m_modelHashes;
 
   // Graphic pipeline
   vk::PipelineLayout          m_pipelineLayout;
   vk::Pipeline                m_graphicsPipeline;
-  nvvk::DescriptorSetBindings m_descSetLayoutBind;
-  vk::DescriptorPool          m_descPool;
-  vk::DescriptorSetLayout     m_descSetLayout;
-  vk::DescriptorSet           m_descSet;
+  vk::Pipeline                m_clusterGraphicsPipeline;  // draws of clustercull.comp, see vert_cluster.vert
+
+  // Scene resources, one copy of the set per frame in flight. The per-model buffers are
+  // indexed by the model index, the textures by `ObjInstance::txtOffset` + texture id
+  static const uint32_t s_maxModels   = 256;
+  static const uint32_t s_maxTextures = 4096;
+  nvvk::BindlessTable   m_bindless;
+  uint32_t              m_modelArray{0};
+  uint32_t              m_textureArray{0};
+  // sets of the post, ray tracing and compute layouts
+  nvvk::DescriptorAllocator m_descAllocator;
 
   nvvk::Buffer               m_cameraMat;  // Device-Host of the camera matrices
   nvvk::Buffer               m_sceneDesc;  // Device buffer of the OBJ instances
   std::vector<nvvk::Texture> m_textures;   // vector of all textures of the scene
+  TextureLoader              m_textureLoader;
+  TextureStreamer            m_textureStreamer;  // high resolution levels of `m_textures`
 
 #if defined(NVVK_ALLOC_DEDICATED)
   nvvk::AllocatorDedicated m_alloc;  // Allocator for buffer, images, acceleration structures
@@ -160,26 +262,228 @@ public:
 
   nvvk::DebugUtil m_debug;  // Utility to name objects
 
+  // Pipelines are compiled on worker threads, while models and BLAS are loaded/built
+  nvvk::PipelineBuilderAsync             m_pipelineBuilder;
+  std::vector<std::future<vk::Pipeline>> m_pipelineTasks;
+
   // #Post
+  // The offscreen image is double buffered: the compute queue post-processes the image of a
+  // frame while the graphics queue renders the next one in the other image. The frame
+  // displays the post-processed image of the previous frame.
   void createOffscreenRender();
   void createPostPipeline();
   void createPostDescriptor();
   void updatePostDescriptorSet();
   void drawPost(vk::CommandBuffer cmdBuf);
+  void createPostCompute();
+  void updatePostComputeDescriptorSets();
+  void beginOffscreenFrame(const vk::CommandBuffer& cmdBuf);
+  void postProcess(uint32_t frame, bool raytraced);
+  uint32_t getOffscreenIndex() const { return static_cast<uint32_t>(m_postFrame & 1); }
+  vk::Framebuffer getOffscreenFramebuffer() const { return m_offscreenFramebuffers[getOffscreenIndex()]; }
 
   nvvk::DescriptorSetBindings m_postDescSetLayoutBind;
-  vk::DescriptorPool          m_postDescPool;
   vk::DescriptorSetLayout     m_postDescSetLayout;
-  vk::DescriptorSet           m_postDescSet;
+  vk::DescriptorSet           m_postDescSets[2];  // displays m_postOutputs[i]
   vk::Pipeline                m_postPipeline;
   vk::PipelineLayout          m_postPipelineLayout;
   vk::RenderPass              m_offscreenRenderPass;
-  vk::Framebuffer             m_offscreenFramebuffer;
-  nvvk::Texture               m_offscreenColor;
+  vk::RenderPass              m_offscreenRenderPassLoad;  // keeps color and depth, for the late draws
+  vk::Framebuffer             m_offscreenFramebuffers[2];
+  nvvk::Texture               m_offscreenColors[2];
   vk::Format                  m_offscreenColorFormat{vk::Format::eR32G32B32A32Sfloat};
   nvvk::Texture               m_offscreenDepth;
   vk::Format                  m_offscreenDepthFormat;
 
+  // Post-processing on m_queue_comp: the ray traced image is denoised by a few iterations of
+  // an edge-aware a-trous filter guided by m_gBuffers, then bloom is added and the result is
+  // tonemapped to m_postOutputs. See denoise.comp, bloom.comp and tonemap.comp.
+  enum PostSource
+  {
+    ePostColor = 0,  // the offscreen image
+    ePostPing  = 1,
+    ePostPong  = 2,
+    ePostBloom = 3,  // half resolution, only read by the tonemapper
+  };
+  struct PostPushConstant
+  {
+    int32_t source{ePostColor};
+    int32_t destination{ePostPing};
+    int32_t stepSize{1};      // a-trous: distance between the taps, bloom: pass, see bloom.comp
+    int32_t samples{1};       // accumulated in the offscreen image
+    float   sigmaLuminance{4.f};
+    float   sigmaNormal{64.f};
+    float   sigmaDepth{1.f};
+    float   exposure{1.f};
+    float   bloomThreshold{1.f};
+    float   bloomIntensity{0.f};  // 0 skips the bloom
+    int32_t tonemapper{0};        // 0: clamp, 1: Reinhard, 2: ACES
+    int32_t renderWidth{1};       // rendered part of the images, upscaled by the tonemapper
+    int32_t renderHeight{1};
+  };
+  static const uint32_t          s_postMaxIterations = 5;
+  PostPushConstant               m_postSettings;
+  bool                           m_useDenoiser{true};
+  int                            m_denoiseIterations{4};
+  nvvk::Texture                  m_gBuffers[2];     // normal and linear depth of the ray traced pixels
+  nvvk::Texture                  m_postPingPong[2];
+  nvvk::Texture                  m_bloom[2];        // half resolution
+  nvvk::Texture                  m_postOutputs[2];  // tonemapped, read by post.frag
+  nvvk::DescriptorSetBindings    m_postCompDescSetLayoutBind;
+  vk::DescriptorSetLayout        m_postCompDescSetLayout;
+  vk::DescriptorSet              m_postCompDescSets[2];  // post-processes m_offscreenColors[i]
+  vk::PipelineLayout             m_postCompPipelineLayout;
+  vk::Pipeline                   m_denoisePipeline;
+  vk::Pipeline                   m_bloomPipeline;
+  vk::Pipeline                   m_tonemapPipeline;
+  std::vector<vk::CommandBuffer> m_postCmdBufs;     // per frame, from m_cmdPool_comp
+  std::vector<uint64_t>          m_postCmdValues;   // m_postTimeline value of the last use of each one
+  vk::Semaphore                  m_renderTimeline;  // frame m_postFrame rendered in its offscreen image
+  vk::Semaphore                  m_postTimeline;    // frame m_postFrame post-processed
+  uint64_t                       m_postFrame{0};
+
+  // #Dynamic resolution
+  // The offscreen images are allocated at the size of the window, the frames render and
+  // post-process the top-left m_renderSize part of them and the tonemapper upscales it. With
+  // dynamic resolution, the render scale follows the GPU time of the frames, measured with
+  // timestamp queries, to hold m_targetFrameTime. Changing the scale never reallocates.
+  void         createFrameTimers();
+  void         updateRenderSize(uint32_t frame);
+  void         endOffscreenFrame(const vk::CommandBuffer& cmdBuf);
+  vk::Extent2D getRenderSize() const { return m_renderSize; }
+
+  bool              m_frameTimersSupported{false};
+  bool              m_useDynamicResolution{false};
+  float             m_targetFrameTime{16.f};  // milliseconds
+  float             m_minRenderScale{0.5f};
+  float             m_maxRenderScale{1.f};
+  float             m_renderScale{1.f};      // of the width and height of the window
+  float             m_gpuFrameTime{0.f};     // smoothed, the sum of the two below
+  float             m_gpuRenderTime{0.f};    // graphics queue, offscreen rendering
+  float             m_gpuPostTime{0.f};      // compute queue, post-processing
+  vk::Extent2D      m_renderSize{1, 1};
+  uint32_t          m_renderScaleCooldown{0};  // frames until the timings are at the new scale
+  vk::QueryPool     m_frameTimers;             // per frame: rendering begin/end, post begin/end
+  std::vector<bool> m_renderTimerWritten;
+  std::vector<bool> m_postTimerWritten;
+  bool              m_postTimersSupported{false};
+
+  // #Culling
+  // The instances are culled on m_queue_comp at the start of the frame, the draw commands of
+  // the visible instances are compacted per model and drawn with vkCmdDrawIndexedIndirectCount.
+  // With occlusion culling, the early pass only draws the instances visible in the previous
+  // frame, a depth pyramid is built from their depth and the late pass draws the other
+  // instances that are not hidden by it, see cull.comp.
+  enum CullMode
+  {
+    eCullFrustum = 0,
+    eCullEarly   = 1,
+    eCullLate    = 2,
+  };
+  static const uint32_t s_maxHizLevels = 16;  // must match MAX_HIZ_LEVELS in depthpyramid.comp
+  struct CullModel
+  {
+    uint32_t nbIndices{0};
+    uint32_t drawOffset{0};   // first command of the region of the model
+    uint32_t nbInstances{0};  // size of the region
+    uint32_t nbLods{1};
+    uint32_t lodFirstIndex[s_maxLods]{};
+    uint32_t lodNbIndices[s_maxLods]{};
+    float    lodError[s_maxLods]{};
+    uint32_t lodFirstCluster[s_maxLods]{};  // in m_clusterBuffer
+    uint32_t lodNbClusters[s_maxLods]{};
+    uint32_t clusterDrawOffset{0};          // first command of the region of the model in m_clusterDraws
+    uint32_t maxClusterDraws{0};            // size of the region, the instances times the most clusters of a level
+  };
+  struct CullPushConstant
+  {
+    Frustum  frustum;
+    uint32_t nbInstances{0};
+    uint32_t drawBase{0};   // regions of the pass in m_cullDraws and m_cullCounts
+    uint32_t countBase{0};
+    uint32_t mode{eCullFrustum};
+    int32_t  pyramidWidth{0};  // level 0 of m_hizPyramid
+    int32_t  pyramidHeight{0};
+    int32_t  pyramidLevels{0};
+    float    lodScale{0.f};  // see selectLod(), 0 draws level 0
+  };
+  static_assert(sizeof(CullPushConstant) <= 128, "push constants are limited to 128 bytes");
+  struct ClusterPushConstant
+  {
+    Frustum  frustum;
+    uint32_t nbInstances{0};
+    uint32_t drawBase{0};   // region of the frame in m_clusterDraws
+    uint32_t countBase{0};  // region of the frame in m_cullCounts
+    float    lodScale{0.f};
+    uint32_t useCones{1};
+  };
+  void             enqueueComputePipeline(const char* file, vk::PipelineLayout layout, vk::Pipeline* pipeline);
+  void             createCullPipeline();
+  void             createCullingBuffers();
+  void             createDepthPyramid();
+  void             updateHizDescriptorSets();
+  CullPushConstant getCullPushConstant(uint32_t frame, CullMode mode) const;
+  void             cullFrame(uint32_t frame);
+  void             buildDepthPyramid(const vk::CommandBuffer& cmdBuf);
+  void             cullLate(const vk::CommandBuffer& cmdBuf);
+  void             cullClusters(const vk::CommandBuffer& cmdBuf, uint32_t frame, const CullPushConstant& instancePushConstant);
+  bool             isCulling() const { return m_useCulling && m_cullingSupported; }
+  bool             isClusterCulling() const { return isCulling() && m_useClusters; }
+  bool             isOcclusionCulling() const
+  {
+    return isCulling() && m_useOcclusion && m_occlusionSupported && !m_useClusters;
+  }
+  float            getLodScale() const;
+
+  bool                           m_useCulling{true};
+  bool                           m_cullingSupported{false};  // drawIndirectCount and drawIndirectFirstInstance
+  bool                           m_useOcclusion{true};
+  bool                           m_occlusionSupported{false};  // timelineSemaphore
+  bool                           m_showCullStats{false};     // the UI shows the counts below, computed only then
+  uint32_t                       m_cpuVisibleInstances{0};   // by the CPU reference, for the UI
+  uint32_t                       m_cpuVisibleTriangles{0};   // at their level of detail
+  bool                           m_useLods{true};
+  bool                           m_useClusters{false};
+  bool                           m_useClusterCones{true};
+  float                          m_lodPixelError{1.f};  // largest error of a level of detail on screen
+  std::vector<CullInstance>      m_cullInstances;  // world bounding boxes, the instances don't move
+  std::vector<CullModel>         m_cullModels;
+  nvvk::Buffer                   m_cullInstanceBuffer;
+  nvvk::Buffer                   m_cullModelBuffer;
+  nvvk::Buffer                   m_cullDraws;       // early and late regions per frame in flight
+  nvvk::Buffer                   m_cullCounts;      // early and late regions per frame in flight
+  nvvk::Buffer                   m_cullVisibility;  // per instance, written by the late pass
+  nvvk::DescriptorSetBindings    m_cullDescSetLayoutBind;
+  vk::DescriptorSetLayout        m_cullDescSetLayout;
+  vk::DescriptorSet              m_cullDescSet;
+  vk::PipelineLayout             m_cullPipelineLayout;
+  vk::Pipeline                   m_cullPipeline;
+  std::vector<vk::CommandBuffer> m_cullCmdBufs;     // per frame, from m_cmdPool_comp
+  std::vector<vk::Semaphore>     m_cullSemaphores;  // per frame, waited by submitFrame()
+  vk::Semaphore                  m_hizTimeline;     // frames with a late pass, waited by the next early pass
+  uint64_t                       m_hizTimelineValue{0};
+
+  nvvk::Texture                  m_hizPyramid;  // farthest depth, the view and sampler cover all levels
+  std::vector<vk::ImageView>     m_hizLevelViews;
+  vk::Extent2D                   m_hizSize;
+  uint32_t                       m_hizLevels{0};
+  nvvk::DescriptorSetBindings    m_hizDescSetLayoutBind;
+  vk::DescriptorSetLayout        m_hizDescSetLayout;
+  vk::DescriptorSet              m_hizDescSet;
+  vk::PipelineLayout             m_hizPipelineLayout;
+  vk::Pipeline                   m_hizPipeline;
+  // cluster culling: each visible instance culls the clusters of its level of detail, the
+  // draws of the visible clusters are compacted per model, see clustercull.comp
+  nvvk::Buffer                   m_clusterBuffer;     // clusters of all models
+  nvvk::Buffer                   m_clusterDraws;      // region per frame in flight
+  nvvk::Buffer                   m_clusterDrawInfos;  // instance and first triangle of each draw, per-instance vertex input
+  uint32_t                       m_clusterDrawsPerFrame{0};
+  nvvk::DescriptorSetBindings    m_clusterDescSetLayoutBind;
+  vk::DescriptorSetLayout        m_clusterDescSetLayout;
+  vk::DescriptorSet              m_clusterDescSet;
+  vk::PipelineLayout             m_clusterPipelineLayout;
+  vk::Pipeline                   m_clusterPipeline;
+
   // #VKRay
   void                                  initRayTracing();
   nvvk::RaytracingBuilderKHR::BlasInput objectToVkGeometryKHR(const ObjModel& model);
@@ -187,23 +491,118 @@ public:
       std::vector<HelloVulkan::ObjModel> models);
   void                                  createBottomLevelAS();
   void                                  createTopLevelAS();
+  void                                  createRtDescriptorSetLayout();
   void                                  createRtDescriptorSet();
   void                                  updateRtDescriptorSet();
   void                                  createRtPipeline();
   void                                  createRtShaderBindingTable();
+  void                                  createRtAccumulation();
+  void                                  createShadowRayBuffers();
+  void                                  createShadowSortPipeline();
   void raytrace(const vk::CommandBuffer& cmdBuf, const nvmath::vec4f& clearColor);
+  void sortShadowRays(const vk::CommandBuffer& cmdBuf);
+  bool validateShadowSort();
+  void updateFrame(const nvmath::vec4f& clearColor);
+  void resetFrame() { m_rtPushConstants.frame = -1; }
 
 
   vk::PhysicalDeviceRayTracingPipelinePropertiesKHR   m_rtProperties;
   nvvk::RaytracingBuilderKHR                          m_rtBuilder;
   nvvk::DescriptorSetBindings                         m_rtDescSetLayoutBind;
-  vk::DescriptorPool                                  m_rtDescPool;
   vk::DescriptorSetLayout                             m_rtDescSetLayout;
-  vk::DescriptorSet                                   m_rtDescSet;
+  vk::DescriptorSet                                   m_rtDescSets[2];  // per offscreen image
   std::vector<vk::RayTracingShaderGroupCreateInfoKHR> m_rtShaderGroups;
   vk::PipelineLayout                                  m_rtPipelineLayout;
   vk::Pipeline                                        m_rtPipeline;
   nvvk::Buffer                                        m_rtSBTBuffer;
+  vk::DeviceSize                                      m_rtSBTSize{0};
+
+  // Shader binding table: the two raygens, the two misses, and one hit record per instance,
+  // the hitGroupId of the instance, with the data of the instance read by raytrace.rchit
+  enum RtRaygen
+  {
+    eRaygenPrimary = 0,  // raytrace.rgen
+    eRaygenShadow  = 1,  // raytraceShadow.rgen
+  };
+  // Must match the shaderRecordEXT block of closesthit.glsl
+  struct RtHitRecord
+  {
+    int               objId;
+    int               txtOffset;
+    vk::DeviceAddress vertexAddress;
+    vk::DeviceAddress indexAddress;
+    vk::DeviceAddress materialAddress;
+    vk::DeviceAddress materialIndexAddress;
+  };
+  nvvk::SbtBuilder m_sbt;
+
+  // How the closest hit shader reaches the buffers of the objects, see closesthit.glsl
+  enum SceneAccess
+  {
+    eSceneDescriptors = 0,  // raytrace.rchit: descriptor arrays indexed by the object
+    eSceneAddresses   = 1,  // raytraceAddress.rchit: device addresses of the hit record
+  };
+  int  m_rtSceneAccess{eSceneDescriptors};
+  void setSceneAccess(int sceneAccess);
+  void benchmarkSceneAccess(uint32_t frames);
+
+  // Progressive accumulation: each frame adds one jittered sample per pixel to the average in
+  // the offscreen image, until the camera, the light or the clear color changes. With adaptive
+  // sampling, the tiles whose standard error fell under the threshold stop tracing rays.
+  static const uint32_t s_rtTileSize = 8;  // must match TILE_SIZE in raytrace.rgen
+  nvvk::Texture         m_rtMoments;       // average squared luminance of the samples
+  nvvk::Buffer          m_rtTiles;         // 2 x tiles: traced in this frame, to trace in the next one
+  vk::Extent2D          m_rtTileCount;     // at the largest render size
+  bool                  m_rtAdaptive{true};
+  float                 m_rtVarianceThreshold{0.02f};  // standard error relative to the luminance
+  uint32_t              m_rtMinSamples{16};
+  nvmath::mat4f         m_rtRefCamera{0.f};  // state of the accumulated frames
+  float                 m_rtRefFov{0.f};
+  nvmath::vec4f         m_rtRefClearColor{0.f};
+  nvmath::vec3f         m_rtRefLightPosition{0.f};
+  float                 m_rtRefLightIntensity{0.f};
+  int                   m_rtRefLightType{0};
+
+  // Shadow rays: traced by the closest hit shader, or deferred. The deferred shadow rays are
+  // written by raytrace.rgen with the two colors of their sample, optionally sorted by the
+  // octant of their direction and the cell of their origin, then traced and accumulated by
+  // raytraceShadow.rgen. The sort is a GPU radix sort, see radixsort.comp.
+  enum ShadowMode
+  {
+    eShadowInline    = 0,  // one trace per hit in raytrace.rchit
+    eShadowWavefront = 1,  // deferred, traced in the order of the primary hits
+    eShadowSorted    = 2,  // deferred and sorted
+  };
+  enum SortStage
+  {
+    eSortHistogram = 0,
+    eSortScan      = 1,
+    eSortScatter   = 2,
+  };
+  // Must match ShadowRay in raycommon.glsl
+  struct ShadowRay
+  {
+    nvmath::vec3f origin;
+    float         tMax;
+    nvmath::vec3f direction;
+    uint32_t      pixel;
+    uint32_t      key;
+    uint32_t      colors[3];
+  };
+  static const uint32_t       s_sortBlockSize = 4096;  // must match BLOCK_SIZE in radixsort.comp
+  int                         m_rtShadowMode{eShadowInline};
+  bool                        m_shadowSortSupported{false};
+  uint32_t                    m_shadowRayCapacity{0};  // one per pixel at the largest render size
+  nvvk::Buffer                m_shadowRays;
+  nvvk::Buffer                m_shadowRayCount;
+  nvvk::Buffer                m_shadowKeys;     // 2 x capacity, sorted in the first half
+  nvvk::Buffer                m_shadowIndices;  // 2 x capacity, into m_shadowRays
+  nvvk::Buffer                m_shadowHistograms;
+  nvvk::DescriptorSetBindings m_sortDescSetLayoutBind;
+  vk::DescriptorSetLayout     m_sortDescSetLayout;
+  vk::DescriptorSet           m_sortDescSet;
+  vk::PipelineLayout          m_sortPipelineLayout;
+  vk::Pipeline                m_sortPipeline;
 
   struct RtPushConstant
   {
@@ -211,5 +610,11 @@ public:
     nvmath::vec3f lightPosition;
     float         lightIntensity;
     int           lightType;
+    uint32_t      feedbackOffset;
+    int           frame{-1};              // samples accumulated before this frame, 0 restarts
+    float         varianceThreshold{0.f};  // 0 traces all pixels
+    uint32_t      minSamples{0};          // traced in every tile before testing it
+    int           shadowMode{eShadowInline};
+    float         cellSize{1.f};  // of the grid of the shadow ray sort keys
   } m_rtPushConstants;
 };
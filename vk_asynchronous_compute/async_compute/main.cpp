@@ -29,6 +29,7 @@
 // pipeline If you are new to ImGui, see examples/README.txt and documentation
 // at the top of imgui.cpp.
 // setprecision example
+#include <algorithm>
 #include <iostream>     // std::cout, std::fixed
 #include <thread>
 #include <iomanip>      // std::setprecision
@@ -101,11 +102,6 @@ void updateTitleBar(GLFWwindow* window)
 //////////////////////////////////////////////////////////////////////////
 static int const SAMPLE_WIDTH  = 1280;
 static int const SAMPLE_HEIGHT = 720;
-void             myFunction(HelloVulkan* helloVk, vk::CommandBuffer& cmdBuf_compute)
-{
-  // Code to be executed in the thread
-  helloVk->executeComputeShaderPipline(cmdBuf_compute);
-}
 
 //--------------------------------------------------------------------------------------------------
 // Application Entry
@@ -203,6 +199,9 @@ int main(int argc, char** argv)
 
   contextInfo.addInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   //contextInfo.addInstanceExtension(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+  // Async compute queues: the first one runs the compute test alongside the frames,
+  // the second, low priority one, runs the benchmarks
+  contextInfo.setComputeQueues({1.0f, 0.1f});
   // Creating Vulkan base application
   nvvk::Context vkctx{};
   vkctx.initInstance(contextInfo);
@@ -229,6 +228,13 @@ int main(int argc, char** argv)
   // Setup Imgui
   helloVk.initGUI(0);  // Using sub-pass 0
 
+  // Pipelines which don't depend on the scene are compiled on worker threads while models load
+  helloVk.createComputeShaderPipline();
+  helloVk.createPostDescriptor();
+  helloVk.createPostPipeline();
+  // Models and textures are written to the bindless table as they load
+  helloVk.createDescriptorSetLayout();
+
  /* // Creation of the example
   std::random_device              rd;  //Will be used to obtain a seed for the random number engine
   std::mt19937                    gen(rd());  //Standard mersenne_twister_engine seeded with rd()
@@ -258,8 +264,6 @@ int main(int argc, char** argv)
  // helloVk.loadModel(nvh::findFile("media/scenes/cube_multi.obj", defaultSearchPaths, true));
   helloVk.loadModel(nvh::findFile("media/scenes/armadillo.obj", defaultSearchPaths, true));
   //helloVk.loadModel(nvh::findFile("media/scenes/lucy.obj", defaultSearchPaths, true));
-  
-  helloVk.createComputeShaderPipline();
 
   std::random_device              rd;  // Will be used to obtain a seed for the random number engine
   std::mt19937                    gen(rd());  // Standard mersenne_twister_engine seeded with rd()
@@ -282,30 +286,39 @@ int main(int argc, char** argv)
   }
 
   helloVk.createOffscreenRender();
-  helloVk.createDescriptorSetLayout();
+  helloVk.createPostCompute();
+  helloVk.createFrameTimers();
   helloVk.createGraphicsPipeline();
+  helloVk.createCullPipeline();
   helloVk.createUniformBuffer();
   helloVk.createSceneDescriptionBuffer();
+  helloVk.createCullingBuffers();
+  helloVk.createTextureFeedbackBuffer();
   helloVk.updateDescriptorSet();
 
   // #VKRay
   helloVk.initRayTracing();
+  helloVk.createRtDescriptorSetLayout();
+  helloVk.createRtPipeline();  // compiles while the acceleration structures are built
+  helloVk.createShadowSortPipeline();
   helloVk.createBottomLevelAS();
   helloVk.createTopLevelAS();
   helloVk.createRtDescriptorSet();
-  helloVk.createRtPipeline();
-  helloVk.createRtShaderBindingTable();
 
-  helloVk.createPostDescriptor();
-  helloVk.createPostPipeline();
   helloVk.updatePostDescriptorSet();
 
+  // All pipelines must exist before the SBT is written and the first frame is recorded
+  helloVk.waitForPipelines();
+  helloVk.createRtShaderBindingTable();
+
 
   nvmath::vec4f clearColor   = nvmath::vec4f(1, 1, 1, 1.00f);
   bool          useRaytracer = false;
 
   
   bool m_runTestComputeShader = true;
+  bool m_runWorkgroupBenchmark = false;
+  bool m_runAccumBenchmark     = false;
   //bool use_cpu_multithread    = false;
   int m_numberOfUsedQueues = 2;
   helloVk.setupGlfwCallbacks(window);
@@ -326,16 +339,108 @@ int main(int argc, char** argv)
     ImGui::NewFrame();
 
     // Show UI window.
+    helloVk.m_showCullStats = false;
     if(helloVk.showGui())
     {
       ImGuiH::Panel::Begin();
       ImGui::ColorEdit3("Clear color", reinterpret_cast<float*>(&clearColor));
-      ImGui::Checkbox("Ray Tracer mode", &useRaytracer);  // Switch between raster and ray tracing
+      if(ImGui::Checkbox("Ray Tracer mode", &useRaytracer))  // Switch between raster and ray tracing
+        helloVk.resetFrame();
+      if(useRaytracer)
+      {
+        ImGui::Text("Accumulated samples: %d", helloVk.m_rtPushConstants.frame + 1);
+        ImGui::Checkbox("Adaptive sampling", &helloVk.m_rtAdaptive);
+        if(helloVk.m_rtAdaptive)
+        {
+          // Tiles converged with the previous settings would not be traced again
+          bool changed = ImGui::SliderFloat("Relative error", &helloVk.m_rtVarianceThreshold, 0.001f, 0.2f, "%.3f",
+                                            ImGuiSliderFlags_Logarithmic);
+          changed |= ImGui::SliderInt("Min samples", reinterpret_cast<int*>(&helloVk.m_rtMinSamples), 2, 256);
+          if(changed)
+            helloVk.resetFrame();
+        }
+        // Same samples in every mode, only the order of the shadow rays changes
+        ImGui::Combo("Shadow rays", &helloVk.m_rtShadowMode, "Closest hit\0" "Wavefront\0" "Wavefront, sorted\0",
+                     helloVk.m_shadowSortSupported ? 3 : 2);
+        if(helloVk.m_frameTimersSupported)
+          ImGui::Text("GPU render time: %.2f ms", helloVk.m_gpuRenderTime);
+        if(helloVk.m_rtShadowMode == HelloVulkan::eShadowSorted && ImGui::Button("Validate sort"))
+          helloVk.validateShadowSort();
+        int sceneAccess = helloVk.m_rtSceneAccess;
+        if(ImGui::Combo("Scene access", &sceneAccess, "Descriptor arrays\0" "Buffer addresses\0"))
+          helloVk.setSceneAccess(sceneAccess);
+        if(helloVk.m_frameTimersSupported && ImGui::Button("Compare scene access"))
+          helloVk.benchmarkSceneAccess(64);
+      }
+      if(helloVk.m_cullingSupported && !useRaytracer)
+      {
+        ImGui::Checkbox("Frustum culling", &helloVk.m_useCulling);
+        helloVk.m_showCullStats = helloVk.m_useCulling;
+        if(helloVk.m_useCulling)
+          ImGui::Text("Visible instances: %u / %zu", helloVk.m_cpuVisibleInstances, helloVk.m_objInstance.size());
+        if(helloVk.m_useCulling && helloVk.m_occlusionSupported && !helloVk.m_useClusters)
+          ImGui::Checkbox("Occlusion culling", &helloVk.m_useOcclusion);
+        if(helloVk.m_useCulling)
+          ImGui::Checkbox("Cluster culling", &helloVk.m_useClusters);
+        if(helloVk.m_useCulling && helloVk.m_useClusters)
+          ImGui::Checkbox("Cone culling", &helloVk.m_useClusterCones);
+        if(helloVk.m_useCulling)
+          ImGui::Text("Triangles in the frustum: %u", helloVk.m_cpuVisibleTriangles);
+      }
+      if(!useRaytracer)
+      {
+        ImGui::Checkbox("Levels of detail", &helloVk.m_useLods);
+        if(helloVk.m_useLods)
+          ImGui::SliderFloat("LOD error (pixels)", &helloVk.m_lodPixelError, 0.25f, 16.f, "%.2f", ImGuiSliderFlags_Logarithmic);
+      }
       
+      if(ImGui::CollapsingHeader("Post-processing"))
+      {
+        HelloVulkan::PostPushConstant& post = helloVk.m_postSettings;
+        if(useRaytracer)
+        {
+          ImGui::Checkbox("Denoiser", &helloVk.m_useDenoiser);
+          if(helloVk.m_useDenoiser)
+          {
+            ImGui::SliderInt("Iterations", &helloVk.m_denoiseIterations, 1, HelloVulkan::s_postMaxIterations);
+            ImGui::SliderFloat("Luminance sigma", &post.sigmaLuminance, 0.01f, 16.f, "%.2f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Normal exponent", &post.sigmaNormal, 1.f, 256.f, "%.0f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Depth sigma", &post.sigmaDepth, 0.1f, 10.f, "%.2f", ImGuiSliderFlags_Logarithmic);
+          }
+        }
+        ImGui::SliderFloat("Exposure", &post.exposure, 0.1f, 10.f, "%.2f", ImGuiSliderFlags_Logarithmic);
+        ImGui::Combo("Tonemapper", &post.tonemapper, "Clamp\0" "Reinhard\0" "ACES\0");
+        ImGui::SliderFloat("Bloom intensity", &post.bloomIntensity, 0.f, 1.f);
+        if(post.bloomIntensity > 0.f)
+          ImGui::SliderFloat("Bloom threshold", &post.bloomThreshold, 0.f, 4.f);
+      }
+
+      if(ImGui::CollapsingHeader("Resolution"))
+      {
+        if(helloVk.m_frameTimersSupported)
+          ImGui::Checkbox("Dynamic resolution", &helloVk.m_useDynamicResolution);
+        if(helloVk.m_useDynamicResolution)
+        {
+          ImGui::SliderFloat("Target GPU time (ms)", &helloVk.m_targetFrameTime, 1.f, 50.f, "%.1f");
+          ImGui::SliderFloat("Min scale", &helloVk.m_minRenderScale, 0.1f, 1.f, "%.2f");
+          ImGui::SliderFloat("Max scale", &helloVk.m_maxRenderScale, helloVk.m_minRenderScale, 1.f, "%.2f");
+        }
+        else
+        {
+          ImGui::SliderFloat("Render scale", &helloVk.m_renderScale, 0.1f, 1.f, "%.2f");
+        }
+        vk::Extent2D renderSize = helloVk.getRenderSize();
+        ImGui::Text("Render size: %u x %u", renderSize.width, renderSize.height);
+        if(helloVk.m_frameTimersSupported)
+          ImGui::Text("GPU time: %.2f ms (render %.2f, post %.2f)", helloVk.m_gpuFrameTime, helloVk.m_gpuRenderTime,
+                      helloVk.m_gpuPostTime);
+      }
+
       //renderUI(helloVk);
       if(ImGui::CollapsingHeader("Test Async Compute", ImGuiTreeNodeFlags_DefaultOpen))
       {
-        ImGui::Checkbox("use atomic op", (bool*)&helloVk.m_PushConstant.use_atomic);
+        ImGui::Combo("Accumulation", &helloVk.m_PushConstant.accum_mode,
+                     "None\0" "Atomic\0" "Subgroup + atomic\0" "Workgroup + atomic\0" "Sharded atomics\0");
         static int x = 1000;
         static int y = 0;
         static int z = 0;
@@ -344,6 +449,19 @@ int main(int argc, char** argv)
         ImGui::SliderInt("t3", &z, 0, 100000);
         helloVk.m_PushConstant.m_threads = x + y + z;
         ImGui::Text("#Threads = %d", helloVk.m_PushConstant.m_threads);
+        // Changing these selects another specialization of parallelTest.comp
+        static const uint32_t workgroupSizes[] = {32, 64, 128, 256, 512, 1024};
+        int workgroupItem = int(std::find(std::begin(workgroupSizes), std::end(workgroupSizes),
+                                          helloVk.m_compVariant.workgroupSize)
+                                - std::begin(workgroupSizes));
+        if(ImGui::Combo("Workgroup size", &workgroupItem, "32\0" "64\0" "128\0" "256\0" "512\0" "1024\0"))
+          helloVk.m_compVariant.workgroupSize = workgroupSizes[workgroupItem];
+        ImGui::SliderInt("Outer loop", &helloVk.m_compVariant.outerLoop, 1, 1000);
+        ImGui::SliderInt("Inner loop", &helloVk.m_compVariant.innerLoop, 1, 1000);
+        if(ImGui::Button("Find fastest workgroup size"))
+          m_runWorkgroupBenchmark = true;
+        if(ImGui::Button("Compare accumulation modes"))
+          m_runAccumBenchmark = true;
         ImGui::Separator();
         ImGui::Text("Use for running Compute/Graphics cammand");
         ImGui::RadioButton("One Queue", &m_numberOfUsedQueues, 1);
@@ -366,9 +484,20 @@ int main(int argc, char** argv)
     // Start command buffer of this frame
     auto                     curFrame = helloVk.getCurFrame();
     const vk::CommandBuffer& cmdBuf   = helloVk.getCommandBuffers()[curFrame];
-    vk::CommandBuffer& cmdBuf_compute = helloVk.getCompCommandBuffer();
+
+    // Render size of this frame, from the GPU time of the last frame that used this image
+    helloVk.updateRenderSize(curFrame);
+
+    // The previous frame using this image is done, its texture feedback can be read and its
+    // descriptor set updated
+    helloVk.updateTextureStreaming(curFrame, useRaytracer);
+    helloVk.m_bindless.flush(curFrame);
+    // The rasterizer draws the instances culled on the compute queue
+    if(!useRaytracer)
+      helloVk.cullFrame(curFrame);
 
     cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    helloVk.beginOffscreenFrame(cmdBuf);
 
     // Updating camera buffer
     helloVk.updateUniformBuffer(cmdBuf);
@@ -387,8 +516,8 @@ int main(int argc, char** argv)
       offscreenRenderPassBeginInfo.setClearValueCount(2);
       offscreenRenderPassBeginInfo.setPClearValues(clearValues);
       offscreenRenderPassBeginInfo.setRenderPass(helloVk.m_offscreenRenderPass);
-      offscreenRenderPassBeginInfo.setFramebuffer(helloVk.m_offscreenFramebuffer);
-      offscreenRenderPassBeginInfo.setRenderArea({{}, helloVk.getSize()});
+      offscreenRenderPassBeginInfo.setFramebuffer(helloVk.getOffscreenFramebuffer());
+      offscreenRenderPassBeginInfo.setRenderArea({{}, helloVk.getRenderSize()});
 
       // Rendering Scene
       if(useRaytracer)
@@ -400,10 +529,22 @@ int main(int argc, char** argv)
         cmdBuf.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
         helloVk.rasterize(cmdBuf);
         cmdBuf.endRenderPass();
+
+        // Instances hidden last frame that the depth of the early draws doesn't occlude
+        if(helloVk.isOcclusionCulling())
+        {
+          helloVk.buildDepthPyramid(cmdBuf);
+          helloVk.cullLate(cmdBuf);
+          offscreenRenderPassBeginInfo.setRenderPass(helloVk.m_offscreenRenderPassLoad);
+          cmdBuf.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
+          helloVk.rasterize(cmdBuf, true);
+          cmdBuf.endRenderPass();
+        }
       }
+      helloVk.endOffscreenFrame(cmdBuf);
     }
 
-    // 2nd rendering pass: tone mapper, UI
+    // 2nd rendering pass: post-processed image of the previous frame, UI
     {
       vk::RenderPassBeginInfo postRenderPassBeginInfo;
       postRenderPassBeginInfo.setClearValueCount(2);
@@ -413,7 +554,7 @@ int main(int argc, char** argv)
       postRenderPassBeginInfo.setRenderArea({{}, helloVk.getSize()});
 
       cmdBuf.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eInline);
-      // Rendering tonemapper
+      // Rendering the tonemapped image
       helloVk.drawPost(cmdBuf);
       // Rendering UI
       ImGui::Render();
@@ -424,6 +565,8 @@ int main(int argc, char** argv)
     // Submit for display
     cmdBuf.end();
     helloVk.submitFrame();
+    // Denoiser, bloom and tonemapper on the compute queue, overlapping the next frame
+    helloVk.postProcess(curFrame, useRaytracer);
     //==============================================
     if(m_runTestComputeShader)
     {
@@ -440,27 +583,15 @@ int main(int argc, char** argv)
         counter                              = 0;
         helloVk.m_isTestComputeShaderRunning = false;
         helloVk.m_waitingComputeShaderFence  = false;
-        helloVk.prepareComputeShader();
         if(m_numberOfUsedQueues == 2)
         {
-          //if(use_cpu_multithread)
-          //{
-          //  // Create a thread and pass the function to be executed
-          //  std::thread myThread(myFunction, &helloVk, cmdBuf_compute);
-          //  myThread.detach();
-          //}
-          //else
-          {
-            helloVk.executeComputeShaderPipline(cmdBuf_compute);
-          }
-
+          helloVk.executeComputeGraph(true);
           helloVk.m_waitingComputeShaderFence = true;
         }
         else
         {
-          
-
-          helloVk.executeComputeShaderPipline_graphicsQueue();
+          helloVk.executeComputeGraph(false);
+          helloVk.m_compGraph.wait();
           clearColor = nvmath::vec4f(1, 1, 1, 1);
           //helloVk.printCounter();
           m_runTestComputeShader = true;
@@ -474,6 +605,16 @@ int main(int argc, char** argv)
       }
     }
     //=====================================
+    if(m_runWorkgroupBenchmark && !helloVk.m_waitingComputeShaderFence)
+    {
+      m_runWorkgroupBenchmark = false;
+      helloVk.benchmarkCompWorkgroupSizes({32, 64, 128, 256, 512, 1024});
+    }
+    if(m_runAccumBenchmark && !helloVk.m_waitingComputeShaderFence)
+    {
+      m_runAccumBenchmark = false;
+      helloVk.benchmarkCompAccumModes();
+    }
     if(helloVk.m_waitingComputeShaderFence && counter>=10)
     {
       counter = 0;
@@ -0,0 +1,96 @@
+// Resources of the ray generation shaders, raytrace.rgen and raytraceShadow.rgen, and the
+// progressive accumulation of their samples.
+//
+// Progressive accumulation: each frame traces one jittered sample per pixel and adds it to
+// the average of `previousImage`, written to `image`, pushC.frame being the number of samples
+// already accumulated. The two images are swapped every frame, the previous one may still be
+// read by the post-processing on the compute queue.
+//
+// Adaptive sampling: the pixels also accumulate their squared luminance in `moments`. A pixel
+// whose standard error is still above the threshold flags its tile to be traced in the next
+// frame, the tiles left unflagged are converged and stop tracing until the accumulation
+// restarts. All tiles are traced for the first pushC.minSamples samples.
+
+#define TILE_SIZE 8  // must match HelloVulkan::s_rtTileSize
+
+// clang-format off
+layout(binding = 0, set = 0) uniform accelerationStructureEXT topLevelAS;
+layout(binding = 1, set = 0, rgba32f) uniform image2D image;
+layout(binding = 2, set = 0, r32f) uniform image2D moments;
+layout(binding = 3, set = 0) buffer Tiles { uint tiles[]; };  // 2 x tiles, flipped every frame
+layout(binding = 4, set = 0, rgba32f) uniform readonly image2D previousImage;
+layout(binding = 5, set = 0, rgba32f) uniform writeonly image2D gBuffer;  // normal, distance
+layout(binding = 6, set = 0, rgba32f) uniform readonly image2D previousGBuffer;
+// Deferred shadow rays, in the order of the primary hits. The keys and indices are sorted in
+// place by radixsort.comp, the second half of their buffers is its scratch space.
+layout(binding = 7, set = 0, scalar) buffer ShadowRays { ShadowRay shadowRays[]; };
+layout(binding = 8, set = 0) buffer ShadowRayCount { uint shadowRayCount; };
+layout(binding = 9, set = 0) buffer ShadowKeys { uint shadowKeys[]; };
+layout(binding = 10, set = 0) buffer ShadowIndices { uint shadowIndices[]; };
+// clang-format on
+
+// Must match HelloVulkan::RtPushConstant
+layout(push_constant) uniform Constants
+{
+  vec4  clearColor;
+  vec3  lightPosition;
+  float lightIntensity;
+  int   lightType;
+  uint  feedbackOffset;
+  int   frame;
+  float varianceThreshold;  // 0 traces all pixels
+  uint  minSamples;
+  int   shadowMode;
+  float cellSize;  // of the grid of the shadow ray keys
+}
+pushC;
+
+// Index of the tile of `pixel` in the flags of a frame, the launch size is the render size
+uint getTile(ivec2 pixel)
+{
+  uvec2 tileCount = (gl_LaunchSizeEXT.xy + TILE_SIZE - 1) / TILE_SIZE;
+  uvec2 tileId    = uvec2(pixel) / TILE_SIZE;
+  return tileId.y * tileCount.x + tileId.x;
+}
+
+uint getTileCount()
+{
+  uvec2 tileCount = (gl_LaunchSizeEXT.xy + TILE_SIZE - 1) / TILE_SIZE;
+  return tileCount.x * tileCount.y;
+}
+
+// True if the tile of `pixel` stops tracing
+bool isConverged(ivec2 pixel)
+{
+  uint current = (pushC.frame & 1) * getTileCount();
+  return pushC.varianceThreshold > 0.0 && pushC.frame > int(pushC.minSamples) && tiles[current + getTile(pixel)] == 0;
+}
+
+// Adds the sample of this frame to the average of the pixel, and flags its tile if the pixel
+// is not converged
+void accumulate(ivec2 pixel, vec3 sampleValue)
+{
+  // Running averages of the color and of the squared luminance
+  float luminance = dot(sampleValue, vec3(0.2126, 0.7152, 0.0722));
+  vec3  color     = sampleValue;
+  float moment    = luminance * luminance;
+  if(pushC.frame > 0)
+  {
+    float a = 1.0 / float(pushC.frame + 1);
+    color   = mix(imageLoad(previousImage, pixel).xyz, color, a);
+    moment  = mix(imageLoad(moments, pixel).x, moment, a);
+  }
+  imageStore(image, pixel, vec4(color, 1.0));
+  imageStore(moments, pixel, vec4(moment));
+
+  // Standard error of the average luminance, relative to it. The flags are also written
+  // without adaptive sampling, so that it can be enabled at any frame.
+  bool  adaptive  = pushC.varianceThreshold > 0.0;
+  float mean      = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  float variance  = max(moment - mean * mean, 0.0);
+  float error     = sqrt(variance / float(pushC.frame + 1));
+  bool  converged = adaptive && pushC.frame >= int(pushC.minSamples)
+                   && error <= pushC.varianceThreshold * max(mean, 1e-3);
+  if(!converged)
+    tiles[((pushC.frame + 1) & 1) * getTileCount() + getTile(pixel)] = 1;
+}
@@ -0,0 +1,194 @@
+// Closest hit shader of raytrace.rchit and raytraceAddress.rchit, which differ by how they
+// reach the buffers of the object that was hit:
+//
+// - raytrace.rchit: the object index of the hit record selects them in the descriptor arrays of
+//   the models, with nonuniformEXT indexing
+// - raytraceAddress.rchit, with SCENE_BUFFER_ADDRESS: they are read through the device
+//   addresses of the hit record, no descriptor is involved
+
+hitAttributeEXT vec2 attribs;
+
+// clang-format off
+layout(location = 0) rayPayloadInEXT hitPayload prd;
+layout(location = 1) rayPayloadEXT bool isShadowed;
+
+layout(binding = 0, set = 0) uniform accelerationStructureEXT topLevelAS;
+
+#ifdef SCENE_BUFFER_ADDRESS
+layout(buffer_reference, scalar) readonly buffer Vertices { Vertex v[]; };
+layout(buffer_reference, scalar) readonly buffer Indices { uint i[]; };
+layout(buffer_reference, scalar) readonly buffer Materials { WaveFrontMaterial m[]; };
+layout(buffer_reference, scalar) readonly buffer MatIndices { int i[]; };
+#else
+layout(binding = 5, set = 1, scalar) buffer Vertices { Vertex v[]; } vertices[];
+layout(binding = 6, set = 1) buffer Indices { uint i[]; } indices[];
+
+layout(binding = 1, set = 1, scalar) buffer MatColorBufferObject { WaveFrontMaterial m[]; } materials[];
+layout(binding = 4, set = 1)  buffer MatIndexColorBuffer { int i[]; } matIndex[];
+#endif
+layout(binding = 3, set = 1) buffer TextureFeedback { uint needed[]; } feedback;
+layout(binding = 7, set = 1) uniform sampler2D textureSamplers[];
+
+// Hit record of the instance, must match HelloVulkan::RtHitRecord
+layout(shaderRecordEXT, std430) buffer SBTData
+{
+  int   objId;
+  int   txtOffset;
+  uvec2 vertexAddress;  // addresses of the buffers of the object, as in its sceneDesc
+  uvec2 indexAddress;
+  uvec2 materialAddress;
+  uvec2 materialIndexAddress;
+} hitRecord;
+// clang-format on
+
+layout(push_constant) uniform Constants
+{
+  vec4  clearColor;
+  vec3  lightPosition;
+  float lightIntensity;
+  int   lightType;
+  uint  feedbackOffset;
+  int   frame;
+  float varianceThreshold;
+  uint  minSamples;
+  int   shadowMode;
+}
+pushC;
+
+
+void main()
+{
+#ifdef SCENE_BUFFER_ADDRESS
+  // Buffers of the object of this instance
+  Indices  indices  = Indices(hitRecord.indexAddress);
+  Vertices vertices = Vertices(hitRecord.vertexAddress);
+
+  // Indices of the triangle
+  ivec3 ind = ivec3(indices.i[3 * gl_PrimitiveID + 0],   //
+                    indices.i[3 * gl_PrimitiveID + 1],   //
+                    indices.i[3 * gl_PrimitiveID + 2]);  //
+  // Vertex of the triangle
+  Vertex v0 = vertices.v[ind.x];
+  Vertex v1 = vertices.v[ind.y];
+  Vertex v2 = vertices.v[ind.z];
+#else
+  // Object of this instance
+  uint objId = hitRecord.objId;
+
+  // Indices of the triangle
+  ivec3 ind = ivec3(indices[nonuniformEXT(objId)].i[3 * gl_PrimitiveID + 0],   //
+                    indices[nonuniformEXT(objId)].i[3 * gl_PrimitiveID + 1],   //
+                    indices[nonuniformEXT(objId)].i[3 * gl_PrimitiveID + 2]);  //
+  // Vertex of the triangle
+  Vertex v0 = vertices[nonuniformEXT(objId)].v[ind.x];
+  Vertex v1 = vertices[nonuniformEXT(objId)].v[ind.y];
+  Vertex v2 = vertices[nonuniformEXT(objId)].v[ind.z];
+#endif
+
+  const vec3 barycentrics = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+
+  // Computing the normal at hit position
+  vec3 normal = v0.nrm * barycentrics.x + v1.nrm * barycentrics.y + v2.nrm * barycentrics.z;
+  // Transforming the normal to world space
+  normal = normalize(vec3(normal * gl_WorldToObjectEXT));
+
+
+  // Computing the coordinates of the hit position
+  vec3 worldPos = v0.pos * barycentrics.x + v1.pos * barycentrics.y + v2.pos * barycentrics.z;
+  // Transforming the position to world space
+  worldPos = vec3(gl_ObjectToWorldEXT * vec4(worldPos, 1.0));
+
+  // Vector toward the light
+  vec3  L;
+  float lightIntensity = pushC.lightIntensity;
+  float lightDistance  = 100000.0;
+  // Point light
+  if(pushC.lightType == 0)
+  {
+    vec3 lDir      = pushC.lightPosition - worldPos;
+    lightDistance  = length(lDir);
+    lightIntensity = pushC.lightIntensity / (lightDistance * lightDistance);
+    L              = normalize(lDir);
+  }
+  else  // Directional light
+  {
+    L = normalize(pushC.lightPosition - vec3(0));
+  }
+
+  // Material of the object
+#ifdef SCENE_BUFFER_ADDRESS
+  int               matIdx = MatIndices(hitRecord.materialIndexAddress).i[gl_PrimitiveID];
+  WaveFrontMaterial mat    = Materials(hitRecord.materialAddress).m[matIdx];
+#else
+  int               matIdx = matIndex[nonuniformEXT(objId)].i[gl_PrimitiveID];
+  WaveFrontMaterial mat    = materials[nonuniformEXT(objId)].m[matIdx];
+#endif
+
+
+  // Diffuse
+  vec3 diffuse = computeDiffuse(mat, L, normal);
+  if(mat.textureId >= 0)
+  {
+    uint txtId = mat.textureId + hitRecord.txtOffset;
+    vec2 texCoord =
+        v0.texCoord * barycentrics.x + v1.texCoord * barycentrics.y + v2.texCoord * barycentrics.z;
+    diffuse *= texture(textureSamplers[nonuniformEXT(txtId)], texCoord).xyz;
+    // No derivatives here, the texture is only marked as used, its levels come from the CPU
+    if(all(equal(gl_LaunchIDEXT.xy & 7u, uvec2(0))))
+      atomicMax(feedback.needed[pushC.feedbackOffset + txtId], 1u);
+  }
+
+  vec3  specular    = vec3(0);
+  float attenuation = 1;
+
+  prd.normal        = normal;
+  prd.depth         = gl_HitTEXT;
+  prd.lightDistance = 0.0;
+
+  // The shadow ray is traced later by raytraceShadow.rgen, with the other shadow rays of the
+  // frame, which picks one of the two colors
+  if(pushC.shadowMode != SHADOW_INLINE && dot(normal, L) > 0)
+  {
+    prd.hitValue       = lightIntensity * (diffuse + computeSpecular(mat, gl_WorldRayDirectionEXT, L, normal));
+    prd.shadowedValue  = lightIntensity * 0.3 * diffuse;
+    prd.lightDirection = L;
+    prd.lightDistance  = lightDistance;
+    return;
+  }
+
+  // Tracing shadow ray only if the light is visible from the surface
+  if(dot(normal, L) > 0)
+  {
+    float tMin   = 0.001;
+    float tMax   = lightDistance;
+    vec3  origin = gl_WorldRayOriginEXT + gl_WorldRayDirectionEXT * gl_HitTEXT;
+    vec3  rayDir = L;
+    uint  flags  = gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT
+                 | gl_RayFlagsSkipClosestHitShaderEXT;
+    isShadowed = true;
+    traceRayEXT(topLevelAS,  // acceleration structure
+                flags,       // rayFlags
+                0xFF,        // cullMask
+                0,           // sbtRecordOffset
+                0,           // sbtRecordStride
+                1,           // missIndex
+                origin,      // ray origin
+                tMin,        // ray min range
+                rayDir,      // ray direction
+                tMax,        // ray max range
+                1            // payload (location = 1)
+    );
+
+    if(isShadowed)
+    {
+      attenuation = 0.3;
+    }
+    else
+    {
+      // Specular
+      specular = computeSpecular(mat, gl_WorldRayDirectionEXT, L, normal);
+    }
+  }
+
+  prd.hitValue = vec3(lightIntensity * attenuation * (diffuse + specular));
+}
@@ -10,9 +10,9 @@
 layout(push_constant) uniform shaderInformation
 {
   vec3  lightPosition;
-  uint  instanceId;
   float lightIntensity;
   int   lightType;
+  uint  feedbackOffset;
 }
 pushC;
 
@@ -23,12 +23,15 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 viewDir;
 layout(location = 4) in vec3 worldPos;
+layout(location = 5) flat in uint instanceId;
+layout(location = 6) flat in uint firstTriangle;  // of the level of detail drawn
 // Outgoing
 layout(location = 0) out vec4 outColor;
 // Buffers
 layout(binding = 1, scalar) buffer MatColorBufferObject { WaveFrontMaterial m[]; } materials[];
 layout(binding = 2, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
-layout(binding = 3) uniform sampler2D[] textureSamplers;
+layout(binding = 3) buffer TextureFeedback { uint needed[]; } feedback;
+layout(binding = 7) uniform sampler2D[] textureSamplers;
 layout(binding = 4, scalar) buffer MatIndex { int i[]; } matIdx[];
 
 // clang-format on
@@ -37,10 +40,10 @@ layout(binding = 4, scalar) buffer MatIndex { int i[]; } matIdx[];
 void main()
 {
   // Object of this instance
-  int objId = scnDesc.i[pushC.instanceId].objId;
+  int objId = scnDesc.i[instanceId].objId;
 
   // Material of the object
-  int               matIndex = matIdx[nonuniformEXT(objId)].i[gl_PrimitiveID];
+  int               matIndex = matIdx[nonuniformEXT(objId)].i[firstTriangle + gl_PrimitiveID];
   WaveFrontMaterial mat      = materials[nonuniformEXT(objId)].m[matIndex];
 
   vec3 N = normalize(fragNormal);
@@ -65,10 +68,19 @@ void main()
   vec3 diffuse = computeDiffuse(mat, L, N);
   if(mat.textureId >= 0)
   {
-    int  txtOffset  = scnDesc.i[pushC.instanceId].txtOffset;
+    int  txtOffset  = scnDesc.i[instanceId].txtOffset;
     uint txtId      = txtOffset + mat.textureId;
     vec3 diffuseTxt = texture(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).xyz;
     diffuse *= diffuseTxt;
+
+    // One pixel out of 64 reports the extent of level 0 it would need, the streamer
+    // loads the matching levels. The unclamped LOD (.x) is not limited to the resident levels,
+    // it is queried outside of the per-pixel branch where the derivatives are defined.
+    ivec2 size   = textureSize(textureSamplers[nonuniformEXT(txtId)], 0);
+    float lod    = textureQueryLod(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).x;
+    float needed = float(max(size.x, size.y)) * exp2(-lod);
+    if(all(equal(uvec2(gl_FragCoord.xy) & 7u, uvec2(0))))
+      atomicMax(feedback.needed[pushC.feedbackOffset + txtId], uint(clamp(needed, 1.0, 65535.0)));
   }
 
   // Specular
@@ -10,9 +10,8 @@ layout(push_constant) uniform shaderInformation
 }
 pushc;
 
+// The image was tonemapped by tonemap.comp
 void main()
 {
-  vec2  uv    = outUV;
-  float gamma = 1. / 2.2;
-  fragColor   = pow(texture(noisyTxt, uv).rgba, vec4(gamma));
+  fragColor = texture(noisyTxt, outUV);
 }
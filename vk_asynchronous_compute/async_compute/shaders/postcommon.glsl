@@ -0,0 +1,65 @@
+// Images and settings of the post-processing passes on the compute queue, see
+// HelloVulkan::postProcess(). A pass reads the offscreen image or one of the ping-pong images
+// and writes another one. Only the top-left RENDER_SIZE part of the images was rendered, the
+// tonemapper upscales it to the output image.
+
+// Must match HelloVulkan::PostSource
+#define POST_COLOR 0
+#define POST_PING 1
+#define POST_PONG 2
+#define POST_BLOOM 3
+
+// Must match HelloVulkan::PostPushConstant
+layout(push_constant) uniform _PushConstant
+{
+  int   source;
+  int   destination;
+  int   stepSize;  // a-trous: distance between the taps, bloom: pass
+  int   samples;   // accumulated in the offscreen image
+  float sigmaLuminance;
+  float sigmaNormal;
+  float sigmaDepth;
+  float exposure;
+  float bloomThreshold;
+  float bloomIntensity;
+  int   tonemapper;
+  int   renderWidth;
+  int   renderHeight;
+}
+pushC;
+
+#define RENDER_SIZE ivec2(pushC.renderWidth, pushC.renderHeight)
+
+// clang-format off
+layout(binding = 0, rgba32f) uniform readonly image2D colorImage;
+layout(binding = 1, rgba32f) uniform readonly image2D gBuffer;  // normal, distance, 0 on a miss
+layout(binding = 2, rgba32f) uniform image2D ping;
+layout(binding = 3, rgba32f) uniform image2D pong;
+layout(binding = 4, rgba16f) uniform image2D bloom0;  // half resolution
+layout(binding = 5, rgba16f) uniform image2D bloom1;
+layout(binding = 6, rgba8) uniform writeonly image2D outputImage;
+// clang-format on
+
+float luminance(vec3 color)
+{
+  return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec4 loadSource(int source, ivec2 pixel)
+{
+  if(source == POST_PING)
+    return imageLoad(ping, pixel);
+  if(source == POST_PONG)
+    return imageLoad(pong, pixel);
+  if(source == POST_BLOOM)
+    return imageLoad(bloom0, pixel);
+  return imageLoad(colorImage, pixel);
+}
+
+void storeDestination(int destination, ivec2 pixel, vec4 value)
+{
+  if(destination == POST_PING)
+    imageStore(ping, pixel, value);
+  else
+    imageStore(pong, pixel, value);
+}
@@ -17,15 +17,6 @@ layout(binding = 0) uniform UniformBufferObject
 }
 ubo;
 
-layout(push_constant) uniform shaderInformation
-{
-  vec3  lightPosition;
-  uint  instanceId;
-  float lightIntensity;
-  int   lightType;
-}
-pushC;
-
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inColor;
@@ -33,6 +24,8 @@ layout(location = 3) in vec2 inTexCoord;
 
 
 //layout(location = 0) flat out int matIndex;
+layout(location = 5) flat out uint instanceId;
+layout(location = 6) flat out uint firstTriangle;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
 layout(location = 3) out vec3 viewDir;
@@ -46,8 +39,11 @@ out gl_PerVertex
 
 void main()
 {
-  mat4 objMatrix   = scnDesc.i[pushC.instanceId].transfo;
-  mat4 objMatrixIT = scnDesc.i[pushC.instanceId].transfoIT;
+  // The firstInstance of the draw holds the instance and its level of detail, see rasterize() and cull.comp
+  instanceId       = uint(gl_InstanceIndex) & 0xffffff;
+  firstTriangle    = scnDesc.i[instanceId].lodFirstTriangle[uint(gl_InstanceIndex) >> 24];
+  mat4 objMatrix   = scnDesc.i[instanceId].transfo;
+  mat4 objMatrixIT = scnDesc.i[instanceId].transfoIT;
 
   vec3 origin = vec3(ubo.viewI * vec4(0, 0, 0, 1));
 
@@ -20,12 +20,19 @@ struct WaveFrontMaterial
   int   textureId;
 };
 
+#define MAX_LODS 4  // must match HelloVulkan::s_maxLods
+
 struct sceneDesc
 {
-  int  objId;
-  int  txtOffset;
-  mat4 transfo;
-  mat4 transfoIT;
+  int   objId;
+  int   txtOffset;
+  mat4  transfo;
+  mat4  transfoIT;
+  uint  lodFirstTriangle[MAX_LODS];  // material index of the first triangle of each level of detail
+  uvec2 vertexAddress;               // device addresses of the buffers of the object, read with
+  uvec2 indexAddress;                // GL_EXT_buffer_reference_uvec2
+  uvec2 materialAddress;
+  uvec2 materialIndexAddress;
 };
 
 
@@ -0,0 +1,149 @@
+/* Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Checks the CPU frustum culler against known planes and boxes, and the SSE
+// path of cullInstances() against the scalar isBoxVisible().
+
+#include "frustum_culler.h"
+#include "tests/check.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+bool nearlyEqual(const nvmath::vec4f& a, const nvmath::vec4f& b)
+{
+  return std::abs(a.x - b.x) < 1e-5f && std::abs(a.y - b.y) < 1e-5f && std::abs(a.z - b.z) < 1e-5f
+         && std::abs(a.w - b.w) < 1e-5f;
+}
+
+CullInstance box(const nvmath::vec3f& bboxMin, const nvmath::vec3f& bboxMax)
+{
+  CullInstance instance;
+  instance.bboxMin = bboxMin;
+  instance.bboxMax = bboxMax;
+  return instance;
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  // The clip volume of the identity: -1 <= x, y <= 1 and 0 <= z <= 1
+  nvmath::mat4f identity;
+  identity.identity();
+  Frustum clip = extractFrustum(identity);
+  CHECK(nearlyEqual(clip.planes[0], nvmath::vec4f(1.f, 0.f, 0.f, 1.f)));
+  CHECK(nearlyEqual(clip.planes[1], nvmath::vec4f(-1.f, 0.f, 0.f, 1.f)));
+  CHECK(nearlyEqual(clip.planes[2], nvmath::vec4f(0.f, 1.f, 0.f, 1.f)));
+  CHECK(nearlyEqual(clip.planes[3], nvmath::vec4f(0.f, -1.f, 0.f, 1.f)));
+  CHECK(nearlyEqual(clip.planes[4], nvmath::vec4f(0.f, 0.f, 1.f, 0.f)));
+  CHECK(nearlyEqual(clip.planes[5], nvmath::vec4f(0.f, 0.f, -1.f, 1.f)));
+
+  // Known boxes against it, in the order of `expected`
+  const CullInstance boxes[] = {
+      box({-0.5f, -0.5f, 0.2f}, {0.5f, 0.5f, 0.8f}),    // inside
+      box({1.5f, -0.5f, 0.2f}, {2.0f, 0.5f, 0.8f}),     // right of it
+      box({0.5f, 0.5f, 0.5f}, {1.5f, 1.5f, 1.5f}),      // across a corner
+      box({-0.5f, -0.5f, -1.0f}, {0.5f, 0.5f, -0.1f}),  // behind the near plane
+      box({1.0f, -0.5f, 0.2f}, {2.0f, 0.5f, 0.8f}),     // touching the right plane
+      box({-0.5f, -3.0f, 1.5f}, {0.5f, -2.0f, 2.0f}),   // below and past the far plane
+      box({-5.0f, -5.0f, -5.0f}, {5.0f, 5.0f, 5.0f}),   // around it
+  };
+  const bool expected[] = {true, false, true, false, true, false, true};
+  const uint32_t count  = uint32_t(sizeof(boxes) / sizeof(boxes[0]));
+
+  std::vector<uint32_t> visible(count);
+  uint32_t              numVisible = cullInstances(clip, boxes, count, visible.data());
+  uint32_t              v          = 0;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    CHECK(isBoxVisible(clip, boxes[i]) == expected[i]);
+    if(expected[i])
+    {
+      CHECK(v < numVisible && visible[v] == i);
+      v++;
+    }
+  }
+  CHECK(v == numVisible);
+
+  // World box of a rotated, scaled and translated local box
+  nvmath::mat4f transform = nvmath::translation_mat4(nvmath::vec3f(10.f, 0.f, 0.f))
+                            * nvmath::rotation_mat4_z(nv_pi * 0.5f) * nvmath::scale_mat4(nvmath::vec3f(2.f));
+  CullInstance instance = makeCullInstance({0.f, 0.f, 0.f}, {1.f, 2.f, 3.f}, transform, 7);
+  CHECK(instance.objIndex == 7);
+  CHECK(std::abs(instance.scale - 2.f) < 1e-5f);
+  CHECK(nearlyEqual(nvmath::vec4f(instance.bboxMin, 0.f), nvmath::vec4f(6.f, 0.f, 0.f, 0.f)));
+  CHECK(nearlyEqual(nvmath::vec4f(instance.bboxMax, 0.f), nvmath::vec4f(10.f, 2.f, 6.f, 0.f)));
+
+  // A camera at the origin looking down -z, and a grid of boxes around it: both paths agree
+  nvmath::mat4f view = nvmath::look_at(nvmath::vec3f(0.f), nvmath::vec3f(0.f, 0.f, -1.f), nvmath::vec3f(0.f, 1.f, 0.f));
+  nvmath::mat4f proj = nvmath::perspectiveVK(60.f, 1.5f, 0.1f, 100.f);
+  Frustum       frustum = extractFrustum(proj * view);
+  CHECK(isBoxVisible(frustum, box({-1.f, -1.f, -11.f}, {1.f, 1.f, -9.f})));
+  CHECK(!isBoxVisible(frustum, box({-1.f, -1.f, 9.f}, {1.f, 1.f, 11.f})));
+  CHECK(!isBoxVisible(frustum, box({-1.f, -1.f, -111.f}, {1.f, 1.f, -109.f})));
+  CHECK(!isBoxVisible(frustum, box({29.f, -1.f, -11.f}, {31.f, 1.f, -9.f})));
+
+  std::vector<CullInstance> grid;
+  for(int z = -20; z <= 20; z++)
+    for(int y = -20; y <= 20; y++)
+      for(int x = -20; x <= 20; x++)
+      {
+        nvmath::vec3f center(float(x) * 2.5f, float(y) * 2.5f, float(z) * 2.5f);
+        grid.push_back(box(center - nvmath::vec3f(0.75f), center + nvmath::vec3f(0.75f)));
+      }
+  visible.resize(grid.size());
+  numVisible = cullInstances(frustum, grid.data(), uint32_t(grid.size()), visible.data());
+  CHECK(numVisible > 0 && numVisible < grid.size());
+  v = 0;
+  for(uint32_t i = 0; i < uint32_t(grid.size()); i++)
+  {
+    if(isBoxVisible(frustum, grid[i]))
+    {
+      CHECK(v < numVisible && visible[v] == i);
+      v++;
+    }
+  }
+  CHECK(v == numVisible);
+
+  // Levels of detail: errors of 0, 0.01 and 0.1 units, one unit covers 1000 pixels at a
+  // distance of one, one pixel of error is allowed
+  const float   lodErrors[] = {0.f, 0.01f, 0.1f};
+  CullInstance  unitBox     = box({-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f});
+  nvmath::mat4f far         = nvmath::translation_mat4(nvmath::vec3f(0.f, 0.f, -50.f));
+  nvmath::mat4f middle      = nvmath::translation_mat4(nvmath::vec3f(0.f, 0.f, -20.f));
+  CHECK(selectLod(unitBox, lodErrors, 3, identity, 1000.f) == 0);  // inside the box
+  CHECK(selectLod(unitBox, lodErrors, 3, middle, 1000.f) == 1);
+  CHECK(selectLod(unitBox, lodErrors, 3, far, 1000.f) == 1);
+  CHECK(selectLod(unitBox, lodErrors, 3, far, 100.f) == 2);
+  CHECK(selectLod(unitBox, lodErrors, 3, far, 0.f) == 0);
+
+  printf("test_frustum_culler: passed\n");
+  return EXIT_SUCCESS;
+}
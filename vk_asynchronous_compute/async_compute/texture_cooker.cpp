@@ -0,0 +1,204 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <filesystem>
+
+#include "fileformats/nv_dds.h"
+#include "texture_cooker.h"
+
+namespace fs = std::filesystem;
+
+void cookTexture(const nvh::MipmapGenerator& mipmaps,
+                 const uint8_t*              rgba,
+                 uint32_t                    width,
+                 uint32_t                    height,
+                 nvh::bc::Format             format,
+                 CookedTexture&              cooked)
+{
+  cooked.format = format;
+  cooked.width  = width;
+  cooked.height = height;
+
+  std::vector<std::vector<uint8_t>> levels;
+  mipmaps.generate(rgba, width, height, levels);
+  cooked.levels.resize(levels.size());
+  for(uint32_t level = 0; level < levels.size(); level++)
+  {
+    uint32_t w = std::max(width >> level, 1u);
+    uint32_t h = std::max(height >> level, 1u);
+    cooked.levels[level].resize(nvh::bc::getImageSize(format, w, h));
+    nvh::bc::encodeImage(format, levels[level].data(), w, h, cooked.levels[level].data());
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+static unsigned int toDdsFormat(nvh::bc::Format format)
+{
+  switch(format)
+  {
+    case nvh::bc::eBC1:
+      return COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case nvh::bc::eBC3:
+      return COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case nvh::bc::eBC4:
+      return COMPRESSED_RED_RGTC1;
+    case nvh::bc::eBC5:
+      return COMPRESSED_RG_RGTC2;
+    case nvh::bc::eBC7:
+    default:
+      return COMPRESSED_RGBA_BPTC_UNORM;
+  }
+}
+
+bool saveCookedTexture(const std::string& filename, const CookedTexture& cooked, bool srgb)
+{
+  if(cooked.levels.empty())
+    return false;
+
+  nv_dds::CTexture texture(cooked.width, cooked.height, 1, static_cast<unsigned int>(cooked.levels[0].size()),
+                           cooked.levels[0].data());
+  for(size_t level = 1; level < cooked.levels.size(); level++)
+  {
+    uint32_t w = std::max(cooked.width >> level, 1u);
+    uint32_t h = std::max(cooked.height >> level, 1u);
+    texture.add_mipmap(nv_dds::CSurface(w, h, 1, static_cast<unsigned int>(cooked.levels[level].size()),
+                                        cooked.levels[level].data()));
+  }
+
+  static const unsigned int components[] = {3, 4, 1, 2, 4};
+  nv_dds::CDDSImage         dds;
+  dds.create_textureFlat(toDdsFormat(cooked.format), components[cooked.format], texture);
+  if(srgb && cooked.format == nvh::bc::eBC1)
+    dds.set_dxgi_format(nv_dds::DXGI_FORMAT_BC1_UNORM_SRGB);
+  else if(srgb && cooked.format == nvh::bc::eBC3)
+    dds.set_dxgi_format(nv_dds::DXGI_FORMAT_BC3_UNORM_SRGB);
+  else if(srgb && cooked.format == nvh::bc::eBC7)
+    dds.set_dxgi_format(nv_dds::DXGI_FORMAT_BC7_UNORM_SRGB);
+
+  // the levels are stored top-down, as they are uploaded
+  return dds.save(filename, false);
+}
+
+bool loadCookedTexture(const std::string& filename, CookedTexture& cooked)
+{
+  nv_dds::CDDSImage dds;
+  if(!dds.load(filename, false, false) || dds.get_type() != nv_dds::TextureFlat || dds.get_depth() != 1)
+    return false;
+
+  switch(dds.get_format())
+  {
+    case COMPRESSED_RGBA_S3TC_DXT1_EXT:
+      cooked.format = nvh::bc::eBC1;
+      break;
+    case COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      cooked.format = nvh::bc::eBC3;
+      break;
+    case COMPRESSED_RED_RGTC1:
+      cooked.format = nvh::bc::eBC4;
+      break;
+    case COMPRESSED_RG_RGTC2:
+      cooked.format = nvh::bc::eBC5;
+      break;
+    case COMPRESSED_RGBA_BPTC_UNORM:
+      cooked.format = nvh::bc::eBC7;
+      break;
+    default:
+      return false;
+  }
+
+  cooked.width  = dds.get_width();
+  cooked.height = dds.get_height();
+  cooked.levels.clear();
+  const uint8_t* base = dds;
+  cooked.levels.emplace_back(base, base + dds.get_size());
+  for(uint32_t mip = 0; mip < dds.get_num_mipmaps(); mip++)
+  {
+    const nv_dds::CSurface& surface = dds.get_mipmap(mip);
+    const uint8_t*          data    = surface;
+    cooked.levels.emplace_back(data, data + surface.get_size());
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+std::string getCookedTextureName(const std::string&                    cacheDirectory,
+                                 const std::string&                    file,
+                                 nvh::bc::Format                       format,
+                                 const nvh::MipmapGenerator::Settings& mipSettings)
+{
+  static const char* suffixes[] = {"bc1", "bc3", "bc4", "bc5", "bc7"};
+
+  // flatten the relative path so that files with the same name in different folders do not collide
+  std::string name = file;
+  for(auto& c : name)
+  {
+    if(c == '/' || c == '\\' || c == ':')
+      c = '_';
+  }
+
+  // the mips depend on the space they are filtered in and on the filter
+  char mips[64];
+  if(mipSettings.filter == nvh::MipmapGenerator::eFilterKaiser)
+    snprintf(mips, sizeof(mips), "kaiser%gx%g", mipSettings.kaiserWidth, mipSettings.kaiserAlpha);
+  else
+    snprintf(mips, sizeof(mips), "box");
+  name += std::string(".") + suffixes[format] + (mipSettings.srgb ? ".srgb." : ".unorm.") + mips + ".dds";
+  return (fs::path(cacheDirectory) / name).string();
+}
+
+bool isCookedTextureUpToDate(const std::string& cached, const std::string& source)
+{
+  std::error_code ec;
+  auto            cachedTime = fs::last_write_time(cached, ec);
+  if(ec)
+    return false;
+  auto sourceTime = fs::last_write_time(source, ec);
+  return !ec && cachedTime >= sourceTime;
+}
+
+vk::Format getCookedTextureFormat(nvh::bc::Format format, bool srgb)
+{
+  switch(format)
+  {
+    case nvh::bc::eBC1:
+      return srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+    case nvh::bc::eBC3:
+      return srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+    case nvh::bc::eBC4:
+      return vk::Format::eBc4UnormBlock;
+    case nvh::bc::eBC5:
+      return vk::Format::eBc5UnormBlock;
+    case nvh::bc::eBC7:
+    default:
+      return srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+  }
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "nvh/bcencoder.hpp"
+#include "nvh/mipmapgenerator.hpp"
+
+//--------------------------------------------------------------------------------------------------
+// Texture cooking: the full mip chain is computed on the CPU, each level is block compressed
+// and the result is stored as a DDS file in a cache directory. Loading a cooked texture is a
+// plain copy of all levels, no conversion nor mipmap generation is needed on the device.
+//
+struct CookedTexture
+{
+  nvh::bc::Format                   format{nvh::bc::eBC7};
+  uint32_t                          width{0};
+  uint32_t                          height{0};
+  std::vector<std::vector<uint8_t>> levels;  // block compressed, level 0 first
+};
+
+// Computes the mip chain of `rgba` (tightly packed RGBA8) down to 1x1 and encodes every level
+void cookTexture(const nvh::MipmapGenerator& mipmaps,
+                 const uint8_t*              rgba,
+                 uint32_t                    width,
+                 uint32_t                    height,
+                 nvh::bc::Format             format,
+                 CookedTexture&              cooked);
+
+// `srgb` is only recorded in the DDS header, the encoded data does not depend on it
+bool saveCookedTexture(const std::string& filename, const CookedTexture& cooked, bool srgb);
+bool loadCookedTexture(const std::string& filename, CookedTexture& cooked);
+
+// Name of the cached file for `file` (as passed to the loader, before the path search), the
+// color space and the filter of the mips are part of it
+std::string getCookedTextureName(const std::string&                    cacheDirectory,
+                                 const std::string&                    file,
+                                 nvh::bc::Format                       format,
+                                 const nvh::MipmapGenerator::Settings& mipSettings);
+// True if `cached` exists and is not older than `source`
+bool isCookedTextureUpToDate(const std::string& cached, const std::string& source);
+
+vk::Format getCookedTextureFormat(nvh::bc::Format format, bool srgb);
+// Size of the `level` mip of a `width` x `height` image
+inline size_t getCookedLevelSize(nvh::bc::Format format, uint32_t width, uint32_t height, uint32_t level)
+{
+  return nvh::bc::getImageSize(format, std::max(width >> level, 1u), std::max(height >> level, 1u));
+}
@@ -0,0 +1,411 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+
+#include "fileformats/stb_image.h"
+#include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvvk/commands_vk.hpp"
+#include "nvvk/images_vk.hpp"
+#include "texture_loader.h"
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void TextureLoader::init(nvvk::Allocator*                alloc,
+                         vk::Device                      device,
+                         vk::Queue                       queue,
+                         uint32_t                        queueFamily,
+                         const std::vector<std::string>& searchPaths)
+{
+  m_alloc       = alloc;
+  m_device      = device;
+  m_queue       = queue;
+  m_queueFamily = queueFamily;
+  m_searchPaths = searchPaths;
+  m_pool.init();
+  m_mipPool.init();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Decodes the image to RGBA8 into `dst`, which holds width * height texels. The image is magenta
+// if the file cannot be read or if it changed size since its header was read.
+// Returns false if the image could not be decoded.
+//
+static bool decodeImage(const std::string& path, bool valid, int width, int height, uint8_t* dst)
+{
+  int      w = 0, h = 0, c = 0;
+  stbi_uc* pixels  = valid ? stbi_load(path.c_str(), &w, &h, &c, STBI_rgb_alpha) : nullptr;
+  bool     decoded = pixels && w == width && h == height;
+  size_t   size    = static_cast<size_t>(width) * height * 4;
+  if(decoded)
+  {
+    memcpy(dst, pixels, size);
+  }
+  else
+  {
+    const uint8_t magenta[4] = {255u, 0u, 255u, 255u};
+    for(size_t p = 0; p < size; p += 4)
+      memcpy(dst + p, magenta, 4);
+  }
+  stbi_image_free(pixels);
+  return decoded;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Block compressed format matching the requested one, returns false if the textures are not cooked
+//
+bool TextureLoader::getCookFormat(vk::Format format, nvh::bc::Format& cookFormat, bool& srgb) const
+{
+  srgb       = format == vk::Format::eR8G8B8A8Srgb;
+  cookFormat = m_cookSettings.colorFormat;
+  switch(format)
+  {
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eR8G8B8A8Unorm:
+      break;
+    case vk::Format::eR8G8Unorm:
+      cookFormat = nvh::bc::eBC5;
+      break;
+    case vk::Format::eR8Unorm:
+      cookFormat = nvh::bc::eBC4;
+      break;
+    default:
+      return false;
+  }
+  return m_cookSettings.enabled;
+}
+
+vk::DeviceSize TextureLoader::getLevelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t level)
+{
+  vk::DeviceSize w = std::max(width >> level, 1u);
+  vk::DeviceSize h = std::max(height >> level, 1u);
+  switch(format)
+  {
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc4UnormBlock:
+      return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+    case vk::Format::eBc7UnormBlock:
+      return ((w + 3) / 4) * ((h + 3) / 4) * 16;
+    default:
+      return w * h * 4;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// All levels of one texture, from the cache or decoded and cooked. Can be called from any thread
+// but the tasks of the loader.
+//
+bool TextureLoader::readLevels(const std::string& file, vk::Format format, TextureLevels& levels) const
+{
+  bool            srgb;
+  nvh::bc::Format cookFormat;
+  bool            cook = getCookFormat(format, cookFormat, srgb);
+  std::string     path = nvh::findFile(file, m_searchPaths, true);
+  if(path.empty())
+    return false;
+
+  // Mip chains are filtered in linear space for sRGB
+  nvh::MipmapGenerator::Settings mipSettings = m_mipSettings;
+  mipSettings.srgb                           = srgb;
+
+  CookedTexture cooked;
+  std::string   cachePath;
+  if(cook && !m_cookSettings.cacheDirectory.empty())
+  {
+    cachePath = getCookedTextureName(m_cookSettings.cacheDirectory, file, cookFormat, mipSettings);
+    if(isCookedTextureUpToDate(cachePath, path) && loadCookedTexture(cachePath, cooked) && cooked.format == cookFormat)
+    {
+      levels.format = getCookedTextureFormat(cookFormat, srgb);
+      levels.width  = cooked.width;
+      levels.height = cooked.height;
+      levels.levels = std::move(cooked.levels);
+      return true;
+    }
+  }
+
+  int w = 0, h = 0, c = 0;
+  if(!stbi_info(path.c_str(), &w, &h, &c))
+    return false;
+  std::vector<uint8_t> rgba(static_cast<size_t>(w) * h * 4);
+  if(!decodeImage(path, true, w, h, rgba.data()))
+    return false;
+
+  nvh::MipmapGenerator mipmaps(mipSettings, &m_mipPool);
+  levels.width  = static_cast<uint32_t>(w);
+  levels.height = static_cast<uint32_t>(h);
+  if(!cook)
+  {
+    levels.format = format;
+    mipmaps.generate(rgba.data(), levels.width, levels.height, levels.levels);
+    return true;
+  }
+  cookTexture(mipmaps, rgba.data(), levels.width, levels.height, cookFormat, cooked);
+  if(!cachePath.empty() && !saveCookedTexture(cachePath, cooked, srgb))
+  {
+    LOGW("Could not write the cooked texture %s\n", cachePath.c_str());
+  }
+  levels.format = getCookedTextureFormat(cookFormat, srgb);
+  levels.levels = std::move(cooked.levels);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Loading all `files`, returns when all textures are on the device. The staging space is
+// released by the next finalizeAndReleaseStaging of the allocator.
+//
+void TextureLoader::load(const std::vector<std::string>& files,
+                         const vk::SamplerCreateInfo&    samplerCreateInfo,
+                         vk::Format                      format,
+                         const ReadyFn&                  onReady,
+                         uint32_t                        maxExtent)
+{
+  using vkIU = vk::ImageUsageFlagBits;
+
+  bool            srgb;
+  nvh::bc::Format cookFormat;
+  bool            cook     = getCookFormat(format, cookFormat, srgb);
+  bool            useCache = cook && !m_cookSettings.cacheDirectory.empty();
+  if(useCache)
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(m_cookSettings.cacheDirectory, ec);
+    useCache = !ec;
+  }
+
+  // Mip chains are computed on the CPU, filtered in linear space for sRGB
+  nvh::MipmapGenerator::Settings mipSettings = m_mipSettings;
+  mipSettings.srgb                           = srgb;
+
+  struct Item
+  {
+    std::string           path;
+    int                   width{0};
+    int                   height{0};
+    nvvk::Image           image;
+    vk::ImageCreateInfo   imageCreateInfo;
+    vk::CommandBuffer     cmdBuf;
+    std::future<void>     decoded;
+    int32_t               submission{-1};
+    uint32_t              numLevels{1};   // of the full resolution image
+    uint32_t              firstLevel{0};  // first uploaded level
+    std::string           cachePath;
+    bool                  cached{false};  // cooked texture read from the cache
+    CookedTexture         cooked;
+    std::vector<uint8_t*> levelStaging;   // one staging space per mip level
+  };
+  std::vector<Item> items(files.size());
+
+  // Headers only, to know the size of each image before decoding it. Up to date cooked
+  // textures are read completely.
+  m_pool.parallelFor(items.size(), [&](uint64_t i) {
+    Item& item = items[i];
+    item.path  = nvh::findFile(files[i], m_searchPaths, true);
+    if(item.path.empty())
+      return;
+    if(useCache)
+    {
+      item.cachePath = getCookedTextureName(m_cookSettings.cacheDirectory, files[i], cookFormat, mipSettings);
+      if(isCookedTextureUpToDate(item.cachePath, item.path) && loadCookedTexture(item.cachePath, item.cooked)
+         && item.cooked.format == cookFormat)
+      {
+        item.cached = true;
+        item.width  = static_cast<int>(item.cooked.width);
+        item.height = static_cast<int>(item.cooked.height);
+        return;
+      }
+    }
+    int channels;
+    if(!stbi_info(item.path.c_str(), &item.width, &item.height, &channels))
+    {
+      item.width = item.height = 0;
+    }
+  });
+
+  nvh::MipmapGenerator mipmaps(mipSettings, &m_mipPool);
+
+  // Images, staging space and upload commands are created on this thread, the staging
+  // manager and the command pool are not thread-safe
+  nvvk::CommandPool cmdPool(m_device, m_queueFamily, vk::CommandPoolCreateFlagBits::eTransient, m_queue);
+  uint32_t          numCached = 0;
+  for(auto& item : items)
+  {
+    bool         valid   = item.width > 0 && item.height > 0;
+    vk::Extent2D imgSize = valid ? vk::Extent2D(item.width, item.height) : vk::Extent2D(1, 1);
+
+    // Levels larger than maxExtent are skipped, they can be streamed later
+    item.numLevels  = item.cached ? static_cast<uint32_t>(item.cooked.levels.size()) : nvvk::mipLevels(imgSize);
+    item.firstLevel = 0;
+    while(maxExtent > 0 && item.firstLevel + 1 < item.numLevels
+          && std::max(imgSize.width, imgSize.height) >> item.firstLevel > maxExtent)
+    {
+      item.firstLevel++;
+    }
+    vk::Extent2D baseSize{std::max(imgSize.width >> item.firstLevel, 1u), std::max(imgSize.height >> item.firstLevel, 1u)};
+
+    vk::Format imageFormat         = cook ? getCookedTextureFormat(cookFormat, srgb) : format;
+    item.imageCreateInfo           = nvvk::makeImage2DCreateInfo(baseSize, imageFormat, vkIU::eSampled);
+    item.imageCreateInfo.mipLevels = item.numLevels - item.firstLevel;
+    item.image  = m_alloc->createImage(item.imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    item.cmdBuf = cmdPool.createCommandBuffer(vk::CommandBufferLevel::ePrimary);
+
+    // All levels are uploaded as they are, no mipmap generation on the device
+    vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, 0, item.imageCreateInfo.mipLevels, 0, 1};
+    nvvk::cmdBarrierImageLayout(item.cmdBuf, item.image.image, vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eTransferDstOptimal, range);
+    for(uint32_t level = item.firstLevel; level < item.numLevels; level++)
+    {
+      VkExtent3D levelExtent{std::max(imgSize.width >> level, 1u), std::max(imgSize.height >> level, 1u), 1};
+      VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, level - item.firstLevel, 0, 1};
+      vk::DeviceSize           levelSize = getLevelSize(imageFormat, imgSize.width, imgSize.height, level);
+      item.levelStaging.push_back(m_alloc->getStaging()->cmdToImageT<uint8_t>(item.cmdBuf, item.image.image, {0, 0, 0},
+                                                                              levelExtent, subresource, levelSize, nullptr));
+    }
+    nvvk::cmdBarrierImageLayout(item.cmdBuf, item.image.image, vk::ImageLayout::eTransferDstOptimal,
+                                vk::ImageLayout::eShaderReadOnlyOptimal, range);
+    item.cmdBuf.end();
+    numCached += item.cached ? 1 : 0;
+
+    // Decoding, computing the mips (and cooking) straight to the staging space
+    Item*                       it = &item;
+    const nvh::MipmapGenerator* mg = &mipmaps;
+    item.decoded = m_pool.enqueue([it, mg, valid, imgSize, cook, cookFormat, srgb] {
+      if(!it->cached)
+      {
+        std::vector<uint8_t> rgba(static_cast<size_t>(imgSize.width) * imgSize.height * 4);
+        bool decoded = decodeImage(it->path, valid, imgSize.width, imgSize.height, rgba.data());
+        if(!cook)
+        {
+          std::vector<std::vector<uint8_t>> levels;
+          mg->generate(rgba.data(), imgSize.width, imgSize.height, levels);
+          for(size_t i = 0; i < it->levelStaging.size(); i++)
+          {
+            memcpy(it->levelStaging[i], levels[it->firstLevel + i].data(), levels[it->firstLevel + i].size());
+          }
+          return;
+        }
+        cookTexture(*mg, rgba.data(), imgSize.width, imgSize.height, cookFormat, it->cooked);
+        if(decoded && !it->cachePath.empty() && !saveCookedTexture(it->cachePath, it->cooked, srgb))
+        {
+          LOGW("Could not write the cooked texture %s\n", it->cachePath.c_str());
+        }
+      }
+      for(size_t i = 0; i < it->levelStaging.size(); i++)
+      {
+        const auto& level = it->cooked.levels[it->firstLevel + i];
+        memcpy(it->levelStaging[i], level.data(), level.size());
+      }
+      it->cooked = CookedTexture();
+    });
+  }
+  if(cook)
+  {
+    LOGI("Textures: %zu block compressed, %u from the cache\n", items.size(), numCached);
+  }
+
+  // Submitting the uploads as the decodes complete
+  std::vector<vk::Fence> fences;
+  size_t                 numSubmitted = 0;
+  size_t                 numReady     = 0;
+  auto                   handBack     = [&](bool wait) {
+    for(size_t i = 0; i < items.size(); i++)
+    {
+      Item& item = items[i];
+      if(item.submission < 0 || !fences[item.submission])
+        continue;
+      vk::Fence fence = fences[item.submission];
+      if(!wait && m_device.getFenceStatus(fence) != vk::Result::eSuccess)
+        continue;
+      if(wait)
+        m_device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+
+      // all the items of this submission are done
+      for(auto& done : items)
+      {
+        if(done.submission != item.submission)
+          continue;
+        vk::ImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(done.image.image, done.imageCreateInfo);
+        TextureInfo             info;
+        info.format     = done.imageCreateInfo.format;
+        info.width      = static_cast<uint32_t>(std::max(done.width, 1));
+        info.height     = static_cast<uint32_t>(std::max(done.height, 1));
+        info.numLevels  = done.numLevels;
+        info.firstLevel = done.firstLevel;
+        onReady(static_cast<uint32_t>(&done - items.data()), m_alloc->createTexture(done.image, ivInfo, samplerCreateInfo), info);
+        numReady++;
+      }
+      m_device.destroy(fence);
+      fences[item.submission] = vk::Fence();
+    }
+  };
+
+  while(numSubmitted < items.size())
+  {
+    std::vector<vk::CommandBuffer> batch;
+    for(auto& item : items)
+    {
+      if(item.submission < 0 && item.decoded.wait_for(std::chrono::milliseconds(batch.empty() ? 1 : 0)) == std::future_status::ready)
+      {
+        item.submission = static_cast<int32_t>(fences.size());
+        batch.push_back(item.cmdBuf);
+      }
+    }
+    if(!batch.empty())
+    {
+      vk::SubmitInfo submitInfo;
+      submitInfo.setCommandBufferCount(static_cast<uint32_t>(batch.size()));
+      submitInfo.setPCommandBuffers(batch.data());
+      vk::Fence fence = m_device.createFence({});
+      m_queue.submit(submitInfo, fence);
+      fences.push_back(fence);
+      numSubmitted += batch.size();
+    }
+    handBack(false);
+  }
+  handBack(true);
+  assert(numReady == items.size());
+
+  std::vector<vk::CommandBuffer> cmdBufs;
+  for(auto& item : items)
+  {
+    cmdBufs.push_back(item.cmdBuf);
+  }
+  if(!cmdBufs.empty())
+  {
+    cmdPool.destroy(cmdBufs);
+  }
+}
@@ -0,0 +1,122 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "nvh/mipmapgenerator.hpp"
+#include "nvh/threadpool.hpp"
+#include "nvvk/allocator_vk.hpp"
+#include "texture_cooker.h"
+
+//--------------------------------------------------------------------------------------------------
+// Loads the textures of a scene in parallel
+// - the image headers are read first to size the images and reserve their staging space
+// - each image is decoded on a worker thread and copied into its mapped staging space
+// - the mip chain of each image is computed on the CPU (nvh::MipmapGenerator)
+// - as soon as some images are decoded, their upload is submitted, while the other images
+//   are still being decoded
+// - `onReady` is called on the calling thread for each texture once it is on the device
+//
+// With cooking enabled, the textures are uploaded block compressed with their precomputed
+// mip chain: a cooked texture from the cache is used if it is up to date, otherwise the
+// image is decoded, cooked on the worker thread and saved to the cache for the next run.
+//
+// With `maxExtent`, only the levels not larger than it are uploaded (the mip tail), the
+// other levels can be read later with readLevels(), see TextureStreamer.
+//
+class TextureLoader
+{
+public:
+  // Levels of a loaded texture, the image holds levels [firstLevel, numLevels) of the full texture
+  struct TextureInfo
+  {
+    vk::Format format{vk::Format::eUndefined};
+    uint32_t   width{1};   // of level 0
+    uint32_t   height{1};  // of level 0
+    uint32_t   numLevels{1};
+    uint32_t   firstLevel{0};
+  };
+
+  // All levels of a texture, as uploaded
+  struct TextureLevels
+  {
+    vk::Format                        format{vk::Format::eUndefined};
+    uint32_t                          width{0};
+    uint32_t                          height{0};
+    std::vector<std::vector<uint8_t>> levels;
+  };
+
+  using ReadyFn = std::function<void(uint32_t index, const nvvk::Texture& texture, const TextureInfo& info)>;
+
+  struct CookSettings
+  {
+    bool            enabled{false};               // requires the textureCompressionBC feature
+    nvh::bc::Format colorFormat{nvh::bc::eBC7};   // for RGBA8 textures, RG8 uses BC5 and R8 uses BC4
+    std::string     cacheDirectory;               // cooked textures are not cached if empty
+  };
+
+  void init(nvvk::Allocator* alloc, vk::Device device, vk::Queue queue, uint32_t queueFamily, const std::vector<std::string>& searchPaths);
+  void deinit()
+  {
+    m_pool.deinit();
+    m_mipPool.deinit();
+  }
+
+  void setCookSettings(const CookSettings& settings) { m_cookSettings = settings; }
+  // `srgb` is ignored, it is derived from the format passed to load()
+  void setMipSettings(const nvh::MipmapGenerator::Settings& settings) { m_mipSettings = settings; }
+
+  void load(const std::vector<std::string>& files,
+            const vk::SamplerCreateInfo&    samplerCreateInfo,
+            vk::Format                      format,
+            const ReadyFn&                  onReady,
+            uint32_t                        maxExtent = 0);
+
+  // Reads or recomputes all levels of `file`, as load() would upload them. Thread safe, but must
+  // not be called from a task of the loader.
+  bool readLevels(const std::string& file, vk::Format format, TextureLevels& levels) const;
+
+  // Bytes of `level` of a texture of `format` stored as by load()
+  static vk::DeviceSize getLevelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t level);
+
+private:
+  bool getCookFormat(vk::Format format, nvh::bc::Format& cookFormat, bool& srgb) const;
+
+  nvvk::Allocator*               m_alloc{nullptr};
+  vk::Device                     m_device;
+  vk::Queue                      m_queue;
+  uint32_t                       m_queueFamily{0};
+  std::vector<std::string>       m_searchPaths;
+  CookSettings                   m_cookSettings;
+  nvh::MipmapGenerator::Settings m_mipSettings;
+  nvh::ThreadPool                m_pool;
+  mutable nvh::ThreadPool        m_mipPool;  // tiles of the mip levels, used from within the tasks of m_pool
+};
@@ -0,0 +1,394 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "nvh/nvprint.hpp"
+#include "nvvk/images_vk.hpp"
+#include "texture_streamer.h"
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void TextureStreamer::init(nvvk::Allocator*     alloc,
+                           vk::Device           device,
+                           vk::Queue            queue,
+                           uint32_t             queueFamily,
+                           const TextureLoader* loader,
+                           const Settings&      settings)
+{
+  m_alloc    = alloc;
+  m_device   = device;
+  m_queue    = queue;
+  m_loader   = loader;
+  m_settings = settings;
+  m_cmdPool.init(device, queueFamily, vk::CommandPoolCreateFlagBits::eTransient, queue);
+  m_pool.init(std::max(settings.maxPendingReads, 1u));
+}
+
+void TextureStreamer::deinit()
+{
+  m_pool.deinit();
+  for(auto& job : m_jobs)
+  {
+    if(job->fence)
+    {
+      m_device.waitForFences(job->fence, VK_TRUE, UINT64_MAX);
+      m_device.destroy(job->fence);
+      m_cmdPool.destroy(job->cmdBuf);
+      m_alloc->destroy(job->texture);
+    }
+  }
+  m_jobs.clear();
+  m_alloc->releaseStaging();
+  m_cmdPool.deinit();
+  if(m_feedbackData)
+  {
+    m_alloc->unmap(m_feedback);
+    m_feedbackData = nullptr;
+  }
+  m_alloc->destroy(m_feedback);
+  m_slots.clear();
+  m_residentBytes = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void TextureStreamer::addTexture(uint32_t                          slot,
+                                 const std::string&                file,
+                                 vk::Format                        format,
+                                 const TextureLoader::TextureInfo& info,
+                                 const vk::SamplerCreateInfo&      samplerCreateInfo)
+{
+  if(slot >= m_slots.size())
+  {
+    m_slots.resize(slot + 1);
+  }
+  Slot& s         = m_slots[slot];
+  s.file          = file;
+  s.sampler       = samplerCreateInfo;
+  s.loadFormat    = format;
+  s.format        = info.format;
+  s.width         = info.width;
+  s.height        = info.height;
+  s.numLevels     = info.numLevels;
+  s.residentLevel = info.firstLevel;
+  s.targetLevel   = info.firstLevel;
+  s.tailLevel     = getLevel(s, m_settings.tailExtent);
+  s.wantedLevel   = s.tailLevel;
+  m_residentBytes += getBytes(s, s.residentLevel);
+}
+
+void TextureStreamer::createFeedbackBuffer(uint32_t numFrames, uint32_t numSlots)
+{
+  using vkBU = vk::BufferUsageFlagBits;
+  using vkMP = vk::MemoryPropertyFlagBits;
+
+  m_feedbackSlots     = numSlots;
+  vk::DeviceSize size = std::max<vk::DeviceSize>(vk::DeviceSize(numFrames) * numSlots, 1) * sizeof(uint32_t);
+  m_feedback          = m_alloc->createBuffer(size, vkBU::eStorageBuffer, vkMP::eHostVisible | vkMP::eHostCoherent);
+  m_feedbackData      = static_cast<uint32_t*>(m_alloc->map(m_feedback));
+  memset(m_feedbackData, 0, size);
+}
+
+void TextureStreamer::request(uint32_t slot, uint32_t extent)
+{
+  if(slot < m_slots.size())
+  {
+    m_slots[slot].requested = std::max(m_slots[slot].requested, extent);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Bytes of the levels [firstLevel, numLevels)
+//
+vk::DeviceSize TextureStreamer::getBytes(const Slot& slot, uint32_t firstLevel) const
+{
+  vk::DeviceSize bytes = 0;
+  for(uint32_t level = firstLevel; level < slot.numLevels; level++)
+  {
+    bytes += TextureLoader::getLevelSize(slot.format, slot.width, slot.height, level);
+  }
+  return bytes;
+}
+
+// Coarsest level with at least `extent` texels along the largest side
+uint32_t TextureStreamer::getLevel(const Slot& slot, uint32_t extent) const
+{
+  uint32_t maxSize = std::max(slot.width, slot.height);
+  uint32_t level   = 0;
+  while(level + 1 < slot.numLevels && (maxSize >> (level + 1)) >= std::max(extent, 1u))
+  {
+    level++;
+  }
+  return level;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Reserves the memory of the new levels and reads the missing ones on a worker thread
+//
+void TextureStreamer::startJob(uint32_t index, uint32_t firstLevel)
+{
+  Slot& s = m_slots[index];
+  m_residentBytes += getBytes(s, firstLevel);
+  m_residentBytes -= getBytes(s, s.targetLevel);
+  s.targetLevel = firstLevel;
+  s.busy        = true;
+
+  m_jobs.emplace_back(new Job());
+  Job* job        = m_jobs.back().get();
+  job->slot       = index;
+  job->firstLevel = firstLevel;
+  if(firstLevel < s.residentLevel)
+  {
+    const TextureLoader* loader = m_loader;
+    std::string          file   = s.file;
+    vk::Format           format = s.loadFormat;
+    job->read = m_pool.enqueue([loader, job, file, format] { return loader->readLevels(file, format, job->levels); });
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// New image holding [firstLevel, numLevels): the resident levels are copied from `previous`,
+// the others are uploaded from the levels read by the job
+//
+void TextureStreamer::submitJob(Job& job, const nvvk::Texture& previous)
+{
+  using vkIU = vk::ImageUsageFlagBits;
+
+  const Slot&  s     = m_slots[job.slot];
+  uint32_t     first = job.firstLevel;
+  vk::Extent2D size{std::max(s.width >> first, 1u), std::max(s.height >> first, 1u)};
+
+  vk::ImageCreateInfo imageCreateInfo = nvvk::makeImage2DCreateInfo(size, s.format, vkIU::eSampled);
+  imageCreateInfo.mipLevels           = s.numLevels - first;
+  nvvk::Image image = m_alloc->createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+  job.cmdBuf        = m_cmdPool.createCommandBuffer(vk::CommandBufferLevel::ePrimary);
+
+  vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, 0, imageCreateInfo.mipLevels, 0, 1};
+  nvvk::cmdBarrierImageLayout(job.cmdBuf, image.image, vk::ImageLayout::eUndefined,
+                              vk::ImageLayout::eTransferDstOptimal, range);
+
+  // Levels already on the device
+  uint32_t                  copyFirst = std::max(first, s.residentLevel);
+  vk::ImageSubresourceRange previousRange{vk::ImageAspectFlagBits::eColor, copyFirst - s.residentLevel,
+                                          s.numLevels - copyFirst, 0, 1};
+  std::vector<vk::ImageCopy> copies;
+  for(uint32_t level = copyFirst; level < s.numLevels; level++)
+  {
+    vk::Extent3D extent{std::max(s.width >> level, 1u), std::max(s.height >> level, 1u), 1};
+    copies.emplace_back(vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level - s.residentLevel, 0, 1},
+                        vk::Offset3D{}, vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level - first, 0, 1},
+                        vk::Offset3D{}, extent);
+  }
+  nvvk::cmdBarrierImageLayout(job.cmdBuf, previous.image, vk::ImageLayout::eShaderReadOnlyOptimal,
+                              vk::ImageLayout::eTransferSrcOptimal, previousRange);
+  job.cmdBuf.copyImage(previous.image, vk::ImageLayout::eTransferSrcOptimal, image.image,
+                       vk::ImageLayout::eTransferDstOptimal, copies);
+  nvvk::cmdBarrierImageLayout(job.cmdBuf, previous.image, vk::ImageLayout::eTransferSrcOptimal,
+                              vk::ImageLayout::eShaderReadOnlyOptimal, previousRange);
+
+  // Streamed levels
+  for(uint32_t level = first; level < copyFirst; level++)
+  {
+    VkExtent3D               extent{std::max(s.width >> level, 1u), std::max(s.height >> level, 1u), 1};
+    VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, level - first, 0, 1};
+    const auto&              data = job.levels.levels[level];
+    m_alloc->getStaging()->cmdToImage(job.cmdBuf, image.image, {0, 0, 0}, extent, subresource, data.size(), data.data());
+  }
+  nvvk::cmdBarrierImageLayout(job.cmdBuf, image.image, vk::ImageLayout::eTransferDstOptimal,
+                              vk::ImageLayout::eShaderReadOnlyOptimal, range);
+  job.cmdBuf.end();
+
+  job.fence = m_device.createFence({});
+  vk::SubmitInfo submitInfo;
+  submitInfo.setCommandBufferCount(1);
+  submitInfo.setPCommandBuffers(&job.cmdBuf);
+  m_queue.submit(submitInfo, job.fence);
+  m_alloc->finalizeStaging(job.fence);
+  job.levels = TextureLoader::TextureLevels();
+
+  vk::ImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
+  job.texture                    = m_alloc->createTexture(image, ivInfo, s.sampler);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called once per frame, after the fence of `frame` was waited
+//
+std::vector<uint32_t> TextureStreamer::update(uint32_t frame, std::vector<nvvk::Texture>& textures, std::vector<nvvk::Texture>& retired)
+{
+  m_frame++;
+  uint32_t numSlots = static_cast<uint32_t>(m_slots.size());
+
+  // Levels needed by the frame that just completed and by the CPU requests
+  uint32_t* needed = m_feedbackData ? m_feedbackData + getFeedbackOffset(frame) : nullptr;
+  for(uint32_t i = 0; i < numSlots; i++)
+  {
+    Slot&    s      = m_slots[i];
+    uint32_t extent = std::max(needed && i < m_feedbackSlots ? needed[i] : 0u, s.requested);
+    bool     expired = m_frame - s.wantedFrame > m_settings.evictAfterFrames;
+    s.requested      = 0;
+    if(extent > 0)
+    {
+      uint32_t level = std::min(getLevel(s, extent), s.tailLevel);
+      s.lastUsed     = m_frame;
+      if(level <= s.wantedLevel || expired)
+      {
+        s.wantedLevel = level;
+        s.wantedFrame = m_frame;
+      }
+    }
+    else if(expired)
+    {
+      s.wantedLevel = s.tailLevel;
+    }
+  }
+  if(needed)
+  {
+    memset(needed, 0, sizeof(uint32_t) * m_feedbackSlots);
+  }
+
+  // Replacing the textures of the finished jobs, the previous images may still be used by
+  // the frames in flight: they are retired, not destroyed
+  std::vector<uint32_t> changed;
+  for(auto it = m_jobs.begin(); it != m_jobs.end();)
+  {
+    Job& job = **it;
+    if(!job.fence || m_device.getFenceStatus(job.fence) != vk::Result::eSuccess)
+    {
+      ++it;
+      continue;
+    }
+    Slot& s = m_slots[job.slot];
+    retired.push_back(textures[job.slot]);
+    textures[job.slot] = job.texture;
+    s.residentLevel    = job.firstLevel;
+    s.busy             = false;
+    m_device.destroy(job.fence);
+    m_cmdPool.destroy(job.cmdBuf);
+    changed.push_back(job.slot);
+    it = m_jobs.erase(it);
+  }
+  if(!changed.empty())
+  {
+    m_alloc->releaseStaging();
+  }
+
+  // Dropping the levels no longer wanted
+  for(uint32_t i = 0; i < numSlots; i++)
+  {
+    Slot& s = m_slots[i];
+    if(!s.busy && s.wantedLevel > s.targetLevel)
+    {
+      startJob(i, s.wantedLevel);
+    }
+  }
+
+  // Streaming the most recently used textures first, evicting the least recently used ones
+  // when over budget
+  std::vector<uint32_t> upgrades;
+  for(uint32_t i = 0; i < numSlots; i++)
+  {
+    if(!m_slots[i].busy && m_slots[i].wantedLevel < m_slots[i].targetLevel)
+    {
+      upgrades.push_back(i);
+    }
+  }
+  std::sort(upgrades.begin(), upgrades.end(), [&](uint32_t a, uint32_t b) {
+    const Slot& sa = m_slots[a];
+    const Slot& sb = m_slots[b];
+    return sa.lastUsed != sb.lastUsed ? sa.lastUsed > sb.lastUsed :
+                                        sa.targetLevel - sa.wantedLevel > sb.targetLevel - sb.wantedLevel;
+  });
+  uint32_t numReads = 0;
+  for(auto& job : m_jobs)
+  {
+    numReads += job->read.valid() ? 1 : 0;
+  }
+  for(uint32_t i : upgrades)
+  {
+    if(numReads >= m_settings.maxPendingReads)
+      break;
+    Slot&          s     = m_slots[i];
+    vk::DeviceSize delta = getBytes(s, s.wantedLevel) - getBytes(s, s.targetLevel);
+    while(m_residentBytes + delta > m_settings.budget)
+    {
+      int32_t victim = -1;
+      for(uint32_t j = 0; j < numSlots; j++)
+      {
+        const Slot& v = m_slots[j];
+        if(!v.busy && v.targetLevel < v.tailLevel && v.lastUsed < s.lastUsed
+           && (victim < 0 || v.lastUsed < m_slots[victim].lastUsed))
+        {
+          victim = static_cast<int32_t>(j);
+        }
+      }
+      if(victim < 0)
+        break;
+      m_slots[victim].wantedLevel = m_slots[victim].tailLevel;
+      startJob(static_cast<uint32_t>(victim), m_slots[victim].tailLevel);
+    }
+    if(m_residentBytes + delta > m_settings.budget)
+      break;
+    startJob(i, s.wantedLevel);
+    numReads++;
+  }
+
+  // Submitting the jobs whose levels are ready
+  for(auto it = m_jobs.begin(); it != m_jobs.end();)
+  {
+    Job& job = **it;
+    if(job.fence || (job.read.valid() && job.read.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+    {
+      ++it;
+      continue;
+    }
+    Slot& s  = m_slots[job.slot];
+    bool  ok = !job.read.valid() || job.read.get();
+    ok       = ok && (job.firstLevel >= s.residentLevel
+                || (job.levels.format == s.format && job.levels.width == s.width && job.levels.height == s.height
+                    && job.levels.levels.size() == s.numLevels));
+    if(!ok)
+    {
+      LOGW("Could not stream %s\n", s.file.c_str());
+      m_residentBytes += getBytes(s, s.residentLevel);
+      m_residentBytes -= getBytes(s, s.targetLevel);
+      s.targetLevel = s.residentLevel;
+      s.wantedLevel = s.residentLevel;
+      s.busy        = false;
+      it            = m_jobs.erase(it);
+      continue;
+    }
+    submitJob(job, textures[job.slot]);
+    ++it;
+  }
+
+  return changed;
+}
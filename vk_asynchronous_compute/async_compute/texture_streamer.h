@@ -0,0 +1,146 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "nvh/threadpool.hpp"
+#include "nvvk/allocator_vk.hpp"
+#include "nvvk/commands_vk.hpp"
+#include "texture_loader.h"
+
+//--------------------------------------------------------------------------------------------------
+// Streams the high resolution levels of textures loaded with only their mip tail
+// - the shaders write, per frame, the extent of level 0 each texture needs in a feedback buffer
+//   (atomicMax), the application can add requests from the CPU with request()
+// - the wanted level of a texture only goes up (to a lower resolution) once it was not needed
+//   for `evictAfterFrames`, textures nobody samples fall back to their mip tail
+// - missing levels are read on a worker thread (TextureLoader::readLevels), the resident levels
+//   are copied on the device from the previous image
+// - the streamed levels are kept under `budget`, the least recently used textures are evicted
+//
+// update() must be called after the fence of `frame` has signaled, it returns the slots whose
+// texture was replaced, their descriptors must be rewritten before recording. The replaced
+// textures are handed back in `retired`, they may still be used by the frames in flight.
+//
+class TextureStreamer
+{
+public:
+  struct Settings
+  {
+    uint32_t       tailExtent{64};                  // levels up to this extent are always resident
+    vk::DeviceSize budget{256ull * 1024 * 1024};    // device memory of all the textures
+    uint32_t       evictAfterFrames{120};           // frames before a level no longer needed is dropped
+    uint32_t       maxPendingReads{4};              // textures read at the same time
+  };
+
+  void init(nvvk::Allocator*     alloc,
+            vk::Device           device,
+            vk::Queue            queue,
+            uint32_t             queueFamily,
+            const TextureLoader* loader,
+            const Settings&      settings = Settings());
+  // waits for the pending jobs, the textures themselves belong to the application
+  void deinit();
+
+  const Settings& getSettings() const { return m_settings; }
+
+  // `format` and `info` are the ones passed to and returned by TextureLoader::load
+  void addTexture(uint32_t                          slot,
+                  const std::string&                file,
+                  vk::Format                        format,
+                  const TextureLoader::TextureInfo& info,
+                  const vk::SamplerCreateInfo&      samplerCreateInfo);
+  // one region of `numSlots` entries of the feedback buffer per frame in flight
+  void createFeedbackBuffer(uint32_t numFrames, uint32_t numSlots);
+
+  vk::Buffer getFeedbackBuffer() const { return m_feedback.buffer; }
+  uint32_t   getFeedbackOffset(uint32_t frame) const { return frame * m_feedbackSlots; }
+
+  // CPU side request for the current frame: `extent` texels are needed along the largest side
+  void request(uint32_t slot, uint32_t extent);
+
+  std::vector<uint32_t> update(uint32_t frame, std::vector<nvvk::Texture>& textures, std::vector<nvvk::Texture>& retired);
+
+  vk::DeviceSize getResidentBytes() const { return m_residentBytes; }
+  uint32_t       getNumPendingJobs() const { return static_cast<uint32_t>(m_jobs.size()); }
+
+private:
+  struct Slot
+  {
+    std::string           file;
+    vk::SamplerCreateInfo sampler;
+    vk::Format            loadFormat{vk::Format::eUndefined};  // passed to the loader
+    vk::Format            format{vk::Format::eUndefined};      // of the image
+    uint32_t              width{1};
+    uint32_t              height{1};
+    uint32_t              numLevels{1};
+    uint32_t              tailLevel{0};      // first level of the mip tail
+    uint32_t              residentLevel{0};  // first level of the current image
+    uint32_t              targetLevel{0};    // first level once the pending job is done
+    uint32_t              wantedLevel{0};
+    uint64_t              wantedFrame{0};    // last frame the wanted level was needed
+    uint32_t              requested{0};      // CPU request of the current frame
+    uint64_t              lastUsed{0};
+    bool                  busy{false};
+  };
+
+  struct Job
+  {
+    uint32_t                     slot;
+    uint32_t                     firstLevel;
+    std::future<bool>            read;  // invalid if all levels come from the previous image
+    TextureLoader::TextureLevels levels;
+    nvvk::Texture                texture;
+    vk::CommandBuffer            cmdBuf;
+    vk::Fence                    fence;
+  };
+
+  vk::DeviceSize getBytes(const Slot& slot, uint32_t firstLevel) const;
+  uint32_t       getLevel(const Slot& slot, uint32_t extent) const;
+  void           startJob(uint32_t index, uint32_t firstLevel);
+  void           submitJob(Job& job, const nvvk::Texture& previous);
+
+  nvvk::Allocator*                  m_alloc{nullptr};
+  vk::Device                        m_device;
+  vk::Queue                         m_queue;
+  const TextureLoader*              m_loader{nullptr};
+  Settings                          m_settings;
+  nvvk::CommandPool                 m_cmdPool;
+  nvh::ThreadPool                   m_pool;
+  std::vector<Slot>                 m_slots;
+  std::vector<std::unique_ptr<Job>> m_jobs;
+  nvvk::Buffer                      m_feedback;
+  uint32_t*                         m_feedbackData{nullptr};
+  uint32_t                          m_feedbackSlots{0};
+  uint64_t                          m_frame{0};
+  vk::DeviceSize                    m_residentBytes{0};  // including the pending jobs
+};